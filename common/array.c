@@ -0,0 +1,139 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+//#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
+
+#include "array.h"
+#include "macro.h"
+#include "mem.h"
+
+#include <string.h>
+
+#define ARRAY_INITIAL_CAPACITY 8
+
+struct array {
+	void **data;
+	unsigned int len;
+	unsigned int capacity;
+};
+
+static void
+array_reserve(array_t *array, unsigned int len)
+{
+	IF_TRUE_RETURN_TRACE(len <= array->capacity);
+
+	unsigned int capacity = array->capacity ? array->capacity : ARRAY_INITIAL_CAPACITY;
+	while (capacity < len)
+		capacity *= 2;
+
+	TRACE("Growing array %p to capacity %u", (void *)array, capacity);
+	array->data = mem_renew(void *, array->data, capacity);
+	array->capacity = capacity;
+}
+
+array_t *
+array_new(void)
+{
+	return mem_new0(array_t, 1);
+}
+
+void
+array_free(array_t *array)
+{
+	IF_NULL_RETURN_TRACE(array);
+
+	mem_free0(array->data);
+	mem_free0(array);
+}
+
+array_t *
+array_append(array_t *array, void *data)
+{
+	if (!array)
+		array = array_new();
+
+	array_reserve(array, array->len + 1);
+	array->data[array->len++] = data;
+
+	return array;
+}
+
+array_t *
+array_prepend(array_t *array, void *data)
+{
+	if (!array)
+		array = array_new();
+
+	array_reserve(array, array->len + 1);
+	memmove(&array->data[1], &array->data[0], array->len * sizeof(void *));
+	array->data[0] = data;
+	array->len++;
+
+	return array;
+}
+
+bool
+array_remove(array_t *array, const void *data)
+{
+	int idx = array_index_of(array, data);
+	IF_TRUE_RETVAL_TRACE(idx < 0, false);
+
+	array->len--;
+	memmove(&array->data[idx], &array->data[idx + 1],
+		(array->len - (unsigned int)idx) * sizeof(void *));
+
+	return true;
+}
+
+unsigned int
+array_length(const array_t *array)
+{
+	return array ? array->len : 0;
+}
+
+void *
+array_get(const array_t *array, unsigned int n)
+{
+	IF_NULL_RETVAL_TRACE(array, NULL);
+	IF_TRUE_RETVAL_TRACE(n >= array->len, NULL);
+
+	return array->data[n];
+}
+
+int
+array_index_of(const array_t *array, const void *data)
+{
+	IF_NULL_RETVAL_TRACE(array, -1);
+
+	for (unsigned int i = 0; i < array->len; i++) {
+		if (array->data[i] == data)
+			return (int)i;
+	}
+	return -1;
+}
+
+bool
+array_contains(const array_t *array, const void *data)
+{
+	return array_index_of(array, data) >= 0;
+}
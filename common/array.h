@@ -0,0 +1,131 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file array.h
+ *
+ * Implements a growable array of payload pointers with cached length and
+ * O(1) indexed access. It can be used instead of list.h where elements are
+ * mainly iterated by index. Similar to the list API, a NULL pointer is a valid
+ * empty array for all read accessors and for array_append/array_prepend, which
+ * allocate the array on first use and return it.
+ */
+
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include <stdbool.h>
+
+typedef struct array array_t;
+
+/**
+ * Creates a new empty array.
+ *
+ * @return Pointer to the newly created array.
+ */
+array_t *
+array_new(void);
+
+/**
+ * Frees the array. The payloads are not touched.
+ *
+ * @param array The array to be freed; may be NULL.
+ */
+void
+array_free(array_t *array);
+
+/**
+ * Puts a payload at the end of the array.
+ *
+ * @param array The array; may be NULL.
+ * @param data The payload; may be NULL.
+ * @return The array (newly allocated if array was NULL).
+ */
+array_t *
+array_append(array_t *array, void *data)
+#if defined(__GNUC__)
+	__attribute__((warn_unused_result))
+#endif
+	;
+
+/**
+ * Puts a payload at the start of the array, moving all other elements.
+ *
+ * @param array The array; may be NULL.
+ * @param data The payload; may be NULL.
+ * @return The array (newly allocated if array was NULL).
+ */
+array_t *
+array_prepend(array_t *array, void *data)
+#if defined(__GNUC__)
+	__attribute__((warn_unused_result))
+#endif
+	;
+
+/**
+ * Removes the first element which contains the supplied payload.
+ * The order of the remaining elements is preserved.
+ *
+ * @param array The array; may be NULL.
+ * @param data The payload to search for as deletion criteria.
+ * @return true if an element was removed, false otherwise.
+ */
+bool
+array_remove(array_t *array, const void *data);
+
+/**
+ * Returns the number of elements contained in the array.
+ *
+ * @param array The array; may be NULL.
+ * @return Number of elements contained in the array.
+ */
+unsigned int
+array_length(const array_t *array);
+
+/**
+ * Returns the payload of the n'th element of the array.
+ *
+ * @param array The array; may be NULL.
+ * @param n The index of the element, starting with 0.
+ * @return The payload of the element with index n or NULL if n is out of range.
+ */
+void *
+array_get(const array_t *array, unsigned int n);
+
+/**
+ * Returns the index of the first element which contains the supplied payload.
+ *
+ * @param array The array; may be NULL.
+ * @param data The payload to search for.
+ * @return The index of the element or -1 if no element matches.
+ */
+int
+array_index_of(const array_t *array, const void *data);
+
+/**
+ * Returns true if and only if the array contains the payload.
+ */
+bool
+array_contains(const array_t *array, const void *data);
+
+#endif /* ARRAY_H */
@@ -0,0 +1,119 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+#include "munit.h"
+
+#include "array.h"
+#include "logf.h"
+#include "macro.h"
+
+static void *
+setup(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	logf_register(&logf_test_write, stderr);
+	return NULL;
+}
+
+static void
+tear_down(UNUSED void *fixture)
+{
+}
+
+static MunitResult
+test_array_append_get(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	static int values[100];
+
+	// NULL is a valid empty array
+	munit_assert_uint(array_length(NULL), ==, 0);
+	munit_assert_null(array_get(NULL, 0));
+
+	array_t *array = NULL;
+	for (int i = 0; i < 100; i++)
+		array = array_append(array, &values[i]);
+	munit_assert_not_null(array);
+	munit_assert_uint(array_length(array), ==, 100);
+
+	for (unsigned int i = 0; i < 100; i++)
+		munit_assert_ptr_equal(array_get(array, i), &values[i]);
+	munit_assert_null(array_get(array, 100));
+
+	array_free(array);
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_array_prepend_remove(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	int a = 1, b = 2, c = 3, d = 4;
+
+	array_t *array = array_append(NULL, &b);
+	array = array_append(array, &c);
+	array = array_prepend(array, &a);
+	array = array_append(array, &d);
+
+	munit_assert_int(array_index_of(array, &a), ==, 0);
+	munit_assert_int(array_index_of(array, &d), ==, 3);
+
+	// removing keeps the order of the remaining elements
+	munit_assert_true(array_remove(array, &b));
+	munit_assert_false(array_remove(array, &b));
+	munit_assert_false(array_contains(array, &b));
+	munit_assert_uint(array_length(array), ==, 3);
+	munit_assert_ptr_equal(array_get(array, 0), &a);
+	munit_assert_ptr_equal(array_get(array, 1), &c);
+	munit_assert_ptr_equal(array_get(array, 2), &d);
+
+	array_free(array);
+	return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+	{
+		"/append and get",	/* name */
+		test_array_append_get,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/prepend and remove",	/* name */
+		test_array_prepend_remove, /* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+
+	// Mark the end of the array with an entry where the test function is NULL
+	{ NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite array_suite = {
+	"/array",		/* name */
+	tests,			/* tests */
+	NULL,			/* suites */
+	1,			/* iterations */
+	MUNIT_SUITE_OPTION_NONE /* options */
+};
@@ -0,0 +1,139 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+#include "chunk_delta.h"
+
+#include "macro.h"
+#include "mem.h"
+#include "fd.h"
+#include "hashmap.h"
+
+#include <stdbool.h>
+
+#define CHUNK_DELTA_FROM_DELTA UINT64_MAX
+
+struct chunk_delta {
+	uint64_t size;	     //!< size of the file
+	uint32_t chunk_size; //!< size of a chunk but the last one
+	size_t n_chunks;
+	uint64_t *source; //!< base chunk of each chunk or CHUNK_DELTA_FROM_DELTA
+	uint64_t delta_size;
+	size_t reused;
+};
+
+static uint64_t
+chunk_delta_chunk_len(uint64_t size, uint32_t chunk_size, size_t i)
+{
+	return MIN(chunk_size, size - (uint64_t)i * chunk_size);
+}
+
+static bool
+chunk_delta_count_matches(size_t count, uint64_t size, uint32_t chunk_size)
+{
+	return count == (size + chunk_size - 1) / chunk_size;
+}
+
+chunk_delta_t *
+chunk_delta_new(char **base_hashes, size_t base_count, uint64_t base_size, char **hashes,
+		size_t count, uint64_t size, uint32_t chunk_size)
+{
+	ASSERT(base_hashes || base_count == 0);
+	ASSERT(hashes || count == 0);
+
+	IF_TRUE_RETVAL(chunk_size == 0, NULL);
+	IF_FALSE_RETVAL(chunk_delta_count_matches(base_count, base_size, chunk_size), NULL);
+	IF_FALSE_RETVAL(chunk_delta_count_matches(count, size, chunk_size), NULL);
+
+	// maps the digest of each base chunk to its index + 1
+	hashmap_t *base_chunks = hashmap_new();
+	for (size_t j = 0; j < base_count; j++)
+		hashmap_put_str(base_chunks, base_hashes[j], (void *)(uintptr_t)(j + 1));
+
+	chunk_delta_t *delta = mem_new0(chunk_delta_t, 1);
+	delta->size = size;
+	delta->chunk_size = chunk_size;
+	delta->n_chunks = count;
+	delta->source = mem_new(uint64_t, count);
+
+	for (size_t i = 0; i < count; i++) {
+		uint64_t len = chunk_delta_chunk_len(size, chunk_size, i);
+		uintptr_t j = (uintptr_t)hashmap_get_str(base_chunks, hashes[i]);
+		// a shorter last chunk of the base file cannot be reused
+		if (j && chunk_delta_chunk_len(base_size, chunk_size, j - 1) == len) {
+			delta->source[i] = j - 1;
+			delta->reused++;
+		} else {
+			delta->source[i] = CHUNK_DELTA_FROM_DELTA;
+			delta->delta_size += len;
+		}
+	}
+	hashmap_free(base_chunks);
+
+	return delta;
+}
+
+void
+chunk_delta_free(chunk_delta_t *delta)
+{
+	IF_NULL_RETURN(delta);
+
+	mem_free0(delta->source);
+	mem_free0(delta);
+}
+
+uint64_t
+chunk_delta_get_size(const chunk_delta_t *delta)
+{
+	ASSERT(delta);
+	return delta->delta_size;
+}
+
+size_t
+chunk_delta_get_reused(const chunk_delta_t *delta)
+{
+	ASSERT(delta);
+	return delta->reused;
+}
+
+int
+chunk_delta_write(const chunk_delta_t *delta, int base_fd, int delta_fd, int out_fd)
+{
+	ASSERT(delta);
+
+	uint64_t delta_off = 0;
+	for (size_t i = 0; i < delta->n_chunks; i++) {
+		uint64_t len = chunk_delta_chunk_len(delta->size, delta->chunk_size, i);
+		int in_fd = base_fd;
+		off_t off = (off_t)(delta->source[i] * delta->chunk_size);
+		if (delta->source[i] == CHUNK_DELTA_FROM_DELTA) {
+			in_fd = delta_fd;
+			off = delta_off;
+			delta_off += len;
+		}
+		if (in_fd < 0 || fd_sendfile(out_fd, in_fd, off, len) != (ssize_t)len) {
+			ERROR("Could not write chunk %zu", i);
+			return -1;
+		}
+	}
+	return 0;
+}
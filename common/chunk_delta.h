@@ -0,0 +1,91 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file chunk_delta.h
+ *
+ * Matches the chunks of a file against the chunks of a base file by their
+ * digests and writes the file from the chunks found in the base file and a
+ * delta, which contains the remaining chunks concatenated in order. Both files
+ * are split into chunks of the same size, only the last chunk of a file may be
+ * shorter.
+ */
+
+#ifndef CHUNK_DELTA_H
+#define CHUNK_DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct chunk_delta chunk_delta_t;
+
+/**
+ * Matches the chunks of a file against the chunks of the base file. A chunk
+ * is taken from the base file if a base chunk of the same digest and length
+ * exists.
+ *
+ * @param base_hashes digests of the chunks of the base file
+ * @param base_count number of chunks of the base file
+ * @param base_size size of the base file
+ * @param hashes digests of the chunks of the file
+ * @param count number of chunks of the file
+ * @param size size of the file
+ * @param chunk_size size of a chunk but the last one of each file
+ * @return the delta or NULL if a number of chunks does not match its size
+ */
+chunk_delta_t *
+chunk_delta_new(char **base_hashes, size_t base_count, uint64_t base_size, char **hashes,
+		size_t count, uint64_t size, uint32_t chunk_size);
+
+/**
+ * Frees the delta.
+ */
+void
+chunk_delta_free(chunk_delta_t *delta);
+
+/**
+ * Returns the size of the delta, i.e., the number of bytes of the file which
+ * are not found in the base file.
+ */
+uint64_t
+chunk_delta_get_size(const chunk_delta_t *delta);
+
+/**
+ * Returns the number of chunks of the file which are found in the base file.
+ */
+size_t
+chunk_delta_get_reused(const chunk_delta_t *delta);
+
+/**
+ * Writes the file from the base file and the delta.
+ *
+ * @param delta the delta
+ * @param base_fd the base file
+ * @param delta_fd the delta or -1 if its size is 0
+ * @param out_fd the file to write to, at its current offset
+ * @return 0 on success, -1 otherwise
+ */
+int
+chunk_delta_write(const chunk_delta_t *delta, int base_fd, int delta_fd, int out_fd);
+
+#endif /* CHUNK_DELTA_H */
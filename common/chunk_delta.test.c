@@ -0,0 +1,225 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+#include "munit.h"
+
+#include "chunk_delta.h"
+#include "file.h"
+#include "logf.h"
+#include "macro.h"
+#include "mem.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// digests of the test chunks are their contents
+#define TEST_CHUNK_DELTA_SIZE 4
+
+typedef struct {
+	char dir[64];
+	char *base;
+	char *delta;
+	char *out;
+} test_chunk_delta_t;
+
+static test_chunk_delta_t test_chunk_delta;
+
+static int
+test_chunk_delta_open(const char *file, const char *content)
+{
+	munit_assert_int(file_write(file, content, strlen(content)), ==, (int)strlen(content));
+	int fd = open(file, O_RDONLY);
+	munit_assert_int(fd, >=, 0);
+	return fd;
+}
+
+/*
+ * Writes the file from the base file and delta and checks that it equals expected.
+ */
+static void
+test_chunk_delta_assert_write(const chunk_delta_t *delta, const char *base, const char *delta_data,
+			      const char *expected)
+{
+	int base_fd = test_chunk_delta_open(test_chunk_delta.base, base);
+	int delta_fd = delta_data ? test_chunk_delta_open(test_chunk_delta.delta, delta_data) : -1;
+	int out_fd = open(test_chunk_delta.out, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	munit_assert_int(out_fd, >=, 0);
+
+	munit_assert_int(chunk_delta_write(delta, base_fd, delta_fd, out_fd), ==, 0);
+	close(out_fd);
+	if (delta_fd >= 0)
+		close(delta_fd);
+	close(base_fd);
+
+	char *out = file_read_new(test_chunk_delta.out, 4096);
+	munit_assert_not_null(out);
+	munit_assert_string_equal(out, expected);
+	mem_free0(out);
+}
+
+static MunitResult
+test_chunk_delta_map(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	char *base_hashes[] = { "AAAA", "BBBB", "CC" };
+	char *hashes[] = { "BBBB", "XXXX", "AAAA", "YYYY", "BBBB", "CC" };
+
+	chunk_delta_t *delta =
+		chunk_delta_new(base_hashes, 3, 10, hashes, 6, 22, TEST_CHUNK_DELTA_SIZE);
+	munit_assert_not_null(delta);
+	// base chunks are reused in any order and more than once
+	munit_assert_int(chunk_delta_get_reused(delta), ==, 4);
+	munit_assert_int(chunk_delta_get_size(delta), ==, 8);
+
+	// the delta is read sequentially, the base file at the offset of each chunk
+	test_chunk_delta_assert_write(delta, "AAAABBBBCC", "XXXXYYYY", "BBBBXXXXAAAAYYYYBBBBCC");
+	chunk_delta_free(delta);
+
+	// an unchanged file needs no delta
+	delta = chunk_delta_new(base_hashes, 3, 10, base_hashes, 3, 10, TEST_CHUNK_DELTA_SIZE);
+	munit_assert_not_null(delta);
+	munit_assert_int(chunk_delta_get_reused(delta), ==, 3);
+	munit_assert_int(chunk_delta_get_size(delta), ==, 0);
+	test_chunk_delta_assert_write(delta, "AAAABBBBCC", NULL, "AAAABBBBCC");
+	chunk_delta_free(delta);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_chunk_delta_last_chunk(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	char *base_hashes[] = { "AAAA", "C" };
+
+	// the shorter last base chunk is only reused as a last chunk of the same length
+	char *hashes[] = { "C", "AAAA", "C" };
+	chunk_delta_t *delta =
+		chunk_delta_new(base_hashes, 2, 5, hashes, 3, 9, TEST_CHUNK_DELTA_SIZE);
+	munit_assert_not_null(delta);
+	munit_assert_int(chunk_delta_get_reused(delta), ==, 2);
+	munit_assert_int(chunk_delta_get_size(delta), ==, 4);
+	test_chunk_delta_assert_write(delta, "AAAAC", "CCCC", "CCCCAAAAC");
+	chunk_delta_free(delta);
+
+	// a full base chunk is not reused as a shorter last chunk
+	char *short_hashes[] = { "AAAA", "AAAA" };
+	delta = chunk_delta_new(base_hashes, 2, 5, short_hashes, 2, 5, TEST_CHUNK_DELTA_SIZE);
+	munit_assert_not_null(delta);
+	munit_assert_int(chunk_delta_get_reused(delta), ==, 1);
+	munit_assert_int(chunk_delta_get_size(delta), ==, 1);
+	test_chunk_delta_assert_write(delta, "AAAAC", "A", "AAAAA");
+	chunk_delta_free(delta);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_chunk_delta_invalid(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	char *base_hashes[] = { "AAAA", "CC" };
+	char *hashes[] = { "AAAA" };
+
+	// the number of chunks has to match the size
+	munit_assert_null(chunk_delta_new(base_hashes, 2, 4, hashes, 1, 4, TEST_CHUNK_DELTA_SIZE));
+	munit_assert_null(chunk_delta_new(base_hashes, 2, 6, hashes, 1, 5, TEST_CHUNK_DELTA_SIZE));
+	munit_assert_null(chunk_delta_new(base_hashes, 2, 6, hashes, 1, 4, 0));
+
+	// a missing delta is an error if chunks have to be taken from it
+	chunk_delta_t *delta =
+		chunk_delta_new(hashes, 1, 4, base_hashes, 2, 6, TEST_CHUNK_DELTA_SIZE);
+	munit_assert_not_null(delta);
+	int base_fd = test_chunk_delta_open(test_chunk_delta.base, "AAAA");
+	int out_fd = open(test_chunk_delta.out, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	munit_assert_int(out_fd, >=, 0);
+	munit_assert_int(chunk_delta_write(delta, base_fd, -1, out_fd), ==, -1);
+	close(out_fd);
+	close(base_fd);
+	chunk_delta_free(delta);
+
+	return MUNIT_OK;
+}
+
+static void *
+setup(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	logf_register(&logf_test_write, stderr);
+
+	mem_memset(&test_chunk_delta, 0, sizeof(test_chunk_delta));
+	strcpy(test_chunk_delta.dir, "/tmp/chunk_delta.test.XXXXXX");
+	munit_assert_not_null(mkdtemp(test_chunk_delta.dir));
+	test_chunk_delta.base = mem_printf("%s/base", test_chunk_delta.dir);
+	test_chunk_delta.delta = mem_printf("%s/delta", test_chunk_delta.dir);
+	test_chunk_delta.out = mem_printf("%s/out", test_chunk_delta.dir);
+	return NULL;
+}
+
+static void
+tear_down(UNUSED void *fixture)
+{
+	unlink(test_chunk_delta.base);
+	unlink(test_chunk_delta.delta);
+	unlink(test_chunk_delta.out);
+	rmdir(test_chunk_delta.dir);
+	mem_free0(test_chunk_delta.base);
+	mem_free0(test_chunk_delta.delta);
+	mem_free0(test_chunk_delta.out);
+}
+
+static MunitTest tests[] = {
+	{
+		"/map",			/* name */
+		test_chunk_delta_map,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/last chunk",		     /* name */
+		test_chunk_delta_last_chunk, /* test */
+		setup,			     /* setup */
+		tear_down,		     /* tear_down */
+		MUNIT_TEST_OPTION_NONE,	     /* options */
+		NULL			     /* parameters */
+	},
+	{
+		"/invalid",		  /* name */
+		test_chunk_delta_invalid, /* test */
+		setup,			  /* setup */
+		tear_down,		  /* tear_down */
+		MUNIT_TEST_OPTION_NONE,	  /* options */
+		NULL			  /* parameters */
+	},
+
+	// Mark the end of the array with an entry where the test function is NULL
+	{ NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite chunk_delta_suite = {
+	"/chunk_delta",		/* name */
+	tests,			/* tests */
+	NULL,			/* suites */
+	1,			/* iterations */
+	MUNIT_SUITE_OPTION_NONE /* options */
+};
@@ -2,7 +2,16 @@
 
 extern MunitSuite mem_suite;
 extern MunitSuite macro_suite;
+extern MunitSuite hashmap_suite;
+extern MunitSuite array_suite;
+extern MunitSuite event_suite;
+extern MunitSuite frame_suite;
+extern MunitSuite threadpool_suite;
 extern MunitSuite ssl_util_suite;
+extern MunitSuite http_download_suite;
+extern MunitSuite file_suite;
+extern MunitSuite seglog_suite;
+extern MunitSuite chunk_delta_suite;
 
 int
 main(int argc, char *argv[MUNIT_ARRAY_PARAM(argc + 1)])
@@ -11,7 +20,16 @@ main(int argc, char *argv[MUNIT_ARRAY_PARAM(argc + 1)])
 
 	failed += munit_suite_main(&mem_suite, NULL, argc, argv);
 	failed += munit_suite_main(&macro_suite, NULL, argc, argv);
+	failed += munit_suite_main(&hashmap_suite, NULL, argc, argv);
+	failed += munit_suite_main(&array_suite, NULL, argc, argv);
+	failed += munit_suite_main(&event_suite, NULL, argc, argv);
+	failed += munit_suite_main(&frame_suite, NULL, argc, argv);
+	failed += munit_suite_main(&threadpool_suite, NULL, argc, argv);
 	failed += munit_suite_main(&ssl_util_suite, NULL, argc, argv);
+	failed += munit_suite_main(&http_download_suite, NULL, argc, argv);
+	failed += munit_suite_main(&file_suite, NULL, argc, argv);
+	failed += munit_suite_main(&seglog_suite, NULL, argc, argv);
+	failed += munit_suite_main(&chunk_delta_suite, NULL, argc, argv);
 
 	return failed;
 }
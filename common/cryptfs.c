@@ -68,6 +68,15 @@
 
 #define ZERO_BUF_SIZE 100 * 1024 * 1024
 
+/* dm-integrity superblock flags, see drivers/md/dm-integrity.c */
+#define INTEGRITY_SB_FLAGS_OFFSET 24
+#define INTEGRITY_SB_FLAG_RECALCULATING 0x2
+#define INTEGRITY_SB_FLAG_FIXED_HMAC 0x10
+
+/* first dm-integrity version which supports fix_hmac */
+#define INTEGRITY_FIX_HMAC_MAJOR 1
+#define INTEGRITY_FIX_HMAC_MINOR 7
+
 /* FIXME Rejig library to record & use errno instead */
 #ifndef DM_EXISTS_FLAG
 #define DM_EXISTS_FLAG 0x00000004
@@ -110,10 +119,15 @@ convert_key_to_hex_ascii(unsigned char *master_key, unsigned int keysize,
 }
 #endif
 
+/*
+ * With fix_hmac, the superblock is authenticated by the journal MAC, which allows
+ * the kernel to calculate missing integrity tags in the background (recalculate)
+ * instead of requiring the whole volume to be written once before it is used.
+ */
 static int
 load_integrity_mapping_table(int fd, const char *real_blk_name, const char *meta_blk_name,
 			     const char *integrity_key_ascii, const char *name, int fs_size,
-			     bool stacked)
+			     bool stacked, bool fix_hmac, bool recalculate)
 {
 	// General variables
 	int ioctl_ret;
@@ -125,10 +139,18 @@ load_integrity_mapping_table(int fd, const char *real_blk_name, const char *meta
 	struct dm_target_spec *tgt;
 	struct dm_ioctl *mapping_io;
 	char *integrity_params;
-	char *extra_params =
-		stacked ? mem_printf("1 meta_device:%s", meta_blk_name) :
-			  mem_printf("3 meta_device:%s internal_hash:%s:%s allow_discards",
-				     meta_blk_name, INTEGRITY_TYPE, integrity_key_ascii);
+	char *extra_params;
+	if (stacked)
+		extra_params = mem_printf("1 meta_device:%s", meta_blk_name);
+	else if (fix_hmac)
+		extra_params = mem_printf("%d meta_device:%s internal_hash:%s:%s journal_mac:%s:%s "
+					  "fix_hmac allow_discards%s",
+					  recalculate ? 6 : 5, meta_blk_name, INTEGRITY_TYPE,
+					  integrity_key_ascii, INTEGRITY_TYPE, integrity_key_ascii,
+					  recalculate ? " recalculate" : "");
+	else
+		extra_params = mem_printf("3 meta_device:%s internal_hash:%s:%s allow_discards",
+					  meta_blk_name, INTEGRITY_TYPE, integrity_key_ascii);
 	int mapping_counter;
 
 	mapping_io = (struct dm_ioctl *)mapping_buffer;
@@ -302,7 +324,8 @@ errout:
  */
 static char *
 create_integrity_blk_dev(const char *real_blk_name, const char *meta_blk_name, const char *key,
-			 const char *name, const unsigned long fs_size, bool stacked)
+			 const char *name, const unsigned long fs_size, bool stacked, bool fix_hmac,
+			 bool recalculate)
 {
 	int fd;
 	int ioctl_ret;
@@ -343,7 +366,7 @@ create_integrity_blk_dev(const char *real_blk_name, const char *meta_blk_name, c
 	DEBUG("Loading Integrity mapping table");
 
 	load_count = load_integrity_mapping_table(fd, real_blk_name, meta_blk_name, key, name,
-						  fs_size, stacked);
+						  fs_size, stacked, fix_hmac, recalculate);
 	if (load_count < 0) {
 		ERROR("Error while loading mapping table");
 		goto error;
@@ -576,6 +599,57 @@ errout:
 	return provided_data_sectors;
 }
 
+/*
+ * Reads the flags of an existing integrity superblock on meta_blk_name.
+ * Returns false if there is no superblock.
+ */
+static bool
+get_superblock_flags(const char *meta_blk_name, uint32_t *flags)
+{
+	int fd;
+	bool ret = false;
+	char magic[8]; // "integrt" on a valid superblock
+
+	*flags = 0;
+	if ((fd = open(meta_blk_name, O_RDONLY)) < 0) {
+		ERROR("Cannot open volume %s", meta_blk_name);
+		return false;
+	}
+
+	if (read(fd, magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, "integrt", 8))
+		goto out;
+
+	if (pread(fd, flags, sizeof(*flags), INTEGRITY_SB_FLAGS_OFFSET) != sizeof(*flags)) {
+		ERROR("Cannot read superblock flags from volume %s", meta_blk_name);
+		*flags = 0;
+		goto out;
+	}
+	DEBUG("Integrity superblock flags of %s: 0x%" PRIx32, meta_blk_name, *flags);
+	ret = true;
+out:
+	close(fd);
+	return ret;
+}
+
+/*
+ * Checks whether the kernel supports fix_hmac, which is required to let
+ * dm-integrity recalculate the tags of a keyed hash in the background.
+ */
+static bool
+integrity_fix_hmac_supported(void)
+{
+	uint32_t version[3];
+	int fd = dm_open_control();
+	IF_TRUE_RETVAL(fd < 0, false);
+
+	int ret = dm_get_target_version(fd, "integrity", version);
+	dm_close_control(fd);
+	IF_TRUE_RETVAL(ret < 0, false);
+
+	return version[0] > INTEGRITY_FIX_HMAC_MAJOR ||
+	       (version[0] == INTEGRITY_FIX_HMAC_MAJOR && version[1] >= INTEGRITY_FIX_HMAC_MINOR);
+}
+
 static int
 cryptfs_write_zeros(char *crypto_blkdev, size_t size)
 {
@@ -641,6 +715,7 @@ cryptfs_setup_volume_new(const char *label, const char *real_blkdev, const char
 	size_t crypto_key_len = 0, integrity_key_len = 0;
 	char *integrity_dev_label = NULL;
 	bool initial_format = false;
+	bool fix_hmac = false, recalculate = false;
 
 	/* do parameter validation */
 	IF_NULL_RETVAL_ERROR(label, NULL);
@@ -738,9 +813,24 @@ cryptfs_setup_volume_new(const char *label, const char *real_blkdev, const char
 		/* check if meta device is initialized */
 		initial_format = get_provided_data_sectors(meta_blkdev) != fs_size;
 
-		if (!(integrity_blkdev =
-			      create_integrity_blk_dev(real_blkdev, meta_blkdev, integrity_key,
-						       integrity_dev_label, fs_size, stacked))) {
+		/*
+		 * The tags of a new volume are calculated in the background by the kernel
+		 * if possible. This requires an internal hash and a superblock which is
+		 * protected by fix_hmac, whose flag must be kept for existing volumes.
+		 * Interrupted calculations are resumed on later setups.
+		 */
+		uint32_t sb_flags;
+		if (get_superblock_flags(meta_blkdev, &sb_flags)) {
+			fix_hmac = !stacked && (sb_flags & INTEGRITY_SB_FLAG_FIXED_HMAC);
+			recalculate = fix_hmac && (sb_flags & INTEGRITY_SB_FLAG_RECALCULATING);
+		} else {
+			fix_hmac = !stacked && integrity_fix_hmac_supported();
+			recalculate = fix_hmac;
+		}
+
+		if (!(integrity_blkdev = create_integrity_blk_dev(
+			      real_blkdev, meta_blkdev, integrity_key, integrity_dev_label,
+			      fs_size, stacked, fix_hmac, recalculate))) {
 			ERROR("create_integrity_blk_dev '%s' failed!", integrity_dev_label);
 			goto error;
 		}
@@ -757,7 +847,10 @@ cryptfs_setup_volume_new(const char *label, const char *real_blkdev, const char
 		crypto_blkdev = integrity_blkdev;
 	}
 
-	if (initial_format) {
+	if (initial_format && recalculate) {
+		INFO("Integrity tags of volume %s are initialized in the background",
+		     crypto_blkdev);
+	} else if (initial_format) {
 		/*
 		 * format crypto device, otherwise I/O errors may occur
 		 * also during write attempts which are not bound to
@@ -832,6 +925,46 @@ error:
 	return NULL;
 }
 
+int
+cryptfs_get_integrity_init_progress(const char *label, uint64_t *done, uint64_t *total)
+{
+	IF_NULL_RETVAL(label, -1);
+
+	int fd, ret = -1;
+	uint8_t buf[DM_INTEGRITY_BUF_SIZE];
+	struct dm_ioctl *io = (struct dm_ioctl *)buf;
+	char *name = mem_printf("%s-%s", label, "integrity");
+
+	IF_TRUE_GOTO((fd = dm_open_control()) < 0, out);
+
+	dm_ioctl_init(io, INDEX_DM_TABLE_STATUS, sizeof(buf), name, NULL, 0, 0, 0, 0);
+	if (dm_ioctl(fd, DM_TABLE_STATUS, io) != 0 || io->target_count != 1) {
+		DEBUG_ERRNO("Cannot get status of dm-integrity device '%s'", name);
+		goto out;
+	}
+
+	/*
+	 * status line: <mismatches> <provided data sectors> <recalc sector>, the
+	 * latter is '-' if no tags are being calculated
+	 */
+	const char *status = (char *)buf + io->data_start + sizeof(struct dm_target_spec);
+	unsigned long long mismatches, sectors, recalc_sector;
+	int n = sscanf(status, "%llu %llu %llu", &mismatches, &sectors, &recalc_sector);
+	if (n < 2) {
+		WARN("Unexpected status of dm-integrity device '%s': %s", name, status);
+		goto out;
+	}
+	if (total)
+		*total = sectors;
+	if (done)
+		*done = (n == 3) ? recalc_sector : sectors;
+	ret = (n == 3) ? 1 : 0;
+out:
+	dm_close_control(fd);
+	mem_free0(name);
+	return ret;
+}
+
 int
 cryptfs_delete_blk_dev(int fd, const char *name, cryptfs_mode_t mode)
 {
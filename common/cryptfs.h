@@ -33,6 +33,7 @@
 #define CRYPTFS_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define CRYPTFS_FDE_KEY_LEN 64
 
@@ -71,6 +72,21 @@ char *
 cryptfs_setup_volume_new(const char *label, const char *real_blk_dev, const char *ascii_key,
 			 const char *meta_blk_dev, cryptfs_mode_t mode);
 
+/**
+ * Get the progress of the initialization of the integrity tags of a volume
+ * created by cryptfs_setup_volume_new(). On recent kernels, the tags of new
+ * volumes which do not use stacked AUTHENC mode are calculated by dm-integrity
+ * in the background, while the volume can already be used.
+ *
+ * @param label The name of the volume
+ * @param done If not NULL, set to the number of sectors already initialized
+ * @param total If not NULL, set to the number of sectors of the volume
+ * @return int 1 while the tags are initialized, 0 once all tags are valid,
+ *     -1 if the volume has no integrity device or on error
+ */
+int
+cryptfs_get_integrity_init_progress(const char *label, uint64_t *done, uint64_t *total);
+
 /**
  * Close a device-mapper volume
  *
@@ -36,6 +36,7 @@
 #include <sys/mount.h>
 #include <errno.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "macro.h"
 #include "mem.h"
@@ -52,7 +53,7 @@ struct dm_cmd_table cmd_table[] = {
 	{ DM_DEV_WAIT, { 4, 0, 0 } },	  { DM_LIST_DEVICES, { 4, 0, 0 } },
 	{ DM_TABLE_CLEAR, { 4, 0, 0 } },  { DM_LIST_VERSIONS, { 4, 1, 0 } },
 	{ DM_TARGET_MSG, { 4, 2, 0 } },	  { DM_DEV_SET_GEOMETRY, { 4, 6, 0 } },
-	{ DM_DEV_ARM_POLL, { 4, 36, 0 } }
+	{ DM_DEV_ARM_POLL, { 4, 36, 0 } }, { DM_GET_TARGET_VERSION, { 4, 41, 0 } }
 };
 
 #ifndef __GNU_LIBRARY__
@@ -196,6 +197,29 @@ dm_list_versions(int fd)
 	return 0;
 }
 
+int
+dm_get_target_version(int fd, const char *target, uint32_t version[3])
+{
+	ASSERT(target);
+	ASSERT(strlen(target) < DM_NAME_LEN);
+
+	uint8_t buf[4096] = { 0 };
+	struct dm_ioctl *dmi = (struct dm_ioctl *)buf;
+
+	// the kernel loads the target module if necessary
+	dm_ioctl_init(dmi, INDEX_DM_GET_TARGET_VERSION, sizeof(buf), target, NULL, 0, 0, 0, 0);
+	int ioctl_ret = dm_ioctl(fd, cmd_table[INDEX_DM_GET_TARGET_VERSION].cmd, dmi);
+	if (ioctl_ret != 0) {
+		DEBUG_ERRNO("DM_GET_TARGET_VERSION ioctl for %s returned %d", target, ioctl_ret);
+		return -1;
+	}
+
+	struct dm_target_versions *tv = (struct dm_target_versions *)(buf + dmi->data_start);
+	memcpy(version, tv->version, sizeof(tv->version));
+	TRACE("DM target %s version: %u.%u.%u", target, version[0], version[1], version[2]);
+	return 0;
+}
+
 char *
 dm_get_target_type_new(int fd, const char *name)
 {
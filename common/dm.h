@@ -160,6 +160,18 @@ dm_read_version(int fd);
 int
 dm_list_versions(int fd);
 
+/**
+ * Get the version of a device-mapper target via the DM_GET_TARGET_VERSION
+ * ioctl, which loads the target module if necessary
+ * @param fd The /dev/mapper/control file descripter (can be retrieved
+ * 				via dm_open_control)
+ * @param target The name of the target, e.g. "integrity"
+ * @param version Filled with the major, minor and patch level of the target
+ * @return int 0 in case of success, -1 in case of failure
+ */
+int
+dm_get_target_version(int fd, const char *target, uint32_t version[3]);
+
 /**
  * Get the target_type of a dm-device
  *
@@ -0,0 +1,91 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/*
+ * Micro-benchmark for the event loop timers: schedules, cancels and
+ * fires a large number of timers and reports the elapsed time per phase.
+ */
+
+#include "event.h"
+#include "macro.h"
+#include "mem.h"
+#include "logf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define EVENT_BENCH_TIMERS 100000
+
+static unsigned int event_bench_fired = 0;
+
+static double
+event_bench_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void
+event_bench_timer_cb(event_timer_t *timer, UNUSED void *data)
+{
+	event_bench_fired++;
+	event_remove_timer(timer);
+	event_timer_free(timer);
+}
+
+int
+main(void)
+{
+	logf_handler_t *h = logf_register(&logf_test_write, stderr);
+	logf_handler_set_prio(h, LOGF_PRIO_WARN);
+	event_init();
+
+	event_timer_t **timers = mem_new0(event_timer_t *, EVENT_BENCH_TIMERS);
+	srand(42);
+
+	double start = event_bench_now_ms();
+	for (int i = 0; i < EVENT_BENCH_TIMERS; i++) {
+		timers[i] = event_timer_new(rand() % 10, 1, event_bench_timer_cb, NULL);
+		event_add_timer(timers[i]);
+	}
+	double scheduled = event_bench_now_ms();
+
+	// cancel every other timer, in reverse order to hit inner heap nodes
+	for (int i = EVENT_BENCH_TIMERS - 1; i >= 0; i -= 2) {
+		event_remove_timer(timers[i]);
+		event_timer_free(timers[i]);
+	}
+	double cancelled = event_bench_now_ms();
+
+	event_loop();
+	double fired = event_bench_now_ms();
+
+	printf("event timers: schedule %d: %.2f ms, cancel %d: %.2f ms, fire %u: %.2f ms\n",
+	       EVENT_BENCH_TIMERS, scheduled - start, EVENT_BENCH_TIMERS / 2, cancelled - scheduled,
+	       event_bench_fired, fired - cancelled);
+
+	mem_free0(timers);
+	return event_bench_fired == EVENT_BENCH_TIMERS / 2 ? 0 : 1;
+}
@@ -27,15 +27,21 @@
 
 #include "mem.h"
 #include "list.h"
+#include "array.h"
+#include "hashmap.h"
 #include "macro.h"
+#include "pidfd.h"
 
 #include <errno.h>
 #include <limits.h>
 #include <time.h>
 #include <string.h>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/epoll.h>
 #include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -83,6 +89,7 @@ struct event_timer {
 	struct timespec next;	  /**< next timeout, absolute value */
 	int repeat;		  /**< how often to repeat, -1 means repeat indefinitely */
 	int repeated;		  /**< how many repetitions the timer has left */
+	int heap_index;		  /**< position in event_timer_heap, -1 if not scheduled */
 };
 
 struct event_io {
@@ -111,7 +118,24 @@ struct event_signal {
 	bool todo;		  /**< helper variable for event_signal_handler() */
 };
 
-static list_t *event_timer_list = NULL;
+struct event_child_watch {
+	void (*func)(pid_t pid, int status, event_child_watch_t *watch,
+		     void *data); /**< the function to call when the child was reaped */
+	void *data;		  /**< a data pointer to pass to the callback function */
+	pid_t pid;		  /**< the pid of the child to be watched */
+	bool active;		  /**< true while the watch is registered in the event loop */
+	event_io_t *pidfd_io;	  /**< pidfd of the child if supported by the kernel */
+};
+
+/*
+ * Scheduled timers are kept in a binary min-heap ordered by their next
+ * expiration. Each timer knows its own position in the heap, thus adding
+ * and removing a timer is O(log n) and finding the next deadline is O(1).
+ */
+static event_timer_t **event_timer_heap = NULL;
+static unsigned int event_timer_heap_len = 0;
+static unsigned int event_timer_heap_size = 0;
+
 static list_t *event_signal_list = NULL;
 static list_t *event_inotify_list = NULL;
 static bool event_signal_received0[NSIG] = { false };
@@ -121,41 +145,114 @@ static unsigned event_io_active = 0;
 static bool event_initialized = false;
 static event_io_t *event_inotify_io = NULL;
 
+/*
+ * Signals handled by the event loop. If possible, they are blocked and read
+ * from a signalfd which is part of the epoll set, otherwise (and in children
+ * after event_reset()) event_sa_handler() just flags them asynchronously.
+ */
+static const int event_signals[] = { SIGTERM, SIGQUIT, SIGINT,	SIGALRM, SIGCHLD,
+				     SIGPIPE, SIGUSR1, SIGUSR2, SIGHUP };
+static sigset_t event_signal_mask;
+static sigset_t event_signal_saved_mask;
+static event_io_t *event_signal_io = NULL;
+
+// watched child processes by pid
+static hashmap_t *event_child_watch_map = NULL;
+static bool event_child_watch_check = false;
+
 /******************************************************************************/
 
-static int
-event_timeout(void)
+static void
+event_timer_heap_set(unsigned int i, event_timer_t *timer)
 {
-	struct timespec next, now, diff;
-	event_timer_t *timer;
-	list_t *l;
+	event_timer_heap[i] = timer;
+	timer->heap_index = i;
+}
 
-	if (!event_timer_list)
-		return -1;
+static void
+event_timer_heap_sift_up(unsigned int i)
+{
+	event_timer_t *timer = event_timer_heap[i];
+
+	while (i > 0) {
+		unsigned int parent = (i - 1) / 2;
+		if (!timespec_cmp(&timer->next, &event_timer_heap[parent]->next, <))
+			break;
+		event_timer_heap_set(i, event_timer_heap[parent]);
+		i = parent;
+	}
+	event_timer_heap_set(i, timer);
+}
 
-	l = event_timer_list;
-	timer = l->data;
+static void
+event_timer_heap_sift_down(unsigned int i)
+{
+	event_timer_t *timer = event_timer_heap[i];
+
+	for (;;) {
+		unsigned int child = 2 * i + 1;
+		if (child >= event_timer_heap_len)
+			break;
+		if (child + 1 < event_timer_heap_len &&
+		    timespec_cmp(&event_timer_heap[child + 1]->next, &event_timer_heap[child]->next,
+				 <))
+			child++;
+		if (!timespec_cmp(&event_timer_heap[child]->next, &timer->next, <))
+			break;
+		event_timer_heap_set(i, event_timer_heap[child]);
+		i = child;
+	}
+	event_timer_heap_set(i, timer);
+}
 
-	ASSERT(timer);
+static void
+event_timer_heap_push(event_timer_t *timer)
+{
+	if (event_timer_heap_len == event_timer_heap_size) {
+		event_timer_heap_size = event_timer_heap_size ? 2 * event_timer_heap_size : 16;
+		event_timer_heap =
+			mem_renew(event_timer_t *, event_timer_heap, event_timer_heap_size);
+	}
+	event_timer_heap_set(event_timer_heap_len++, timer);
+	event_timer_heap_sift_up(timer->heap_index);
+}
 
-	timespec_set(&timer->next, &next);
+static void
+event_timer_heap_delete(event_timer_t *timer)
+{
+	unsigned int i = timer->heap_index;
+	event_timer_t *last = event_timer_heap[--event_timer_heap_len];
 
-	// find the smallest next time in list
-	for (l = l->next; l; l = l->next) {
-		timer = l->data;
+	timer->heap_index = -1;
+	if (last == timer)
+		return;
 
-		ASSERT(timer);
+	event_timer_heap_set(i, last);
+	if (i > 0 && timespec_cmp(&last->next, &event_timer_heap[(i - 1) / 2]->next, <))
+		event_timer_heap_sift_up(i);
+	else
+		event_timer_heap_sift_down(i);
+}
 
-		if (timespec_cmp(&next, &timer->next, >))
-			timespec_set(&timer->next, &next);
-	}
+static int
+event_timeout(void)
+{
+	struct timespec now, diff;
+
+	if (!event_timer_heap_len)
+		return -1;
+
+	// the root of the heap holds the smallest next time
+	event_timer_t *timer = event_timer_heap[0];
+
+	ASSERT(timer);
 
 	timespec_now(&now);
 
-	if (timespec_cmp(&next, &now, <))
+	if (timespec_cmp(&timer->next, &now, <))
 		return 0;
 
-	timespec_sub(&next, &now, &diff);
+	timespec_sub(&timer->next, &now, &diff);
 
 	// should not happen, because timeout was an int too
 	ASSERT(diff.tv_sec <= (INT_MAX / 1000));
@@ -169,44 +266,38 @@ event_timeout_handler(void)
 {
 	struct timespec now;
 
-	IF_NULL_RETURN(event_timer_list);
+	IF_TRUE_RETURN(event_timer_heap_len == 0);
 
 	timespec_now(&now);
 
-	for (list_t *l = event_timer_list; l;) {
-		event_timer_t *timer = l->data;
+	// timer->func might add or remove timers, so always look at the current root
+	while (event_timer_heap_len > 0) {
+		event_timer_t *timer = event_timer_heap[0];
 
 		ASSERT(timer);
 
-		if (timespec_cmp(&now, &timer->next, >)) {
-			if (!timer->repeated) {
-				event_remove_timer(timer);
-			} else {
-				if (timer->repeated > 0)
-					timer->repeated--;
-				if (!timer->repeated)
-					event_remove_timer(timer);
-				else
-					timespec_add(&timer->diff, &timer->next, &timer->next);
-
-				TRACE("Handling timer event %p (func=%p, data=%p, diff=%u.%09us, repeat=%d)",
-				      (void *)timer, CAST_FUNCPTR_VOIDPTR timer->func, timer->data,
-				      (unsigned)timer->diff.tv_sec, (unsigned)timer->diff.tv_nsec,
-				      timer->repeat);
-
-				(timer->func)(timer, timer->data);
-			}
+		if (!timespec_cmp(&now, &timer->next, >))
+			break;
 
-			// event_timer_remove modifies the timer list
-			// and timer->func might modify the timer list
-			// so we will start again at its head...
-			if (event_timer_list)
-				l = event_timer_list;
-			else
-				break;
+		if (!timer->repeated) {
+			event_remove_timer(timer);
+			continue;
+		}
+
+		if (timer->repeated > 0)
+			timer->repeated--;
+		if (!timer->repeated) {
+			event_remove_timer(timer);
 		} else {
-			l = l->next;
+			timespec_add(&timer->diff, &timer->next, &timer->next);
+			event_timer_heap_sift_down(timer->heap_index);
 		}
+
+		TRACE("Handling timer event %p (func=%p, data=%p, diff=%u.%09us, repeat=%d)",
+		      (void *)timer, CAST_FUNCPTR_VOIDPTR timer->func, timer->data,
+		      (unsigned)timer->diff.tv_sec, (unsigned)timer->diff.tv_nsec, timer->repeat);
+
+		(timer->func)(timer, timer->data);
 	}
 }
 
@@ -226,6 +317,7 @@ event_timer_new(int timeout, int repeat, void (*func)(event_timer_t *timer, void
 	timer->next.tv_sec = 0;
 	timer->next.tv_nsec = 0;
 	timer->repeat = repeat;
+	timer->heap_index = -1;
 
 	return timer;
 }
@@ -235,6 +327,11 @@ event_timer_free(event_timer_t *timer)
 {
 	IF_NULL_RETURN(timer);
 
+	if (timer->heap_index >= 0) {
+		DEBUG("Freeing scheduled timer %p, removing it from event loop", (void *)timer);
+		event_timer_heap_delete(timer);
+	}
+
 	mem_free0(timer);
 }
 
@@ -249,7 +346,11 @@ event_add_timer(event_timer_t *timer)
 	timespec_add(&now, &timer->diff, &timer->next);
 	timer->repeated = timer->repeat;
 
-	event_timer_list = list_append(event_timer_list, timer);
+	// adding an already scheduled timer restarts it
+	if (timer->heap_index >= 0)
+		event_timer_heap_delete(timer);
+
+	event_timer_heap_push(timer);
 
 	TRACE("Added timer event %p (func=%p, data=%p, diff=%u.%09us, repeat=%d)", (void *)timer,
 	      CAST_FUNCPTR_VOIDPTR timer->func, timer->data, (unsigned)timer->diff.tv_sec,
@@ -261,8 +362,10 @@ event_remove_timer(event_timer_t *timer)
 {
 	IF_NULL_RETURN(timer);
 
-	TRACE("Removing timer event %p from list %p", (void *)timer, (void *)event_timer_list);
-	event_timer_list = list_remove(event_timer_list, timer);
+	TRACE("Removing timer event %p from heap", (void *)timer);
+	IF_TRUE_RETURN_TRACE(timer->heap_index < 0);
+
+	event_timer_heap_delete(timer);
 
 	TRACE("Removed timer event %p (func=%p, data=%p, diff=%u.%09us, repeat=%d)", (void *)timer,
 	      CAST_FUNCPTR_VOIDPTR timer->func, timer->data, (unsigned)timer->diff.tv_sec,
@@ -309,17 +412,24 @@ event_reset_fd(void)
 // compiling with -Wall, -Werror
 // must cast types appropriately in wrapper functions
 static void
-wrapped_remove_timer(void *elem)
+wrapped_remove_signal(void *elem)
 {
-	event_remove_timer((event_timer_t *)elem);
-	event_timer_free(elem);
+	event_remove_signal((event_signal_t *)elem);
+	event_signal_free(elem);
 }
 
 static void
-wrapped_remove_signal(void *elem)
+wrapped_free_child_watch(void *elem, UNUSED void *data)
 {
-	event_remove_signal((event_signal_t *)elem);
-	event_signal_free(elem);
+	event_child_watch_t *watch = elem;
+	// the epoll fd was already reset, thus just close the pidfd
+	if (watch->pidfd_io) {
+		close(watch->pidfd_io->fd);
+		event_io_free(watch->pidfd_io);
+		watch->pidfd_io = NULL;
+	}
+	watch->active = false;
+	event_child_watch_free(watch);
 }
 
 static void
@@ -401,6 +511,30 @@ event_remove_io(event_io_t *io)
 	//TODO unlink?
 }
 
+void
+event_modify_io(event_io_t *io, unsigned events)
+{
+	struct epoll_event epoll_event;
+
+	IF_NULL_RETURN(io);
+	IF_TRUE_RETURN_TRACE(io->events == events);
+
+	epoll_event.events = 0;
+	epoll_event.events |= (events & EVENT_IO_READ) ? EPOLLIN : 0;
+	epoll_event.events |= (events & EVENT_IO_WRITE) ? EPOLLOUT : 0;
+	epoll_event.events |= (events & EVENT_IO_PRI) ? EPOLLPRI : 0;
+	epoll_event.data.ptr = io;
+
+	if (epoll_ctl(event_epoll_fd(0), EPOLL_CTL_MOD, io->fd, &epoll_event) < 0) {
+		WARN_ERRNO("epoll_ctl failed");
+		return;
+	}
+	io->events = events;
+
+	TRACE("Modified io event %p (func=%p, data=%p, fd=%d, events=0x%x)", (void *)io,
+	      CAST_FUNCPTR_VOIDPTR io->func, io->data, io->fd, io->events);
+}
+
 static int
 event_epoll(int timeout)
 {
@@ -737,6 +871,236 @@ event_remove_signal(event_signal_t *sig)
 	      CAST_FUNCPTR_VOIDPTR sig->func, sig->data, sig->signum, strsignal(sig->signum));
 }
 
+/******************************************************************************/
+
+static bool
+event_child_watch_reap(event_child_watch_t *watch);
+
+static void
+event_child_watch_pidfd_cb(UNUSED int fd, unsigned events, UNUSED event_io_t *io, void *data)
+{
+	event_child_watch_t *watch = data;
+	ASSERT(watch);
+
+	if (events & (EVENT_IO_READ | EVENT_IO_EXCEPT))
+		event_child_watch_reap(watch);
+}
+
+/*
+ * If supported, the pidfd of the child becomes readable as soon as it exits,
+ * so it is reaped without waiting for SIGCHLD and without any probing.
+ * Like the signalfd it is not accounted in event_io_active.
+ */
+static void
+event_child_watch_pidfd_add(event_child_watch_t *watch)
+{
+	struct epoll_event epoll_event = { .events = EPOLLIN };
+	int pidfd = pidfd_open(watch->pid, 0);
+
+	if (pidfd < 0) {
+		TRACE_ERRNO("Could not open pidfd for %d, relying on SIGCHLD", watch->pid);
+		return;
+	}
+
+	watch->pidfd_io = event_io_new(pidfd, EVENT_IO_READ, &event_child_watch_pidfd_cb, watch);
+	epoll_event.data.ptr = watch->pidfd_io;
+
+	if (epoll_ctl(event_epoll_fd(0), EPOLL_CTL_ADD, pidfd, &epoll_event) < 0) {
+		WARN_ERRNO("Could not add pidfd of %d to epoll", watch->pid);
+		close(pidfd);
+		event_io_free(watch->pidfd_io);
+		watch->pidfd_io = NULL;
+	}
+}
+
+event_child_watch_t *
+event_child_watch_new(pid_t pid,
+		      void (*func)(pid_t pid, int status, event_child_watch_t *watch, void *data),
+		      void *data)
+{
+	event_child_watch_t *watch;
+
+	IF_NULL_RETVAL(func, NULL);
+	IF_FALSE_RETVAL(pid > 0, NULL);
+
+	watch = mem_new0(event_child_watch_t, 1);
+	watch->func = func;
+	watch->data = data;
+	watch->pid = pid;
+	watch->active = false;
+
+	return watch;
+}
+
+void
+event_child_watch_free(event_child_watch_t *watch)
+{
+	IF_NULL_RETURN(watch);
+
+	if (watch->active) {
+		DEBUG("Freeing active child watch %p, removing it from event loop", (void *)watch);
+		event_remove_child_watch(watch);
+	}
+
+	mem_free0(watch);
+}
+
+pid_t
+event_child_watch_get_pid(const event_child_watch_t *watch)
+{
+	IF_NULL_RETVAL(watch, -1);
+
+	return watch->pid;
+}
+
+int
+event_add_child_watch(event_child_watch_t *watch)
+{
+	IF_NULL_RETVAL(watch, -1);
+	IF_TRUE_RETVAL_TRACE(watch->active, 0);
+
+	if (!event_child_watch_map)
+		event_child_watch_map = hashmap_new();
+
+	if (hashmap_get_u64(event_child_watch_map, watch->pid)) {
+		ERROR("Could not add a second child watch for PID %d!", watch->pid);
+		return -EEXIST;
+	}
+
+	hashmap_put_u64(event_child_watch_map, watch->pid, watch);
+	watch->active = true;
+
+	event_child_watch_pidfd_add(watch);
+
+	// the child might already have exited, check on next loop iteration
+	event_child_watch_check = true;
+
+	TRACE("Added child watch %p (func=%p, data=%p, pid=%d, pidfd=%d)", (void *)watch,
+	      CAST_FUNCPTR_VOIDPTR watch->func, watch->data, watch->pid,
+	      watch->pidfd_io ? watch->pidfd_io->fd : -1);
+
+	return 0;
+}
+
+void
+event_remove_child_watch(event_child_watch_t *watch)
+{
+	IF_NULL_RETURN(watch);
+	IF_FALSE_RETURN_TRACE(watch->active);
+
+	hashmap_remove_u64(event_child_watch_map, watch->pid);
+	watch->active = false;
+
+	if (watch->pidfd_io) {
+		if (epoll_ctl(event_epoll_fd(0), EPOLL_CTL_DEL, watch->pidfd_io->fd, NULL) < 0)
+			WARN_ERRNO("epoll_ctl failed");
+		close(watch->pidfd_io->fd);
+		event_io_free(watch->pidfd_io);
+		watch->pidfd_io = NULL;
+	}
+
+	TRACE("Removed child watch %p (func=%p, data=%p, pid=%d)", (void *)watch,
+	      CAST_FUNCPTR_VOIDPTR watch->func, watch->data, watch->pid);
+}
+
+static bool
+event_child_watch_reap(event_child_watch_t *watch)
+{
+	int status = 0;
+	pid_t pid = waitpid(watch->pid, &status, WNOHANG);
+
+	if (pid == 0)
+		return false;
+
+	if (pid < 0) {
+		/*
+		 * Without a pidfd, ECHILD means that the process is not (yet) our
+		 * child, e.g., the init of a container, which is watched before it
+		 * is reparented to us. Keep the watch until the process is ours,
+		 * as long as the process exists at all. A readable pidfd, in
+		 * contrast, tells that the process has exited.
+		 */
+		int err = errno;
+		if (err == ECHILD && !watch->pidfd_io &&
+		    !(kill(watch->pid, 0) < 0 && errno == ESRCH)) {
+			TRACE("Watched process %d is not our child (yet)", watch->pid);
+			return false;
+		}
+		errno = err;
+		// reaped by someone else, e.g., a synchronous proc_waitpid()
+		WARN_ERRNO("Could not reap watched child with PID %d", watch->pid);
+		status = -1;
+	}
+
+	event_remove_child_watch(watch);
+
+	TRACE("Handling child watch %p (func=%p, data=%p, pid=%d, status=%d)", (void *)watch,
+	      CAST_FUNCPTR_VOIDPTR watch->func, watch->data, watch->pid, status);
+
+	(watch->func)(watch->pid, status, watch, watch->data);
+	return true;
+}
+
+static void
+event_child_watch_collect_cb(void *value, void *data)
+{
+	event_child_watch_t *watch = value;
+	array_t **pids = data;
+
+	// children with a pidfd are notified through epoll anyway
+	if (!watch->pidfd_io)
+		*pids = array_append(*pids, (void *)(intptr_t)watch->pid);
+}
+
+/*
+ * Reaps exited children which are watched and dispatches them to their owner.
+ * waitid(P_ALL, WNOWAIT) peeks at the next exited child without reaping it,
+ * so only one syscall is needed to find the owner. Children which are not
+ * watched are left alone for the remaining SIGCHLD signal handlers. As such
+ * a child hides all others from waitid(), the watched pids are probed one
+ * by one in this case.
+ */
+static void
+event_child_watch_handler(void)
+{
+	IF_TRUE_RETURN(hashmap_size(event_child_watch_map) == 0);
+
+	for (;;) {
+		siginfo_t info = { 0 };
+
+		if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) < 0) {
+			if (errno != ECHILD)
+				WARN_ERRNO("waitid failed");
+			return;
+		}
+		if (info.si_pid == 0)
+			return;
+
+		event_child_watch_t *watch = hashmap_get_u64(event_child_watch_map, info.si_pid);
+		if (!watch)
+			break;
+
+		if (!event_child_watch_reap(watch))
+			return;
+
+		IF_TRUE_RETURN(hashmap_size(event_child_watch_map) == 0);
+	}
+
+	TRACE("Unwatched child exited, probing watched children without pidfd");
+
+	// func might add, remove or free watches, thus work on a copy of the pids
+	array_t *pids = NULL;
+	hashmap_foreach(event_child_watch_map, event_child_watch_collect_cb, &pids);
+
+	for (unsigned int i = 0; i < array_length(pids); i++) {
+		pid_t pid = (pid_t)(intptr_t)array_get(pids, i);
+		event_child_watch_t *watch = hashmap_get_u64(event_child_watch_map, pid);
+		if (watch)
+			event_child_watch_reap(watch);
+	}
+	array_free(pids);
+}
+
 static void
 event_signal_handler(void)
 {
@@ -755,6 +1119,12 @@ event_signal_handler(void)
 	else
 		event_signal_received = event_signal_received0;
 
+	// watched children are dispatched before the generic SIGCHLD handlers
+	if (received[SIGCHLD] || event_child_watch_check) {
+		event_child_watch_check = false;
+		event_child_watch_handler();
+	}
+
 	for (list_t *l = event_signal_list; l; l = l->next) {
 		event_signal_t *sig = l->data;
 
@@ -812,6 +1182,94 @@ event_sa_handler(int signum)
 		event_signal_received[signum] = true;
 }
 
+static void
+event_signal_fd_cb(int fd, unsigned events, UNUSED event_io_t *io, UNUSED void *data)
+{
+	struct signalfd_siginfo info[16];
+	ssize_t n;
+
+	if (!(events & EVENT_IO_READ))
+		return;
+
+	// only flag the signals here, they are dispatched by event_signal_handler()
+	while ((n = read(fd, info, sizeof(info))) > 0) {
+		for (size_t i = 0; i < (size_t)n / sizeof(struct signalfd_siginfo); i++) {
+			TRACE("Read signal %u (%s) from signalfd", info[i].ssi_signo,
+			      strsignal(info[i].ssi_signo));
+			if (info[i].ssi_signo < NSIG)
+				event_signal_received[info[i].ssi_signo] = true;
+		}
+	}
+
+	if (n < 0 && errno != EAGAIN)
+		WARN_ERRNO("Failed to read from signalfd");
+}
+
+static void
+event_signal_fd_init(void)
+{
+	struct epoll_event epoll_event = { .events = EPOLLIN };
+	int fd;
+
+	if (sigprocmask(SIG_BLOCK, &event_signal_mask, &event_signal_saved_mask) < 0) {
+		WARN_ERRNO("Could not block signals, falling back to asynchronous signal handling");
+		return;
+	}
+
+	if ((fd = signalfd(-1, &event_signal_mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+		WARN_ERRNO("Could not create signalfd, "
+			   "falling back to asynchronous signal handling");
+		goto error;
+	}
+
+	event_signal_io = event_io_new(fd, EVENT_IO_READ, &event_signal_fd_cb, NULL);
+	epoll_event.data.ptr = event_signal_io;
+
+	// not accounted in event_io_active, signal events keep the loop running on their own
+	if (epoll_ctl(event_epoll_fd(0), EPOLL_CTL_ADD, fd, &epoll_event) < 0) {
+		WARN_ERRNO("Could not add signalfd to epoll");
+		close(fd);
+		event_io_free(event_signal_io);
+		event_signal_io = NULL;
+		goto error;
+	}
+
+	TRACE("Handling signals via signalfd %d", fd);
+	return;
+
+error:
+	if (sigprocmask(SIG_SETMASK, &event_signal_saved_mask, NULL) < 0)
+		WARN_ERRNO("Could not restore signal mask");
+}
+
+/*
+ * Closes the signalfd and restores the signal mask, thus signals are
+ * flagged by event_sa_handler() again. The signalfd is not removed from
+ * the epoll set since it may be shared with the parent process.
+ */
+static void
+event_signal_fd_reset(void)
+{
+	IF_NULL_RETURN(event_signal_io);
+
+	close(event_signal_io->fd);
+	event_io_free(event_signal_io);
+	event_signal_io = NULL;
+
+	if (sigprocmask(SIG_SETMASK, &event_signal_saved_mask, NULL) < 0)
+		WARN_ERRNO("Could not restore signal mask");
+}
+
+/*
+ * The blocked signal mask would be inherited by exec'ed helper programs,
+ * thus restore it in every forked child.
+ */
+static void
+event_signal_atfork_child(void)
+{
+	event_signal_fd_reset();
+}
+
 void
 event_init(void)
 {
@@ -824,19 +1282,28 @@ event_init(void)
 	ASSERT(sigemptyset(&action.sa_mask) >= 0);
 	action.sa_flags = 0;
 
-	event_sigaction(SIGTERM, &action, NULL);
-	event_sigaction(SIGQUIT, &action, NULL);
-	event_sigaction(SIGINT, &action, NULL);
-	event_sigaction(SIGALRM, &action, NULL);
-	event_sigaction(SIGCHLD, &action, NULL);
-	event_sigaction(SIGPIPE, &action, NULL);
-	event_sigaction(SIGUSR1, &action, NULL);
-	event_sigaction(SIGUSR2, &action, NULL);
-	event_sigaction(SIGHUP, &action, NULL);
+	ASSERT(sigemptyset(&event_signal_mask) >= 0);
+	for (size_t i = 0; i < ELEMENTSOF(event_signals); i++) {
+		event_sigaction(event_signals[i], &action, NULL);
+		ASSERT(sigaddset(&event_signal_mask, event_signals[i]) >= 0);
+	}
+
+	static bool atfork_registered = false;
+	if (!atfork_registered && !pthread_atfork(NULL, NULL, &event_signal_atfork_child))
+		atfork_registered = true;
+
+	event_signal_fd_init();
 
 	event_initialized = true;
 }
 
+static bool
+event_loop_active(void)
+{
+	return event_signal_list || event_timer_heap_len || event_io_active ||
+	       hashmap_size(event_child_watch_map);
+}
+
 void
 event_loop(void)
 {
@@ -846,11 +1313,15 @@ event_loop(void)
 	}
 	DEBUG("Starting event loop");
 
-	while (event_signal_list || event_timer_list || event_io_active) {
+	while (event_loop_active()) {
 		int timeout;
 
 		event_signal_handler();
 
+		// signal and child watch callbacks might have removed the last event
+		if (!event_loop_active())
+			break;
+
 		timeout = event_timeout();
 
 		event_epoll(timeout);
@@ -880,10 +1351,16 @@ event_reset()
 	TRACE("Resetting event epoll fd");
 	event_reset_fd();
 
-	if (event_timer_list) {
+	TRACE("Resetting event signalfd");
+	event_signal_fd_reset();
+
+	if (event_timer_heap_len) {
 		TRACE("Resetting event timers");
-		list_foreach(event_timer_list, wrapped_remove_timer);
-		event_timer_list = NULL;
+		while (event_timer_heap_len) {
+			event_timer_t *timer = event_timer_heap[event_timer_heap_len - 1];
+			event_remove_timer(timer);
+			event_timer_free(timer);
+		}
 	}
 	if (event_signal_list) {
 		TRACE("Resetting event signal handler list");
@@ -895,4 +1372,10 @@ event_reset()
 		list_foreach(event_inotify_list, wrapped_remove_inotify);
 		event_inotify_list = NULL;
 	}
+	if (event_child_watch_map) {
+		TRACE("Resetting event child watches");
+		hashmap_foreach(event_child_watch_map, wrapped_free_child_watch, NULL);
+		hashmap_free(event_child_watch_map);
+		event_child_watch_map = NULL;
+	}
 }
@@ -37,6 +37,7 @@
 #define EVENT_H
 
 #include <stdint.h>
+#include <sys/types.h>
 
 typedef struct event_timer event_timer_t;
 
@@ -133,6 +134,17 @@ event_add_io(event_io_t *io);
 void
 event_remove_io(event_io_t *io);
 
+/**
+ * Changes the events monitored for an I/O event which is already added to
+ * the event loop, e.g. to temporarily watch for EVENT_IO_WRITE while output
+ * is pending on a non-blocking fd.
+ *
+ * @param io The I/O event which has been added to the event loop.
+ * @param events Bitwise-or'd events to be monitored on the fd from now on.
+ */
+void
+event_modify_io(event_io_t *io, unsigned events);
+
 /**
  * Resets the event subsystem to its initial state
  * As this sets all event lists to zero,
@@ -197,18 +209,80 @@ event_add_signal(event_signal_t *sig);
 void
 event_remove_signal(event_signal_t *sig);
 
+typedef struct event_child_watch event_child_watch_t;
+
+/**
+ * Creates a new child watch. Once added to the event loop, the child process
+ * with the given pid is reaped by the event loop as soon as it exits and func
+ * is called with its exit status. Other SIGCHLD signal events are not
+ * involved in this, thus the owner of a child process does not have to
+ * probe for it with waitpid() on each SIGCHLD. If supported by the kernel,
+ * the exit is noticed through a pidfd of the child, otherwise on SIGCHLD.
+ *
+ * @param pid The pid of a child process of the calling process. The process
+ *        may also become a child only later, e.g., by being reparented.
+ * @param func A pointer to the callback function which gets the pid and the
+ *        status as returned by waitpid() or -1 if the child could not be reaped,
+ *        e.g., as it has been reaped elsewhere and no longer exists.
+ * @param data Payload data to be passed to the callback function.
+ * @return The newly created child watch.
+ */
+event_child_watch_t *
+event_child_watch_new(pid_t pid,
+		      void (*func)(pid_t pid, int status, event_child_watch_t *watch, void *data),
+		      void *data);
+
+/**
+ * Frees the allocated memory of the child watch. If it is still part of the
+ * event loop, it is removed first.
+ *
+ * @param watch The child watch to be freed.
+ */
+void
+event_child_watch_free(event_child_watch_t *watch);
+
+/**
+ * Get the pid of the child process watched by the child watch.
+ *
+ * @param watch The child watch.
+ * @return The pid of the watched child process.
+ */
+pid_t
+event_child_watch_get_pid(const event_child_watch_t *watch);
+
+/**
+ * Adds the child watch to the event loop. The watch is removed from the event
+ * loop automatically before its callback is invoked, which may free it.
+ *
+ * @param watch The child watch to be added to the event loop.
+ * @return 0 on success, -EEXIST if the pid is already watched, -1 otherwise.
+ */
+int
+event_add_child_watch(event_child_watch_t *watch);
+
+/**
+ * Removes the child watch from the event loop without reaping the child.
+ *
+ * @param watch The child watch to be removed from the event loop.
+ */
+void
+event_remove_child_watch(event_child_watch_t *watch);
+
 /**
  * Initializes the event loop. Should be called before event_add_signal() is used;
  * otherwise, signals that occur before event_loop() is started might be lost and
  * not get delivered to their registered signal handlers.
+ * If supported, the handled signals are blocked and received through a signalfd
+ * in the epoll set. The original signal mask is restored in forked children
+ * and by event_reset().
  */
 void
 event_init(void);
 
 /**
- * Invokes the event loop that handles all registered timer, I/O, and signal
- * events. The function returns if there are no more registered timer, I/O, and
- * signal events.
+ * Invokes the event loop that handles all registered timer, I/O, signal and
+ * child watch events. The function returns if there are no more registered
+ * timer, I/O, signal and child watch events.
  */
 void
 event_loop(void);
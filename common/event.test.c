@@ -0,0 +1,192 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+#include "munit.h"
+
+#include "event.h"
+#include "logf.h"
+#include "macro.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TEST_EVENT_CHILDREN 8
+
+static int test_event_status[TEST_EVENT_CHILDREN];
+static unsigned int test_event_reaped;
+
+static void *
+setup(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	logf_register(&logf_test_write, stderr);
+	event_init();
+	return NULL;
+}
+
+static void
+tear_down(UNUSED void *fixture)
+{
+	event_reset();
+}
+
+static pid_t
+test_event_fork_exit(int code)
+{
+	pid_t pid = fork();
+	munit_assert_int(pid, >=, 0);
+	if (pid == 0)
+		_exit(code);
+	return pid;
+}
+
+static void
+test_event_child_cb(pid_t pid, int status, event_child_watch_t *watch, void *data)
+{
+	int *idx = data;
+
+	munit_assert_int(event_child_watch_get_pid(watch), ==, pid);
+	test_event_status[*idx] = status;
+	test_event_reaped++;
+
+	event_child_watch_free(watch);
+}
+
+static MunitResult
+test_event_child_watch(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	static int idx[TEST_EVENT_CHILDREN];
+
+	// an unwatched child is left alone and must not hide the watched ones
+	pid_t unwatched = test_event_fork_exit(42);
+
+	test_event_reaped = 0;
+	for (int i = 0; i < TEST_EVENT_CHILDREN; i++) {
+		idx[i] = i;
+		pid_t pid = test_event_fork_exit(i);
+		event_child_watch_t *watch =
+			event_child_watch_new(pid, test_event_child_cb, &idx[i]);
+		munit_assert_not_null(watch);
+		munit_assert_int(event_add_child_watch(watch), ==, 0);
+	}
+
+	// the loop returns as soon as all watched children are reaped
+	event_loop();
+
+	munit_assert_uint(test_event_reaped, ==, TEST_EVENT_CHILDREN);
+	for (int i = 0; i < TEST_EVENT_CHILDREN; i++) {
+		munit_assert_true(WIFEXITED(test_event_status[i]));
+		munit_assert_int(WEXITSTATUS(test_event_status[i]), ==, i);
+	}
+
+	int status;
+	munit_assert_int(waitpid(unwatched, &status, 0), ==, unwatched);
+	munit_assert_int(WEXITSTATUS(status), ==, 42);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_event_child_watch_twice(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	pid_t pid = test_event_fork_exit(0);
+
+	event_child_watch_t *watch = event_child_watch_new(pid, test_event_child_cb, NULL);
+	event_child_watch_t *watch2 = event_child_watch_new(pid, test_event_child_cb, NULL);
+
+	munit_assert_int(event_add_child_watch(watch), ==, 0);
+	munit_assert_int(event_add_child_watch(watch2), <, 0);
+
+	// removing the watch does not reap the child
+	event_child_watch_free(watch);
+	event_child_watch_free(watch2);
+
+	int status;
+	munit_assert_int(waitpid(pid, &status, 0), ==, pid);
+
+	return MUNIT_OK;
+}
+
+static void
+test_event_signal_cb(int signum, event_signal_t *sig, void *data)
+{
+	int *received = data;
+	*received = signum;
+
+	event_remove_signal(sig);
+	event_signal_free(sig);
+}
+
+static MunitResult
+test_event_signal(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	int received = 0;
+
+	event_signal_t *sig = event_signal_new(SIGUSR1, test_event_signal_cb, &received);
+	event_add_signal(sig);
+
+	munit_assert_int(kill(getpid(), SIGUSR1), ==, 0);
+	event_loop();
+
+	munit_assert_int(received, ==, SIGUSR1);
+
+	return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+	{
+		"/child watch",		/* name */
+		test_event_child_watch, /* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/child watch twice",	      /* name */
+		test_event_child_watch_twice, /* test */
+		setup,			      /* setup */
+		tear_down,		      /* tear_down */
+		MUNIT_TEST_OPTION_NONE,	      /* options */
+		NULL			      /* parameters */
+	},
+	{
+		"/signal",		/* name */
+		test_event_signal,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+
+	// Mark the end of the array with an entry where the test function is NULL
+	{ NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite event_suite = {
+	"/event",		/* name */
+	tests,			/* tests */
+	NULL,			/* suites */
+	1,			/* iterations */
+	MUNIT_SUITE_OPTION_NONE /* options */
+};
@@ -25,6 +25,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 
 #include "mem.h"
 #include "macro.h"
@@ -71,6 +73,79 @@ fd_write(int fd, const char *buf, ssize_t len)
 	return len - remain;
 }
 
+ssize_t
+fd_writev(int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t written = 0;
+
+	while (iovcnt > 0) {
+		ssize_t ret = writev(fd, iov, iovcnt);
+
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				TRACE_ERRNO("Writing to fd %d: Blocked, retrying...", fd);
+				continue;
+			} else if (errno == EINTR) {
+				TRACE("Writing to fd %d: Interrupted, retrying...", fd);
+				continue;
+			}
+
+			ERROR_ERRNO("Failed to write to fd %d", fd);
+			return -1;
+		}
+		if (ret == 0)
+			break;
+
+		written += ret;
+		TRACE("Writing to fd %d: Wrote %zd bytes", fd, ret);
+
+		// skip completely written buffers and adjust the partially written one
+		while (iovcnt > 0 && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return written;
+}
+
+ssize_t
+fd_sendfile(int out_fd, int in_fd, off_t offset, size_t len)
+{
+	size_t remain = len;
+
+	while (remain > 0) {
+		ssize_t ret = sendfile(out_fd, in_fd, &offset, remain);
+
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				TRACE_ERRNO("Writing to fd %d: Blocked, retrying...", out_fd);
+				continue;
+			} else if (errno == EINTR) {
+				TRACE("Writing to fd %d: Interrupted, retrying...", out_fd);
+				continue;
+			}
+
+			ERROR_ERRNO("Failed to send from fd %d to fd %d", in_fd, out_fd);
+			return -1;
+		}
+		// source file is shorter than expected
+		if (ret == 0)
+			break;
+
+		remain -= ret;
+		TRACE("Sending from fd %d to fd %d: Sent %zd bytes, %zu bytes remaining.", in_fd,
+		      out_fd, ret, remain);
+	}
+
+	return len - remain;
+}
+
 int
 fd_read(int fd, char *buf, size_t len)
 {
@@ -32,6 +32,9 @@
 #define FD_H
 
 #include <stddef.h>
+#include <sys/types.h>
+
+struct iovec;
 
 /**
  * Writes the given buffer of the given length to the given file descriptor,
@@ -44,6 +47,33 @@
 ssize_t
 fd_write(const int fd, const char *buf, ssize_t len);
 
+/**
+ * Writes all given buffers to the given file descriptor with a single writev()
+ * where possible, looping as necessary. In contrast to fd_write(), the fd
+ * is not fsync'ed, which makes this the preferred variant for sockets.
+ * The iovec array is modified in place to keep track of partial writes.
+ *
+ * @param fd the file descriptor to write to
+ * @param iov array of buffers
+ * @param iovcnt number of elements in iov
+ * @return the number of bytes written or -1 on error
+ */
+ssize_t
+fd_writev(int fd, struct iovec *iov, int iovcnt);
+
+/**
+ * Copies len bytes starting at offset from in_fd to out_fd using sendfile(),
+ * looping as necessary, so the data does not pass through userspace.
+ *
+ * @param out_fd the file descriptor to write to
+ * @param in_fd the file descriptor to read from, must support mmap-like operations
+ * @param offset offset in in_fd to start reading from
+ * @param len number of bytes to copy
+ * @return the number of bytes written or -1 on error
+ */
+ssize_t
+fd_sendfile(int out_fd, int in_fd, off_t offset, size_t len);
+
 /*
  * Reads the specified amount of bytes from the given file descriptor to the given buffer,
  * looping over read() as necessary.
@@ -39,10 +39,24 @@
 #include <fcntl.h>
 #include <alloca.h>
 #include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
 #include <errno.h>
 
 /******************************************************************************/
 
+// buffer size for copies which cannot be done in the kernel
+#define FILE_COPY_BUF_SIZE (1024 * 1024)
+
+typedef enum {
+	FILE_COPY_METHOD_REFLINK,
+	FILE_COPY_METHOD_COPY_FILE_RANGE,
+	FILE_COPY_METHOD_SENDFILE,
+	FILE_COPY_METHOD_READ_WRITE,
+} file_copy_method_t;
+
+/******************************************************************************/
+
 bool
 file_exists(const char *file)
 {
@@ -125,13 +139,151 @@ file_is_fifo(const char *file)
 	return !lstat(file, &s) && S_ISFIFO(s.st_mode);
 }
 
+static const char *
+file_copy_method_to_string(file_copy_method_t method)
+{
+	switch (method) {
+	case FILE_COPY_METHOD_REFLINK:
+		return "reflink";
+	case FILE_COPY_METHOD_COPY_FILE_RANGE:
+		return "copy_file_range";
+	case FILE_COPY_METHOD_SENDFILE:
+		return "sendfile";
+	case FILE_COPY_METHOD_READ_WRITE:
+		return "read/write";
+	}
+	return "unknown";
+}
+
+/*
+ * Copies len bytes, or everything up to the end of the input if len is
+ * negative, from in_fd to out_fd, at *in_off and *out_off or, if these are
+ * NULL, at the current file positions. *method is lowered from
+ * copy_file_range() over sendfile() to a read/write loop until a method
+ * works, so that unsupported methods are not retried for later ranges.
+ * Returns the number of bytes copied or -1 on error.
+ */
+static ssize_t
+file_copy_fd_range(int in_fd, off_t *in_off, int out_fd, off_t *out_off, ssize_t len,
+		   unsigned char **buf, size_t buf_size, file_copy_method_t *method)
+{
+	ssize_t copied = 0;
+
+	while (len < 0 || copied < len) {
+		size_t n = (len < 0) ? buf_size : (size_t)(len - copied);
+		ssize_t num_bytes;
+
+		if (*method == FILE_COPY_METHOD_COPY_FILE_RANGE) {
+			num_bytes = copy_file_range(in_fd, in_off, out_fd, out_off, n, 0);
+			if (num_bytes < 0 && (errno == EXDEV || errno == EINVAL ||
+					      errno == ENOSYS || errno == EOPNOTSUPP)) {
+				TRACE_ERRNO("copy_file_range not possible, trying sendfile");
+				*method = FILE_COPY_METHOD_SENDFILE;
+				continue;
+			}
+		} else if (*method == FILE_COPY_METHOD_SENDFILE) {
+			if (out_off && lseek(out_fd, *out_off, SEEK_SET) < 0) {
+				DEBUG_ERRNO("Could not lseek in output fd %d", out_fd);
+				return -1;
+			}
+			num_bytes = sendfile(out_fd, in_fd, in_off, n);
+			if (num_bytes < 0 && (errno == EINVAL || errno == ENOSYS)) {
+				TRACE_ERRNO("sendfile not possible, falling back to read/write");
+				*method = FILE_COPY_METHOD_READ_WRITE;
+				continue;
+			}
+			if (num_bytes > 0 && out_off)
+				*out_off += num_bytes;
+		} else {
+			if (!*buf)
+				*buf = mem_alloc(buf_size);
+			n = MIN(n, buf_size);
+			num_bytes = in_off ? pread(in_fd, *buf, n, *in_off) : read(in_fd, *buf, n);
+			if (num_bytes > 0) {
+				ssize_t written =
+					out_off ? pwrite(out_fd, *buf, num_bytes, *out_off) :
+						  fd_write(out_fd, (char *)*buf, num_bytes);
+				if (written != num_bytes) {
+					DEBUG_ERRNO("Could not write to output fd %d", out_fd);
+					return -1;
+				}
+				if (in_off)
+					*in_off += num_bytes;
+				if (out_off)
+					*out_off += num_bytes;
+			}
+		}
+
+		if (num_bytes < 0) {
+			if (errno == EINTR)
+				continue;
+			DEBUG_ERRNO("Could not copy from fd %d to fd %d using %s", in_fd, out_fd,
+				    file_copy_method_to_string(*method));
+			return -1;
+		}
+		if (num_bytes == 0) {
+			if (len >= 0) {
+				DEBUG("Input fd %d ended after %zd of %zd bytes", in_fd, copied,
+				      len);
+				return -1;
+			}
+			break;
+		}
+		copied += num_bytes;
+	}
+	return copied;
+}
+
+/*
+ * Copies only the data extents of the first size bytes of the regular file
+ * in_fd to out_fd at out_base, so that holes stay holes in the output file,
+ * which therefore has to be empty.
+ */
+static int
+file_copy_sparse(int in_fd, int out_fd, off_t out_base, off_t size, unsigned char **buf,
+		 size_t buf_size, file_copy_method_t *method)
+{
+	off_t data = 0;
+
+	while (data < size) {
+		data = lseek(in_fd, data, SEEK_DATA);
+		if (data < 0 && errno == ENXIO) // no more data
+			break;
+		if (data < 0) {
+			DEBUG_ERRNO("Could not seek to data in input fd %d", in_fd);
+			return -1;
+		}
+		if (data >= size)
+			break;
+		off_t hole = lseek(in_fd, data, SEEK_HOLE);
+		if (hole < 0) {
+			DEBUG_ERRNO("Could not seek to hole in input fd %d", in_fd);
+			return -1;
+		}
+		hole = MIN(hole, size);
+
+		off_t in_off = data;
+		off_t out_off = out_base + data;
+		if (file_copy_fd_range(in_fd, &in_off, out_fd, &out_off, hole - data, buf, buf_size,
+				       method) < 0)
+			return -1;
+		data = hole;
+	}
+
+	// the input may end with a hole
+	if (ftruncate(out_fd, out_base + size) < 0) {
+		DEBUG_ERRNO("Could not truncate output fd %d", out_fd);
+		return -1;
+	}
+	return 0;
+}
+
 int
 file_copy(const char *in_file, const char *out_file, ssize_t count, size_t bs, off_t seek)
 {
-	int in_fd, out_fd, ret = 0;
-
-	ssize_t i = 0;
-	unsigned char *buf;
+	int in_fd, out_fd, ret = -1;
+	unsigned char *buf = NULL;
+	file_copy_method_t method = FILE_COPY_METHOD_COPY_FILE_RANGE;
 
 	IF_NULL_RETVAL(in_file, -1);
 	IF_NULL_RETVAL(out_file, -1);
@@ -150,90 +302,64 @@ file_copy(const char *in_file, const char *out_file, ssize_t count, size_t bs, o
 		return -1;
 	}
 
-	ret = lseek(out_fd, seek * bs, SEEK_SET);
-	if (ret < 0) {
+	off_t out_off = MUL_WITH_OVERFLOW_CHECK(seek, (off_t)bs);
+	if (lseek(out_fd, out_off, SEEK_SET) < 0) {
 		DEBUG_ERRNO("Could not lseek in output file %s", out_file);
 		goto out;
 	}
 
-	// reset ret
-	ret = 0;
-
-	ssize_t len = 0;
-	struct stat stat;
-	if (fstat(in_fd, &stat) != 0) {
-		DEBUG_ERRNO("fstat on %s failed", in_file);
-		// use fallback
-		goto fallback;
+	struct stat in_s, out_s;
+	if (fstat(in_fd, &in_s) < 0 || fstat(out_fd, &out_s) < 0) {
+		DEBUG_ERRNO("fstat on %s or %s failed", in_file, out_file);
+		goto out;
 	}
-	len = (count < 0) ? stat.st_size :
-			    MIN(stat.st_size, (off_t)MUL_WITH_OVERFLOW_CHECK(count, bs));
-
-	// corner case: special file systems
-	IF_TRUE_GOTO_TRACE((count < 0 && len == 0), fallback);
 
-	int ctr = 0;
-	while (len > 0) {
-		ssize_t num_bytes = sendfile(out_fd, in_fd, NULL, len);
-		if (num_bytes == 0) {
-			ctr++;
-			IF_TRUE_GOTO_ERROR(ctr == 5, out);
-		} else if (num_bytes < 0) {
-			DEBUG_ERRNO("sendfile failed");
-			if (errno == EINVAL || errno == ENOSYS) {
-				goto fallback;
-			} else {
-				ret = -1;
-				goto out;
-			}
-		} else { // num_bytes > 0
-			ctr = 0;
-			len -= num_bytes;
-		}
+	// number of bytes to copy, -1 to read until the end of the input
+	off_t len = -1;
+	if (S_ISREG(in_s.st_mode) && in_s.st_size > 0)
+		len = in_s.st_size;
+	else if (S_ISBLK(in_s.st_mode))
+		len = lseek(in_fd, 0, SEEK_END);
+	if (count >= 0) {
+		off_t max = MUL_WITH_OVERFLOW_CHECK((off_t)count, (off_t)bs);
+		len = (len < 0) ? max : MIN(len, max);
 	}
 
-	if (0 != fsync(out_fd)) {
-		TRACE_ERRNO("Could not sync fd %d", out_fd);
+	bool both_regular = S_ISREG(in_s.st_mode) && S_ISREG(out_s.st_mode);
+
+	// on file systems such as btrfs or xfs, the copy just shares the extents of the input
+	if (both_regular && count < 0 && seek == 0 && len > 0 &&
+	    ioctl(out_fd, FICLONE, in_fd) == 0) {
+		method = FILE_COPY_METHOD_REFLINK;
+		ret = 0;
+		goto out;
 	}
 
-	ret = 0;
-	goto out;
-
-	// slow copy as fallback
-fallback:
-	buf = mem_alloc0(bs);
-
-	for (i = 0; i != count; i++) {
-		ssize_t len;
-
-		len = read(in_fd, buf, bs);
-
-		if (0 == (i % 1024))
-			TRACE("Copied %zd bytes from %s to %s", MUL_WITH_OVERFLOW_CHECK(bs, i),
-			      in_file, out_file);
-
-		if (len == 0) {
-			goto out_fallback;
-		} else if (len < 0) {
-			DEBUG_ERRNO("Could not read from input file %s", in_file);
-			ret = -1;
-			goto out_fallback;
-		} else /* if (len > 0) */ {
-			if (write(out_fd, buf, len) < 0) {
-				DEBUG_ERRNO("Could not write to output file %s", out_file);
-				ret = -1;
-				goto out_fallback;
-			}
+	size_t buf_size = MAX(bs, FILE_COPY_BUF_SIZE);
+	if (both_regular && len > 0) {
+		ret = file_copy_sparse(in_fd, out_fd, out_off, len, &buf, buf_size, &method);
+	} else {
+		if (len < 0) {
+			// e.g. files of special file systems, which report a size of 0
+			method = FILE_COPY_METHOD_READ_WRITE;
+		} else if (lseek(in_fd, 0, SEEK_SET) < 0) {
+			DEBUG_ERRNO("Could not lseek in input file %s", in_file);
+			goto out;
 		}
+		if (file_copy_fd_range(in_fd, NULL, out_fd, NULL, len, &buf, buf_size,
+				       &method) >= 0)
+			ret = 0;
 	}
 
-	if (0 != fsync(out_fd)) {
+	if (ret == 0 && 0 != fsync(out_fd)) {
 		TRACE_ERRNO("Could not sync fd %d", out_fd);
 	}
 
-out_fallback:
-	mem_free(buf);
 out:
+	if (ret == 0)
+		DEBUG("Copied %s to %s using %s", in_file, out_file,
+		      file_copy_method_to_string(method));
+	mem_free(buf);
 	close(out_fd);
 	close(in_fd);
 
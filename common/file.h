@@ -62,10 +62,14 @@ file_is_fifo(const char *file);
 
 /**
  * Copy a file.
+ * A whole regular file is cloned if the file system supports reflinks,
+ * otherwise the data is copied in the kernel if possible, and holes of
+ * regular files are preserved. Only if neither works, the data is read and
+ * written through a buffer of at least 1 MiB.
  * @param in_file The file to be read.
  * @param out_file The file to be written.
  * @param count Copy count input blocks, may be -1 to copy until end of file.
- * @param bs Read and write up to bs bytes at a time.
+ * @param bs Size of the blocks count and seek refer to.
  * @param seek Skip seek blocks at start of output.
  * @return -1 on error else 0.
  */
@@ -0,0 +1,243 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+#include "munit.h"
+
+#include "file.h"
+#include "logf.h"
+#include "macro.h"
+#include "mem.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_FILE_CHUNK (64 * 1024)
+
+typedef struct {
+	char dir[64];
+	char *in;
+	char *out;
+} test_file_t;
+
+static test_file_t test_file;
+
+/*
+ * Writes a chunk of pattern data at each of the given chunk indices of a file
+ * of n_chunks chunks, leaving holes in between.
+ */
+static void
+test_file_write_sparse(const char *file, size_t n_chunks, const size_t *data_chunks,
+		       size_t n_data)
+{
+	unsigned char *buf = mem_alloc(TEST_FILE_CHUNK);
+	int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	munit_assert_int(fd, >=, 0);
+
+	for (size_t i = 0; i < n_data; i++) {
+		for (size_t j = 0; j < TEST_FILE_CHUNK; j++)
+			buf[j] = (data_chunks[i] * 13 + j) & 0xff;
+		off_t off = (off_t)data_chunks[i] * TEST_FILE_CHUNK;
+		munit_assert_int(pwrite(fd, buf, TEST_FILE_CHUNK, off), ==, TEST_FILE_CHUNK);
+	}
+	munit_assert_int(ftruncate(fd, (off_t)n_chunks * TEST_FILE_CHUNK), ==, 0);
+	close(fd);
+	mem_free0(buf);
+}
+
+static unsigned char *
+test_file_read(const char *file, off_t *size)
+{
+	*size = file_size(file);
+	munit_assert_int(*size, >=, 0);
+
+	unsigned char *buf = mem_alloc0(*size + 1);
+	int fd = open(file, O_RDONLY);
+	munit_assert_int(fd, >=, 0);
+	munit_assert_int(read(fd, buf, *size), ==, *size);
+	close(fd);
+	return buf;
+}
+
+static void
+test_file_assert_equal(const char *a, const char *b)
+{
+	off_t a_size, b_size;
+	unsigned char *a_buf = test_file_read(a, &a_size);
+	unsigned char *b_buf = test_file_read(b, &b_size);
+
+	munit_assert_int(a_size, ==, b_size);
+	munit_assert_memory_equal(a_size, a_buf, b_buf);
+	mem_free0(a_buf);
+	mem_free0(b_buf);
+}
+
+static MunitResult
+test_file_copy(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	const size_t chunks[] = { 0, 1, 2, 3 };
+	test_file_write_sparse(test_file.in, 4, chunks, 4);
+
+	munit_assert_int(file_copy(test_file.in, test_file.out, -1, 512, 0), ==, 0);
+	test_file_assert_equal(test_file.in, test_file.out);
+
+	// overwrite an existing, larger output file
+	test_file_write_sparse(test_file.out, 8, chunks, 4);
+	munit_assert_int(file_copy(test_file.in, test_file.out, -1, 512, 0), ==, 0);
+	test_file_assert_equal(test_file.in, test_file.out);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_file_copy_sparse(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	// a leading, inner and trailing hole
+	const size_t chunks[] = { 16, 17, 40 };
+	test_file_write_sparse(test_file.in, 64, chunks, 3);
+
+	struct stat in_s;
+	munit_assert_int(stat(test_file.in, &in_s), ==, 0);
+	if ((off_t)in_s.st_blocks * 512 >= in_s.st_size)
+		return MUNIT_SKIP; // the file system does not support sparse files
+
+	munit_assert_int(file_copy(test_file.in, test_file.out, -1, 512, 0), ==, 0);
+	test_file_assert_equal(test_file.in, test_file.out);
+
+	// holes are preserved, unless the copy shares the extents of the input anyway
+	struct stat out_s;
+	munit_assert_int(stat(test_file.out, &out_s), ==, 0);
+	munit_assert_int((off_t)out_s.st_blocks * 512, <, out_s.st_size);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_file_copy_count_seek(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	const size_t chunks[] = { 0, 2 };
+	test_file_write_sparse(test_file.in, 4, chunks, 2);
+
+	// copy the first three chunks behind one chunk of hole
+	munit_assert_int(file_copy(test_file.in, test_file.out, 3, TEST_FILE_CHUNK, 1), ==, 0);
+
+	off_t in_size, out_size;
+	unsigned char *in_buf = test_file_read(test_file.in, &in_size);
+	unsigned char *out_buf = test_file_read(test_file.out, &out_size);
+
+	munit_assert_int(out_size, ==, 4 * TEST_FILE_CHUNK);
+	for (size_t j = 0; j < TEST_FILE_CHUNK; j++)
+		munit_assert_uint8(out_buf[j], ==, 0);
+	munit_assert_memory_equal(3 * TEST_FILE_CHUNK, out_buf + TEST_FILE_CHUNK, in_buf);
+
+	mem_free0(in_buf);
+	mem_free0(out_buf);
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_file_copy_special(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	// procfs reports a size of 0 for its files
+	munit_assert_int(file_copy("/proc/self/stat", test_file.out, -1, 512, 0), ==, 0);
+	munit_assert_int(file_size(test_file.out), >, 0);
+
+	// character devices are read up to the given count of blocks
+	munit_assert_int(file_copy("/dev/zero", test_file.out, 3, 4096, 0), ==, 0);
+	munit_assert_int(file_size(test_file.out), ==, 3 * 4096);
+
+	munit_assert_int(file_copy("/nonexistent", test_file.out, -1, 512, 0), ==, -1);
+
+	return MUNIT_OK;
+}
+
+static void *
+setup(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	logf_register(&logf_test_write, stderr);
+
+	mem_memset(&test_file, 0, sizeof(test_file));
+	strcpy(test_file.dir, "/tmp/file.test.XXXXXX");
+	munit_assert_not_null(mkdtemp(test_file.dir));
+	test_file.in = mem_printf("%s/in", test_file.dir);
+	test_file.out = mem_printf("%s/out", test_file.dir);
+	return NULL;
+}
+
+static void
+tear_down(UNUSED void *fixture)
+{
+	unlink(test_file.in);
+	unlink(test_file.out);
+	rmdir(test_file.dir);
+	mem_free0(test_file.in);
+	mem_free0(test_file.out);
+}
+
+static MunitTest tests[] = {
+	{
+		"/copy",	       /* name */
+		test_file_copy,	       /* test */
+		setup,		       /* setup */
+		tear_down,	       /* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL		       /* parameters */
+	},
+	{
+		"/copy sparse",	       /* name */
+		test_file_copy_sparse, /* test */
+		setup,		       /* setup */
+		tear_down,	       /* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL		       /* parameters */
+	},
+	{
+		"/copy count seek",	   /* name */
+		test_file_copy_count_seek, /* test */
+		setup,			   /* setup */
+		tear_down,		   /* tear_down */
+		MUNIT_TEST_OPTION_NONE,	   /* options */
+		NULL			   /* parameters */
+	},
+	{
+		"/copy special",	/* name */
+		test_file_copy_special, /* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+
+	// Mark the end of the array with an entry where the test function is NULL
+	{ NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite file_suite = {
+	"/file",		/* name */
+	tests,			/* tests */
+	NULL,			/* suites */
+	1,			/* iterations */
+	MUNIT_SUITE_OPTION_NONE /* options */
+};
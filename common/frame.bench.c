@@ -0,0 +1,249 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/*
+ * Micro-benchmark for the message send paths: compares the former two-write
+ * framing with writev() framing and framed connections for small replies,
+ * and buffered against sendfile() transfers for multi-MB log-like blobs.
+ * A forked child drains the socket, so the numbers include the receiver.
+ */
+
+#include "event.h"
+#include "fd.h"
+#include "frame.h"
+#include "macro.h"
+#include "mem.h"
+#include "logf.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAME_BENCH_SMALL_COUNT 100000
+#define FRAME_BENCH_SMALL_SIZE 64
+#define FRAME_BENCH_LARGE_COUNT 8
+#define FRAME_BENCH_LARGE_SIZE (8 * 1024 * 1024)
+
+static double
+frame_bench_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * Forks a child which reads total bytes from the returned socket and exits.
+ */
+static int
+frame_bench_reader(size_t total, pid_t *pid)
+{
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		exit(1);
+
+	*pid = fork();
+	if (*pid < 0)
+		exit(1);
+
+	if (*pid == 0) {
+		static char buf[256 * 1024];
+		close(sv[0]);
+		while (total > 0) {
+			ssize_t n = read(sv[1], buf, MIN(total, sizeof(buf)));
+			if (n <= 0)
+				_exit(1);
+			total -= n;
+		}
+		_exit(0);
+	}
+
+	close(sv[1]);
+	return sv[0];
+}
+
+static void
+frame_bench_wait(int fd, pid_t pid)
+{
+	int status;
+	close(fd);
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status))
+		exit(1);
+}
+
+static void
+frame_bench_report(const char *name, int count, size_t size, double ms)
+{
+	printf("%-32s %6d x %8zu bytes: %9.2f ms, %10.0f msg/s, %8.1f MB/s\n", name, count, size,
+	       ms, count / (ms / 1000.0), (double)count * size / (1024 * 1024) / (ms / 1000.0));
+}
+
+static void
+frame_bench_two_writes(const uint8_t *msg, size_t size, int count)
+{
+	pid_t pid;
+	int fd = frame_bench_reader((4 + size) * count, &pid);
+
+	double start = frame_bench_now_ms();
+	for (int i = 0; i < count; i++) {
+		// former protobuf_send_message(): pack into a fresh buffer, write length and data
+		uint8_t *buf = mem_alloc(size);
+		memcpy(buf, msg, size);
+		fd_write(fd, (char *)&(uint32_t){ htonl(size) }, sizeof(uint32_t));
+		fd_write(fd, (char *)buf, size);
+		mem_free0(buf);
+	}
+	frame_bench_wait(fd, pid);
+	frame_bench_report("two writes", count, size, frame_bench_now_ms() - start);
+}
+
+static void
+frame_bench_writev(const uint8_t *msg, size_t size, int count)
+{
+	pid_t pid;
+	int fd = frame_bench_reader((4 + size) * count, &pid);
+
+	double start = frame_bench_now_ms();
+	for (int i = 0; i < count; i++) {
+		struct iovec iov[2] = {
+			{ .iov_base = &(uint32_t){ htonl(size) }, .iov_len = sizeof(uint32_t) },
+			{ .iov_base = (uint8_t *)msg, .iov_len = size },
+		};
+		fd_writev(fd, iov, 2);
+	}
+	frame_bench_wait(fd, pid);
+	frame_bench_report("writev", count, size, frame_bench_now_ms() - start);
+}
+
+static void
+frame_bench_recv_cb(UNUSED frame_conn_t *conn, UNUSED uint8_t *buf, UNUSED uint32_t len,
+		    UNUSED void *data)
+{
+}
+
+static void
+frame_bench_close_cb(frame_conn_t *conn, UNUSED void *data)
+{
+	frame_conn_free(conn);
+}
+
+static void
+frame_bench_conn(const uint8_t *msg, size_t size, int count, int file_fd)
+{
+	pid_t pid;
+	int fd = frame_bench_reader((4 + size) * count, &pid);
+	frame_conn_t *conn = frame_conn_new(fd, frame_bench_recv_cb, frame_bench_close_cb, NULL);
+
+	double start = frame_bench_now_ms();
+	for (int i = 0; i < count; i++) {
+		int ret = file_fd < 0 ? frame_conn_send(conn, msg, size) :
+					frame_conn_send_file(conn, NULL, 0, file_fd, 0, size);
+		if (ret < 0)
+			exit(1);
+	}
+	// the loop returns when the reader is done and the connection is closed
+	event_loop();
+
+	int status;
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status))
+		exit(1);
+	frame_bench_report(file_fd < 0 ? "frame_conn_send" : "frame_conn_send_file (sendfile)",
+			   count, size, frame_bench_now_ms() - start);
+}
+
+static void
+frame_bench_read_file(int file_fd, size_t size, int count)
+{
+	pid_t pid;
+	int fd = frame_bench_reader((4 + size) * count, &pid);
+
+	double start = frame_bench_now_ms();
+	for (int i = 0; i < count; i++) {
+		// former log transfer: read the whole file into memory, then write it
+		uint8_t *buf = mem_alloc(size);
+		if (pread(file_fd, buf, size, 0) != (ssize_t)size)
+			exit(1);
+		fd_write(fd, (char *)&(uint32_t){ htonl(size) }, sizeof(uint32_t));
+		fd_write(fd, (char *)buf, size);
+		mem_free0(buf);
+	}
+	frame_bench_wait(fd, pid);
+	frame_bench_report("read file + two writes", count, size, frame_bench_now_ms() - start);
+}
+
+static void
+frame_bench_sendfile(int file_fd, size_t size, int count)
+{
+	pid_t pid;
+	int fd = frame_bench_reader((4 + size) * count, &pid);
+
+	double start = frame_bench_now_ms();
+	for (int i = 0; i < count; i++) {
+		struct iovec iov = { .iov_base = &(uint32_t){ htonl(size) },
+				     .iov_len = sizeof(uint32_t) };
+		fd_writev(fd, &iov, 1);
+		fd_sendfile(fd, file_fd, 0, size);
+	}
+	frame_bench_wait(fd, pid);
+	frame_bench_report("writev + sendfile", count, size, frame_bench_now_ms() - start);
+}
+
+int
+main(void)
+{
+	logf_handler_t *h = logf_register(&logf_test_write, stderr);
+	logf_handler_set_prio(h, LOGF_PRIO_WARN);
+	event_init();
+
+	uint8_t *msg = mem_alloc0(FRAME_BENCH_SMALL_SIZE);
+	frame_bench_two_writes(msg, FRAME_BENCH_SMALL_SIZE, FRAME_BENCH_SMALL_COUNT);
+	frame_bench_writev(msg, FRAME_BENCH_SMALL_SIZE, FRAME_BENCH_SMALL_COUNT);
+	frame_bench_conn(msg, FRAME_BENCH_SMALL_SIZE, FRAME_BENCH_SMALL_COUNT, -1);
+	mem_free0(msg);
+
+	char path[] = "/tmp/frame.bench.XXXXXX";
+	int file_fd = mkstemp(path);
+	if (file_fd < 0)
+		return 1;
+	unlink(path);
+	uint8_t *blob = mem_alloc(FRAME_BENCH_LARGE_SIZE);
+	for (size_t i = 0; i < FRAME_BENCH_LARGE_SIZE; i++)
+		blob[i] = 'a' + i % 26;
+	if (write(file_fd, blob, FRAME_BENCH_LARGE_SIZE) != FRAME_BENCH_LARGE_SIZE)
+		return 1;
+	mem_free0(blob);
+
+	frame_bench_read_file(file_fd, FRAME_BENCH_LARGE_SIZE, FRAME_BENCH_LARGE_COUNT);
+	frame_bench_sendfile(file_fd, FRAME_BENCH_LARGE_SIZE, FRAME_BENCH_LARGE_COUNT);
+	frame_bench_conn(NULL, FRAME_BENCH_LARGE_SIZE, FRAME_BENCH_LARGE_COUNT, file_fd);
+
+	close(file_fd);
+	return 0;
+}
@@ -0,0 +1,672 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+//#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
+
+#include "frame.h"
+
+#include "event.h"
+#include "fd.h"
+#include "hashmap.h"
+#include "macro.h"
+#include "mem.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define FRAME_CONN_HEADER_SIZE sizeof(uint32_t)
+// initial size and minimal growth of the receive buffer on stream sockets
+#define FRAME_CONN_READ_CHUNK (64 * 1024)
+// frames handled per wakeup before yielding to other events
+#define FRAME_CONN_FRAMES_PER_EVENT 16
+// number of queued buffers handed to a single writev
+#define FRAME_CONN_IOV_MAX 64
+
+typedef struct frame_buf {
+	struct frame_buf *next;
+	size_t len;
+	size_t off;
+	int file_fd;	 // if >= 0, data is sent from this file instead of data[]
+	off_t file_off; // start offset in file_fd
+	uint8_t data[];
+} frame_buf_t;
+
+struct frame_conn {
+	int fd;
+	bool seqpacket;
+	event_io_t *io;
+
+	void (*recv_cb)(frame_conn_t *conn, uint8_t *buf, uint32_t len, void *data);
+	void (*close_cb)(frame_conn_t *conn, void *data);
+	void *data;
+
+	// producer which is asked for more output once the queue runs low
+	void (*drain_cb)(frame_conn_t *conn, void *data);
+	void *drain_data;
+
+	// receive state of the current frame
+	uint8_t header[FRAME_CONN_HEADER_SIZE];
+	size_t header_len;
+	uint8_t *body;
+	uint32_t body_len;
+	uint32_t body_have;
+	uint32_t body_cap;
+
+	// output queue
+	frame_buf_t *out_head;
+	frame_buf_t *out_tail;
+	size_t queued;
+
+	bool eof;    // peer closed its side, close after output is drained
+	bool failed; // I/O error, close on next wakeup
+	bool closed; // removed from the event loop, close_cb invoked
+	bool freed;
+	unsigned int busy;
+};
+
+static hashmap_t *frame_conn_map = NULL;
+
+static void
+frame_conn_atfork_child(void)
+{
+	// the child does not run our event loop; fall back to blocking I/O there
+	hashmap_free(frame_conn_map);
+	frame_conn_map = NULL;
+}
+
+static void
+frame_conn_register(frame_conn_t *conn)
+{
+	if (!frame_conn_map) {
+		static bool atfork_registered = false;
+		if (!atfork_registered) {
+			pthread_atfork(NULL, NULL, frame_conn_atfork_child);
+			atfork_registered = true;
+		}
+		frame_conn_map = hashmap_new();
+	}
+	hashmap_put_u64(frame_conn_map, (uint64_t)conn->fd, conn);
+}
+
+static void
+frame_conn_unregister(frame_conn_t *conn)
+{
+	IF_NULL_RETURN_TRACE(frame_conn_map);
+
+	if (hashmap_get_u64(frame_conn_map, (uint64_t)conn->fd) == conn)
+		hashmap_remove_u64(frame_conn_map, (uint64_t)conn->fd);
+}
+
+frame_conn_t *
+frame_conn_get_by_fd(int fd)
+{
+	IF_NULL_RETVAL_TRACE(frame_conn_map, NULL);
+
+	return hashmap_get_u64(frame_conn_map, (uint64_t)fd);
+}
+
+static void
+frame_conn_update_events(frame_conn_t *conn)
+{
+	IF_NULL_RETURN_TRACE(conn->io);
+
+	unsigned events = conn->eof ? 0 : EVENT_IO_READ;
+	if (conn->out_head || conn->failed || conn->drain_cb)
+		events |= EVENT_IO_WRITE;
+
+	// an eof'ed connection without output is closed by the caller
+	IF_FALSE_RETURN_TRACE(events);
+
+	event_modify_io(conn->io, events);
+}
+
+static void
+frame_conn_enqueue_buf(frame_conn_t *conn, frame_buf_t *buf)
+{
+	if (conn->out_tail)
+		conn->out_tail->next = buf;
+	else
+		conn->out_head = buf;
+	conn->out_tail = buf;
+	conn->queued += buf->len;
+
+	TRACE("Queued %zu bytes on fd %d (%zu bytes pending)", buf->len, conn->fd, conn->queued);
+}
+
+static void
+frame_conn_buf_free(frame_buf_t *buf)
+{
+	if (buf->file_fd >= 0)
+		close(buf->file_fd);
+	mem_free0(buf);
+}
+
+static void
+frame_conn_enqueue(frame_conn_t *conn, const uint8_t *head, size_t head_len, const uint8_t *tail,
+		   size_t tail_len)
+{
+	frame_buf_t *buf = mem_alloc(sizeof(frame_buf_t) + head_len + tail_len);
+
+	buf->next = NULL;
+	buf->len = head_len + tail_len;
+	buf->off = 0;
+	buf->file_fd = -1;
+	if (head_len)
+		memcpy(buf->data, head, head_len);
+	if (tail_len)
+		memcpy(buf->data + head_len, tail, tail_len);
+
+	frame_conn_enqueue_buf(conn, buf);
+}
+
+static void
+frame_conn_enqueue_file(frame_conn_t *conn, int file_fd, off_t offset, size_t len)
+{
+	frame_buf_t *buf = mem_new0(frame_buf_t, 1);
+
+	buf->len = len;
+	buf->file_fd = file_fd;
+	buf->file_off = offset;
+
+	frame_conn_enqueue_buf(conn, buf);
+}
+
+static void
+frame_conn_consume(frame_conn_t *conn, size_t written)
+{
+	conn->queued -= written;
+
+	while (written > 0) {
+		frame_buf_t *buf = conn->out_head;
+		ASSERT(buf);
+
+		size_t rest = buf->len - buf->off;
+		if (written < rest) {
+			buf->off += written;
+			return;
+		}
+		written -= rest;
+		conn->out_head = buf->next;
+		if (!conn->out_head)
+			conn->out_tail = NULL;
+		frame_conn_buf_free(buf);
+	}
+}
+
+static void
+frame_conn_drop_output(frame_conn_t *conn)
+{
+	while (conn->out_head) {
+		frame_buf_t *buf = conn->out_head;
+		conn->out_head = buf->next;
+		frame_conn_buf_free(buf);
+	}
+	conn->out_tail = NULL;
+	conn->queued = 0;
+}
+
+/**
+ * Writes as much of the output queue as the socket accepts. Consecutive
+ * memory buffers are gathered into one writev(), file-backed buffers are
+ * sent with sendfile(). On SOCK_SEQPACKET sockets, each queued buffer is
+ * written as one packet.
+ *
+ * @return 0 on success or if the socket would block, -1 on error.
+ */
+static int
+frame_conn_flush(frame_conn_t *conn)
+{
+	while (conn->out_head) {
+		frame_buf_t *head = conn->out_head;
+		ssize_t n;
+
+		if (head->file_fd >= 0) {
+			off_t off = head->file_off + head->off;
+			n = sendfile(conn->fd, head->file_fd, &off, head->len - head->off);
+			if (n == 0) {
+				// the frame header promised more data than the file holds
+				WARN("File on fd %d shrunk while sending to fd %d", head->file_fd,
+				     conn->fd);
+				return -1;
+			}
+		} else {
+			struct iovec iov[FRAME_CONN_IOV_MAX];
+			int iovcnt = 0;
+
+			for (frame_buf_t *buf = head; buf && buf->file_fd < 0 &&
+						      iovcnt < FRAME_CONN_IOV_MAX;
+			     buf = buf->next) {
+				iov[iovcnt].iov_base = buf->data + buf->off;
+				iov[iovcnt].iov_len = buf->len - buf->off;
+				iovcnt++;
+				if (conn->seqpacket)
+					break;
+			}
+			n = writev(conn->fd, iov, iovcnt);
+		}
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			DEBUG_ERRNO("Failed to write to fd %d", conn->fd);
+			return -1;
+		}
+		TRACE("Flushed %zd bytes on fd %d", n, conn->fd);
+		frame_conn_consume(conn, n);
+	}
+
+	frame_conn_update_events(conn);
+	return 0;
+}
+
+/**
+ * Reads from the socket and dispatches complete frames to recv_cb.
+ *
+ * @return 1 if the socket would block, 0 on EOF, -1 on error.
+ */
+static int
+frame_conn_recv(frame_conn_t *conn)
+{
+	int frames = 0;
+
+	while (frames < FRAME_CONN_FRAMES_PER_EVENT) {
+		uint8_t *dst;
+		size_t want;
+
+		if (conn->header_len < FRAME_CONN_HEADER_SIZE) {
+			dst = conn->header + conn->header_len;
+			want = FRAME_CONN_HEADER_SIZE - conn->header_len;
+		} else {
+			if (conn->body_have == conn->body_cap) {
+				// a packet has to be read at once, streams grow with the data
+				conn->body_cap =
+					conn->seqpacket ?
+						conn->body_len :
+						MIN(conn->body_len,
+						    MAX(2 * conn->body_cap, FRAME_CONN_READ_CHUNK));
+				conn->body = mem_renew(uint8_t, conn->body, conn->body_cap);
+			}
+			dst = conn->body + conn->body_have;
+			want = conn->body_cap - conn->body_have;
+		}
+
+		ssize_t n = read(conn->fd, dst, want);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 1;
+			if (errno == ECONNRESET)
+				return 0;
+			DEBUG_ERRNO("Failed to read from fd %d", conn->fd);
+			return -1;
+		}
+		if (n == 0) {
+			if (conn->header_len > 0)
+				DEBUG("Peer on fd %d closed connection within a frame", conn->fd);
+			return 0;
+		}
+
+		if (conn->header_len < FRAME_CONN_HEADER_SIZE) {
+			conn->header_len += n;
+			if (conn->header_len < FRAME_CONN_HEADER_SIZE)
+				continue;
+
+			uint32_t len;
+			memcpy(&len, conn->header, sizeof(len));
+			conn->body_len = ntohl(len);
+			TRACE("Receiving frame of %u bytes on fd %d", conn->body_len, conn->fd);
+
+			if (conn->body_len >= FRAME_CONN_MAX_FRAME_SIZE) {
+				WARN("Protocol violation on fd %d: frame of %u bytes exceeds limit",
+				     conn->fd, conn->body_len);
+				return -1;
+			}
+		} else {
+			conn->body_have += n;
+		}
+
+		if (conn->body_have < conn->body_len)
+			continue;
+
+		// frame complete, reset receive state before handing it out
+		uint8_t *body = conn->body;
+		uint32_t body_len = conn->body_len;
+		conn->body = NULL;
+		conn->body_len = conn->body_have = conn->body_cap = 0;
+		conn->header_len = 0;
+		frames++;
+
+		conn->recv_cb(conn, body, body_len, conn->data);
+		mem_free0(body);
+
+		IF_TRUE_RETVAL_TRACE(conn->closed || conn->freed, 1);
+	}
+
+	return 1;
+}
+
+static void
+frame_conn_stop(frame_conn_t *conn)
+{
+	IF_NULL_RETURN_TRACE(conn->io);
+
+	event_remove_io(conn->io);
+	event_io_free(conn->io);
+	conn->io = NULL;
+}
+
+static void
+frame_conn_close(frame_conn_t *conn)
+{
+	IF_TRUE_RETURN_TRACE(conn->closed || conn->freed);
+
+	TRACE("Closing framed connection on fd %d", conn->fd);
+	frame_conn_stop(conn);
+	conn->closed = true;
+
+	if (conn->close_cb)
+		conn->close_cb(conn, conn->data);
+}
+
+static void
+frame_conn_destroy(frame_conn_t *conn)
+{
+	mem_free0(conn->body);
+	mem_free0(conn);
+}
+
+static void
+frame_conn_cb(UNUSED int fd, unsigned events, UNUSED event_io_t *io, void *data)
+{
+	frame_conn_t *conn = data;
+
+	conn->busy++;
+
+	if (conn->failed)
+		goto close;
+
+	if (events & EVENT_IO_WRITE) {
+		if (frame_conn_flush(conn) < 0)
+			goto close;
+		if (conn->drain_cb && conn->queued < FRAME_CONN_DRAIN_THRESHOLD) {
+			conn->drain_cb(conn, conn->drain_data);
+			if (conn->closed || conn->freed)
+				goto out;
+			frame_conn_update_events(conn);
+		}
+	}
+
+	if (events & EVENT_IO_READ) {
+		int ret = frame_conn_recv(conn);
+		if (conn->closed || conn->freed)
+			goto out;
+		if (ret < 0)
+			goto close;
+		if (ret == 0) {
+			TRACE("Peer on fd %d closed connection", conn->fd);
+			conn->eof = true;
+		}
+	}
+
+	// peer is gone (or errored), pending output cannot be delivered anymore
+	if (events & EVENT_IO_EXCEPT)
+		goto close;
+
+	if (conn->eof) {
+		if (!conn->out_head && !conn->drain_cb)
+			goto close;
+		// stop reading, keep draining the output queue
+		frame_conn_update_events(conn);
+	}
+	goto out;
+
+close:
+	frame_conn_close(conn);
+out:
+	conn->busy--;
+	if (conn->freed && !conn->busy)
+		frame_conn_destroy(conn);
+}
+
+frame_conn_t *
+frame_conn_new(int fd, void (*recv_cb)(frame_conn_t *conn, uint8_t *buf, uint32_t len, void *data),
+	       void (*close_cb)(frame_conn_t *conn, void *data), void *data)
+{
+	IF_TRUE_RETVAL(fd < 0, NULL);
+	IF_NULL_RETVAL(recv_cb, NULL);
+
+	if (fd_make_non_blocking(fd) < 0)
+		return NULL;
+
+	frame_conn_t *conn = mem_new0(frame_conn_t, 1);
+	conn->fd = fd;
+	conn->recv_cb = recv_cb;
+	conn->close_cb = close_cb;
+	conn->data = data;
+
+	int type;
+	socklen_t type_len = sizeof(type);
+	if (!getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_len))
+		conn->seqpacket = (type == SOCK_SEQPACKET);
+
+	conn->io = event_io_new(fd, EVENT_IO_READ, frame_conn_cb, conn);
+	event_add_io(conn->io);
+	frame_conn_register(conn);
+
+	TRACE("Created framed connection %p on fd %d%s", (void *)conn, fd,
+	      conn->seqpacket ? " (seqpacket)" : "");
+	return conn;
+}
+
+void
+frame_conn_free(frame_conn_t *conn)
+{
+	IF_NULL_RETURN(conn);
+	IF_TRUE_RETURN_TRACE(conn->freed);
+
+	TRACE("Freeing framed connection on fd %d (%zu bytes dropped)", conn->fd, conn->queued);
+
+	frame_conn_stop(conn);
+	frame_conn_unregister(conn);
+	frame_conn_drop_output(conn);
+	close(conn->fd);
+	conn->freed = true;
+
+	// called from within one of our callbacks, frame_conn_cb finishes the job
+	IF_TRUE_RETURN_TRACE(conn->busy);
+
+	frame_conn_destroy(conn);
+}
+
+int
+frame_conn_send(frame_conn_t *conn, const uint8_t *buf, uint32_t len)
+{
+	IF_NULL_RETVAL(conn, -1);
+	IF_TRUE_RETVAL(conn->closed || conn->freed || conn->failed, -1);
+	IF_TRUE_RETVAL(len > 0 && !buf, -1);
+
+	if (len >= FRAME_CONN_MAX_FRAME_SIZE) {
+		WARN("Frame of %u bytes exceeds limit", len);
+		return -1;
+	}
+	if (conn->queued + FRAME_CONN_HEADER_SIZE + len > FRAME_CONN_MAX_QUEUED) {
+		WARN("Output queue of fd %d exceeded (%zu bytes pending), dropping frame", conn->fd,
+		     conn->queued);
+		return -1;
+	}
+
+	uint8_t header[FRAME_CONN_HEADER_SIZE];
+	memcpy(header, &(uint32_t){ htonl(len) }, sizeof(header));
+	size_t total = FRAME_CONN_HEADER_SIZE + len;
+	size_t written = 0;
+
+	// nothing pending, try to send directly without copying
+	while (!conn->out_head && written < total) {
+		struct iovec iov[2];
+		int iovcnt = 0;
+
+		if (written < FRAME_CONN_HEADER_SIZE) {
+			iov[iovcnt].iov_base = header + written;
+			iov[iovcnt].iov_len = FRAME_CONN_HEADER_SIZE - written;
+			iovcnt++;
+		}
+		// length prefix and payload are separate packets on SOCK_SEQPACKET
+		if (len > 0 && !(conn->seqpacket && iovcnt)) {
+			size_t off = 0;
+			if (written > FRAME_CONN_HEADER_SIZE)
+				off = written - FRAME_CONN_HEADER_SIZE;
+			iov[iovcnt].iov_base = (uint8_t *)buf + off;
+			iov[iovcnt].iov_len = len - off;
+			iovcnt++;
+		}
+
+		ssize_t n = writev(conn->fd, iov, iovcnt);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			DEBUG_ERRNO("Failed to write frame to fd %d", conn->fd);
+			// let the event loop report the broken connection via close_cb
+			conn->failed = true;
+			frame_conn_update_events(conn);
+			return -1;
+		}
+		written += n;
+	}
+
+	if (written == total)
+		return 0;
+
+	if (conn->seqpacket) {
+		// packets are either written completely or not at all
+		if (written < FRAME_CONN_HEADER_SIZE)
+			frame_conn_enqueue(conn, header, FRAME_CONN_HEADER_SIZE, NULL, 0);
+		if (len > 0)
+			frame_conn_enqueue(conn, NULL, 0, buf, len);
+	} else if (written < FRAME_CONN_HEADER_SIZE) {
+		frame_conn_enqueue(conn, header + written, FRAME_CONN_HEADER_SIZE - written, buf,
+				   len);
+	} else {
+		size_t off = written - FRAME_CONN_HEADER_SIZE;
+		frame_conn_enqueue(conn, NULL, 0, buf + off, len - off);
+	}
+
+	frame_conn_update_events(conn);
+	return 0;
+}
+
+int
+frame_conn_send_file(frame_conn_t *conn, const uint8_t *head, uint32_t head_len, int file_fd,
+		     off_t offset, uint32_t len)
+{
+	IF_NULL_RETVAL(conn, -1);
+	IF_TRUE_RETVAL(conn->closed || conn->freed || conn->failed, -1);
+	IF_TRUE_RETVAL(head_len > 0 && !head, -1);
+
+	uint64_t frame_len = (uint64_t)head_len + len;
+	if (frame_len >= FRAME_CONN_MAX_FRAME_SIZE) {
+		WARN("Frame of %" PRIu64 " bytes exceeds limit", frame_len);
+		return -1;
+	}
+	if (conn->queued + FRAME_CONN_HEADER_SIZE + frame_len > FRAME_CONN_MAX_QUEUED) {
+		WARN("Output queue of fd %d exceeded (%zu bytes pending), dropping frame", conn->fd,
+		     conn->queued);
+		return -1;
+	}
+
+	if (conn->seqpacket) {
+		// the payload has to go out as a single packet, so it has to be in memory
+		uint8_t *buf = mem_alloc(frame_len);
+		if (head_len)
+			memcpy(buf, head, head_len);
+		ssize_t n = pread(file_fd, buf + head_len, len, offset);
+		int ret = -1;
+		if (n == (ssize_t)len)
+			ret = frame_conn_send(conn, buf, frame_len);
+		else
+			WARN_ERRNO("Failed to read %u bytes from fd %d", len, file_fd);
+		mem_free0(buf);
+		return ret;
+	}
+
+	int dup_fd = dup(file_fd);
+	if (dup_fd < 0) {
+		WARN_ERRNO("Failed to duplicate fd %d", file_fd);
+		return -1;
+	}
+
+	uint8_t header[FRAME_CONN_HEADER_SIZE];
+	memcpy(header, &(uint32_t){ htonl(frame_len) }, sizeof(header));
+	frame_conn_enqueue(conn, header, FRAME_CONN_HEADER_SIZE, head, head_len);
+	if (len > 0)
+		frame_conn_enqueue_file(conn, dup_fd, offset, len);
+	else
+		close(dup_fd);
+
+	if (frame_conn_flush(conn) < 0) {
+		// let the event loop report the broken connection via close_cb
+		conn->failed = true;
+		frame_conn_update_events(conn);
+		return -1;
+	}
+	return 0;
+}
+
+void
+frame_conn_set_drain_cb(frame_conn_t *conn, void (*drain_cb)(frame_conn_t *conn, void *data),
+			void *data)
+{
+	IF_NULL_RETURN(conn);
+
+	conn->drain_cb = drain_cb;
+	conn->drain_data = data;
+	frame_conn_update_events(conn);
+}
+
+int
+frame_conn_get_fd(const frame_conn_t *conn)
+{
+	IF_NULL_RETVAL(conn, -1);
+
+	return conn->fd;
+}
+
+size_t
+frame_conn_get_queued(const frame_conn_t *conn)
+{
+	IF_NULL_RETVAL(conn, 0);
+
+	return conn->queued;
+}
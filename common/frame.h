@@ -0,0 +1,159 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file frame.h
+ *
+ * Implements non-blocking, length-prefixed message framing on top of the event
+ * loop. Each frame is a 4 byte length in network byte order followed by the
+ * payload, which is the wire format used by protobuf.h for all control
+ * sockets.
+ *
+ * Incoming data is read incrementally into a per-connection buffer and the
+ * receive callback is invoked only for complete frames, so a slow or malicious
+ * peer can no longer stall the event loop with a partial message. Outgoing
+ * frames are written immediately as far as the socket accepts them; the rest
+ * is queued and drained as soon as the fd becomes writable again.
+ *
+ * On SOCK_SEQPACKET sockets, the length prefix and the payload are sent as
+ * separate packets to stay compatible with peers using the blocking
+ * protobuf_recv_message().
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// same limit as PROTOBUF_MAX_MESSAGE_SIZE
+#define FRAME_CONN_MAX_FRAME_SIZE (1024 * 1024 * 64)
+// upper bound for queued output per connection until sends are rejected
+#define FRAME_CONN_MAX_QUEUED (2 * FRAME_CONN_MAX_FRAME_SIZE)
+// queued output below which a registered drain callback is asked for more
+#define FRAME_CONN_DRAIN_THRESHOLD (256 * 1024)
+
+typedef struct frame_conn frame_conn_t;
+
+/**
+ * Creates a framed connection on an already connected socket, switches the fd
+ * to non-blocking mode and adds it to the event loop. The connection takes
+ * ownership of the fd which is closed by frame_conn_free().
+ *
+ * @param fd The connected socket.
+ * @param recv_cb Callback invoked for each complete frame. The buffer is only
+ *                valid during the callback and is NULL for empty frames.
+ * @param close_cb Callback invoked once if the peer closed the connection or
+ *                 an I/O or protocol error occurred. The callback is expected
+ *                 to release the connection with frame_conn_free().
+ * @param data Payload data to be passed to the callback functions.
+ * @return The newly created connection or NULL on error.
+ */
+frame_conn_t *
+frame_conn_new(int fd, void (*recv_cb)(frame_conn_t *conn, uint8_t *buf, uint32_t len, void *data),
+	       void (*close_cb)(frame_conn_t *conn, void *data), void *data);
+
+/**
+ * Removes the connection from the event loop, drops any queued output,
+ * closes the fd and frees the connection. May be called from within the
+ * connection's own callbacks.
+ *
+ * @param conn The connection to be freed.
+ */
+void
+frame_conn_free(frame_conn_t *conn);
+
+/**
+ * Queues a frame for sending. As much as possible is written immediately,
+ * the remaining data is sent asynchronously by the event loop.
+ *
+ * @param conn The connection.
+ * @param buf The payload of the frame; may be NULL if len is 0.
+ * @param len The length of the payload.
+ * @return 0 on success, -1 if the connection is closed, the frame is too
+ *         large or the output queue limit would be exceeded.
+ */
+int
+frame_conn_send(frame_conn_t *conn, const uint8_t *buf, uint32_t len);
+
+/**
+ * Queues a frame whose payload consists of a memory head followed by len
+ * bytes of a file. The file content is sent with sendfile() and never
+ * copied to userspace, e.g. to transfer large log files. file_fd is
+ * duplicated, thus the caller keeps ownership. On SOCK_SEQPACKET sockets,
+ * the payload is read into memory as it has to be sent as a single packet.
+ *
+ * @param conn The connection.
+ * @param head Data preceding the file content; may be NULL if head_len is 0.
+ * @param head_len The length of head.
+ * @param file_fd The file to read the rest of the payload from.
+ * @param offset The start offset in file_fd.
+ * @param len The number of bytes to be sent from file_fd.
+ * @return 0 on success, -1 on error (see frame_conn_send()).
+ */
+int
+frame_conn_send_file(frame_conn_t *conn, const uint8_t *head, uint32_t head_len, int file_fd,
+		     off_t offset, uint32_t len);
+
+/**
+ * Registers a producer for output which is too large to be queued at once,
+ * e.g. a file transfer in chunks. While registered, drain_cb is invoked from
+ * the event loop whenever the socket is writable and less than
+ * FRAME_CONN_DRAIN_THRESHOLD bytes are queued. The producer should then send
+ * a bounded amount of data and unregister itself by passing NULL once done.
+ * This keeps the event loop responsive for other connections and lets other
+ * replies on the same connection interleave with the transfer.
+ *
+ * @param conn The connection.
+ * @param drain_cb The producer callback or NULL to unregister.
+ * @param data Payload data to be passed to drain_cb.
+ */
+void
+frame_conn_set_drain_cb(frame_conn_t *conn, void (*drain_cb)(frame_conn_t *conn, void *data),
+			void *data);
+
+/**
+ * Returns the socket of the connection.
+ */
+int
+frame_conn_get_fd(const frame_conn_t *conn);
+
+/**
+ * Returns the number of bytes which are queued but not yet written.
+ */
+size_t
+frame_conn_get_queued(const frame_conn_t *conn);
+
+/**
+ * Looks up the framed connection which owns the given fd. This allows code
+ * which only knows the fd of a client, e.g. protobuf_send_message(), to use
+ * the non-blocking send path.
+ *
+ * @param fd The socket fd.
+ * @return The connection or NULL if the fd is not managed by a framed connection.
+ */
+frame_conn_t *
+frame_conn_get_by_fd(int fd);
+
+#endif /* FRAME_H */
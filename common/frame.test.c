@@ -0,0 +1,407 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+#include "munit.h"
+
+#include "event.h"
+#include "frame.h"
+#include "logf.h"
+#include "macro.h"
+#include "mem.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TEST_FRAME_LARGE (4 * 1024 * 1024)
+
+typedef struct {
+	unsigned int frames;
+	uint32_t lens[8];
+	uint8_t last[16];
+	bool closed;
+	int peer;
+	uint8_t *sent;
+	uint8_t *received;
+	size_t received_len;
+} test_frame_state_t;
+
+static void *
+setup(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	logf_register(&logf_test_write, stderr);
+	event_init();
+	return NULL;
+}
+
+static void
+tear_down(UNUSED void *fixture)
+{
+	event_reset();
+}
+
+static void
+test_frame_write_raw(int fd, const void *buf, size_t len)
+{
+	munit_assert_int(write(fd, buf, len), ==, (ssize_t)len);
+}
+
+static void
+test_frame_recv_cb(UNUSED frame_conn_t *conn, uint8_t *buf, uint32_t len, void *data)
+{
+	test_frame_state_t *state = data;
+
+	munit_assert_uint(state->frames, <, ELEMENTSOF(state->lens));
+	state->lens[state->frames++] = len;
+	if (len) {
+		munit_assert_not_null(buf);
+		memcpy(state->last, buf, MIN(len, sizeof(state->last)));
+	}
+}
+
+static void
+test_frame_close_cb(frame_conn_t *conn, void *data)
+{
+	test_frame_state_t *state = data;
+
+	state->closed = true;
+	frame_conn_free(conn);
+}
+
+static void
+test_frame_timer_cb(event_timer_t *timer, void *data)
+{
+	test_frame_state_t *state = data;
+
+	// second half of the split frame, then end the stream
+	test_frame_write_raw(state->peer, "world", 5);
+	shutdown(state->peer, SHUT_WR);
+
+	event_remove_timer(timer);
+	event_timer_free(timer);
+}
+
+static MunitResult
+test_frame_recv(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	test_frame_state_t state = { 0 };
+	int sv[2];
+
+	munit_assert_int(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), ==, 0);
+	state.peer = sv[1];
+
+	frame_conn_t *conn = frame_conn_new(sv[0], test_frame_recv_cb, test_frame_close_cb, &state);
+	munit_assert_not_null(conn);
+	munit_assert_ptr_equal(frame_conn_get_by_fd(sv[0]), conn);
+
+	// an empty frame, a complete frame and a frame split across wakeups
+	test_frame_write_raw(sv[1], &(uint32_t){ htonl(0) }, 4);
+	test_frame_write_raw(sv[1], &(uint32_t){ htonl(3) }, 4);
+	test_frame_write_raw(sv[1], "abc", 3);
+	test_frame_write_raw(sv[1], &(uint32_t){ htonl(10) }, 4);
+	test_frame_write_raw(sv[1], "hello", 5);
+
+	event_timer_t *timer = event_timer_new(10, 1, test_frame_timer_cb, &state);
+	event_add_timer(timer);
+
+	// the loop returns once the connection is closed and freed
+	event_loop();
+
+	munit_assert_true(state.closed);
+	munit_assert_uint(state.frames, ==, 3);
+	munit_assert_uint(state.lens[0], ==, 0);
+	munit_assert_uint(state.lens[1], ==, 3);
+	munit_assert_uint(state.lens[2], ==, 10);
+	munit_assert_memory_equal(10, state.last, "helloworld");
+	munit_assert_null(frame_conn_get_by_fd(sv[0]));
+
+	close(sv[1]);
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_frame_too_large(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	test_frame_state_t state = { 0 };
+	int sv[2];
+
+	munit_assert_int(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), ==, 0);
+
+	frame_conn_t *conn = frame_conn_new(sv[0], test_frame_recv_cb, test_frame_close_cb, &state);
+	munit_assert_not_null(conn);
+
+	// a protocol violation closes the connection without allocating the frame
+	test_frame_write_raw(sv[1], &(uint32_t){ htonl(0xffffffff) }, 4);
+	event_loop();
+
+	munit_assert_true(state.closed);
+	munit_assert_uint(state.frames, ==, 0);
+
+	close(sv[1]);
+	return MUNIT_OK;
+}
+
+static void
+test_frame_peer_cb(int fd, UNUSED unsigned events, event_io_t *io, void *data)
+{
+	test_frame_state_t *state = data;
+	size_t total = 4 + TEST_FRAME_LARGE;
+
+	ssize_t n = read(fd, state->received + state->received_len, total - state->received_len);
+	munit_assert_int(n, >, 0);
+	state->received_len += n;
+
+	if (state->received_len == total) {
+		event_remove_io(io);
+		event_io_free(io);
+		// closing the peer makes the connection close as well
+		close(fd);
+	}
+}
+
+static MunitResult
+test_frame_send_queued(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	test_frame_state_t state = { 0 };
+	int sv[2];
+
+	munit_assert_int(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), ==, 0);
+
+	frame_conn_t *conn = frame_conn_new(sv[0], test_frame_recv_cb, test_frame_close_cb, &state);
+	munit_assert_not_null(conn);
+
+	state.sent = mem_alloc(TEST_FRAME_LARGE);
+	for (size_t i = 0; i < TEST_FRAME_LARGE; i++)
+		state.sent[i] = i & 0xff;
+	state.received = mem_alloc(4 + TEST_FRAME_LARGE);
+
+	// the frame does not fit into the socket buffer, so the rest is queued
+	munit_assert_int(frame_conn_send(conn, state.sent, TEST_FRAME_LARGE), ==, 0);
+	munit_assert_size(frame_conn_get_queued(conn), >, 0);
+
+	event_io_t *io = event_io_new(sv[1], EVENT_IO_READ, test_frame_peer_cb, &state);
+	event_add_io(io);
+	event_loop();
+
+	munit_assert_true(state.closed);
+	munit_assert_size(state.received_len, ==, 4 + TEST_FRAME_LARGE);
+	munit_assert_uint32(ntohl(*(uint32_t *)state.received), ==, TEST_FRAME_LARGE);
+	munit_assert_memory_equal(TEST_FRAME_LARGE, state.received + 4, state.sent);
+
+	mem_free0(state.sent);
+	mem_free0(state.received);
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_frame_seqpacket(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	test_frame_state_t state = { 0 };
+	uint8_t buf[16];
+	int sv[2];
+
+	munit_assert_int(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv), ==, 0);
+
+	frame_conn_t *conn = frame_conn_new(sv[0], test_frame_recv_cb, test_frame_close_cb, &state);
+	munit_assert_not_null(conn);
+
+	// length prefix and payload are separate packets
+	munit_assert_int(frame_conn_send(conn, (const uint8_t *)"abc", 3), ==, 0);
+	munit_assert_int(read(sv[1], buf, sizeof(buf)), ==, 4);
+	munit_assert_uint32(ntohl(*(uint32_t *)buf), ==, 3);
+	munit_assert_int(read(sv[1], buf, sizeof(buf)), ==, 3);
+	munit_assert_memory_equal(3, buf, "abc");
+
+	// and are received as such
+	test_frame_write_raw(sv[1], &(uint32_t){ htonl(5) }, 4);
+	test_frame_write_raw(sv[1], "hello", 5);
+	close(sv[1]);
+	event_loop();
+
+	munit_assert_true(state.closed);
+	munit_assert_uint(state.frames, ==, 1);
+	munit_assert_memory_equal(5, state.last, "hello");
+
+	return MUNIT_OK;
+}
+
+#define TEST_FRAME_DRAIN_FRAMES 64
+#define TEST_FRAME_DRAIN_SIZE (64 * 1024)
+
+static void
+test_frame_drain_cb(frame_conn_t *conn, void *data)
+{
+	test_frame_state_t *state = data;
+
+	// never called with more than the threshold pending
+	munit_assert_size(frame_conn_get_queued(conn), <, FRAME_CONN_DRAIN_THRESHOLD);
+
+	while (state->frames < TEST_FRAME_DRAIN_FRAMES &&
+	       frame_conn_get_queued(conn) < FRAME_CONN_DRAIN_THRESHOLD) {
+		munit_assert_int(frame_conn_send(conn, state->sent, TEST_FRAME_DRAIN_SIZE), ==, 0);
+		state->frames++;
+	}
+	if (state->frames == TEST_FRAME_DRAIN_FRAMES)
+		frame_conn_set_drain_cb(conn, NULL, NULL);
+}
+
+static void
+test_frame_drain_peer_cb(int fd, UNUSED unsigned events, event_io_t *io, void *data)
+{
+	test_frame_state_t *state = data;
+	uint8_t buf[8192];
+
+	ssize_t n = read(fd, buf, sizeof(buf));
+	munit_assert_int(n, >, 0);
+	state->received_len += n;
+
+	if (state->received_len == TEST_FRAME_DRAIN_FRAMES * (4 + TEST_FRAME_DRAIN_SIZE)) {
+		event_remove_io(io);
+		event_io_free(io);
+		close(fd);
+	}
+}
+
+static MunitResult
+test_frame_drain(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	test_frame_state_t state = { 0 };
+	int sv[2];
+
+	munit_assert_int(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), ==, 0);
+
+	frame_conn_t *conn = frame_conn_new(sv[0], test_frame_recv_cb, test_frame_close_cb, &state);
+	munit_assert_not_null(conn);
+	state.sent = mem_alloc0(TEST_FRAME_DRAIN_SIZE);
+
+	// the producer is driven by the event loop until it unregisters itself
+	frame_conn_set_drain_cb(conn, test_frame_drain_cb, &state);
+	event_io_t *io = event_io_new(sv[1], EVENT_IO_READ, test_frame_drain_peer_cb, &state);
+	event_add_io(io);
+	event_loop();
+
+	munit_assert_true(state.closed);
+	munit_assert_uint(state.frames, ==, TEST_FRAME_DRAIN_FRAMES);
+	munit_assert_size(state.received_len, ==,
+			  TEST_FRAME_DRAIN_FRAMES * (4 + TEST_FRAME_DRAIN_SIZE));
+
+	mem_free0(state.sent);
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_frame_send_file(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	test_frame_state_t state = { 0 };
+	uint8_t buf[16];
+	int sv[2];
+
+	munit_assert_int(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), ==, 0);
+
+	frame_conn_t *conn = frame_conn_new(sv[0], test_frame_recv_cb, test_frame_close_cb, &state);
+	munit_assert_not_null(conn);
+
+	char path[] = "/tmp/frame.test.XXXXXX";
+	int file_fd = mkstemp(path);
+	munit_assert_int(file_fd, >=, 0);
+	unlink(path);
+	test_frame_write_raw(file_fd, "xxcdefxx", 8);
+
+	// the frame consists of the memory head and the file range
+	munit_assert_int(frame_conn_send_file(conn, (const uint8_t *)"ab", 2, file_fd, 2, 4), ==,
+			 0);
+	close(file_fd);
+
+	munit_assert_int(read(sv[1], buf, sizeof(buf)), ==, 10);
+	munit_assert_uint32(ntohl(*(uint32_t *)buf), ==, 6);
+	munit_assert_memory_equal(6, buf + 4, "abcdef");
+	munit_assert_size(frame_conn_get_queued(conn), ==, 0);
+
+	frame_conn_free(conn);
+	close(sv[1]);
+	return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+	{
+		"/receive",		/* name */
+		test_frame_recv,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/frame too large",	/* name */
+		test_frame_too_large,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/send queued",		/* name */
+		test_frame_send_queued, /* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/seqpacket",		/* name */
+		test_frame_seqpacket,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/send file",		/* name */
+		test_frame_send_file,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/drain callback",	/* name */
+		test_frame_drain,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+
+	// Mark the end of the array with an entry where the test function is NULL
+	{ NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite frame_suite = {
+	"/frame",		/* name */
+	tests,			/* tests */
+	NULL,			/* suites */
+	1,			/* iterations */
+	MUNIT_SUITE_OPTION_NONE /* options */
+};
@@ -0,0 +1,231 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+//#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
+
+#include "hashmap.h"
+#include "macro.h"
+#include "mem.h"
+
+#include <string.h>
+
+#define HASHMAP_INITIAL_BUCKETS 16
+
+typedef struct hashmap_entry hashmap_entry_t;
+struct hashmap_entry {
+	uint64_t hash;
+	unsigned char *key;
+	size_t key_len;
+	void *data;
+	hashmap_entry_t *next;
+};
+
+struct hashmap {
+	hashmap_entry_t **buckets;
+	size_t n_buckets; // always a power of two
+	unsigned int size;
+};
+
+/* 64-bit FNV-1a */
+static uint64_t
+hashmap_hash(const void *key, size_t key_len)
+{
+	const unsigned char *p = key;
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < key_len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static hashmap_entry_t **
+hashmap_lookup(const hashmap_t *map, uint64_t hash, const void *key, size_t key_len)
+{
+	hashmap_entry_t **pe = &map->buckets[hash & (map->n_buckets - 1)];
+
+	for (; *pe; pe = &(*pe)->next) {
+		if ((*pe)->hash == hash && (*pe)->key_len == key_len &&
+		    !memcmp((*pe)->key, key, key_len))
+			break;
+	}
+	return pe;
+}
+
+static void
+hashmap_grow(hashmap_t *map)
+{
+	size_t n_buckets = map->n_buckets * 2;
+	hashmap_entry_t **buckets = mem_new0(hashmap_entry_t *, n_buckets);
+
+	TRACE("Growing hashmap %p to %zu buckets", (void *)map, n_buckets);
+
+	for (size_t i = 0; i < map->n_buckets; i++) {
+		hashmap_entry_t *e = map->buckets[i];
+		while (e) {
+			hashmap_entry_t *next = e->next;
+			size_t idx = e->hash & (n_buckets - 1);
+			e->next = buckets[idx];
+			buckets[idx] = e;
+			e = next;
+		}
+	}
+	mem_free0(map->buckets);
+	map->buckets = buckets;
+	map->n_buckets = n_buckets;
+}
+
+hashmap_t *
+hashmap_new(void)
+{
+	hashmap_t *map = mem_new0(hashmap_t, 1);
+	map->n_buckets = HASHMAP_INITIAL_BUCKETS;
+	map->buckets = mem_new0(hashmap_entry_t *, map->n_buckets);
+	return map;
+}
+
+void
+hashmap_free(hashmap_t *map)
+{
+	IF_NULL_RETURN_TRACE(map);
+
+	for (size_t i = 0; i < map->n_buckets; i++) {
+		hashmap_entry_t *e = map->buckets[i];
+		while (e) {
+			hashmap_entry_t *next = e->next;
+			mem_free0(e->key);
+			mem_free0(e);
+			e = next;
+		}
+	}
+	mem_free0(map->buckets);
+	mem_free0(map);
+}
+
+void *
+hashmap_put(hashmap_t *map, const void *key, size_t key_len, void *data)
+{
+	ASSERT(map);
+	ASSERT(key || key_len == 0);
+
+	uint64_t hash = hashmap_hash(key, key_len);
+	hashmap_entry_t **pe = hashmap_lookup(map, hash, key, key_len);
+
+	if (*pe) {
+		void *old = (*pe)->data;
+		(*pe)->data = data;
+		return old;
+	}
+
+	if (map->size + 1 > map->n_buckets) {
+		hashmap_grow(map);
+		pe = &map->buckets[hash & (map->n_buckets - 1)];
+	}
+
+	hashmap_entry_t *e = mem_new0(hashmap_entry_t, 1);
+	e->hash = hash;
+	e->key = mem_alloc(key_len ? key_len : 1);
+	memcpy(e->key, key, key_len);
+	e->key_len = key_len;
+	e->data = data;
+	e->next = *pe;
+	*pe = e;
+	map->size++;
+
+	return NULL;
+}
+
+void *
+hashmap_get(const hashmap_t *map, const void *key, size_t key_len)
+{
+	IF_NULL_RETVAL_TRACE(map, NULL);
+
+	hashmap_entry_t **pe = hashmap_lookup(map, hashmap_hash(key, key_len), key, key_len);
+	return *pe ? (*pe)->data : NULL;
+}
+
+bool
+hashmap_contains(const hashmap_t *map, const void *key, size_t key_len)
+{
+	IF_NULL_RETVAL_TRACE(map, false);
+
+	return *hashmap_lookup(map, hashmap_hash(key, key_len), key, key_len) != NULL;
+}
+
+void *
+hashmap_remove(hashmap_t *map, const void *key, size_t key_len)
+{
+	IF_NULL_RETVAL_TRACE(map, NULL);
+
+	hashmap_entry_t **pe = hashmap_lookup(map, hashmap_hash(key, key_len), key, key_len);
+	IF_NULL_RETVAL_TRACE(*pe, NULL);
+
+	hashmap_entry_t *e = *pe;
+	void *data = e->data;
+
+	*pe = e->next;
+	mem_free0(e->key);
+	mem_free0(e);
+	map->size--;
+
+	return data;
+}
+
+unsigned int
+hashmap_size(const hashmap_t *map)
+{
+	return map ? map->size : 0;
+}
+
+void
+hashmap_foreach(const hashmap_t *map, void (*func)(void *value, void *data), void *data)
+{
+	ASSERT(func);
+	IF_NULL_RETURN_TRACE(map);
+
+	for (size_t i = 0; i < map->n_buckets; i++)
+		for (hashmap_entry_t *e = map->buckets[i]; e; e = e->next)
+			func(e->data, data);
+}
+
+void *
+hashmap_put_str(hashmap_t *map, const char *key, void *data)
+{
+	ASSERT(key);
+	return hashmap_put(map, key, strlen(key), data);
+}
+
+void *
+hashmap_get_str(const hashmap_t *map, const char *key)
+{
+	IF_NULL_RETVAL(key, NULL);
+	return hashmap_get(map, key, strlen(key));
+}
+
+void *
+hashmap_remove_str(hashmap_t *map, const char *key)
+{
+	IF_NULL_RETVAL(key, NULL);
+	return hashmap_remove(map, key, strlen(key));
+}
@@ -0,0 +1,156 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file hashmap.h
+ *
+ * Implements a simple hash table with separate chaining which maps
+ * arbitrary binary keys to payload pointers. Keys are copied on insertion,
+ * payloads are owned by the caller. The table grows automatically to keep
+ * the average chain length below one, so lookups are O(1) on average.
+ */
+
+#ifndef HASHMAP_H
+#define HASHMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct hashmap hashmap_t;
+
+/**
+ * Creates a new empty hash map.
+ *
+ * @return Pointer to the newly created hash map.
+ */
+hashmap_t *
+hashmap_new(void);
+
+/**
+ * Frees the hash map including all stored keys.
+ * The payloads are not touched.
+ *
+ * @param map The hash map to be freed; may be NULL.
+ */
+void
+hashmap_free(hashmap_t *map);
+
+/**
+ * Inserts a payload for the given key. An already existing
+ * entry with the same key is replaced.
+ *
+ * @param map The hash map.
+ * @param key Pointer to the key bytes.
+ * @param key_len The length of the key in bytes.
+ * @param data The payload; may be NULL.
+ * @return The payload previously stored for key or NULL if there was none.
+ */
+void *
+hashmap_put(hashmap_t *map, const void *key, size_t key_len, void *data);
+
+/**
+ * Returns the payload stored for the given key.
+ *
+ * @param map The hash map.
+ * @param key Pointer to the key bytes.
+ * @param key_len The length of the key in bytes.
+ * @return The stored payload or NULL if key is not contained in the map.
+ */
+void *
+hashmap_get(const hashmap_t *map, const void *key, size_t key_len);
+
+/**
+ * Returns true if and only if the map contains an entry for the given key.
+ *
+ * @param map The hash map.
+ * @param key Pointer to the key bytes.
+ * @param key_len The length of the key in bytes.
+ * @return true if the key is contained, false otherwise.
+ */
+bool
+hashmap_contains(const hashmap_t *map, const void *key, size_t key_len);
+
+/**
+ * Removes the entry for the given key from the map.
+ *
+ * @param map The hash map.
+ * @param key Pointer to the key bytes.
+ * @param key_len The length of the key in bytes.
+ * @return The payload of the removed entry or NULL if there was none.
+ */
+void *
+hashmap_remove(hashmap_t *map, const void *key, size_t key_len);
+
+/**
+ * Returns the number of entries contained in the map.
+ *
+ * @param map The hash map.
+ * @return Number of entries contained in the map.
+ */
+unsigned int
+hashmap_size(const hashmap_t *map);
+
+/**
+ * Calls the given function on each payload stored in the map.
+ * The map must not be modified from within func.
+ *
+ * @param map The hash map.
+ * @param func The callback to be applied to each payload.
+ * @param data Additional data passed to func.
+ */
+void
+hashmap_foreach(const hashmap_t *map, void (*func)(void *value, void *data), void *data);
+
+/**
+ * Convenience wrappers for maps which are keyed by an unsigned 64-bit integer
+ * or by a NULL-terminated string.
+ */
+static inline void *
+hashmap_put_u64(hashmap_t *map, uint64_t key, void *data)
+{
+	return hashmap_put(map, &key, sizeof(key), data);
+}
+
+static inline void *
+hashmap_get_u64(const hashmap_t *map, uint64_t key)
+{
+	return hashmap_get(map, &key, sizeof(key));
+}
+
+static inline void *
+hashmap_remove_u64(hashmap_t *map, uint64_t key)
+{
+	return hashmap_remove(map, &key, sizeof(key));
+}
+
+void *
+hashmap_put_str(hashmap_t *map, const char *key, void *data);
+
+void *
+hashmap_get_str(const hashmap_t *map, const char *key);
+
+void *
+hashmap_remove_str(hashmap_t *map, const char *key);
+
+#endif /* HASHMAP_H */
@@ -0,0 +1,127 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+#include "munit.h"
+
+#include "hashmap.h"
+#include "logf.h"
+#include "macro.h"
+
+#define TEST_HASHMAP_ENTRIES 10000
+
+static void *
+setup(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	logf_register(&logf_test_write, stderr);
+	return NULL;
+}
+
+static void
+tear_down(UNUSED void *fixture)
+{
+}
+
+static MunitResult
+test_hashmap_put_get_remove(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	static int values[TEST_HASHMAP_ENTRIES];
+	hashmap_t *map = hashmap_new();
+	munit_assert_not_null(map);
+
+	// inserting many keys grows the table and keeps all entries
+	for (int i = 0; i < TEST_HASHMAP_ENTRIES; i++)
+		munit_assert_null(hashmap_put_u64(map, (uint64_t)i * 100000, &values[i]));
+	munit_assert_uint(hashmap_size(map), ==, TEST_HASHMAP_ENTRIES);
+
+	for (int i = 0; i < TEST_HASHMAP_ENTRIES; i++)
+		munit_assert_ptr_equal(hashmap_get_u64(map, (uint64_t)i * 100000), &values[i]);
+	munit_assert_null(hashmap_get_u64(map, 1));
+
+	// replacing returns the old payload and does not change the size
+	munit_assert_ptr_equal(hashmap_put_u64(map, 0, &values[1]), &values[0]);
+	munit_assert_ptr_equal(hashmap_get_u64(map, 0), &values[1]);
+	munit_assert_uint(hashmap_size(map), ==, TEST_HASHMAP_ENTRIES);
+
+	// removing returns the payload and the key is gone afterwards
+	munit_assert_ptr_equal(hashmap_remove_u64(map, 200000), &values[2]);
+	munit_assert_false(hashmap_contains(map, &(uint64_t){ 200000 }, sizeof(uint64_t)));
+	munit_assert_null(hashmap_remove_u64(map, 200000));
+	munit_assert_uint(hashmap_size(map), ==, TEST_HASHMAP_ENTRIES - 1);
+
+	hashmap_free(map);
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_hashmap_string_keys(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	int a = 1, b = 2;
+	hashmap_t *map = hashmap_new();
+
+	// keys are copied on insertion
+	char key[] = "00000000-0000-0000-0000-000000000000";
+	hashmap_put_str(map, key, &a);
+	key[0] = '1';
+	hashmap_put_str(map, key, &b);
+
+	munit_assert_ptr_equal(hashmap_get_str(map, "00000000-0000-0000-0000-000000000000"), &a);
+	munit_assert_ptr_equal(hashmap_get_str(map, key), &b);
+	munit_assert_null(hashmap_get_str(map, "0000"));
+	munit_assert_null(hashmap_get_str(map, NULL));
+
+	munit_assert_ptr_equal(hashmap_remove_str(map, key), &b);
+	munit_assert_uint(hashmap_size(map), ==, 1);
+
+	hashmap_free(map);
+	return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+	{
+		"/put, get and remove", /* name */
+		test_hashmap_put_get_remove, /* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/string keys",		/* name */
+		test_hashmap_string_keys, /* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+
+	// Mark the end of the array with an entry where the test function is NULL
+	{ NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite hashmap_suite = {
+	"/hashmap",		/* name */
+	tests,			/* tests */
+	NULL,			/* suites */
+	1,			/* iterations */
+	MUNIT_SUITE_OPTION_NONE /* options */
+};
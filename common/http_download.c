@@ -0,0 +1,995 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+#include "http_download.h"
+
+#include "event.h"
+#include "file.h"
+#include "list.h"
+#include "macro.h"
+#include "mem.h"
+#include "threadpool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HTTP_DOWNLOAD_URL_PREFIX "http://"
+#define HTTP_DOWNLOAD_MARKER_SUFFIX ".ranges"
+#define HTTP_DOWNLOAD_HDR_MAX 8192
+#define HTTP_DOWNLOAD_BUF_SIZE (64 * 1024)
+// smallest part of a file which is fetched over an additional connection
+#define HTTP_DOWNLOAD_RANGE_MIN (4 * 1024 * 1024)
+#define HTTP_DOWNLOAD_MAX_REDIRECTS 5
+#define HTTP_DOWNLOAD_TIMEOUT_MS (60 * 1000)
+#define HTTP_DOWNLOAD_WATCHDOG_MS 1000
+#define HTTP_DOWNLOAD_PROGRESS_MS 500
+#define HTTP_DOWNLOAD_RATE_TICK_MS 50
+#define HTTP_DOWNLOAD_RESOLVER_THREADS 2
+
+#define HTTP_DOWNLOAD_END_UNKNOWN UINT64_MAX
+
+// result of handling an event on a connection
+typedef enum {
+	HTTP_DOWNLOAD_CONTINUE,
+	HTTP_DOWNLOAD_FAILED,
+	HTTP_DOWNLOAD_COMPLETE,
+} http_download_state_t;
+
+typedef struct http_download_resolve http_download_resolve_t;
+
+typedef struct http_download_conn {
+	http_download_t *dl;		  // only valid as long as the connection is not closed
+	http_download_resolve_t *resolve; // host name resolution in progress or NULL
+	int sock;
+	event_io_t *io; // NULL until the host name has been resolved
+	bool connected;
+	bool closed;
+	bool paused; // reading is paused by the rate limit
+	char *req;
+	size_t req_len;
+	size_t req_off;
+	char hdr[HTTP_DOWNLOAD_HDR_MAX];
+	size_t hdr_len;
+	bool hdr_done;
+	uint64_t pos; // file offset of the next byte received
+	uint64_t end; // end of the range or HTTP_DOWNLOAD_END_UNKNOWN
+} http_download_conn_t;
+
+/*
+ * Resolving a host name may block for a long time, thus it is done by a worker
+ * thread. The result is handed to the connection from the event loop, unless
+ * the connection has been closed in the meantime.
+ */
+struct http_download_resolve {
+	http_download_conn_t *conn; // NULL if the connection has been closed
+	char *host;
+	char *port;
+	struct addrinfo *res;
+	int status;
+};
+
+struct http_download {
+	char *url; // current URL, i.e., after redirects
+	char *host;
+	char *port;
+	char *hostport; // value of the Host header
+	char *path;
+	char *file;
+	char *marker;
+	unsigned int ranges;
+	http_download_complete_cb_t on_complete;
+	http_download_progress_cb_t on_progress;
+	void *data;
+	int fd;
+	http_download_conn_t **conns; // ordered by file offset, NULL once done
+	unsigned int n_conns;
+	unsigned int n_done;
+	bool running;
+	bool split; // the file has been split into ranges (or not, once is enough)
+	unsigned int redirects;
+	bool redirect_unsupported; // redirected to a URL which is not supported
+	uint64_t resume_offset;
+	uint64_t received;
+	uint64_t total;
+	uint64_t last_activity_ms;
+	uint64_t last_progress_ms;
+	event_timer_t *watchdog;
+};
+
+static uint8_t http_download_buf[HTTP_DOWNLOAD_BUF_SIZE];
+
+static threadpool_t *http_download_resolver = NULL;
+
+// closed connections may still have events pending in the current epoll batch
+static list_t *http_download_dead_conns = NULL;
+static event_timer_t *http_download_reaper = NULL;
+
+// token bucket shared by all downloads, tokens are kept in 1/1000 bytes
+static uint64_t http_download_rate_limit = 0;
+static uint64_t http_download_rate_tokens = 0;
+static uint64_t http_download_rate_last_ms = 0;
+static list_t *http_download_paused_conns = NULL;
+static event_timer_t *http_download_rate_timer = NULL;
+
+static void
+http_download_conn_cb(int fd, unsigned events, event_io_t *io, void *data);
+
+static void
+http_download_finish(http_download_t *dl, bool success);
+
+static uint64_t
+http_download_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/******************************************************************************/
+
+void
+http_download_set_rate_limit(uint64_t bytes_per_sec)
+{
+	http_download_rate_limit = bytes_per_sec;
+	http_download_rate_tokens = 0;
+	http_download_rate_last_ms = http_download_now_ms();
+}
+
+/*
+ * Returns how many of len bytes may be read now.
+ */
+static size_t
+http_download_rate_allowance(size_t len)
+{
+	IF_TRUE_RETVAL(http_download_rate_limit == 0, len);
+
+	uint64_t now = http_download_now_ms();
+	uint64_t burst = MAX(http_download_rate_limit * HTTP_DOWNLOAD_RATE_TICK_MS, 1000);
+	uint64_t refill = (now - http_download_rate_last_ms) * http_download_rate_limit;
+	http_download_rate_tokens = MIN(burst, http_download_rate_tokens + refill);
+	http_download_rate_last_ms = now;
+
+	return MIN(len, http_download_rate_tokens / 1000);
+}
+
+static void
+http_download_rate_consume(size_t len)
+{
+	IF_TRUE_RETURN(http_download_rate_limit == 0);
+	http_download_rate_tokens -= MIN(http_download_rate_tokens, (uint64_t)len * 1000);
+}
+
+static void
+http_download_rate_timer_cb(event_timer_t *timer, UNUSED void *data)
+{
+	for (list_t *l = http_download_paused_conns; l; l = l->next) {
+		http_download_conn_t *conn = l->data;
+		conn->paused = false;
+		event_add_io(conn->io);
+	}
+	list_delete(http_download_paused_conns);
+	http_download_paused_conns = NULL;
+
+	event_remove_timer(timer);
+	event_timer_free(timer);
+	http_download_rate_timer = NULL;
+}
+
+static void
+http_download_conn_pause(http_download_conn_t *conn)
+{
+	event_remove_io(conn->io);
+	conn->paused = true;
+	http_download_paused_conns = list_append(http_download_paused_conns, conn);
+
+	if (!http_download_rate_timer) {
+		http_download_rate_timer = event_timer_new(HTTP_DOWNLOAD_RATE_TICK_MS, 1,
+							   http_download_rate_timer_cb, NULL);
+		event_add_timer(http_download_rate_timer);
+	}
+}
+
+/******************************************************************************/
+
+static void
+http_download_reaper_cb(event_timer_t *timer, UNUSED void *data)
+{
+	for (list_t *l = http_download_dead_conns; l; l = l->next) {
+		http_download_conn_t *conn = l->data;
+		if (conn->io)
+			event_io_free(conn->io);
+		mem_free0(conn->req);
+		mem_free0(conn);
+	}
+	list_delete(http_download_dead_conns);
+	http_download_dead_conns = NULL;
+
+	event_timer_free(timer);
+	http_download_reaper = NULL;
+}
+
+static void
+http_download_conn_close(http_download_conn_t *conn)
+{
+	IF_TRUE_RETURN(conn->closed);
+
+	if (conn->resolve) {
+		conn->resolve->conn = NULL;
+		conn->resolve = NULL;
+	}
+	if (conn->paused)
+		http_download_paused_conns = list_remove(http_download_paused_conns, conn);
+	else if (conn->io)
+		event_remove_io(conn->io);
+	if (conn->sock >= 0)
+		close(conn->sock);
+	conn->closed = true;
+	conn->dl = NULL;
+
+	http_download_dead_conns = list_append(http_download_dead_conns, conn);
+	if (!http_download_reaper) {
+		http_download_reaper = event_timer_new(0, 1, http_download_reaper_cb, NULL);
+		event_add_timer(http_download_reaper);
+	}
+}
+
+static int
+http_download_connect(struct addrinfo *res, const char *host, const char *port)
+{
+	int sock = -1;
+	for (struct addrinfo *cur = res; cur; cur = cur->ai_next) {
+		sock = socket(cur->ai_family, cur->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			      cur->ai_protocol);
+		if (sock < 0)
+			continue;
+		if (connect(sock, cur->ai_addr, cur->ai_addrlen) == 0 || errno == EINPROGRESS)
+			break;
+		close(sock);
+		sock = -1;
+	}
+	if (sock < 0)
+		WARN_ERRNO("Could not connect to %s:%s", host, port);
+
+	return sock;
+}
+
+static void
+http_download_resolve_free(http_download_resolve_t *resolve)
+{
+	if (resolve->res)
+		freeaddrinfo(resolve->res);
+	mem_free0(resolve->host);
+	mem_free0(resolve->port);
+	mem_free0(resolve);
+}
+
+// runs in a worker thread of http_download_resolver
+static void
+http_download_resolve_run(void *data)
+{
+	http_download_resolve_t *resolve = data;
+
+	struct addrinfo hints;
+	mem_memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	resolve->status = getaddrinfo(resolve->host, resolve->port, &hints, &resolve->res);
+}
+
+static void
+http_download_resolve_done_cb(void *data)
+{
+	http_download_resolve_t *resolve = data;
+	http_download_conn_t *conn = resolve->conn;
+
+	if (!conn) {
+		http_download_resolve_free(resolve);
+		return;
+	}
+	conn->resolve = NULL;
+
+	if (resolve->status)
+		WARN("Could not resolve %s: %s", resolve->host, gai_strerror(resolve->status));
+	else
+		conn->sock = http_download_connect(resolve->res, resolve->host, resolve->port);
+	http_download_resolve_free(resolve);
+
+	if (conn->sock < 0) {
+		http_download_finish(conn->dl, false);
+		return;
+	}
+	conn->io = event_io_new(conn->sock, EVENT_IO_WRITE, http_download_conn_cb, conn);
+	event_add_io(conn->io);
+}
+
+static http_download_conn_t *
+http_download_conn_new(http_download_t *dl, uint64_t pos, uint64_t end)
+{
+	if (!http_download_resolver &&
+	    !(http_download_resolver = threadpool_new(HTTP_DOWNLOAD_RESOLVER_THREADS))) {
+		WARN("Could not create threads to resolve host names");
+		return NULL;
+	}
+
+	http_download_resolve_t *resolve = mem_new0(http_download_resolve_t, 1);
+	resolve->host = mem_strdup(dl->host);
+	resolve->port = mem_strdup(dl->port);
+	if (threadpool_add(http_download_resolver, http_download_resolve_run,
+			   http_download_resolve_done_cb, resolve) < 0) {
+		WARN("Could not resolve %s", dl->host);
+		http_download_resolve_free(resolve);
+		return NULL;
+	}
+
+	http_download_conn_t *conn = mem_new0(http_download_conn_t, 1);
+	conn->dl = dl;
+	conn->resolve = resolve;
+	conn->sock = -1;
+	conn->pos = pos;
+	conn->end = end;
+	resolve->conn = conn;
+
+	// an open range is also requested from the start to learn whether ranges are supported
+	char *range = NULL;
+	if (end != HTTP_DOWNLOAD_END_UNKNOWN)
+		range = mem_printf("Range: bytes=%" PRIu64 "-%" PRIu64 "\r\n", pos, end - 1);
+	else if (pos > 0 || dl->ranges > 1)
+		range = mem_printf("Range: bytes=%" PRIu64 "-\r\n", pos);
+
+	conn->req = mem_printf("GET %s HTTP/1.1\r\n"
+			       "Host: %s\r\n"
+			       "User-Agent: cmld\r\n"
+			       "Accept-Encoding: identity\r\n"
+			       "Connection: close\r\n"
+			       "%s"
+			       "\r\n",
+			       dl->path, dl->hostport, range ? range : "");
+	conn->req_len = strlen(conn->req);
+	mem_free0(range);
+
+	TRACE("Connecting to %s for range %" PRIu64 "-%" PRIu64 " of %s", dl->hostport, pos,
+	      end, dl->file);
+	return conn;
+}
+
+/******************************************************************************/
+
+static void
+http_download_report_progress(http_download_t *dl, bool force)
+{
+	IF_NULL_RETURN(dl->on_progress);
+
+	uint64_t now = http_download_now_ms();
+	IF_TRUE_RETURN(!force && now - dl->last_progress_ms < HTTP_DOWNLOAD_PROGRESS_MS);
+	dl->last_progress_ms = now;
+
+	dl->on_progress(dl, dl->received, dl->total, dl->data);
+}
+
+/*
+ * Splits the remainder of the file received by the first connection into
+ * ranges which are fetched over additional connections.
+ */
+static int
+http_download_split(http_download_t *dl)
+{
+	http_download_conn_t *first = dl->conns[0];
+
+	dl->split = true;
+	IF_TRUE_RETVAL(dl->ranges < 2 || first->end == HTTP_DOWNLOAD_END_UNKNOWN, 0);
+
+	uint64_t remaining = first->end - first->pos;
+	unsigned int n = MIN(dl->ranges, remaining / HTTP_DOWNLOAD_RANGE_MIN);
+	IF_TRUE_RETVAL(n < 2, 0);
+
+	if (file_touch(dl->marker) < 0) {
+		WARN("Could not create %s, downloading %s over a single connection", dl->marker,
+		     dl->file);
+		return 0;
+	}
+
+	uint64_t part = remaining / n;
+	uint64_t end = first->end;
+	uint64_t pos = first->pos + part;
+	first->end = pos;
+	for (unsigned int i = 1; i < n; i++) {
+		uint64_t next = (i == n - 1) ? end : pos + part;
+		http_download_conn_t *conn = http_download_conn_new(dl, pos, next);
+		IF_NULL_RETVAL(conn, -1);
+		dl->conns[dl->n_conns++] = conn;
+		pos = next;
+	}
+
+	DEBUG("Downloading %s over %u connections", dl->file, n);
+	return 0;
+}
+
+/*
+ * Closes a connection which has received its range completely.
+ */
+static http_download_state_t
+http_download_conn_done(http_download_conn_t *conn)
+{
+	http_download_t *dl = conn->dl;
+
+	for (unsigned int i = 0; i < dl->n_conns; i++) {
+		if (dl->conns[i] == conn)
+			dl->conns[i] = NULL;
+	}
+	http_download_conn_close(conn);
+
+	return (++dl->n_done == dl->n_conns) ? HTTP_DOWNLOAD_COMPLETE : HTTP_DOWNLOAD_CONTINUE;
+}
+
+static int
+http_download_set_url(http_download_t *dl, const char *url)
+{
+	IF_FALSE_RETVAL(http_download_url_is_supported(url), -1);
+
+	const char *hostport = url + strlen(HTTP_DOWNLOAD_URL_PREFIX);
+	const char *path = strchr(hostport, '/');
+	char *host = path ? mem_strndup(hostport, path - hostport) : mem_strdup(hostport);
+	IF_TRUE_GOTO(!*host, error);
+
+	char *port = NULL;
+	char *colon = strrchr(host, ':');
+	if (host[0] == '[') {
+		// IPv6 address literal
+		char *bracket = strchr(host, ']');
+		IF_NULL_GOTO(bracket, error);
+		if (bracket[1] == ':')
+			port = mem_strdup(bracket + 2);
+		else
+			IF_TRUE_GOTO(bracket[1] != '\0', error);
+		*bracket = '\0';
+		memmove(host, host + 1, strlen(host));
+	} else if (colon) {
+		port = mem_strdup(colon + 1);
+		*colon = '\0';
+	}
+
+	mem_free0(dl->hostport);
+	mem_free0(dl->host);
+	mem_free0(dl->port);
+	mem_free0(dl->path);
+	mem_free0(dl->url);
+	dl->hostport = path ? mem_strndup(hostport, path - hostport) : mem_strdup(hostport);
+	dl->host = host;
+	dl->port = (port && *port) ? port : mem_strdup("80");
+	if (port && !*port)
+		mem_free0(port);
+	dl->path = mem_strdup(path ? path : "/");
+	dl->url = mem_strdup(url);
+	return 0;
+
+error:
+	WARN("Invalid URL %s", url);
+	mem_free0(host);
+	return -1;
+}
+
+/*
+ * Handles a redirect received on the first connection, before anything has
+ * been received.
+ */
+static http_download_state_t
+http_download_redirect(http_download_conn_t *conn, const char *location)
+{
+	http_download_t *dl = conn->dl;
+
+	if (++dl->redirects > HTTP_DOWNLOAD_MAX_REDIRECTS) {
+		WARN("Too many redirects for %s", dl->url);
+		return HTTP_DOWNLOAD_FAILED;
+	}
+	if (!http_download_url_is_supported(location)) {
+		INFO("Redirected from %s to %s, which is not supported", dl->url, location);
+		dl->redirect_unsupported = true;
+		return HTTP_DOWNLOAD_FAILED;
+	}
+	DEBUG("Following redirect from %s to %s", dl->url, location);
+	if (http_download_set_url(dl, location) < 0) {
+		WARN("Cannot follow redirect to %s", location);
+		return HTTP_DOWNLOAD_FAILED;
+	}
+
+	http_download_conn_t *next = http_download_conn_new(dl, conn->pos, conn->end);
+	IF_NULL_RETVAL(next, HTTP_DOWNLOAD_FAILED);
+	dl->conns[0] = next;
+	http_download_conn_close(conn);
+	return HTTP_DOWNLOAD_CONTINUE;
+}
+
+/*
+ * Restarts the download from the beginning of the file, e.g., if the server
+ * does not support ranges.
+ */
+static int
+http_download_restart(http_download_t *dl)
+{
+	if (ftruncate(dl->fd, 0) < 0) {
+		WARN_ERRNO("Could not truncate %s", dl->file);
+		return -1;
+	}
+	dl->conns[0]->pos = 0;
+	dl->resume_offset = 0;
+	dl->received = 0;
+	return 0;
+}
+
+static http_download_state_t
+http_download_conn_response(http_download_conn_t *conn)
+{
+	http_download_t *dl = conn->dl;
+	bool first_only = (conn == dl->conns[0] && dl->n_conns == 1);
+
+	int status = 0;
+	if (sscanf(conn->hdr, "HTTP/%*d.%*d %d", &status) != 1) {
+		WARN("Invalid HTTP response for %s", dl->url);
+		return HTTP_DOWNLOAD_FAILED;
+	}
+
+	int64_t content_length = -1;
+	const char *content_range = NULL;
+	const char *location = NULL;
+	bool encoded = false;
+
+	char *saveptr = NULL;
+	strtok_r(conn->hdr, "\r\n", &saveptr); // status line
+	for (char *line = strtok_r(NULL, "\r\n", &saveptr); line;
+	     line = strtok_r(NULL, "\r\n", &saveptr)) {
+		char *value = strchr(line, ':');
+		if (!value)
+			continue;
+		*value++ = '\0';
+		value += strspn(value, " \t");
+
+		if (!strcasecmp(line, "Content-Length"))
+			sscanf(value, "%" SCNd64, &content_length);
+		else if (!strcasecmp(line, "Content-Range"))
+			content_range = value;
+		else if (!strcasecmp(line, "Location"))
+			location = value;
+		else if (!strcasecmp(line, "Transfer-Encoding"))
+			encoded = !!strcasecmp(value, "identity");
+	}
+
+	TRACE("Received HTTP status %d for range %" PRIu64 "- of %s", status, conn->pos, dl->url);
+
+	if (status >= 300 && status < 400 && location && first_only)
+		return http_download_redirect(conn, location);
+
+	if (encoded) {
+		WARN("Transfer encodings, e.g., chunked, are not supported (%s)", dl->url);
+		return HTTP_DOWNLOAD_FAILED;
+	}
+
+	uint64_t range_first, range_last, range_total;
+	switch (status) {
+	case 206:
+		if (!content_range ||
+		    sscanf(content_range, "bytes %" SCNu64 "-%" SCNu64, &range_first,
+			   &range_last) != 2 ||
+		    range_first != conn->pos || range_last < range_first ||
+		    (conn->end != HTTP_DOWNLOAD_END_UNKNOWN && range_last + 1 != conn->end)) {
+			WARN("Unexpected Content-Range '%s' for %s",
+			     content_range ? content_range : "", dl->url);
+			return HTTP_DOWNLOAD_FAILED;
+		}
+		if (first_only) {
+			conn->end = range_last + 1;
+			const char *slash = strchr(content_range, '/');
+			if (slash && sscanf(slash + 1, "%" SCNu64, &range_total) == 1)
+				dl->total = range_total;
+			if (!dl->split && http_download_split(dl) < 0)
+				return HTTP_DOWNLOAD_FAILED;
+		}
+		break;
+	case 200:
+		// the server ignored the range request
+		if (!first_only) {
+			WARN("Server does not support ranges for %s", dl->url);
+			return HTTP_DOWNLOAD_FAILED;
+		}
+		dl->split = true;
+		if (conn->pos > 0) {
+			DEBUG("Server does not support ranges, restarting download of %s",
+			      dl->file);
+			IF_TRUE_RETVAL(http_download_restart(dl) < 0, HTTP_DOWNLOAD_FAILED);
+		}
+		if (content_length >= 0) {
+			conn->end = content_length;
+			dl->total = content_length;
+		}
+		break;
+	case 416:
+		// the resumed file may already be complete
+		if (first_only && conn->pos > 0 && content_range &&
+		    sscanf(content_range, "bytes */%" SCNu64, &range_total) == 1 &&
+		    range_total == conn->pos) {
+			DEBUG("%s has already been downloaded completely", dl->file);
+			dl->total = range_total;
+			return http_download_conn_done(conn);
+		}
+		WARN("Cannot resume %s at offset %" PRIu64 ", restarting next time", dl->file,
+		     conn->pos);
+		http_download_restart(dl);
+		return HTTP_DOWNLOAD_FAILED;
+	default:
+		WARN("Download of %s failed with HTTP status %d", dl->url, status);
+		return HTTP_DOWNLOAD_FAILED;
+	}
+
+	if (conn->end != HTTP_DOWNLOAD_END_UNKNOWN && conn->pos >= conn->end)
+		return http_download_conn_done(conn);
+	return HTTP_DOWNLOAD_CONTINUE;
+}
+
+static http_download_state_t
+http_download_conn_write(http_download_conn_t *conn, const uint8_t *buf, size_t len)
+{
+	http_download_t *dl = conn->dl;
+
+	// the first connection keeps receiving beyond its range after a split
+	if (conn->end != HTTP_DOWNLOAD_END_UNKNOWN)
+		len = MIN(len, conn->end - conn->pos);
+
+	while (len > 0) {
+		ssize_t n = pwrite(dl->fd, buf, len, conn->pos);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			WARN_ERRNO("Could not write to %s", dl->file);
+			return HTTP_DOWNLOAD_FAILED;
+		}
+		buf += n;
+		len -= n;
+		conn->pos += n;
+		dl->received += n;
+	}
+	http_download_report_progress(dl, false);
+
+	if (conn->end != HTTP_DOWNLOAD_END_UNKNOWN && conn->pos >= conn->end)
+		return http_download_conn_done(conn);
+	return HTTP_DOWNLOAD_CONTINUE;
+}
+
+static http_download_state_t
+http_download_conn_data(http_download_conn_t *conn, const uint8_t *buf, size_t len)
+{
+	if (!conn->hdr_done) {
+		size_t old_len = conn->hdr_len;
+		size_t n = MIN(len, sizeof(conn->hdr) - 1 - conn->hdr_len);
+		memcpy(conn->hdr + conn->hdr_len, buf, n);
+		conn->hdr_len += n;
+		conn->hdr[conn->hdr_len] = '\0';
+
+		char *hdr_end = strstr(conn->hdr, "\r\n\r\n");
+		if (!hdr_end) {
+			if (conn->hdr_len == sizeof(conn->hdr) - 1) {
+				WARN("HTTP response header too large (%s)", conn->dl->url);
+				return HTTP_DOWNLOAD_FAILED;
+			}
+			return HTTP_DOWNLOAD_CONTINUE;
+		}
+		size_t consumed = hdr_end + 4 - conn->hdr - old_len;
+		*hdr_end = '\0';
+		conn->hdr_done = true;
+
+		http_download_state_t state = http_download_conn_response(conn);
+		// a redirect or completion closes the connection
+		if (state != HTTP_DOWNLOAD_CONTINUE || conn->closed)
+			return state;
+
+		buf += consumed;
+		len -= consumed;
+	}
+	IF_TRUE_RETVAL(len == 0, HTTP_DOWNLOAD_CONTINUE);
+
+	return http_download_conn_write(conn, buf, len);
+}
+
+static http_download_state_t
+http_download_conn_recv(http_download_conn_t *conn)
+{
+	size_t len = http_download_rate_allowance(sizeof(http_download_buf));
+	if (len == 0) {
+		http_download_conn_pause(conn);
+		return HTTP_DOWNLOAD_CONTINUE;
+	}
+
+	ssize_t n = read(conn->sock, http_download_buf, len);
+	if (n < 0) {
+		IF_TRUE_RETVAL(errno == EAGAIN || errno == EINTR, HTTP_DOWNLOAD_CONTINUE);
+		WARN_ERRNO("Could not receive %s", conn->dl->url);
+		return HTTP_DOWNLOAD_FAILED;
+	}
+	http_download_rate_consume(n);
+
+	if (n > 0)
+		return http_download_conn_data(conn, http_download_buf, n);
+
+	// connection closed by the server
+	if (!conn->hdr_done) {
+		WARN("Connection closed before a response was received (%s)", conn->dl->url);
+		return HTTP_DOWNLOAD_FAILED;
+	}
+	if (conn->end != HTTP_DOWNLOAD_END_UNKNOWN) {
+		WARN("Connection closed at offset %" PRIu64 " before offset %" PRIu64 " (%s)",
+		     conn->pos, conn->end, conn->dl->url);
+		return HTTP_DOWNLOAD_FAILED;
+	}
+	conn->dl->total = conn->pos;
+	return http_download_conn_done(conn);
+}
+
+static http_download_state_t
+http_download_conn_send(http_download_conn_t *conn)
+{
+	if (!conn->connected) {
+		int err = 0;
+		socklen_t err_len = sizeof(err);
+		if (getsockopt(conn->sock, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0)
+			err = errno;
+		if (err) {
+			errno = err;
+			WARN_ERRNO("Could not connect to %s", conn->dl->hostport);
+			return HTTP_DOWNLOAD_FAILED;
+		}
+		conn->connected = true;
+	}
+
+	ssize_t n = send(conn->sock, conn->req + conn->req_off, conn->req_len - conn->req_off,
+			 MSG_NOSIGNAL);
+	if (n < 0) {
+		IF_TRUE_RETVAL(errno == EAGAIN || errno == EINTR, HTTP_DOWNLOAD_CONTINUE);
+		WARN_ERRNO("Could not send request for %s", conn->dl->url);
+		return HTTP_DOWNLOAD_FAILED;
+	}
+	conn->req_off += n;
+	if (conn->req_off == conn->req_len)
+		event_modify_io(conn->io, EVENT_IO_READ);
+
+	return HTTP_DOWNLOAD_CONTINUE;
+}
+
+/******************************************************************************/
+
+/*
+ * Stops all activity of the download. On failure, the file is truncated to
+ * its prefix which has been written completely.
+ */
+static void
+http_download_stop(http_download_t *dl, bool success)
+{
+	IF_FALSE_RETURN(dl->running);
+
+	uint64_t prefix = 0;
+	bool have_prefix = false;
+	for (unsigned int i = 0; i < dl->n_conns; i++) {
+		http_download_conn_t *conn = dl->conns[i];
+		if (!conn)
+			continue;
+		if (!have_prefix) {
+			prefix = conn->pos;
+			have_prefix = true;
+		}
+		http_download_conn_close(conn);
+		dl->conns[i] = NULL;
+	}
+	dl->n_conns = 0;
+	dl->n_done = 0;
+
+	if (!success && dl->split && have_prefix && ftruncate(dl->fd, prefix) < 0)
+		WARN_ERRNO("Could not truncate %s", dl->file);
+	if (file_exists(dl->marker) && unlink(dl->marker) < 0)
+		WARN_ERRNO("Could not remove %s", dl->marker);
+
+	event_remove_timer(dl->watchdog);
+	event_timer_free(dl->watchdog);
+	dl->watchdog = NULL;
+
+	close(dl->fd);
+	dl->fd = -1;
+	dl->running = false;
+}
+
+static void
+http_download_finish(http_download_t *dl, bool success)
+{
+	if (success) {
+		http_download_report_progress(dl, true);
+		INFO("Downloaded %s (%" PRIu64 " bytes, resumed at %" PRIu64 ")", dl->url,
+		     dl->received, dl->resume_offset);
+	}
+	http_download_stop(dl, success);
+
+	// the callback may free the download
+	dl->on_complete(dl, success, dl->data);
+}
+
+static void
+http_download_conn_cb(UNUSED int fd, unsigned events, UNUSED event_io_t *io, void *data)
+{
+	http_download_conn_t *conn = data;
+	// the connection may have been closed while this event was pending
+	IF_TRUE_RETURN(conn->closed);
+
+	http_download_t *dl = conn->dl;
+	dl->last_activity_ms = http_download_now_ms();
+
+	http_download_state_t state;
+	if (conn->req_off < conn->req_len) {
+		state = (events & EVENT_IO_WRITE || events & EVENT_IO_EXCEPT) ?
+				http_download_conn_send(conn) :
+				HTTP_DOWNLOAD_CONTINUE;
+	} else {
+		state = http_download_conn_recv(conn);
+	}
+
+	if (state != HTTP_DOWNLOAD_CONTINUE)
+		http_download_finish(dl, state == HTTP_DOWNLOAD_COMPLETE);
+}
+
+static void
+http_download_watchdog_cb(UNUSED event_timer_t *timer, void *data)
+{
+	http_download_t *dl = data;
+	if (http_download_now_ms() - dl->last_activity_ms < HTTP_DOWNLOAD_TIMEOUT_MS)
+		return;
+
+	WARN("Download of %s timed out", dl->url);
+	http_download_finish(dl, false);
+}
+
+/******************************************************************************/
+
+bool
+http_download_url_is_supported(const char *url)
+{
+	IF_NULL_RETVAL(url, false);
+	return !strncasecmp(url, HTTP_DOWNLOAD_URL_PREFIX, strlen(HTTP_DOWNLOAD_URL_PREFIX));
+}
+
+http_download_t *
+http_download_new(const char *url, const char *file, unsigned int ranges,
+		  http_download_complete_cb_t on_complete, http_download_progress_cb_t on_progress,
+		  void *data)
+{
+	ASSERT(file);
+	ASSERT(on_complete);
+
+	http_download_t *dl = mem_new0(http_download_t, 1);
+	if (http_download_set_url(dl, url) < 0) {
+		mem_free0(dl);
+		return NULL;
+	}
+	dl->file = mem_strdup(file);
+	dl->marker = mem_printf("%s%s", file, HTTP_DOWNLOAD_MARKER_SUFFIX);
+	dl->ranges = MAX(ranges, 1);
+	dl->conns = mem_new0(http_download_conn_t *, dl->ranges);
+	dl->on_complete = on_complete;
+	dl->on_progress = on_progress;
+	dl->data = data;
+	dl->fd = -1;
+	return dl;
+}
+
+void
+http_download_free(http_download_t *dl)
+{
+	IF_NULL_RETURN(dl);
+
+	http_download_stop(dl, false);
+	mem_free0(dl->conns);
+	mem_free0(dl->url);
+	mem_free0(dl->host);
+	mem_free0(dl->port);
+	mem_free0(dl->hostport);
+	mem_free0(dl->path);
+	mem_free0(dl->file);
+	mem_free0(dl->marker);
+	mem_free0(dl);
+}
+
+int
+http_download_start(http_download_t *dl, bool resume)
+{
+	ASSERT(dl);
+	IF_TRUE_RETVAL(dl->running, -1);
+
+	// a file with several ranges in progress may contain holes
+	if (file_exists(dl->marker)) {
+		DEBUG("Found %s, restarting download of %s", dl->marker, dl->file);
+		resume = false;
+		if (unlink(dl->marker) < 0)
+			WARN_ERRNO("Could not remove %s", dl->marker);
+	}
+
+	dl->fd = open(dl->file, O_WRONLY | O_CREAT | O_CLOEXEC | (resume ? 0 : O_TRUNC), 00666);
+	if (dl->fd < 0) {
+		WARN_ERRNO("Could not open %s", dl->file);
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(dl->fd, &st) < 0) {
+		WARN_ERRNO("Could not stat %s", dl->file);
+		close(dl->fd);
+		dl->fd = -1;
+		return -1;
+	}
+
+	dl->resume_offset = st.st_size;
+	dl->received = st.st_size;
+	dl->total = 0;
+	dl->split = false;
+	dl->redirects = 0;
+	dl->redirect_unsupported = false;
+
+	http_download_conn_t *conn =
+		http_download_conn_new(dl, dl->resume_offset, HTTP_DOWNLOAD_END_UNKNOWN);
+	if (!conn) {
+		close(dl->fd);
+		dl->fd = -1;
+		return -1;
+	}
+	dl->conns[0] = conn;
+	dl->n_conns = 1;
+
+	dl->last_activity_ms = http_download_now_ms();
+	dl->last_progress_ms = dl->last_activity_ms;
+	dl->watchdog = event_timer_new(HTTP_DOWNLOAD_WATCHDOG_MS, EVENT_TIMER_REPEAT_FOREVER,
+				       http_download_watchdog_cb, dl);
+	event_add_timer(dl->watchdog);
+	dl->running = true;
+
+	if (dl->resume_offset > 0)
+		INFO("Resuming download of %s at offset %" PRIu64, dl->url, dl->resume_offset);
+	else
+		INFO("Downloading %s to %s", dl->url, dl->file);
+	return 0;
+}
+
+uint64_t
+http_download_get_resume_offset(const http_download_t *dl)
+{
+	ASSERT(dl);
+	return dl->resume_offset;
+}
+
+bool
+http_download_is_redirect_unsupported(const http_download_t *dl)
+{
+	ASSERT(dl);
+	return dl->redirect_unsupported;
+}
@@ -0,0 +1,122 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file http_download.h
+ *
+ * Minimal HTTP/1.1 client which downloads a file over non-blocking sockets
+ * driven by the event loop, so that any number of downloads run concurrently
+ * inside the calling process.
+ *
+ * An existing partial file is resumed with a Range request. Large files may be
+ * fetched over several connections, each one writing its own byte range of the
+ * file. While such a download is in progress, a marker file <file>.ranges
+ * exists, since the file may contain holes; if the marker is found on start,
+ * the download is restarted from the beginning. If a download with several
+ * ranges fails, the file is truncated to its completely written prefix, which
+ * is resumed by the next attempt.
+ *
+ * Only plain http:// URLs are supported, responses must not use a chunked
+ * transfer encoding. Redirects to http:// URLs are followed, a redirect to any
+ * other URL, e.g., https://, fails the download, so that the caller may fall
+ * back to another download method. Host names are resolved by worker threads.
+ */
+
+#ifndef HTTP_DOWNLOAD_H
+#define HTTP_DOWNLOAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct http_download http_download_t;
+
+/**
+ * Callback type for functions called after a download has been completed or has failed.
+ */
+typedef void (*http_download_complete_cb_t)(http_download_t *dl, bool success, void *data);
+
+/**
+ * Callback type for functions called to report the progress of a download.
+ * @param received number of bytes of the file already present, including a resumed part
+ * @param total size of the file or 0 if not known (yet)
+ */
+typedef void (*http_download_progress_cb_t)(http_download_t *dl, uint64_t received,
+					    uint64_t total, void *data);
+
+/**
+ * Returns true if the given URL can be downloaded by this module.
+ */
+bool
+http_download_url_is_supported(const char *url);
+
+/**
+ * Instantiates a new download from the given URL to the given file.
+ *
+ * @param url the http:// URL to download from
+ * @param file the file to download to
+ * @param ranges the maximum number of connections used to download parts of the file in parallel
+ * @param on_complete the callback to call after the download is finished or has failed
+ * @param on_progress the callback to report the progress or NULL
+ * @param data custom parameter passed to the callbacks
+ * @return the download instance or NULL if the URL is not supported
+ */
+http_download_t *
+http_download_new(const char *url, const char *file, unsigned int ranges,
+		  http_download_complete_cb_t on_complete, http_download_progress_cb_t on_progress,
+		  void *data);
+
+/**
+ * Frees the given download instance, a download still in progress is aborted
+ * without calling the completion callback.
+ */
+void
+http_download_free(http_download_t *dl);
+
+/**
+ * Starts the given download. An existing file is resumed, unless resume is false.
+ * @return 0 if the download has been started, -1 otherwise
+ */
+int
+http_download_start(http_download_t *dl, bool resume);
+
+/**
+ * Returns the offset from which the download has been resumed, 0 if it started from scratch.
+ */
+uint64_t
+http_download_get_resume_offset(const http_download_t *dl);
+
+/**
+ * Returns true if the download has failed because the server redirected it to
+ * a URL which is not supported by this module.
+ */
+bool
+http_download_is_redirect_unsupported(const http_download_t *dl);
+
+/**
+ * Limits the bandwidth used by all downloads together.
+ * @param bytes_per_sec the limit in bytes per second, 0 for no limit
+ */
+void
+http_download_set_rate_limit(uint64_t bytes_per_sec);
+
+#endif /* HTTP_DOWNLOAD_H */
@@ -0,0 +1,530 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+#include "munit.h"
+
+#include "http_download.h"
+#include "event.h"
+#include "file.h"
+#include "logf.h"
+#include "macro.h"
+#include "mem.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEST_HTTP_BUF_SIZE (64 * 1024)
+
+typedef struct {
+	char dir[64];
+	char *file;
+	char *conn_log; // the server appends one byte per connection
+	pid_t server;
+	int port;
+	uint64_t size;
+	bool ranges;
+	// result
+	bool complete;
+	bool success;
+	uint64_t progress_received;
+	uint64_t progress_total;
+} test_http_t;
+
+static test_http_t test_http;
+
+static uint8_t
+test_http_byte(uint64_t i)
+{
+	return (i * 7 + i / 4096) & 0xff;
+}
+
+static void
+test_http_write_all(int sock, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	while (len > 0) {
+		ssize_t n = write(sock, p, len);
+		if (n <= 0)
+			_exit(0); // the client closed the connection
+		p += n;
+		len -= n;
+	}
+}
+
+static void
+test_http_handle(int sock)
+{
+	char req[4096] = { 0 };
+	size_t len = 0;
+	while (!strstr(req, "\r\n\r\n") && len < sizeof(req) - 1) {
+		ssize_t n = read(sock, req + len, sizeof(req) - 1 - len);
+		if (n <= 0)
+			return;
+		len += n;
+	}
+
+	int log = open(test_http.conn_log, O_WRONLY | O_APPEND | O_CREAT, 0600);
+	if (log >= 0) {
+		test_http_write_all(log, "c", 1);
+		close(log);
+	}
+
+	char path[256] = { 0 };
+	sscanf(req, "GET %255s", path);
+
+	char hdr[512];
+	if (!strcmp(path, "/redirect")) {
+		snprintf(hdr, sizeof(hdr),
+			 "HTTP/1.1 302 Found\r\nLocation: http://127.0.0.1:%d/file\r\n"
+			 "Content-Length: 0\r\n\r\n",
+			 test_http.port);
+		test_http_write_all(sock, hdr, strlen(hdr));
+		return;
+	}
+	if (!strcmp(path, "/redirect_https")) {
+		snprintf(hdr, sizeof(hdr),
+			 "HTTP/1.1 301 Moved Permanently\r\nLocation: https://127.0.0.1:%d/file\r\n"
+			 "Content-Length: 0\r\n\r\n",
+			 test_http.port);
+		test_http_write_all(sock, hdr, strlen(hdr));
+		return;
+	}
+	if (strcmp(path, "/file")) {
+		snprintf(hdr, sizeof(hdr), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+		test_http_write_all(sock, hdr, strlen(hdr));
+		return;
+	}
+
+	uint64_t first = 0, last = test_http.size - 1;
+	const char *range = strstr(req, "Range: bytes=");
+	if (range && test_http.ranges) {
+		int n = sscanf(range, "Range: bytes=%" SCNu64 "-%" SCNu64, &first, &last);
+		if (n < 2)
+			last = test_http.size - 1;
+		if (first >= test_http.size) {
+			snprintf(hdr, sizeof(hdr),
+				 "HTTP/1.1 416 Range Not Satisfiable\r\n"
+				 "Content-Range: bytes */%" PRIu64 "\r\nContent-Length: 0\r\n\r\n",
+				 test_http.size);
+			test_http_write_all(sock, hdr, strlen(hdr));
+			return;
+		}
+		snprintf(hdr, sizeof(hdr),
+			 "HTTP/1.1 206 Partial Content\r\n"
+			 "Content-Range: bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64 "\r\n"
+			 "Content-Length: %" PRIu64 "\r\n\r\n",
+			 first, last, test_http.size, last - first + 1);
+	} else {
+		snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Length: %" PRIu64 "\r\n\r\n",
+			 test_http.size);
+	}
+	test_http_write_all(sock, hdr, strlen(hdr));
+
+	static uint8_t buf[TEST_HTTP_BUF_SIZE];
+	for (uint64_t off = first; off <= last;) {
+		size_t n = MIN((uint64_t)sizeof(buf), last + 1 - off);
+		for (size_t i = 0; i < n; i++)
+			buf[i] = test_http_byte(off + i);
+		test_http_write_all(sock, buf, n);
+		off += n;
+	}
+}
+
+static void
+test_http_server_start(uint64_t size, bool ranges)
+{
+	test_http.size = size;
+	test_http.ranges = ranges;
+
+	int lsock = socket(AF_INET, SOCK_STREAM, 0);
+	munit_assert_int(lsock, >=, 0);
+	struct sockaddr_in addr = { .sin_family = AF_INET,
+				    .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+	socklen_t addr_len = sizeof(addr);
+	munit_assert_int(bind(lsock, (struct sockaddr *)&addr, sizeof(addr)), ==, 0);
+	munit_assert_int(listen(lsock, 16), ==, 0);
+	munit_assert_int(getsockname(lsock, (struct sockaddr *)&addr, &addr_len), ==, 0);
+	test_http.port = ntohs(addr.sin_port);
+
+	test_http.server = fork();
+	munit_assert_int(test_http.server, >=, 0);
+	if (test_http.server == 0) {
+		signal(SIGCHLD, SIG_IGN);
+		signal(SIGPIPE, SIG_IGN);
+		for (;;) {
+			int sock = accept(lsock, NULL, NULL);
+			if (sock < 0)
+				continue;
+			if (fork() == 0) {
+				close(lsock);
+				test_http_handle(sock);
+				_exit(0);
+			}
+			close(sock);
+		}
+	}
+	close(lsock);
+}
+
+static char *
+test_http_url_new(const char *path)
+{
+	return mem_printf("http://127.0.0.1:%d%s", test_http.port, path);
+}
+
+static void
+test_http_write_prefix(uint64_t len, bool garbage)
+{
+	FILE *f = fopen(test_http.file, "w");
+	munit_assert_not_null(f);
+	for (uint64_t i = 0; i < len; i++)
+		fputc(garbage ? ~test_http_byte(i) : test_http_byte(i), f);
+	fclose(f);
+}
+
+static void
+test_http_assert_file(void)
+{
+	FILE *f = fopen(test_http.file, "r");
+	munit_assert_not_null(f);
+	uint64_t i = 0;
+	int c;
+	while ((c = fgetc(f)) != EOF) {
+		munit_assert_uint64(i, <, test_http.size);
+		munit_assert_uint8(c, ==, test_http_byte(i));
+		i++;
+	}
+	fclose(f);
+	munit_assert_uint64(i, ==, test_http.size);
+}
+
+static off_t
+test_http_conn_count(void)
+{
+	struct stat st;
+	return stat(test_http.conn_log, &st) ? 0 : st.st_size;
+}
+
+static void
+test_http_complete_cb(UNUSED http_download_t *dl, bool success, UNUSED void *data)
+{
+	test_http.complete = true;
+	test_http.success = success;
+}
+
+static void
+test_http_progress_cb(UNUSED http_download_t *dl, uint64_t received, uint64_t total,
+		      UNUSED void *data)
+{
+	munit_assert_uint64(received, >=, test_http.progress_received);
+	test_http.progress_received = received;
+	test_http.progress_total = total;
+}
+
+/*
+ * Runs the given download until it has completed and returns whether it succeeded.
+ */
+static bool
+test_http_download(const char *path, unsigned int ranges, bool resume, uint64_t *resume_offset)
+{
+	char *url = test_http_url_new(path);
+	http_download_t *dl = http_download_new(url, test_http.file, ranges, test_http_complete_cb,
+						test_http_progress_cb, NULL);
+	munit_assert_not_null(dl);
+	mem_free0(url);
+
+	test_http.complete = false;
+	test_http.success = false;
+	test_http.progress_received = 0;
+	munit_assert_int(http_download_start(dl, resume), ==, 0);
+	if (resume_offset)
+		*resume_offset = http_download_get_resume_offset(dl);
+
+	event_loop();
+	munit_assert_true(test_http.complete);
+
+	http_download_free(dl);
+	return test_http.success;
+}
+
+static void *
+setup(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	logf_register(&logf_test_write, stderr);
+	event_init();
+
+	mem_memset(&test_http, 0, sizeof(test_http));
+	strcpy(test_http.dir, "/tmp/http_download.test.XXXXXX");
+	munit_assert_not_null(mkdtemp(test_http.dir));
+	test_http.file = mem_printf("%s/image", test_http.dir);
+	test_http.conn_log = mem_printf("%s/conns", test_http.dir);
+	return NULL;
+}
+
+static void
+tear_down(UNUSED void *fixture)
+{
+	if (test_http.server > 0) {
+		kill(test_http.server, SIGKILL);
+		waitpid(test_http.server, NULL, 0);
+	}
+	http_download_set_rate_limit(0);
+	event_reset();
+
+	unlink(test_http.file);
+	unlink(test_http.conn_log);
+	rmdir(test_http.dir);
+	mem_free0(test_http.file);
+	mem_free0(test_http.conn_log);
+}
+
+static MunitResult
+test_http_download_full(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	test_http_server_start(1000 * 1000, true);
+
+	munit_assert_true(test_http_download("/file", 1, true, NULL));
+	test_http_assert_file();
+	munit_assert_uint64(test_http.progress_received, ==, test_http.size);
+	munit_assert_uint64(test_http.progress_total, ==, test_http.size);
+	munit_assert_int(test_http_conn_count(), ==, 1);
+
+	// an existing file is overwritten if resuming is not requested
+	test_http_write_prefix(1234, true);
+	munit_assert_true(test_http_download("/file", 1, false, NULL));
+	test_http_assert_file();
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_http_download_resume(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	uint64_t resume_offset = 0;
+	test_http_server_start(1000 * 1000, true);
+
+	test_http_write_prefix(300 * 1000, false);
+	munit_assert_true(test_http_download("/file", 1, true, &resume_offset));
+	munit_assert_uint64(resume_offset, ==, 300 * 1000);
+	test_http_assert_file();
+
+	// resuming a complete file succeeds without transferring anything
+	munit_assert_true(test_http_download("/file", 1, true, &resume_offset));
+	munit_assert_uint64(resume_offset, ==, test_http.size);
+	test_http_assert_file();
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_http_download_resume_unsupported(UNUSED const MunitParameter params[],
+				      UNUSED void *data)
+{
+	test_http_server_start(1000 * 1000, false);
+
+	// the server sends the whole file, which replaces the partial one
+	test_http_write_prefix(300 * 1000, true);
+	munit_assert_true(test_http_download("/file", 4, true, NULL));
+	test_http_assert_file();
+	munit_assert_int(test_http_conn_count(), ==, 1);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_http_download_ranges(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	test_http_server_start(17 * 1000 * 1000 + 17, true);
+
+	munit_assert_true(test_http_download("/file", 3, true, NULL));
+	test_http_assert_file();
+	munit_assert_int(test_http_conn_count(), ==, 3);
+
+	char *marker = mem_printf("%s.ranges", test_http.file);
+	munit_assert_false(file_exists(marker));
+
+	// a leftover marker means the file may contain holes, so it is not resumed
+	test_http_write_prefix(5 * 1000 * 1000, true);
+	munit_assert_int(file_touch(marker), ==, 0);
+	munit_assert_true(test_http_download("/file", 1, true, NULL));
+	test_http_assert_file();
+	munit_assert_false(file_exists(marker));
+	mem_free0(marker);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_http_download_redirect(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	test_http_server_start(4096, true);
+
+	munit_assert_true(test_http_download("/redirect", 1, true, NULL));
+	test_http_assert_file();
+	munit_assert_int(test_http_conn_count(), ==, 2);
+
+	// a redirect to https:// is left to the caller
+	char *url = test_http_url_new("/redirect_https");
+	http_download_t *dl = http_download_new(url, test_http.file, 1, test_http_complete_cb,
+						NULL, NULL);
+	mem_free0(url);
+	test_http.complete = false;
+	munit_assert_int(http_download_start(dl, false), ==, 0);
+	munit_assert_false(http_download_is_redirect_unsupported(dl));
+	event_loop();
+	munit_assert_true(test_http.complete);
+	munit_assert_false(test_http.success);
+	munit_assert_true(http_download_is_redirect_unsupported(dl));
+	http_download_free(dl);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_http_download_not_found(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	test_http_server_start(4096, true);
+
+	munit_assert_false(test_http_download("/missing", 1, true, NULL));
+
+	// no server listening
+	kill(test_http.server, SIGKILL);
+	waitpid(test_http.server, NULL, 0);
+	test_http.server = 0;
+	char *url = test_http_url_new("/file");
+	http_download_t *dl = http_download_new(url, test_http.file, 1, test_http_complete_cb,
+						NULL, NULL);
+	mem_free0(url);
+	test_http.complete = false;
+	if (http_download_start(dl, true) == 0) {
+		event_loop();
+		munit_assert_true(test_http.complete);
+		munit_assert_false(test_http.success);
+	}
+	http_download_free(dl);
+
+	munit_assert_null(http_download_new("https://127.0.0.1/file", test_http.file, 1,
+					    test_http_complete_cb, NULL, NULL));
+	munit_assert_false(http_download_url_is_supported("file:///tmp/file"));
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_http_download_rate_limit(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	test_http_server_start(400 * 1024, true);
+	http_download_set_rate_limit(1024 * 1024);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	munit_assert_true(test_http_download("/file", 1, true, NULL));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	test_http_assert_file();
+
+	long ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+	munit_assert_long(ms, >=, 300);
+
+	return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+	{
+		"/full",		 /* name */
+		test_http_download_full, /* test */
+		setup,			 /* setup */
+		tear_down,		 /* tear_down */
+		MUNIT_TEST_OPTION_NONE,	 /* options */
+		NULL			 /* parameters */
+	},
+	{
+		"/resume",		   /* name */
+		test_http_download_resume, /* test */
+		setup,			   /* setup */
+		tear_down,		   /* tear_down */
+		MUNIT_TEST_OPTION_NONE,	   /* options */
+		NULL			   /* parameters */
+	},
+	{
+		"/resume unsupported",		       /* name */
+		test_http_download_resume_unsupported, /* test */
+		setup,				       /* setup */
+		tear_down,			       /* tear_down */
+		MUNIT_TEST_OPTION_NONE,		       /* options */
+		NULL				       /* parameters */
+	},
+	{
+		"/ranges",		   /* name */
+		test_http_download_ranges, /* test */
+		setup,			   /* setup */
+		tear_down,		   /* tear_down */
+		MUNIT_TEST_OPTION_NONE,	   /* options */
+		NULL			   /* parameters */
+	},
+	{
+		"/redirect",		     /* name */
+		test_http_download_redirect, /* test */
+		setup,			     /* setup */
+		tear_down,		     /* tear_down */
+		MUNIT_TEST_OPTION_NONE,	     /* options */
+		NULL			     /* parameters */
+	},
+	{
+		"/not found",		      /* name */
+		test_http_download_not_found, /* test */
+		setup,			      /* setup */
+		tear_down,		      /* tear_down */
+		MUNIT_TEST_OPTION_NONE,	      /* options */
+		NULL			      /* parameters */
+	},
+	{
+		"/rate limit",		       /* name */
+		test_http_download_rate_limit, /* test */
+		setup,			       /* setup */
+		tear_down,		       /* tear_down */
+		MUNIT_TEST_OPTION_NONE,	       /* options */
+		NULL			       /* parameters */
+	},
+
+	// Mark the end of the array with an entry where the test function is NULL
+	{ NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite http_download_suite = {
+	"/http_download",	/* name */
+	tests,			/* tests */
+	NULL,			/* suites */
+	1,			/* iterations */
+	MUNIT_SUITE_OPTION_NONE /* options */
+};
@@ -36,6 +36,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/limits.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -226,21 +227,70 @@ logf_message_file_hexdump(logf_prio_t prio, const char *file, int line, const vo
 
 static list_t *logf_handler_list = NULL;
 
+/*
+ * Serializes the handler list and the handlers themselves between threads
+ * (e.g. threadpool workers). The mutex is recursive since handlers such as
+ * logf_file_write may log themselves.
+ */
+static pthread_mutex_t logf_mutex;
+static pthread_once_t logf_mutex_once = PTHREAD_ONCE_INIT;
+
 struct logf_handler {
 	void (*func)(logf_prio_t prio, const char *msg, void *data);
 	void *data;
 	logf_prio_t prio;
 };
 
+static void
+logf_lock(void)
+{
+	pthread_mutex_lock(&logf_mutex);
+}
+
+static void
+logf_unlock(void)
+{
+	pthread_mutex_unlock(&logf_mutex);
+}
+
+static void
+logf_mutex_create(void)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&logf_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+static void
+logf_mutex_init(void)
+{
+	logf_mutex_create();
+
+	/*
+	 * Never let a forked child inherit the mutex held by another thread.
+	 * The child cannot unlock it, since the owner of a recursive mutex is the
+	 * thread id of the parent, thus it gets a fresh one.
+	 */
+	pthread_atfork(logf_lock, logf_unlock, logf_mutex_create);
+}
+
 void
 logf_write(logf_prio_t prio, const char *msg)
 {
+	pthread_once(&logf_mutex_once, logf_mutex_init);
+	logf_lock();
+
 	for (list_t *l = logf_handler_list; l; l = l->next) {
 		logf_handler_t *h = l->data;
 		if (h && h->func && prio >= h->prio) {
 			(h->func)(prio, msg, h->data);
 		}
 	}
+
+	logf_unlock();
 }
 
 logf_handler_t *
@@ -252,7 +302,10 @@ logf_register(void (*func)(logf_prio_t prio, const char *msg, void *data), void
 	handler->data = data;
 	handler->prio = LOGF_PRIO_TRACE;
 
+	pthread_once(&logf_mutex_once, logf_mutex_init);
+	logf_lock();
 	logf_handler_list = list_append(logf_handler_list, handler);
+	logf_unlock();
 
 	return handler;
 }
@@ -261,7 +314,11 @@ void
 logf_unregister(logf_handler_t *handler)
 {
 	IF_NULL_RETURN(handler);
+
+	pthread_once(&logf_mutex_once, logf_mutex_init);
+	logf_lock();
 	logf_handler_list = list_remove(logf_handler_list, handler);
+	logf_unlock();
 
 	mem_free0(handler);
 }
@@ -327,19 +384,25 @@ logf_get_current_log_files_new(const char *path)
 	return current_log_files;
 }
 
-int
-logf_lock_apply(const char *path)
+static int
+logf_lock_apply_op(const char *path, int op)
 {
 	char *file_path = mem_printf("%s/%s", path, ".lock-delete-old");
+	int err = 0;
 
 	int lock_fd = open(file_path, O_RDONLY | O_CREAT, 0644);
 	if (lock_fd < 0) {
+		err = errno;
 		ERROR_ERRNO("Failed to open %s", file_path);
 		lock_fd = -1;
 		goto out;
 	}
-	if (flock(lock_fd, LOCK_EX) < 0) {
-		ERROR_ERRNO("Failed to get lock on %s", file_path);
+	if (flock(lock_fd, op) < 0) {
+		err = errno;
+		if (err == EWOULDBLOCK)
+			DEBUG("Lock on %s is held by someone else", file_path);
+		else
+			ERROR_ERRNO("Failed to get lock on %s", file_path);
 		close(lock_fd);
 		lock_fd = -1;
 		goto out;
@@ -347,9 +410,22 @@ logf_lock_apply(const char *path)
 
 out:
 	mem_free0(file_path);
+	errno = err;
 	return lock_fd;
 }
 
+int
+logf_lock_apply(const char *path)
+{
+	return logf_lock_apply_op(path, LOCK_EX);
+}
+
+int
+logf_lock_try_apply(const char *path)
+{
+	return logf_lock_apply_op(path, LOCK_EX | LOCK_NB);
+}
+
 int
 logf_lock_release(const char *path, int lock_fd)
 {
@@ -361,6 +361,15 @@ logf_get_current_log_files_new(const char *path);
 int
 logf_lock_apply(const char *path);
 
+/**
+ * Apply the lock to the log folder without waiting for it.
+ * @param path The path to the log folder
+ * @return the fd holding the lock, or -1 with errno set to EWOULDBLOCK
+ *         if the lock is held by someone else, or -1 on any other error
+ */
+int
+logf_lock_try_apply(const char *path);
+
 /**
  * Release the lock to the log folder.
  * @param path The path to the log folder
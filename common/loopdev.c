@@ -28,11 +28,15 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/sysmacros.h>
 
 #include "loopdev.h"
 
 #include "macro.h"
 #include "mem.h"
+#include "file.h"
 
 #ifndef LOOP_CTL_GET_FREE
 #define LOOP_CTL_GET_FREE 0x4C82
@@ -49,6 +53,8 @@
 #define SECTOR_SHIFT 9
 #define SECTOR_SIZE (1 << SECTOR_SHIFT)
 
+#define LOOPDEV_POOL_MAX 32U
+
 /**
  * Get a free loop device.
  * @return The path of the loop device or NULL in case of an error.
@@ -91,24 +97,116 @@ loopdev_new(void)
 	return mem_strdup(dev);
 }
 
+/**
+ * Checks whether the existing loop device with the given index has a backing file.
+ */
+static bool
+loopdev_is_bound(int i)
+{
+	char *path = mem_printf("/sys/block/loop%d/loop/backing_file", i);
+	bool bound = file_exists(path);
+	mem_free0(path);
+	return bound;
+}
+
+/*
+ * Returns the logical block size of the block device the image file resides
+ * on, or 0 if it cannot be determined, e.g., for virtual file systems.
+ */
+static unsigned int
+loopdev_get_backing_block_size(int img_fd)
+{
+	struct stat st;
+	unsigned int block_size = 0;
+
+	if (fstat(img_fd, &st) < 0 || major(st.st_dev) == 0)
+		return 0;
+
+	// partitions do not have a queue directory of their own
+	for (int parent = 0; parent < 2 && !block_size; parent++) {
+		char *path = mem_printf("/sys/dev/block/%u:%u/%squeue/logical_block_size",
+					major(st.st_dev), minor(st.st_dev), parent ? "../" : "");
+		char *val = file_read_new(path, 16);
+		if (val && sscanf(val, "%u", &block_size) != 1)
+			block_size = 0;
+		mem_free0(val);
+		mem_free0(path);
+	}
+	TRACE("Logical block size of backing device: %u", block_size);
+	return block_size;
+}
+
+/*
+ * Sets up the loop device with separate ioctls for kernels which do not
+ * support LOOP_CONFIGURE.
+ */
+static int
+loopdev_setup_legacy(int loop_fd, const char *loop_dev, const struct loop_config *config)
+{
+	struct loop_info64 info;
+
+	if (config->block_size > SECTOR_SIZE) {
+		ioctl(loop_fd, LOOP_SET_BLOCK_SIZE, (unsigned long)config->block_size);
+	}
+
+	memcpy(&info, &config->info, sizeof(info));
+	info.lo_flags &= ~(LO_FLAGS_DIRECT_IO | LO_FLAGS_READ_ONLY);
+	if (ioctl(loop_fd, LOOP_SET_STATUS64, &info) < 0) {
+		ERROR_ERRNO("Failed to set AUTOCLEAR for loop device %s", loop_dev);
+		return -1;
+	}
+
+	if ((config->info.lo_flags & LO_FLAGS_DIRECT_IO) &&
+	    ioctl(loop_fd, LOOP_SET_DIRECT_IO, 1UL) < 0)
+		DEBUG_ERRNO("Could not enable direct I/O for loop device %s", loop_dev);
+
+	return 0;
+}
+
+/*
+ * LOOP_CONFIGURE is available since kernel 5.8, older kernels reject it as an
+ * unknown loop ioctl with EINVAL. As EINVAL may also be caused by a specific
+ * configuration, it only tells that LOOP_CONFIGURE is unsupported as long as
+ * it has never succeeded. 0 if unknown yet, 1 if supported, -1 if not. Images
+ * are prepared from several threads concurrently, thus it is accessed atomically.
+ */
+static int loopdev_configure_support = 0;
+
 char *
 loopdev_create_new(int *loop_fd, const char *img, int readonly, size_t blocksize)
 {
+	struct loop_config config;
+	mem_memset(&config, 0, sizeof(config));
 	struct loop_info64 info;
-	mem_memset(&info, 0, sizeof(info));
 	int img_fd;
 	char *loop_dev = NULL;
 
+	*loop_fd = -1;
+
 	img_fd = open(img, (readonly ? O_RDONLY : O_RDWR) | O_EXCL);
 	if (img_fd < 0) {
 		ERROR_ERRNO("Could not open image file %s with readonly = %d", img, readonly);
 		goto error;
 	}
 
+	config.fd = img_fd;
+	config.block_size = blocksize > SECTOR_SIZE ? blocksize : 0;
 	// Set file name
-	strncpy((char *)info.lo_file_name, img, sizeof(info.lo_file_name) - 1);
+	strncpy((char *)config.info.lo_file_name, img, sizeof(config.info.lo_file_name) - 1);
 	// Do not require detach after umount
-	info.lo_flags |= LO_FLAGS_AUTOCLEAR;
+	config.info.lo_flags = LO_FLAGS_AUTOCLEAR;
+	if (readonly)
+		config.info.lo_flags |= LO_FLAGS_READ_ONLY;
+
+	/*
+	 * Bypass the page cache for the image file to avoid caching its data twice.
+	 * Direct I/O requires the block size of the loop device to be a multiple of
+	 * the logical block size of the backing device. As the block size must not
+	 * change under an existing file system, direct I/O is only used if this holds.
+	 */
+	unsigned int backing_block_size = loopdev_get_backing_block_size(img_fd);
+	if (backing_block_size > 0 && backing_block_size <= MAX(blocksize, SECTOR_SIZE))
+		config.info.lo_flags |= LO_FLAGS_DIRECT_IO;
 
 	do {
 		loop_dev = loopdev_new();
@@ -123,11 +221,39 @@ loopdev_create_new(int *loop_fd, const char *img, int readonly, size_t blocksize
 			goto error;
 		}
 
-		if (ioctl(*loop_fd, LOOP_SET_FD, img_fd) < 0) {
+		int ret = -1;
+		int support = __atomic_load_n(&loopdev_configure_support, __ATOMIC_RELAXED);
+		bool legacy = support < 0;
+		if (!legacy) {
+			ret = ioctl(*loop_fd, LOOP_CONFIGURE, &config);
+			if (ret == 0) {
+				__atomic_store_n(&loopdev_configure_support, 1, __ATOMIC_RELAXED);
+			} else if (errno == ENOTTY || (errno == EINVAL && support == 0)) {
+				DEBUG("LOOP_CONFIGURE unsupported, falling back to LOOP_SET_FD");
+				// unless it has succeeded for another image in the meantime
+				int expected = 0;
+				__atomic_compare_exchange_n(&loopdev_configure_support, &expected,
+							    -1, false, __ATOMIC_RELAXED,
+							    __ATOMIC_RELAXED);
+				legacy = true;
+			} else if (errno == EINVAL) {
+				// e.g., a configuration not supported for this image only
+				DEBUG_ERRNO("LOOP_CONFIGURE failed for %s, using LOOP_SET_FD", img);
+				legacy = true;
+			}
+		}
+		if (legacy) {
+			ret = ioctl(*loop_fd, LOOP_SET_FD, img_fd);
+			if (ret == 0 && loopdev_setup_legacy(*loop_fd, loop_dev, &config) < 0)
+				goto error;
+		}
+
+		if (ret < 0) {
 			if (errno != EBUSY) {
-				ERROR_ERRNO("LOOP_SET_FD ioctl failed");
+				ERROR_ERRNO("Could not set up loop device %s", loop_dev);
 				goto error;
 			}
+			// the loop device has been taken in the meantime
 			mem_free(loop_dev);
 			loop_dev = NULL;
 			close(*loop_fd);
@@ -135,17 +261,6 @@ loopdev_create_new(int *loop_fd, const char *img, int readonly, size_t blocksize
 		}
 	} while (*loop_fd < 0);
 
-	if (blocksize > SECTOR_SIZE) {
-		ioctl(*loop_fd, LOOP_SET_BLOCK_SIZE, (unsigned long)blocksize);
-	}
-
-	// TODO For kernel 5.8 and later, LOOP_CONFIGURE could be used instead
-	// (https://man7.org/linux/man-pages/man4/loop.4.html)
-	if (ioctl(*loop_fd, LOOP_SET_STATUS64, &info) < 0) {
-		ERROR_ERRNO("Failed to set AUTOCLEAR for loop device %s", loop_dev);
-		goto error;
-	}
-
 	mem_memset0(&info, sizeof(info));
 	if (ioctl(*loop_fd, LOOP_GET_STATUS64, &info) < 0) {
 		ERROR_ERRNO("Failed to get status64 for loop device %s", loop_dev);
@@ -157,6 +272,9 @@ loopdev_create_new(int *loop_fd, const char *img, int readonly, size_t blocksize
 		ERROR("Autoclear not successfully set");
 		goto error;
 	}
+	DEBUG("Set up loop device %s for %s (%s%s)", loop_dev, img,
+	      (info.lo_flags & LO_FLAGS_READ_ONLY) ? "read-only" : "read-write",
+	      (info.lo_flags & LO_FLAGS_DIRECT_IO) ? ", direct I/O" : "");
 
 	close(img_fd);
 	return loop_dev;
@@ -174,6 +292,46 @@ error:
 	return NULL;
 }
 
+void
+loopdev_pool_fill(unsigned int count)
+{
+	int fd, first;
+	unsigned int free_count = 0;
+
+	count = MIN(count, LOOPDEV_POOL_MAX);
+	IF_TRUE_RETURN(count == 0);
+
+	fd = open(LOOP_CONTROL, O_RDONLY);
+	if (fd < 0) {
+		WARN_ERRNO("Cannot open %s", LOOP_CONTROL);
+		return;
+	}
+
+	// the lowest free loop device, which is created if necessary
+	first = ioctl(fd, LOOP_CTL_GET_FREE);
+	if (first < 0) {
+		WARN_ERRNO("Cannot get free loop device");
+		goto out;
+	}
+	free_count++;
+
+	// create the following devices unless they exist, in which case they may be in use
+	for (int i = first + 1; free_count < count && i < first + 2 * (int)LOOPDEV_POOL_MAX;
+	     i++) {
+		if (ioctl(fd, LOOP_CTL_ADD, i) >= 0) {
+			free_count++;
+		} else if (errno != EEXIST) {
+			DEBUG_ERRNO("Cannot add loop device %d", i);
+			break;
+		} else if (!loopdev_is_bound(i)) {
+			free_count++;
+		}
+	}
+	DEBUG("%u free loop devices available from %s%d on", free_count, LOOP_DEV_PREFIX, first);
+out:
+	close(fd);
+}
+
 void
 loopdev_free(char *dev)
 {
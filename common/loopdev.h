@@ -34,6 +34,9 @@
 
 /**
  * Setup a loop device for an image file.
+ * The device is configured atomically with LOOP_CONFIGURE if the kernel
+ * supports it. Direct I/O is enabled if the block size of the backing device
+ * allows it, so that the data of the image is not cached twice.
  * @param loop_fd The file descriptor for the newly created loop device
  * @param img The path to an image file.
  * @param readonly 1 for readonly, 0 for read-write
@@ -45,6 +48,14 @@
 char *
 loopdev_create_new(int *loop_fd, const char *img, int readonly, size_t blocksize);
 
+/**
+ * Make sure that a number of free loop devices exist, so that they need not be
+ * created while setting up images, e.g., before mounting the images of a container.
+ * @param count The number of free loop devices, limited to a small maximum.
+ */
+void
+loopdev_pool_fill(unsigned int count);
+
 /**
  * Free the device path of a loop device.
  * @param dev The device string, e.g. /dev/loop0 as returned by loopdev_create_new().
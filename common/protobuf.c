@@ -23,18 +23,88 @@
 
 #include "protobuf.h"
 #include <errno.h>
+#include <inttypes.h>
+#include <string.h>
 
 //#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
 #include "macro.h"
 #include "mem.h"
 #include "fd.h"
 #include "file.h"
+#include "frame.h"
 
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 // TODO update naming scheme
 
+// pack buffers up to this size are kept for reuse by the next message
+#define PROTOBUF_PACK_BUF_KEEP (256 * 1024)
+
+/*
+ * Growable buffer for protobuf_c_message_pack_to_buffer(). One instance per
+ * thread is reused for all sends, as the packed data is either written out
+ * or copied into the connection's output queue before the send returns.
+ */
+typedef struct protobuf_pack_buf {
+	ProtobufCBuffer base;
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+} protobuf_pack_buf_t;
+
+static void
+protobuf_pack_buf_append(ProtobufCBuffer *buffer, size_t len, const uint8_t *data)
+{
+	protobuf_pack_buf_t *buf = (protobuf_pack_buf_t *)buffer;
+
+	if (buf->len + len > buf->cap) {
+		size_t cap = buf->cap ? buf->cap : 4096;
+		while (cap < buf->len + len)
+			cap *= 2;
+		buf->data = mem_renew(uint8_t, buf->data, cap);
+		buf->cap = cap;
+	}
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static __thread protobuf_pack_buf_t protobuf_pack_buf = {
+	.base = { .append = protobuf_pack_buf_append },
+};
+
+static uint8_t *
+protobuf_pack_message_reuse(const ProtobufCMessage *message, uint32_t *len)
+{
+	protobuf_pack_buf.len = 0;
+	*len = protobuf_c_message_pack_to_buffer(message, &protobuf_pack_buf.base);
+	ASSERT(*len == protobuf_pack_buf.len);
+
+	return protobuf_pack_buf.data;
+}
+
+static void
+protobuf_pack_message_release(void)
+{
+	// do not pin the memory of an exceptionally large message
+	if (protobuf_pack_buf.cap > PROTOBUF_PACK_BUF_KEEP) {
+		mem_free0(protobuf_pack_buf.data);
+		protobuf_pack_buf.cap = 0;
+	}
+	protobuf_pack_buf.len = 0;
+}
+
+static bool
+protobuf_fd_is_seqpacket(int fd)
+{
+	int type;
+	socklen_t type_len = sizeof(type);
+
+	return !getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_len) && type == SOCK_SEQPACKET;
+}
+
 uint32_t
 protobuf_pack_message_new(const ProtobufCMessage *message, uint8_t **ptr)
 {
@@ -61,27 +131,38 @@ protobuf_send_message_packed(int fd, const uint8_t *buf, uint32_t buflen)
 
 	IF_FALSE_RETVAL(buflen < PROTOBUF_MAX_MESSAGE_SIZE, -1);
 
-	ssize_t bytes_sent = fd_write(fd, (char *)&(uint32_t){ htonl(buflen) }, sizeof(uint32_t));
-	if (-1 == bytes_sent)
-		goto error_write;
-	TRACE("sent protobuf message length (%zd bytes sent, %zu bytes expected, len=%d)",
-	      bytes_sent, sizeof(uint32_t), buflen);
-	ASSERT((size_t)bytes_sent == sizeof(uint32_t));
+	// connections served by the event loop must not block, queue the message there
+	frame_conn_t *conn = frame_conn_get_by_fd(fd);
+	if (conn) {
+		if (frame_conn_send(conn, buf, buflen) < 0)
+			goto error_write;
+		TRACE("queued protobuf message (len=%u, %zu bytes pending)", buflen,
+		      frame_conn_get_queued(conn));
+		return buflen;
+	}
 
 	// serialized form of message with all default values has zero length
 	// => transmit its (zero) length prefix only
-	if (buflen == 0)
-		return 0;
-
-	// TODO sending large messages: might have to send multiple chunks
-	// need good (generic?!) solution that interacts nicely with event handling!
-	bytes_sent = fd_write(fd, (char *)buf, buflen);
-	if (-1 == bytes_sent)
+	struct iovec iov[2] = {
+		{ .iov_base = &(uint32_t){ htonl(buflen) }, .iov_len = sizeof(uint32_t) },
+		{ .iov_base = (uint8_t *)buf, .iov_len = buflen },
+	};
+	int iovcnt = buflen ? 2 : 1;
+	ssize_t bytes_sent;
+
+	// peers read length prefix and data as separate packets on SOCK_SEQPACKET
+	if (iovcnt > 1 && protobuf_fd_is_seqpacket(fd)) {
+		bytes_sent = fd_writev(fd, &iov[0], 1);
+		if (bytes_sent == (ssize_t)sizeof(uint32_t))
+			bytes_sent += fd_writev(fd, &iov[1], 1);
+	} else {
+		bytes_sent = fd_writev(fd, iov, iovcnt);
+	}
+	if (bytes_sent != (ssize_t)(sizeof(uint32_t) + buflen))
 		goto error_write;
-	TRACE("sent protobuf message data (%zd bytes sent, %u bytes expected)", bytes_sent, buflen);
+	TRACE("sent protobuf message (%zd bytes sent, len=%u)", bytes_sent, buflen);
 
-	ASSERT((size_t)bytes_sent == buflen);
-	return bytes_sent;
+	return buflen;
 
 error_write:
 	DEBUG_ERRNO("Failed to write binary protobuf message to fd %d.", fd);
@@ -93,29 +174,96 @@ protobuf_send_message(int fd, const ProtobufCMessage *message)
 {
 	ASSERT(message);
 
-	uint8_t *buf = NULL;
-	uint32_t buflen = protobuf_pack_message_new(message, &buf);
+	uint32_t buflen;
+	uint8_t *buf = protobuf_pack_message_reuse(message, &buflen);
 
 	if (!(buflen < PROTOBUF_MAX_MESSAGE_SIZE)) {
 		ERROR("Packed message exceeds PROTOBUF_MAX_MESSAGE_SIZE");
-		if (buf)
-			mem_free0(buf);
-
+		protobuf_pack_message_release();
 		return -1;
 	}
 
 	TRACE("Sending protobuf message with len %u", buflen);
 	TRACE_HEXDUMP(buf, buflen, "Message");
 
-	if (-1 == protobuf_send_message_packed(fd, buf, buflen)) {
+	// an empty message leaves the buffer unallocated
+	uint8_t empty;
+	if (-1 == protobuf_send_message_packed(fd, buf ? buf : &empty, buflen)) {
 		ERROR_ERRNO("Failed to write packed protobuf message to fd %d.", fd);
-		mem_free0(buf);
+		protobuf_pack_message_release();
 		return -1;
 	}
 
-	mem_free0(buf);
+	protobuf_pack_message_release();
+
+	return buflen;
+}
+
+size_t
+protobuf_pack_field_header(uint8_t *out, uint32_t field_id, size_t len)
+{
+	ASSERT(out);
+
+	// tag with wire type 2 (length-delimited) followed by the length, both varints
+	uint64_t values[2] = { ((uint64_t)field_id << 3) | 2, len };
+	size_t n = 0;
+
+	for (int i = 0; i < 2; i++) {
+		uint64_t v = values[i];
+		while (v >= 0x80) {
+			out[n++] = (uint8_t)(v | 0x80);
+			v >>= 7;
+		}
+		out[n++] = (uint8_t)v;
+	}
+
+	return n;
+}
+
+ssize_t
+protobuf_send_packed_with_file(int fd, const uint8_t *head, uint32_t head_len, int file_fd,
+			       off_t offset, uint32_t file_len)
+{
+	ASSERT(head || !head_len);
 
+	uint64_t buflen = (uint64_t)head_len + file_len;
+	IF_FALSE_RETVAL(buflen < PROTOBUF_MAX_MESSAGE_SIZE, -1);
+
+	frame_conn_t *conn = frame_conn_get_by_fd(fd);
+	if (conn) {
+		if (frame_conn_send_file(conn, head, head_len, file_fd, offset, file_len) < 0)
+			goto error_write;
+		TRACE("queued protobuf message with file content (len=%" PRIu64 ")", buflen);
+		return buflen;
+	}
+
+	if (protobuf_fd_is_seqpacket(fd)) {
+		// the body has to be a single packet
+		uint8_t *buf = mem_alloc(buflen ? buflen : 1);
+		if (head_len)
+			memcpy(buf, head, head_len);
+		ssize_t ret = -1;
+		if (pread(file_fd, buf + head_len, file_len, offset) == (ssize_t)file_len)
+			ret = protobuf_send_message_packed(fd, buf, buflen);
+		mem_free0(buf);
+		return ret;
+	}
+
+	struct iovec iov[2] = {
+		{ .iov_base = &(uint32_t){ htonl(buflen) }, .iov_len = sizeof(uint32_t) },
+		{ .iov_base = (uint8_t *)head, .iov_len = head_len },
+	};
+	if (fd_writev(fd, iov, head_len ? 2 : 1) != (ssize_t)(sizeof(uint32_t) + head_len))
+		goto error_write;
+	if (fd_sendfile(fd, file_fd, offset, file_len) != (ssize_t)file_len)
+		goto error_write;
+
+	TRACE("sent protobuf message with file content (len=%" PRIu64 ")", buflen);
 	return buflen;
+
+error_write:
+	DEBUG_ERRNO("Failed to write protobuf message with file content to fd %d.", fd);
+	return -1;
 }
 
 uint8_t *
@@ -40,6 +40,8 @@
 // The protobuf default byte size limit is 64MB
 #define PROTOBUF_MAX_MESSAGE_SIZE 1024 * 1024 * 64
 #define PROTOBUF_MAX_OVERHEAD 1024
+// maximum size of a length-delimited field header (tag and length varints)
+#define PROTOBUF_FIELD_HEADER_MAX 15
 
 /**
  * Packs the given protobuf message struct
@@ -59,6 +61,8 @@ protobuf_pack_message_new(const ProtobufCMessage *message, uint8_t **ptr);
  * (e.g. a file or socket).
  *
  * The serialized message is prefixed with the length of the actual data.
+ * If fd belongs to a framed connection (see frame.h), the message is queued
+ * for non-blocking transmission by the event loop instead of written directly.
  *
  * @param fd        the file descriptor that the serialized message is written to
  * @param buf       the serialized protobuf message to write
@@ -72,6 +76,8 @@ protobuf_send_message_packed(int fd, const uint8_t *buf, uint32_t buflen);
  * (e.g. a file or socket) in binary serialized form.
  *
  * The serialized message is prefixed with the length of the actual data.
+ * The message is packed into a reusable per-thread buffer and written together
+ * with its length prefix by a single writev().
  *
  * @param fd        the file descriptor that the serialized message is written to
  * @param message   the protobuf message struct to serialize and write
@@ -80,6 +86,41 @@ protobuf_send_message_packed(int fd, const uint8_t *buf, uint32_t buflen);
 ssize_t
 protobuf_send_message(int fd, const ProtobufCMessage *message);
 
+/**
+ * Encodes the header of a length-delimited (bytes, string or sub-message)
+ * field, i.e. its tag followed by the given length. Together with
+ * protobuf_send_packed_with_file(), this allows to send messages whose last
+ * field is taken directly from a file.
+ *
+ * @param out       buffer of at least PROTOBUF_FIELD_HEADER_MAX bytes
+ * @param field_id  the field number as defined in the .proto file
+ * @param len       the length of the field's content
+ * @return          the number of bytes written to out
+ */
+size_t
+protobuf_pack_field_header(uint8_t *out, uint32_t field_id, size_t len);
+
+/**
+ * Writes a serialized protobuf message to the given file descriptor whose
+ * serialized form consists of the given head followed by file_len bytes of
+ * file_fd starting at offset. The file content is sent with sendfile() and
+ * not copied through userspace. The head has to end with the header of the
+ * field which carries the file content (see protobuf_pack_field_header()).
+ * Like protobuf_send_message_packed(), framed connections are served
+ * non-blocking.
+ *
+ * @param fd        the file descriptor that the serialized message is written to
+ * @param head      the serialized message fields preceding the file content
+ * @param head_len  the length of head
+ * @param file_fd   the file descriptor to read the file content from
+ * @param offset    offset of the file content in file_fd
+ * @param file_len  the length of the file content
+ * @return          the length of the serialized message (without length prefix) or -1 on error
+ */
+ssize_t
+protobuf_send_packed_with_file(int fd, const uint8_t *head, uint32_t head_len, int file_fd,
+			       off_t offset, uint32_t file_len);
+
 /**
  * Reads a serialized protobuf message from the given file descriptor
  * (e.g. a file or socket) and deserializes it into a new message struct
@@ -0,0 +1,720 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+//#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
+
+#include "seglog.h"
+
+#include "macro.h"
+#include "mem.h"
+#include "dir.h"
+#include "fd.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define SEGLOG_SEGMENT_SUFFIX ".seg"
+#define SEGLOG_CURSOR_FILE "cursor"
+#define SEGLOG_LOCK_FILE "lock"
+
+typedef struct {
+	uint32_t len;
+	uint32_t crc; //!< CRC32 of the record data
+} seglog_header_t;
+
+typedef struct {
+	uint64_t segment;
+	uint64_t offset;
+	uint32_t crc; //!< CRC32 of segment and offset
+	uint32_t reserved;
+} seglog_cursor_t;
+
+struct seglog {
+	char *dir;
+	size_t segment_size;
+	uint64_t head;	   //!< segment of the read cursor
+	uint64_t head_off; //!< offset of the read cursor in the head segment
+	int head_fd;
+	uint64_t tail;	    //!< segment records are appended to
+	uint64_t tail_size; //!< size of the tail segment
+	int tail_fd;
+	int cursor_fd;
+	uint64_t count; //!< number of unconsumed records
+	uint64_t size;	//!< size of unconsumed records including headers
+};
+
+/*
+ * Takes the lock which serializes the operations on the log of all processes
+ * using it. The lock file is opened for each operation, as a lock held via an
+ * open file shared with a forked child would not exclude the child.
+ */
+static int
+seglog_lock(const seglog_t *log)
+{
+	char *lock_file = mem_printf("%s/%s", log->dir, SEGLOG_LOCK_FILE);
+	int fd = open(lock_file, O_RDWR | O_CREAT | O_CLOEXEC, 00600);
+	if (fd < 0) {
+		ERROR_ERRNO("Could not open lock file %s", lock_file);
+		goto out;
+	}
+	while (flock(fd, LOCK_EX) < 0) {
+		if (errno == EINTR)
+			continue;
+		ERROR_ERRNO("Could not lock log %s", log->dir);
+		close(fd);
+		fd = -1;
+		break;
+	}
+out:
+	mem_free0(lock_file);
+	return fd;
+}
+
+static void
+seglog_unlock(int lock)
+{
+	close(lock);
+}
+
+static uint32_t seglog_crc_table[256];
+static pthread_once_t seglog_crc_table_once = PTHREAD_ONCE_INIT;
+
+static void
+seglog_crc_table_init(void)
+{
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (int k = 0; k < 8; k++)
+			c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		seglog_crc_table[i] = c;
+	}
+}
+
+static uint32_t
+seglog_crc32(const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t crc = 0xffffffff;
+
+	// logs may be used by several threads, each one by a single thread at a time
+	pthread_once(&seglog_crc_table_once, seglog_crc_table_init);
+	for (size_t i = 0; i < len; i++)
+		crc = seglog_crc_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+	return crc ^ 0xffffffff;
+}
+
+static char *
+seglog_segment_file_new(const seglog_t *log, uint64_t id)
+{
+	return mem_printf("%s/%016" PRIx64 SEGLOG_SEGMENT_SUFFIX, log->dir, id);
+}
+
+static int
+seglog_open_segment(const seglog_t *log, uint64_t id, int flags)
+{
+	char *file = seglog_segment_file_new(log, id);
+	int fd = open(file, flags | O_CLOEXEC, 00600);
+	if (fd < 0 && !(errno == ENOENT && !(flags & O_CREAT)))
+		ERROR_ERRNO("Could not open log segment %s", file);
+	mem_free0(file);
+	return fd;
+}
+
+static void
+seglog_delete_segment(const seglog_t *log, uint64_t id)
+{
+	char *file = seglog_segment_file_new(log, id);
+	if (unlink(file) < 0 && errno != ENOENT)
+		WARN_ERRNO("Could not remove log segment %s", file);
+	else
+		TRACE("Removed log segment %s", file);
+	mem_free0(file);
+}
+
+static void
+seglog_sync_dir(const seglog_t *log)
+{
+	int fd = open(log->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0 || fsync(fd) < 0)
+		WARN_ERRNO("Could not sync log directory %s", log->dir);
+	if (fd >= 0)
+		close(fd);
+}
+
+static int
+seglog_write_cursor(seglog_t *log)
+{
+	seglog_cursor_t cursor = { .segment = log->head, .offset = log->head_off };
+	cursor.crc = seglog_crc32(&cursor, offsetof(seglog_cursor_t, crc));
+
+	if (pwrite(log->cursor_fd, &cursor, sizeof(cursor), 0) != sizeof(cursor) ||
+	    fdatasync(log->cursor_fd) < 0) {
+		ERROR_ERRNO("Could not persist read cursor of log %s", log->dir);
+		return -1;
+	}
+	return 0;
+}
+
+static bool
+seglog_read_cursor(seglog_t *log, seglog_cursor_t *cursor)
+{
+	ssize_t len = pread(log->cursor_fd, cursor, sizeof(*cursor), 0);
+	if (len == 0)
+		return false;
+	if (len != sizeof(*cursor) ||
+	    cursor->crc != seglog_crc32(cursor, offsetof(seglog_cursor_t, crc))) {
+		WARN("Invalid read cursor of log %s, starting at its oldest record", log->dir);
+		return false;
+	}
+	return true;
+}
+
+typedef struct {
+	bool found;
+	uint64_t min;
+	uint64_t max;
+} seglog_scan_t;
+
+static int
+seglog_scan_cb(UNUSED const char *path, const char *file, void *data)
+{
+	seglog_scan_t *scan = data;
+	uint64_t id;
+	int n = 0;
+
+	if (sscanf(file, "%16" SCNx64 SEGLOG_SEGMENT_SUFFIX "%n", &id, &n) != 1 ||
+	    (size_t)n != strlen(file))
+		return 0;
+
+	scan->min = scan->found ? MIN(scan->min, id) : id;
+	scan->max = scan->found ? MAX(scan->max, id) : id;
+	scan->found = true;
+	return 0;
+}
+
+/*
+ * Walks the records of a segment and truncates it after its last complete
+ * record. If the segment is the tail, its last record is dropped as well if it
+ * does not match its CRC, as it has been torn by an interrupted append. Counts
+ * the records starting at offset start, which must be the offset of a record
+ * or the end of the segment.
+ */
+static int
+seglog_check_segment(seglog_t *log, uint64_t id, uint64_t start, uint64_t *count,
+		     uint64_t *size)
+{
+	int ret = -1;
+	*count = *size = 0;
+
+	int fd = seglog_open_segment(log, id, O_RDWR);
+	IF_TRUE_RETVAL(fd < 0, errno == ENOENT ? 0 : -1);
+
+	struct stat s;
+	if (fstat(fd, &s) < 0) {
+		ERROR_ERRNO("Could not stat log segment %" PRIx64, id);
+		goto out;
+	}
+
+	uint64_t off = 0, last = 0;
+	bool start_found = start == 0;
+	while (off < (uint64_t)s.st_size) {
+		seglog_header_t hdr;
+		if (pread(fd, &hdr, sizeof(hdr), off) != sizeof(hdr) ||
+		    off + sizeof(hdr) + hdr.len > (uint64_t)s.st_size)
+			break;
+		if (off == start)
+			start_found = true;
+		if (off >= start) {
+			*count += 1;
+			*size += sizeof(hdr) + hdr.len;
+		}
+		last = off;
+		off += sizeof(hdr) + hdr.len;
+	}
+
+	if (id == log->tail && off > 0 && off == (uint64_t)s.st_size) {
+		seglog_header_t hdr;
+		uint8_t *buf = NULL;
+		if (pread(fd, &hdr, sizeof(hdr), last) == sizeof(hdr)) {
+			buf = mem_alloc(hdr.len + 1);
+			if (pread(fd, buf, hdr.len, last + sizeof(hdr)) != (ssize_t)hdr.len ||
+			    seglog_crc32(buf, hdr.len) != hdr.crc) {
+				off = last;
+				if (last >= start) {
+					*count -= 1;
+					*size -= sizeof(hdr) + hdr.len;
+				}
+			}
+		}
+		mem_free0(buf);
+	}
+
+	if (off < (uint64_t)s.st_size) {
+		WARN("Dropping incomplete record at offset %" PRIu64 " of log segment %" PRIx64
+		     " in %s",
+		     off, id, log->dir);
+		if (ftruncate(fd, off) < 0) {
+			ERROR_ERRNO("Could not truncate log segment %" PRIx64, id);
+			goto out;
+		}
+	}
+	if (start > off)
+		start_found = false;
+	else if (start == off)
+		start_found = true;
+
+	ret = start_found ? 0 : 1;
+out:
+	close(fd);
+	return ret;
+}
+
+/*
+ * Returns the size of the head segment, i.e., the offset a new record would
+ * be appended at.
+ */
+static int64_t
+seglog_head_end(const seglog_t *log)
+{
+	if (log->head == log->tail)
+		return log->tail_size;
+
+	struct stat s;
+	if (fstat(log->head_fd, &s) < 0) {
+		ERROR_ERRNO("Could not stat log segment %" PRIx64 " in %s", log->head, log->dir);
+		return -1;
+	}
+	return s.st_size;
+}
+
+/*
+ * Moves the read cursor over the ends of completely consumed segments, which
+ * are deleted.
+ */
+static int
+seglog_head_seek(seglog_t *log)
+{
+	while (log->head < log->tail) {
+		int64_t end = seglog_head_end(log);
+		IF_TRUE_RETVAL(end < 0, -1);
+		if (log->head_off < (uint64_t)end)
+			break;
+
+		uint64_t old = log->head;
+		int fd = -1;
+		// skip segments which went missing
+		do {
+			log->head++;
+			fd = seglog_open_segment(log, log->head, O_RDONLY);
+		} while (fd < 0 && errno == ENOENT && log->head < log->tail);
+		IF_TRUE_RETVAL(fd < 0, -1);
+
+		close(log->head_fd);
+		log->head_fd = fd;
+		log->head_off = 0;
+
+		// the cursor must not refer to a deleted segment
+		IF_TRUE_RETVAL(seglog_write_cursor(log) < 0, -1);
+		seglog_delete_segment(log, old);
+	}
+	return 0;
+}
+
+/*
+ * Counts the records of the segments from first on, starting at offset start
+ * of the first segment, and adds them to the in-memory counters.
+ */
+static int
+seglog_count_records(seglog_t *log, uint64_t first, uint64_t start)
+{
+	for (uint64_t id = first; id <= log->tail; id++) {
+		uint64_t count, size;
+		int ret = seglog_check_segment(log, id, id == first ? start : 0, &count, &size);
+		if (ret != 0) {
+			ERROR("Could not count the records of log segment %" PRIx64 " in %s", id,
+			      log->dir);
+			return -1;
+		}
+		log->count += count;
+		log->size += size;
+	}
+	return 0;
+}
+
+/*
+ * Synchronizes the in-memory state with the changes other processes made to
+ * the log since it has been opened or last synchronized, i.e., appended
+ * records, started segments and consumed records. Must be called with the
+ * lock held.
+ */
+static int
+seglog_sync(seglog_t *log)
+{
+	uint64_t old_tail = log->tail;
+	uint64_t old_tail_size = log->tail_size;
+
+	for (;;) {
+		int fd = seglog_open_segment(log, log->tail + 1, O_WRONLY | O_APPEND);
+		if (fd < 0) {
+			IF_TRUE_RETVAL(errno != ENOENT, -1);
+			break;
+		}
+		close(log->tail_fd);
+		log->tail_fd = fd;
+		log->tail++;
+	}
+
+	struct stat s;
+	if (fstat(log->tail_fd, &s) < 0) {
+		ERROR_ERRNO("Could not stat log segment %" PRIx64 " in %s", log->tail, log->dir);
+		return -1;
+	}
+	log->tail_size = s.st_size;
+
+	seglog_cursor_t cursor;
+	if (seglog_read_cursor(log, &cursor) &&
+	    (cursor.segment != log->head || cursor.offset != log->head_off)) {
+		// the cursor never refers to a deleted segment
+		int fd = seglog_open_segment(log, cursor.segment, O_RDONLY);
+		IF_TRUE_RETVAL(fd < 0, -1);
+		close(log->head_fd);
+		log->head_fd = fd;
+		log->head = cursor.segment;
+		log->head_off = cursor.offset;
+
+		TRACE("Records of log %s have been consumed elsewhere, counting them again",
+		      log->dir);
+		log->count = log->size = 0;
+		IF_TRUE_RETVAL(seglog_count_records(log, log->head, log->head_off) < 0, -1);
+	} else if (log->tail != old_tail || log->tail_size != old_tail_size) {
+		TRACE("Records have been appended to log %s elsewhere", log->dir);
+		IF_TRUE_RETVAL(seglog_count_records(log, old_tail, old_tail_size) < 0, -1);
+	} else {
+		return 0;
+	}
+
+	// the count may have dropped a torn record of the tail
+	if (fstat(log->tail_fd, &s) < 0) {
+		ERROR_ERRNO("Could not stat log segment %" PRIx64 " in %s", log->tail, log->dir);
+		return -1;
+	}
+	log->tail_size = s.st_size;
+	return 0;
+}
+
+seglog_t *
+seglog_open(const char *dir, size_t segment_size)
+{
+	ASSERT(dir);
+	ASSERT(segment_size > 0);
+
+	if (dir_mkdir_p(dir, 0700) < 0) {
+		ERROR_ERRNO("Could not create log directory %s", dir);
+		return NULL;
+	}
+
+	seglog_t *log = mem_new0(seglog_t, 1);
+	log->dir = mem_strdup(dir);
+	log->segment_size = segment_size;
+	log->head_fd = log->tail_fd = log->cursor_fd = -1;
+
+	int lock = seglog_lock(log);
+	IF_TRUE_GOTO(lock < 0, err);
+
+	char *cursor_file = mem_printf("%s/%s", dir, SEGLOG_CURSOR_FILE);
+	log->cursor_fd = open(cursor_file, O_RDWR | O_CREAT | O_CLOEXEC, 00600);
+	if (log->cursor_fd < 0) {
+		ERROR_ERRNO("Could not open read cursor %s", cursor_file);
+		mem_free0(cursor_file);
+		goto err;
+	}
+	mem_free0(cursor_file);
+
+	seglog_scan_t scan = { .found = false };
+	if (dir_foreach(dir, seglog_scan_cb, &scan) < 0)
+		goto err;
+	log->head = scan.min;
+	log->tail = scan.max;
+
+	seglog_cursor_t cursor;
+	if (seglog_read_cursor(log, &cursor) && cursor.segment >= scan.min &&
+	    cursor.segment <= scan.max) {
+		log->head = cursor.segment;
+		log->head_off = cursor.offset;
+	}
+	for (uint64_t id = scan.min; scan.found && id < log->head; id++)
+		seglog_delete_segment(log, id);
+
+	for (uint64_t id = log->head; scan.found && id <= log->tail; id++) {
+		uint64_t start = (id == log->head) ? log->head_off : 0;
+		uint64_t count, size;
+		int ret = seglog_check_segment(log, id, start, &count, &size);
+		if (ret > 0) {
+			WARN("Read cursor of log %s is not at a record, starting at its segment",
+			     dir);
+			log->head_off = 0;
+			ret = seglog_check_segment(log, id, 0, &count, &size);
+		}
+		IF_TRUE_GOTO(ret < 0, err);
+		log->count += count;
+		log->size += size;
+	}
+
+	log->tail_fd = seglog_open_segment(log, log->tail, O_WRONLY | O_CREAT | O_APPEND);
+	IF_TRUE_GOTO(log->tail_fd < 0, err);
+	struct stat s;
+	if (fstat(log->tail_fd, &s) < 0) {
+		ERROR_ERRNO("Could not stat log segment in %s", dir);
+		goto err;
+	}
+	log->tail_size = s.st_size;
+	if (!scan.found)
+		seglog_sync_dir(log);
+
+	// a missing head segment is replaced by an empty one, which is skipped
+	log->head_fd = seglog_open_segment(log, log->head, O_RDONLY | O_CREAT);
+	IF_TRUE_GOTO(log->head_fd < 0, err);
+	IF_TRUE_GOTO(seglog_head_seek(log) < 0, err);
+
+	seglog_unlock(lock);
+	DEBUG("Opened log %s with %" PRIu64 " records (%" PRIu64 " bytes)", dir, log->count,
+	      log->size);
+	return log;
+err:
+	if (lock >= 0)
+		seglog_unlock(lock);
+	seglog_close(log);
+	return NULL;
+}
+
+void
+seglog_close(seglog_t *log)
+{
+	IF_NULL_RETURN(log);
+
+	if (log->head_fd >= 0)
+		close(log->head_fd);
+	if (log->tail_fd >= 0)
+		close(log->tail_fd);
+	if (log->cursor_fd >= 0)
+		close(log->cursor_fd);
+	mem_free0(log->dir);
+	mem_free0(log);
+}
+
+/*
+ * Starts a new tail segment.
+ */
+static int
+seglog_rotate(seglog_t *log)
+{
+	int fd = seglog_open_segment(log, log->tail + 1, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND);
+	IF_TRUE_RETVAL(fd < 0, -1);
+	seglog_sync_dir(log);
+
+	close(log->tail_fd);
+	log->tail_fd = fd;
+	log->tail++;
+	log->tail_size = 0;
+
+	TRACE("Started log segment %" PRIx64 " in %s", log->tail, log->dir);
+
+	// the previous tail may have been consumed completely
+	return seglog_head_seek(log);
+}
+
+/*
+ * Appends a single record, must be called with the lock held and the
+ * in-memory state synchronized.
+ */
+static int
+seglog_append_locked(seglog_t *log, const void *buf, size_t len)
+{
+	IF_TRUE_RETVAL(len > UINT32_MAX - sizeof(seglog_header_t), -1);
+
+	uint64_t rec_len = sizeof(seglog_header_t) + len;
+	if (log->tail_size > 0 && log->tail_size + rec_len > log->segment_size)
+		IF_TRUE_RETVAL(seglog_rotate(log) < 0, -1);
+
+	seglog_header_t hdr = { .len = len, .crc = seglog_crc32(buf, len) };
+	struct iovec iov[2] = { { .iov_base = &hdr, .iov_len = sizeof(hdr) },
+				{ .iov_base = (void *)buf, .iov_len = len } };
+
+	if (fd_writev(log->tail_fd, iov, 2) != (ssize_t)rec_len || fdatasync(log->tail_fd) < 0) {
+		ERROR_ERRNO("Could not append record to log %s", log->dir);
+		// drop a partially written record
+		if (ftruncate(log->tail_fd, log->tail_size) < 0)
+			WARN_ERRNO("Could not truncate log segment in %s", log->dir);
+		return -1;
+	}
+
+	log->tail_size += rec_len;
+	log->count++;
+	log->size += rec_len;
+	return 0;
+}
+
+int
+seglog_append(seglog_t *log, const void *buf, size_t len)
+{
+	ASSERT(log);
+	ASSERT(buf || len == 0);
+
+	struct iovec rec = { .iov_base = (void *)buf, .iov_len = len };
+	return seglog_append_multi(log, &rec, 1) == 1 ? 0 : -1;
+}
+
+ssize_t
+seglog_append_multi(seglog_t *log, const struct iovec *recs, size_t n)
+{
+	ASSERT(log);
+	ASSERT(recs || n == 0);
+
+	int lock = seglog_lock(log);
+	IF_TRUE_RETVAL(lock < 0, -1);
+
+	ssize_t ret = -1;
+	IF_TRUE_GOTO(seglog_sync(log) < 0, out);
+
+	for (ret = 0; (size_t)ret < n; ret++) {
+		if (seglog_append_locked(log, recs[ret].iov_base, recs[ret].iov_len) < 0)
+			break;
+	}
+out:
+	seglog_unlock(lock);
+	return ret;
+}
+
+/*
+ * Reads the header of the record at the read cursor.
+ */
+static int
+seglog_read_header(seglog_t *log, seglog_header_t *hdr)
+{
+	IF_TRUE_RETVAL(log->count == 0, -1);
+	IF_TRUE_RETVAL(seglog_head_seek(log) < 0, -1);
+
+	if (pread(log->head_fd, hdr, sizeof(*hdr), log->head_off) != sizeof(*hdr)) {
+		ERROR_ERRNO("Could not read record header at offset %" PRIu64
+			    " of log segment %" PRIx64 " in %s",
+			    log->head_off, log->head, log->dir);
+		return -1;
+	}
+	return 0;
+}
+
+ssize_t
+seglog_read_new(seglog_t *log, uint8_t **buf, bool *intact)
+{
+	ASSERT(log);
+	ASSERT(buf);
+
+	ssize_t ret = -1;
+	int lock = seglog_lock(log);
+	IF_TRUE_RETVAL(lock < 0, -1);
+
+	seglog_header_t hdr;
+	IF_TRUE_GOTO(seglog_sync(log) < 0 || seglog_read_header(log, &hdr) < 0, out);
+
+	*buf = mem_alloc0(hdr.len + 1);
+	if (pread(log->head_fd, *buf, hdr.len, log->head_off + sizeof(hdr)) != (ssize_t)hdr.len) {
+		ERROR_ERRNO("Could not read record at offset %" PRIu64 " of log segment %" PRIx64
+			    " in %s",
+			    log->head_off, log->head, log->dir);
+		mem_free0(*buf);
+		goto out;
+	}
+
+	bool crc_ok = seglog_crc32(*buf, hdr.len) == hdr.crc;
+	if (!crc_ok)
+		WARN("Record at offset %" PRIu64 " of log segment %" PRIx64
+		     " in %s does not match its CRC",
+		     log->head_off, log->head, log->dir);
+	if (intact)
+		*intact = crc_ok;
+	ret = hdr.len;
+out:
+	seglog_unlock(lock);
+	return ret;
+}
+
+int
+seglog_consume(seglog_t *log)
+{
+	ASSERT(log);
+
+	int ret = -1;
+	int lock = seglog_lock(log);
+	IF_TRUE_RETVAL(lock < 0, -1);
+
+	seglog_header_t hdr;
+	IF_TRUE_GOTO(seglog_sync(log) < 0 || seglog_read_header(log, &hdr) < 0, out);
+
+	log->head_off += sizeof(hdr) + hdr.len;
+	log->count--;
+	log->size -= sizeof(hdr) + hdr.len;
+
+	IF_TRUE_GOTO(seglog_write_cursor(log) < 0, out);
+	ret = seglog_head_seek(log);
+out:
+	seglog_unlock(lock);
+	return ret;
+}
+
+/*
+ * Synchronizes the in-memory counters with the changes of other processes, on
+ * error the last known values are kept.
+ */
+static void
+seglog_sync_counters(seglog_t *log)
+{
+	int lock = seglog_lock(log);
+	IF_TRUE_RETURN(lock < 0);
+	if (seglog_sync(log) < 0)
+		WARN("Could not synchronize log %s, counters may be outdated", log->dir);
+	seglog_unlock(lock);
+}
+
+uint64_t
+seglog_get_count(seglog_t *log)
+{
+	ASSERT(log);
+	seglog_sync_counters(log);
+	return log->count;
+}
+
+uint64_t
+seglog_get_size(seglog_t *log)
+{
+	ASSERT(log);
+	seglog_sync_counters(log);
+	return log->size;
+}
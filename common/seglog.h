@@ -0,0 +1,128 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file seglog.h
+ *
+ * Implements a persistent, append-only queue of binary records, stored in a
+ * directory as a sequence of segment files of bounded size. Each record is
+ * prefixed with its length and a CRC32 of its data. Records are consumed in
+ * order through a read cursor, which is persisted in the directory as well;
+ * segments are deleted as soon as all of their records have been consumed.
+ * Thus, neither appending nor consuming a record rewrites stored data.
+ *
+ * On open, the segments are checked and an incomplete record left over from an
+ * interrupted append is dropped. The number and size of the unconsumed records
+ * are kept in memory.
+ *
+ * Several processes, e.g., a daemon and its forked children, may use the same
+ * log. Their operations are serialized by a lock file in the directory, and
+ * each operation first synchronizes the in-memory state with the changes made
+ * by the other processes. Within a process, a log must only be used by one
+ * thread at a time.
+ */
+
+#ifndef SEGLOG_H
+#define SEGLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// size of the header stored in front of each record
+#define SEGLOG_RECORD_HEADER_SIZE 8
+
+typedef struct seglog seglog_t;
+
+/**
+ * Opens the log stored in the given directory, which is created if necessary.
+ *
+ * @param dir the directory of the log
+ * @param segment_size size at which a new segment is started; a segment
+ *	  holds at least one record, even if it is larger
+ * @return the opened log or NULL on error
+ */
+seglog_t *
+seglog_open(const char *dir, size_t segment_size);
+
+/**
+ * Closes the log and frees its in-memory state, the stored records are kept.
+ */
+void
+seglog_close(seglog_t *log);
+
+/**
+ * Appends a record to the log and syncs it to disk.
+ *
+ * @return 0 on success, -1 otherwise
+ */
+int
+seglog_append(seglog_t *log, const void *buf, size_t len);
+
+/**
+ * Appends several records to the log in order, without any operation of
+ * another process in between, and syncs each of them to disk.
+ *
+ * @param recs the records, one per element
+ * @param n the number of records
+ * @return the number of records appended before an error, which may be less
+ *	   than n, or -1 if none could be appended as the log was inaccessible
+ */
+ssize_t
+seglog_append_multi(seglog_t *log, const struct iovec *recs, size_t n);
+
+/**
+ * Reads the oldest unconsumed record without consuming it.
+ *
+ * @param buf returns the newly allocated data of the record, must be freed
+ * @param intact returns false if the data of the record does not match its CRC
+ * @return the length of the record or -1 if the log is empty or on error
+ */
+ssize_t
+seglog_read_new(seglog_t *log, uint8_t **buf, bool *intact);
+
+/**
+ * Consumes the oldest unconsumed record, i.e., advances and persists the read
+ * cursor and deletes the segment it has left.
+ *
+ * @return 0 on success, -1 if the log is empty or on error
+ */
+int
+seglog_consume(seglog_t *log);
+
+/**
+ * Returns the number of unconsumed records.
+ */
+uint64_t
+seglog_get_count(seglog_t *log);
+
+/**
+ * Returns the number of bytes taken by the unconsumed records including their
+ * headers.
+ */
+uint64_t
+seglog_get_size(seglog_t *log);
+
+#endif /* SEGLOG_H */
@@ -0,0 +1,354 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+#include "munit.h"
+
+#include "seglog.h"
+#include "dir.h"
+#include "file.h"
+#include "logf.h"
+#include "macro.h"
+#include "mem.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static char test_seglog_dir[64];
+
+static void
+test_seglog_append_str(seglog_t *log, const char *str)
+{
+	munit_assert_int(seglog_append(log, str, strlen(str)), ==, 0);
+}
+
+static void
+test_seglog_assert_next(seglog_t *log, const char *str, bool intact)
+{
+	uint8_t *buf = NULL;
+	bool ok = !intact;
+
+	munit_assert_int(seglog_read_new(log, &buf, &ok), ==, strlen(str));
+	munit_assert_memory_equal(strlen(str), buf, str);
+	munit_assert(ok == intact);
+	mem_free0(buf);
+}
+
+static int
+test_seglog_count_segments_cb(UNUSED const char *path, const char *file, UNUSED void *data)
+{
+	return strstr(file, ".seg") ? 1 : 0;
+}
+
+static int
+test_seglog_count_segments(void)
+{
+	return dir_foreach(test_seglog_dir, test_seglog_count_segments_cb, NULL);
+}
+
+static MunitResult
+test_seglog_consume(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	seglog_t *log = seglog_open(test_seglog_dir, 4096);
+	munit_assert_not_null(log);
+	munit_assert_int(seglog_get_count(log), ==, 0);
+	munit_assert_int(seglog_consume(log), ==, -1);
+
+	test_seglog_append_str(log, "first");
+	test_seglog_append_str(log, "");
+	test_seglog_append_str(log, "third");
+	munit_assert_int(seglog_get_count(log), ==, 3);
+	munit_assert_int(seglog_get_size(log), ==, 3 * 8 + 10);
+
+	// reading does not consume
+	test_seglog_assert_next(log, "first", true);
+	test_seglog_assert_next(log, "first", true);
+	munit_assert_int(seglog_consume(log), ==, 0);
+	test_seglog_assert_next(log, "", true);
+	munit_assert_int(seglog_consume(log), ==, 0);
+	test_seglog_assert_next(log, "third", true);
+	munit_assert_int(seglog_consume(log), ==, 0);
+
+	munit_assert_int(seglog_get_count(log), ==, 0);
+	munit_assert_int(seglog_get_size(log), ==, 0);
+	munit_assert_int(seglog_consume(log), ==, -1);
+
+	seglog_close(log);
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_seglog_rotate(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	char rec[32];
+
+	// three records of 8 + 24 bytes per segment
+	seglog_t *log = seglog_open(test_seglog_dir, 96);
+	munit_assert_not_null(log);
+
+	for (int i = 0; i < 10; i++) {
+		snprintf(rec, sizeof(rec), "record %016d", i);
+		test_seglog_append_str(log, rec);
+	}
+	munit_assert_int(test_seglog_count_segments(), ==, 4);
+
+	for (int i = 0; i < 7; i++) {
+		snprintf(rec, sizeof(rec), "record %016d", i);
+		test_seglog_assert_next(log, rec, true);
+		munit_assert_int(seglog_consume(log), ==, 0);
+	}
+	// consumed segments are removed
+	munit_assert_int(test_seglog_count_segments(), ==, 2);
+	munit_assert_int(seglog_get_count(log), ==, 3);
+
+	for (int i = 7; i < 10; i++) {
+		snprintf(rec, sizeof(rec), "record %016d", i);
+		test_seglog_assert_next(log, rec, true);
+		munit_assert_int(seglog_consume(log), ==, 0);
+	}
+	munit_assert_int(test_seglog_count_segments(), ==, 1);
+
+	// a completely consumed tail is removed on rotation
+	for (int i = 10; i < 12; i++) {
+		snprintf(rec, sizeof(rec), "record %016d", i);
+		test_seglog_append_str(log, rec);
+		munit_assert_int(seglog_consume(log), ==, 0);
+	}
+	test_seglog_append_str(log, "last");
+	munit_assert_int(test_seglog_count_segments(), ==, 1);
+	test_seglog_assert_next(log, "last", true);
+	munit_assert_int(seglog_consume(log), ==, 0);
+
+	// records appended together are rotated like single ones
+	char multi[4][32];
+	struct iovec recs[4];
+	for (int i = 0; i < 4; i++) {
+		snprintf(multi[i], sizeof(multi[i]), "record %016d", 12 + i);
+		recs[i].iov_base = multi[i];
+		recs[i].iov_len = strlen(multi[i]);
+	}
+	munit_assert_int(seglog_append_multi(log, recs, 4), ==, 4);
+	munit_assert_int(seglog_get_count(log), ==, 4);
+	munit_assert_int(test_seglog_count_segments(), ==, 2);
+	for (int i = 0; i < 4; i++) {
+		test_seglog_assert_next(log, multi[i], true);
+		munit_assert_int(seglog_consume(log), ==, 0);
+	}
+
+	seglog_close(log);
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_seglog_reopen(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	seglog_t *log = seglog_open(test_seglog_dir, 64);
+	munit_assert_not_null(log);
+	test_seglog_append_str(log, "first record");
+	test_seglog_append_str(log, "second record");
+	test_seglog_append_str(log, "third record");
+	munit_assert_int(seglog_consume(log), ==, 0);
+	uint64_t size = seglog_get_size(log);
+	seglog_close(log);
+
+	// the read cursor and the counters are restored
+	log = seglog_open(test_seglog_dir, 64);
+	munit_assert_not_null(log);
+	munit_assert_int(seglog_get_count(log), ==, 2);
+	munit_assert_int(seglog_get_size(log), ==, size);
+	test_seglog_assert_next(log, "second record", true);
+	munit_assert_int(seglog_consume(log), ==, 0);
+	test_seglog_append_str(log, "fourth record");
+	seglog_close(log);
+
+	log = seglog_open(test_seglog_dir, 64);
+	munit_assert_not_null(log);
+	munit_assert_int(seglog_get_count(log), ==, 2);
+	test_seglog_assert_next(log, "third record", true);
+	munit_assert_int(seglog_consume(log), ==, 0);
+	test_seglog_assert_next(log, "fourth record", true);
+
+	seglog_close(log);
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_seglog_corrupt(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	char *seg = mem_printf("%s/%016x.seg", test_seglog_dir, 0);
+
+	seglog_t *log = seglog_open(test_seglog_dir, 4096);
+	munit_assert_not_null(log);
+	test_seglog_append_str(log, "first");
+	test_seglog_append_str(log, "second");
+	test_seglog_append_str(log, "third");
+	seglog_close(log);
+
+	// flip a bit of the first record and tear the last one
+	int fd = open(seg, O_RDWR);
+	munit_assert_int(fd, >=, 0);
+	munit_assert_int(pwrite(fd, "F", 1, 8), ==, 1);
+	munit_assert_int(pwrite(fd, "T", 1, 8 + 5 + 8 + 6 + 8), ==, 1);
+	close(fd);
+
+	log = seglog_open(test_seglog_dir, 4096);
+	munit_assert_not_null(log);
+	munit_assert_int(seglog_get_count(log), ==, 2);
+	test_seglog_assert_next(log, "First", false);
+	munit_assert_int(seglog_consume(log), ==, 0);
+	test_seglog_assert_next(log, "second", true);
+	munit_assert_int(seglog_consume(log), ==, 0);
+	munit_assert_int(file_size(seg), ==, 8 + 5 + 8 + 6);
+
+	// an incomplete header is dropped
+	seglog_close(log);
+	fd = open(seg, O_WRONLY | O_APPEND);
+	munit_assert_int(write(fd, "xyz", 3), ==, 3);
+	close(fd);
+
+	log = seglog_open(test_seglog_dir, 4096);
+	munit_assert_not_null(log);
+	munit_assert_int(seglog_get_count(log), ==, 0);
+	test_seglog_append_str(log, "fourth");
+	test_seglog_assert_next(log, "fourth", true);
+
+	seglog_close(log);
+	mem_free0(seg);
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_seglog_shared(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	seglog_t *log = seglog_open(test_seglog_dir, 64);
+	munit_assert_not_null(log);
+	test_seglog_append_str(log, "first record");
+
+	// a forked child appends to the inherited log and starts new segments
+	pid_t pid = fork();
+	munit_assert_int(pid, >=, 0);
+	if (pid == 0) {
+		for (int i = 0; i < 4; i++) {
+			if (seglog_append(log, "child record", strlen("child record")) < 0)
+				_exit(1);
+		}
+		_exit(seglog_get_count(log) == 5 ? 0 : 1);
+	}
+	int status;
+	munit_assert_int(waitpid(pid, &status, 0), ==, pid);
+	munit_assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	munit_assert_int(seglog_get_count(log), ==, 5);
+	munit_assert_int(seglog_get_size(log), ==, 5 * (8 + 12));
+	test_seglog_append_str(log, "second record");
+
+	// records consumed by another user of the log are no longer counted
+	seglog_t *other = seglog_open(test_seglog_dir, 64);
+	munit_assert_not_null(other);
+	munit_assert_int(seglog_get_count(other), ==, 6);
+	for (int i = 0; i < 3; i++)
+		munit_assert_int(seglog_consume(other), ==, 0);
+	seglog_close(other);
+
+	munit_assert_int(seglog_get_count(log), ==, 3);
+	test_seglog_assert_next(log, "child record", true);
+	munit_assert_int(seglog_consume(log), ==, 0);
+	munit_assert_int(seglog_consume(log), ==, 0);
+	test_seglog_assert_next(log, "second record", true);
+	munit_assert_int(seglog_get_size(log), ==, 8 + 13);
+
+	seglog_close(log);
+	return MUNIT_OK;
+}
+
+static void *
+setup(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	logf_register(&logf_test_write, stderr);
+
+	strcpy(test_seglog_dir, "/tmp/seglog.test.XXXXXX");
+	munit_assert_not_null(mkdtemp(test_seglog_dir));
+	return NULL;
+}
+
+static void
+tear_down(UNUSED void *fixture)
+{
+	munit_assert_int(dir_delete_folder("/tmp", test_seglog_dir + strlen("/tmp/")), ==, 0);
+}
+
+static MunitTest tests[] = {
+	{
+		"/consume",		/* name */
+		test_seglog_consume,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/rotate",		/* name */
+		test_seglog_rotate,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/reopen",		/* name */
+		test_seglog_reopen,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/corrupt",		/* name */
+		test_seglog_corrupt,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/shared",		/* name */
+		test_seglog_shared,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+
+	// Mark the end of the array with an entry where the test function is NULL
+	{ NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite seglog_suite = {
+	"/seglog",		/* name */
+	tests,			/* tests */
+	NULL,			/* suites */
+	1,			/* iterations */
+	MUNIT_SUITE_OPTION_NONE /* options */
+};
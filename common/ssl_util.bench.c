@@ -0,0 +1,152 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/*
+ * Micro-benchmark for file hashing: compares the former fread() loop with a
+ * small stack buffer against ssl_hash_file_multi(), which reads large aligned
+ * chunks on a helper thread while digesting, for one and for two digests.
+ * Pass a path to hash an existing image instead of a generated file; note that
+ * ssl_hash_file_multi() drops hashed pages from the page cache.
+ */
+
+#include "ssl_util.h"
+#include "macro.h"
+#include "mem.h"
+#include "logf.h"
+
+#include <openssl/evp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SSL_HASH_BENCH_FILE_SIZE (128 * 1024 * 1024)
+#define SSL_HASH_BENCH_FREAD_SIZE 4096
+
+static double
+ssl_hash_bench_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void
+ssl_hash_bench_report(const char *name, size_t size, double ms)
+{
+	printf("%-40s %8.1f ms %8.1f MB/s\n", name, ms, (size / (1024.0 * 1024.0)) / (ms / 1000.0));
+}
+
+/*
+ * The hashing loop as it was before, reading the file once per digest.
+ */
+static void
+ssl_hash_bench_fread(const char *file, const char *const *algos, size_t n)
+{
+	unsigned char buffer[SSL_HASH_BENCH_FREAD_SIZE];
+	unsigned char md[EVP_MAX_MD_SIZE];
+
+	for (size_t i = 0; i < n; i++) {
+		FILE *fp = fopen(file, "rb");
+		if (!fp)
+			exit(1);
+		EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
+		EVP_DigestInit(md_ctx, EVP_get_digestbyname(algos[i]));
+		size_t len;
+		while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+			EVP_DigestUpdate(md_ctx, buffer, len);
+		EVP_DigestFinal(md_ctx, md, NULL);
+		EVP_MD_CTX_free(md_ctx);
+		fclose(fp);
+	}
+}
+
+static void
+ssl_hash_bench_multi(const char *file, const char *const *algos, size_t n)
+{
+	unsigned char *hashes[n];
+	unsigned int hash_lens[n];
+
+	if (ssl_hash_file_multi(file, algos, n, hashes, hash_lens) < 0)
+		exit(1);
+	for (size_t i = 0; i < n; i++)
+		mem_free0(hashes[i]);
+}
+
+int
+main(int argc, char **argv)
+{
+	logf_handler_t *h = logf_register(&logf_test_write, stderr);
+	logf_handler_set_prio(h, LOGF_PRIO_WARN);
+
+	char path[] = "/tmp/ssl_util.bench.XXXXXX";
+	const char *file = path;
+
+	if (argc > 1) {
+		file = argv[1];
+	} else {
+		int fd = mkstemp(path);
+		if (fd < 0)
+			return 1;
+		uint8_t *blob = mem_alloc(1024 * 1024);
+		for (size_t i = 0; i < 1024 * 1024; i++)
+			blob[i] = 'a' + i % 26;
+		for (int i = 0; i < SSL_HASH_BENCH_FILE_SIZE / (1024 * 1024); i++)
+			if (write(fd, blob, 1024 * 1024) != 1024 * 1024)
+				return 1;
+		mem_free0(blob);
+		close(fd);
+	}
+
+	struct stat st;
+	if (stat(file, &st) < 0)
+		return 1;
+
+	const char *algos[] = { "SHA256", "SHA1" };
+	double start;
+
+	start = ssl_hash_bench_now_ms();
+	ssl_hash_bench_fread(file, algos, 1);
+	ssl_hash_bench_report("fread 4K, sha256", st.st_size, ssl_hash_bench_now_ms() - start);
+
+	start = ssl_hash_bench_now_ms();
+	ssl_hash_bench_multi(file, algos, 1);
+	ssl_hash_bench_report("ssl_hash_file_multi, sha256", st.st_size,
+			      ssl_hash_bench_now_ms() - start);
+
+	start = ssl_hash_bench_now_ms();
+	ssl_hash_bench_fread(file, algos, 2);
+	ssl_hash_bench_report("fread 4K, sha256 + sha1 (two passes)", st.st_size,
+			      ssl_hash_bench_now_ms() - start);
+
+	start = ssl_hash_bench_now_ms();
+	ssl_hash_bench_multi(file, algos, 2);
+	ssl_hash_bench_report("ssl_hash_file_multi, sha256 + sha1", st.st_size,
+			      ssl_hash_bench_now_ms() - start);
+
+	if (file == path)
+		unlink(path);
+	return 0;
+}
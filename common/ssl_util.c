@@ -39,10 +39,19 @@
 #include <openssl/bio.h>
 #include <openssl/x509_vfy.h>
 #include <openssl/evp.h>
+#include <openssl/hmac.h>
 #include <openssl/params.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 //#undef LOGF_LOG_MIN_PRIO
 //#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
@@ -71,8 +80,13 @@
 #define RSA_KEY_SIZE_MKKEYP 4096
 
 #define RSA_KEY_EXPONENT RSA_F4
-/* Chunk size for reading sig-/hashfiles */
-#define SIGN_HASH_BUFFER_SIZE 4096
+/* Size and alignment of each of the two read buffers for hashing files */
+#define SSL_HASH_FILE_CHUNK_SIZE (1024 * 1024)
+#define SSL_HASH_FILE_ALIGNMENT 4096
+/* Maximum block size for hashing the blocks of a file range individually */
+#define SSL_HASH_FILE_BLOCK_MAX_SIZE (64 * 1024 * 1024)
+// interval in which a file that is still being written is checked for new data
+#define SSL_HASH_FILE_FOLLOW_POLL_MS 20
 
 /*** self provisioning flags and functions */
 #define TEST_C "DE"
@@ -910,14 +924,18 @@ cb_verify_ignore_time(int ok, X509_STORE_CTX *ctx)
 	return ok;
 }
 
-int
-ssl_verify_certificate(const char *test_cert_file, const char *root_cert_file, bool ignore_time)
+/*
+ * Verifies the first PEM certificate in stackbio against the root certificate
+ * in root_cert_file. All further certificates in stackbio are treated as
+ * untrusted intermediates of its chain.
+ */
+static int
+ssl_verify_certificate_bio(BIO *stackbio, const char *root_cert_file, bool ignore_time)
 {
 	X509 *test_cert = NULL;
 	X509_STORE *store = NULL;
 	X509_STORE_CTX *context = NULL;
 	STACK_OF(X509) *chainstack = NULL;
-	BIO *stackbio = NULL;
 	int ret = 0;
 
 	if ((store = X509_STORE_new()) == NULL) {
@@ -943,13 +961,6 @@ ssl_verify_certificate(const char *test_cert_file, const char *root_cert_file, b
 		goto end;
 	}
 
-	stackbio = BIO_new(BIO_s_file());
-	if (BIO_read_filename(stackbio, test_cert_file) <= 0) {
-		ERROR("Error loading certificate chain");
-		ret = -2;
-		goto end;
-	}
-
 	if (!PEM_read_bio_X509(stackbio, &test_cert, 0, NULL)) {
 		ERROR("Failed to load cert from certificate under test");
 		ret = -2;
@@ -1012,8 +1023,6 @@ end:
 	}
 	if (store != NULL)
 		X509_STORE_free(store);
-	if (stackbio != NULL)
-		BIO_free(stackbio);
 	if (chainstack != NULL)
 		sk_X509_pop_free(chainstack, X509_free);
 	if (test_cert != NULL)
@@ -1021,6 +1030,42 @@ end:
 	return ret;
 }
 
+int
+ssl_verify_certificate(const char *test_cert_file, const char *root_cert_file, bool ignore_time)
+{
+	BIO *stackbio = BIO_new(BIO_s_file());
+	if (!stackbio || BIO_read_filename(stackbio, test_cert_file) <= 0) {
+		ERROR("Error loading certificate chain");
+		if (stackbio)
+			BIO_free(stackbio);
+		return -2;
+	}
+
+	int ret = ssl_verify_certificate_bio(stackbio, root_cert_file, ignore_time);
+
+	BIO_free(stackbio);
+	return ret;
+}
+
+int
+ssl_verify_certificate_from_buf(const uint8_t *cert_buf, size_t cert_len,
+				const char *root_cert_file, bool ignore_time)
+{
+	IF_NULL_RETVAL(cert_buf, -2);
+	IF_TRUE_RETVAL(cert_len > INT_MAX, -2);
+
+	BIO *stackbio = BIO_new_mem_buf(cert_buf, (int)cert_len);
+	if (!stackbio) {
+		ERROR("Error loading certificate chain");
+		return -2;
+	}
+
+	int ret = ssl_verify_certificate_bio(stackbio, root_cert_file, ignore_time);
+
+	BIO_free(stackbio);
+	return ret;
+}
+
 static int
 ssl_set_pkey_ctx_rsa_pss(EVP_PKEY_CTX *ctx, const EVP_MD *hash_fct)
 {
@@ -1194,6 +1239,307 @@ error:
 	return ret;
 }
 
+unsigned char *
+ssl_hmac_buf(const unsigned char *key, size_t key_len, const unsigned char *buf, size_t buf_len,
+	     unsigned int *calc_len, const char *digest_algo)
+{
+	ASSERT(key);
+	ASSERT(buf);
+	ASSERT(digest_algo);
+
+	const EVP_MD *hash_fct;
+	if ((hash_fct = EVP_get_digestbyname(digest_algo)) == NULL) {
+		ERROR("Error in hmac computation (unable to initialize hash function %s)",
+		      digest_algo);
+		return NULL;
+	}
+
+	unsigned char *ret = mem_alloc0(EVP_MAX_MD_SIZE);
+	if (HMAC(hash_fct, key, (int)key_len, buf, buf_len, ret, calc_len) == NULL) {
+		ERROR("Error in hmac computation");
+		mem_free0(ret);
+		return NULL;
+	}
+	return ret;
+}
+
+/*
+ * File hashing engine: a helper thread reads the file in large aligned chunks
+ * into one of two buffers while the caller digests the other one, so that
+ * I/O and digest computation overlap.
+ */
+typedef struct ssl_hash_reader {
+	int fd;
+	unsigned char *buf[2];
+	ssize_t len[2]; // bytes in buf, 0 on EOF, -1 on read error
+	int error;	// errno of a read error
+	bool full[2];
+	bool abort;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	// the file is still being written, wait at EOF until remaining bytes are read
+	bool follow;
+	uint64_t remaining;
+	unsigned int timeout_ms;
+} ssl_hash_reader_t;
+
+/*
+ * Waits for the writer of a followed file to append data. Fails if the file
+ * has been removed or truncated, if the hash has been aborted, or if the file
+ * has not grown for the reader's timeout.
+ */
+static int
+ssl_hash_reader_wait(ssl_hash_reader_t *reader, unsigned int *idle_ms)
+{
+	struct stat st;
+	if (fstat(reader->fd, &st) < 0)
+		return -1;
+	if (st.st_nlink == 0) {
+		errno = ENOENT;
+		return -1;
+	}
+	if (lseek(reader->fd, 0, SEEK_CUR) > st.st_size) {
+		errno = ESPIPE;
+		return -1;
+	}
+	if (*idle_ms >= reader->timeout_ms) {
+		errno = ETIMEDOUT;
+		return -1;
+	}
+
+	pthread_mutex_lock(&reader->lock);
+	bool abort = reader->abort;
+	pthread_mutex_unlock(&reader->lock);
+	if (abort) {
+		errno = ECANCELED;
+		return -1;
+	}
+
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = SSL_HASH_FILE_FOLLOW_POLL_MS * 1000000L };
+	nanosleep(&ts, NULL);
+	*idle_ms += SSL_HASH_FILE_FOLLOW_POLL_MS;
+	return 0;
+}
+
+static ssize_t
+ssl_hash_reader_fill(ssl_hash_reader_t *reader, unsigned char *buf, size_t size)
+{
+	size_t len = 0;
+	unsigned int idle_ms = 0;
+
+	if (reader->follow)
+		size = MIN(size, reader->remaining);
+
+	while (len < size) {
+		ssize_t r = read(reader->fd, buf + len, size - len);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (r == 0) {
+			if (!reader->follow)
+				break;
+			if (ssl_hash_reader_wait(reader, &idle_ms) < 0)
+				return -1;
+			continue;
+		}
+		len += r;
+		idle_ms = 0;
+	}
+
+	if (reader->follow)
+		reader->remaining -= len;
+	return len;
+}
+
+static void *
+ssl_hash_reader_thread(void *data)
+{
+	ssl_hash_reader_t *reader = data;
+
+	for (int i = 0;; i ^= 1) {
+		pthread_mutex_lock(&reader->lock);
+		while (reader->full[i] && !reader->abort)
+			pthread_cond_wait(&reader->cond, &reader->lock);
+		bool abort = reader->abort;
+		pthread_mutex_unlock(&reader->lock);
+
+		if (abort)
+			break;
+
+		ssize_t len =
+			ssl_hash_reader_fill(reader, reader->buf[i], SSL_HASH_FILE_CHUNK_SIZE);
+
+		pthread_mutex_lock(&reader->lock);
+		reader->len[i] = len;
+		reader->error = len < 0 ? errno : 0;
+		reader->full[i] = true;
+		pthread_cond_signal(&reader->cond);
+		pthread_mutex_unlock(&reader->lock);
+
+		if (len <= 0)
+			break;
+	}
+	return NULL;
+}
+
+static double
+ssl_hash_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int
+ssl_hash_file_multi_internal(const char *file_to_hash, const char *const *hash_algos, size_t n,
+			     bool follow, uint64_t size, unsigned int timeout_ms,
+			     unsigned char **hashes, unsigned int *hash_lens)
+{
+	ASSERT(file_to_hash);
+	ASSERT(hash_algos);
+	ASSERT(hashes);
+	ASSERT(hash_lens);
+
+	int ret = -1;
+	bool reader_started = false;
+	off_t offset = 0;
+	double start = ssl_hash_now_ms();
+	EVP_MD_CTX **md_ctx = mem_new0(EVP_MD_CTX *, n);
+	ssl_hash_reader_t reader = { .fd = -1,
+				     .lock = PTHREAD_MUTEX_INITIALIZER,
+				     .cond = PTHREAD_COND_INITIALIZER,
+				     .follow = follow,
+				     .remaining = size,
+				     .timeout_ms = timeout_ms };
+	pthread_t reader_thread;
+
+	for (size_t i = 0; i < n; i++) {
+		const EVP_MD *hash_fct;
+		hashes[i] = NULL;
+
+		if ((hash_fct = EVP_get_digestbyname(hash_algos[i])) == NULL) {
+			ERROR("Error in file hasing (unable to initialize hash function %s)",
+			      hash_algos[i]);
+			goto out;
+		}
+		if ((md_ctx[i] = EVP_MD_CTX_new()) == NULL) {
+			ERROR("Allocating EVP_MD failed!");
+			goto out;
+		}
+		EVP_DigestInit(md_ctx[i], hash_fct);
+	}
+
+	if ((reader.fd = open(file_to_hash, O_RDONLY | O_CLOEXEC)) < 0) {
+		ERROR_ERRNO("Error in file hasing (opening hash file)");
+		goto out;
+	}
+
+	// the file is read exactly once from start to end, let the kernel read ahead
+	if ((errno = posix_fadvise(reader.fd, 0, 0, POSIX_FADV_SEQUENTIAL)))
+		TRACE_ERRNO("posix_fadvise(SEQUENTIAL) failed for %s", file_to_hash);
+
+	for (int i = 0; i < 2; i++) {
+		if ((errno = posix_memalign((void **)&reader.buf[i], SSL_HASH_FILE_ALIGNMENT,
+					    SSL_HASH_FILE_CHUNK_SIZE))) {
+			ERROR_ERRNO("Error in file hashing (allocating read buffer)");
+			goto out;
+		}
+	}
+
+	if ((errno = pthread_create(&reader_thread, NULL, ssl_hash_reader_thread, &reader))) {
+		ERROR_ERRNO("Error in file hashing (starting reader thread)");
+		goto out;
+	}
+	reader_started = true;
+
+	// digest the chunks in the order the reader fills them
+	for (int i = 0;; i ^= 1) {
+		pthread_mutex_lock(&reader.lock);
+		while (!reader.full[i])
+			pthread_cond_wait(&reader.cond, &reader.lock);
+		ssize_t len = reader.len[i];
+		errno = reader.error;
+		pthread_mutex_unlock(&reader.lock);
+
+		if (len < 0) {
+			ERROR_ERRNO("Error in file hashing (reading file failed)");
+			goto out;
+		}
+		if (len == 0)
+			break;
+
+		for (size_t j = 0; j < n; j++) {
+			if (!EVP_DigestUpdate(md_ctx[j], reader.buf[i], len)) {
+				ERROR("Error in file hashing (reading/hashing file failed");
+				goto out;
+			}
+		}
+
+		// hashed data is not needed anymore, do not let it evict the page cache
+		posix_fadvise(reader.fd, offset, len, POSIX_FADV_DONTNEED);
+		offset += len;
+
+		pthread_mutex_lock(&reader.lock);
+		reader.full[i] = false;
+		pthread_cond_signal(&reader.cond);
+		pthread_mutex_unlock(&reader.lock);
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		hashes[i] = (unsigned char *)mem_alloc0(EVP_MAX_MD_SIZE);
+		if (EVP_DigestFinal(md_ctx[i], hashes[i], &hash_lens[i]) != 1) {
+			ERROR("Error in file hashing (computing hash)");
+			goto out;
+		}
+	}
+	ret = 0;
+
+	double elapsed = ssl_hash_now_ms() - start;
+	TRACE("Hashed %s (%jd bytes, %zu digests) in %.1f ms, %.1f MB/s", file_to_hash,
+	      (intmax_t)offset, n, elapsed,
+	      elapsed > 0 ? (offset / (1024.0 * 1024.0)) / (elapsed / 1000.0) : 0.0);
+
+out:
+	if (reader_started) {
+		pthread_mutex_lock(&reader.lock);
+		reader.abort = true;
+		pthread_cond_signal(&reader.cond);
+		pthread_mutex_unlock(&reader.lock);
+		pthread_join(reader_thread, NULL);
+	}
+	if (reader.fd >= 0)
+		close(reader.fd);
+	for (int i = 0; i < 2; i++)
+		mem_free(reader.buf[i]);
+	for (size_t i = 0; i < n; i++) {
+		if (md_ctx[i])
+			EVP_MD_CTX_free(md_ctx[i]);
+		if (ret && hashes[i])
+			mem_free0(hashes[i]);
+	}
+	mem_free0(md_ctx);
+	return ret;
+}
+
+int
+ssl_hash_file_multi(const char *file_to_hash, const char *const *hash_algos, size_t n,
+		    unsigned char **hashes, unsigned int *hash_lens)
+{
+	return ssl_hash_file_multi_internal(file_to_hash, hash_algos, n, false, 0, 0, hashes,
+					    hash_lens);
+}
+
+int
+ssl_hash_file_follow_multi(const char *file_to_hash, const char *const *hash_algos, size_t n,
+			   uint64_t size, unsigned int timeout_ms, unsigned char **hashes,
+			   unsigned int *hash_lens)
+{
+	return ssl_hash_file_multi_internal(file_to_hash, hash_algos, n, true, size, timeout_ms,
+					    hashes, hash_lens);
+}
+
 unsigned char *
 ssl_hash_file(const char *file_to_hash, unsigned int *calc_len, const char *hash_algo)
 {
@@ -1201,57 +1547,100 @@ ssl_hash_file(const char *file_to_hash, unsigned int *calc_len, const char *hash
 	ASSERT(hash_algo);
 
 	unsigned char *ret = NULL;
-	FILE *fp = NULL;
+
+	if (ssl_hash_file_multi(file_to_hash, &hash_algo, 1, &ret, calc_len) < 0)
+		return NULL;
+
+	return ret;
+}
+
+unsigned char **
+ssl_hash_file_blocks_new(const char *file_to_hash, const char *hash_algo, uint64_t offset,
+			 uint64_t len, size_t block_size, const unsigned char *salt,
+			 size_t salt_len, unsigned int *hash_len, size_t *n_blocks)
+{
+	ASSERT(file_to_hash);
+	ASSERT(hash_algo);
+	ASSERT(hash_len);
+	ASSERT(n_blocks);
+
+	int fd = -1;
+	unsigned char *buf = NULL;
+	unsigned char **hashes = NULL;
+	size_t n = 0;
 	const EVP_MD *hash_fct;
 	EVP_MD_CTX *md_ctx = NULL;
 
-	if (!(fp = fopen(file_to_hash, "rb"))) {
-		ERROR("Error in file hasing (opening hash file)");
-		return NULL;
-	}
+	IF_TRUE_RETVAL(len == 0 || block_size == 0 || block_size > SSL_HASH_FILE_BLOCK_MAX_SIZE,
+		       NULL);
 
 	if ((hash_fct = EVP_get_digestbyname(hash_algo)) == NULL) {
-		ERROR("Error in file hasing (unable to initialize hash function");
-		fclose(fp);
+		ERROR("Error in file hasing (unable to initialize hash function %s)", hash_algo);
 		return NULL;
 	}
-
 	if ((md_ctx = EVP_MD_CTX_new()) == NULL) {
 		ERROR("Allocating EVP_MD failed!");
-		fclose(fp);
 		return NULL;
 	}
+	if ((fd = open(file_to_hash, O_RDONLY | O_CLOEXEC)) < 0) {
+		ERROR_ERRNO("Error in file hasing (opening hash file)");
+		goto error;
+	}
+	if ((errno = posix_fadvise(fd, offset, len, POSIX_FADV_SEQUENTIAL)))
+		TRACE_ERRNO("posix_fadvise(SEQUENTIAL) failed for %s", file_to_hash);
 
-	EVP_DigestInit(md_ctx, hash_fct);
+	size_t max_blocks = len / block_size + (len % block_size ? 1 : 0);
+	hashes = mem_new0(unsigned char *, max_blocks);
+	buf = mem_alloc(block_size);
 
-	int len = 0;
-	unsigned char buffer[SIGN_HASH_BUFFER_SIZE];
+	// the last block may be shorter than block_size
+	for (uint64_t pos = offset; pos < offset + len; pos += block_size) {
+		size_t want = MIN(block_size, offset + len - pos);
+		size_t got = 0;
+		while (got < want) {
+			ssize_t r = pread(fd, buf + got, want - got, pos + got);
+			if (r < 0 && errno == EINTR)
+				continue;
+			if (r < 0) {
+				ERROR_ERRNO("Error in file hashing (reading block at %" PRIu64 ")",
+					    pos);
+				goto error;
+			}
+			if (r == 0) {
+				ERROR("Error in file hashing (block at %" PRIu64 " exceeds file)",
+				      pos);
+				goto error;
+			}
+			got += r;
+		}
 
-	while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
-		if (!EVP_DigestUpdate(md_ctx, buffer, len)) {
-			ERROR("Error in file hashing (reading/hashing file failed");
-			fclose(fp);
+		unsigned char *hash = hashes[n++] = mem_alloc0(EVP_MAX_MD_SIZE);
+		if (EVP_DigestInit_ex(md_ctx, hash_fct, NULL) != 1 ||
+		    (salt_len && EVP_DigestUpdate(md_ctx, salt, salt_len) != 1) ||
+		    EVP_DigestUpdate(md_ctx, buf, want) != 1 ||
+		    EVP_DigestFinal_ex(md_ctx, hash, hash_len) != 1) {
+			ERROR("Error in file hashing (computing hash)");
 			goto error;
 		}
 	}
-	fclose(fp);
 
-	ret = (unsigned char *)mem_alloc0(EVP_MAX_MD_SIZE);
-	if (EVP_DigestFinal(md_ctx, ret, calc_len) != 1) {
-		ERROR("Error in file hashing (computing hash)");
-		mem_free0(ret);
-		ret = NULL;
-		goto error;
-	}
-	/* DEBUG OUTPUT
-	char *string = mem_alloc0(*calc_len*2+1);
-	for (unsigned int i = 0;  i < *calc_len;  i++) snprintf(string+2*i, 3, "%02x", ret[i]);
-	DEBUG("Calc hash: %s", string);
-	*/
+	*n_blocks = n;
+	close(fd);
+	mem_free0(buf);
+	EVP_MD_CTX_free(md_ctx);
+	return hashes;
 
 error:
+	for (size_t i = 0; i < n; i++)
+		mem_free0(hashes[i]);
+	if (hashes)
+		mem_free0(hashes);
+	if (buf)
+		mem_free0(buf);
+	if (fd >= 0)
+		close(fd);
 	EVP_MD_CTX_free(md_ctx);
-	return ret;
+	return NULL;
 }
 
 int
@@ -25,6 +25,7 @@
 #define P12UTIL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <openssl/evp.h>
 #include <openssl/x509v3.h>
@@ -113,6 +114,16 @@ ssl_unwrap_key_sym(const unsigned char *kek, const unsigned char *wrapped_key,
 int
 ssl_verify_certificate(const char *test_cert_file, const char *root_cert_file, bool ignore_time);
 
+/**
+ * Same as ssl_verify_certificate, but reads the PEM encoded certificate (and
+ * its optional chain) under test from cert_buf instead of a file.
+ * @return Returns 0 on success, -1 if the verification failed and -2 in case of
+ * an unexpected verification error.
+ */
+int
+ssl_verify_certificate_from_buf(const uint8_t *cert_buf, size_t cert_len,
+				const char *root_cert_file, bool ignore_time);
+
 /**
  * verifies a signature stored in signed_file with a certificate stored in cert_file. Thereby, the original
  * file located in signature_file is hashed with the hash algorithm hash_algo.
@@ -155,6 +166,15 @@ unsigned char *
 ssl_hash_buf(const unsigned char *buf_to_hash, unsigned int buf_len, unsigned int *calc_len,
 	     const char *digest_algo);
 
+/**
+ * Computes the HMAC of the buffer buf with the given key and the digest algorithm digest_algo.
+ * @return The function reveals the tag as return value and its length via the parameter calc_len.
+ * In case of a failure, NULL is returned.
+ */
+unsigned char *
+ssl_hmac_buf(const unsigned char *key, size_t key_len, const unsigned char *buf, size_t buf_len,
+	     unsigned int *calc_len, const char *digest_algo);
+
 /**
  * The file located in file_to_hash is hashed with the hash algorithm hash_algo.
  * @return The function reveals the hash  as return value and its length via the parameter calc_len.
@@ -163,6 +183,44 @@ ssl_hash_buf(const unsigned char *buf_to_hash, unsigned int buf_len, unsigned in
 unsigned char *
 ssl_hash_file(const char *file_to_hash, unsigned int *calc_len, const char *hash_algo);
 
+/**
+ * The file located in file_to_hash is hashed with each of the n hash algorithms
+ * in hash_algos at once, i.e., the file is only read once.
+ * @return Returns 0 on success and stores the newly allocated hashes and their
+ * lengths in hashes and hash_lens (in the order of hash_algos), -1 on failure.
+ */
+int
+ssl_hash_file_multi(const char *file_to_hash, const char *const *hash_algos, size_t n,
+		    unsigned char **hashes, unsigned int *hash_lens);
+
+/**
+ * Like ssl_hash_file_multi(), but for a file which is still being written, e.g.,
+ * by a download. The file is hashed as the data arrives until it reaches size
+ * bytes, so that the hashes are available as soon as the writer is done.
+ * Hashing fails if the file is removed or truncated meanwhile, or if it has
+ * not grown for timeout_ms milliseconds.
+ * @return Returns 0 on success and stores the newly allocated hashes and their
+ * lengths in hashes and hash_lens (in the order of hash_algos), -1 on failure.
+ */
+int
+ssl_hash_file_follow_multi(const char *file_to_hash, const char *const *hash_algos, size_t n,
+			   uint64_t size, unsigned int timeout_ms, unsigned char **hashes,
+			   unsigned int *hash_lens);
+
+/**
+ * The range [offset, offset + len) of the file located in file_to_hash is split
+ * into blocks of block_size bytes (the last one may be shorter) and each block
+ * is hashed individually with hash_algo. If salt is given, it is prepended to
+ * each block, as done for the blocks of a dm-verity hash tree.
+ * @return Returns a newly allocated array of the newly allocated block hashes
+ * of length hash_len and stores the number of blocks in n_blocks, or NULL on
+ * failure, e.g., if the range exceeds the file.
+ */
+unsigned char **
+ssl_hash_file_blocks_new(const char *file_to_hash, const char *hash_algo, uint64_t offset,
+			 uint64_t len, size_t block_size, const unsigned char *salt,
+			 size_t salt_len, unsigned int *hash_len, size_t *n_blocks);
+
 /**
  * creates a pkcs 12 softtoken located in the file token_file, locked with the password passphrase.
  * The corresponding (currently) self-signed certificate is stored in the file cert_file, if specified
@@ -1,5 +1,8 @@
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "munit.h"
@@ -691,6 +694,201 @@ test_ssl_verify_cert_null_untrusted_complete_chain(UNUSED const MunitParameter p
 	return MUNIT_OK;
 }
 
+// Test <trusted chain> from memory against <trusted rootca>
+static MunitResult
+test_ssl_verify_cert_from_buf_trusted_chain(UNUSED const MunitParameter params[],
+					    UNUSED void *data)
+{
+	const char *cert_file = "testdata/testpki/ssig_cml.cert";
+	off_t cert_len = file_size(cert_file);
+	munit_assert(cert_len > 0);
+
+	char *cert_buf = file_read_new(cert_file, cert_len);
+	munit_assert_not_null(cert_buf);
+
+	int ret = ssl_verify_certificate_from_buf((uint8_t *)cert_buf, cert_len,
+						  "testdata/testpki/ssig_rootca.cert", false);
+	munit_assert(ret == 0);
+
+	mem_free0(cert_buf);
+	return MUNIT_OK;
+}
+
+// Test <untrusted chain> from memory against <trusted rootca>
+static MunitResult
+test_ssl_verify_cert_from_buf_untrusted_chain(UNUSED const MunitParameter params[],
+					      UNUSED void *data)
+{
+	const char *cert_file = "testdata/testpki_untrusted/ssig_cml.cert";
+	off_t cert_len = file_size(cert_file);
+	munit_assert(cert_len > 0);
+
+	char *cert_buf = file_read_new(cert_file, cert_len);
+	munit_assert_not_null(cert_buf);
+
+	int ret = ssl_verify_certificate_from_buf((uint8_t *)cert_buf, cert_len,
+						  "testdata/testpki/ssig_rootca.cert", false);
+	munit_assert(ret == -1);
+
+	// garbage is an error, not an invalid certificate
+	ret = ssl_verify_certificate_from_buf((uint8_t *)"garbage", 7,
+					      "testdata/testpki/ssig_rootca.cert", false);
+	munit_assert(ret == -2);
+
+	mem_free0(cert_buf);
+	return MUNIT_OK;
+}
+
+// Test that hashing a file with several digests at once matches single digests
+static MunitResult
+test_ssl_hash_file_multi(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	const char *file = "testdata/create_certs.sh";
+	const char *algos[] = { "SHA1", "SHA256", "SHA512" };
+	unsigned char *hashes[3];
+	unsigned int hash_lens[3];
+
+	off_t len = file_size(file);
+	munit_assert(len > 0);
+	unsigned char *buf = mem_alloc0(len);
+	munit_assert(file_read(file, (char *)buf, len) == len);
+
+	munit_assert(ssl_hash_file_multi(file, algos, 3, hashes, hash_lens) == 0);
+
+	for (int i = 0; i < 3; i++) {
+		unsigned int expected_len;
+		unsigned char *expected = ssl_hash_buf(buf, len, &expected_len, algos[i]);
+		munit_assert_not_null(expected);
+		munit_assert_uint(hash_lens[i], ==, expected_len);
+		munit_assert_memory_equal(expected_len, hashes[i], expected);
+		mem_free0(expected);
+		mem_free0(hashes[i]);
+	}
+
+	// a missing file is an error for all digests
+	munit_assert(ssl_hash_file_multi("testdata/nonexistent", algos, 3, hashes, hash_lens) ==
+		     -1);
+
+	mem_free0(buf);
+	return MUNIT_OK;
+}
+
+typedef struct {
+	const char *file;
+	const unsigned char *buf;
+	size_t len;
+} follow_writer_t;
+
+// appends the buffer to the file in a few pieces, as a download would
+static void *
+follow_writer_thread(void *data)
+{
+	follow_writer_t *w = data;
+	const struct timespec delay = { .tv_sec = 0, .tv_nsec = 30 * 1000000L };
+
+	int fd = open(w->file, O_WRONLY | O_APPEND);
+	for (size_t pos = 0; fd >= 0 && pos < w->len;) {
+		size_t piece = MIN(w->len - pos, w->len / 4 + 1);
+		if (write(fd, w->buf + pos, piece) != (ssize_t)piece)
+			break;
+		pos += piece;
+		nanosleep(&delay, NULL);
+	}
+	if (fd >= 0)
+		close(fd);
+	return NULL;
+}
+
+static MunitResult
+test_ssl_hash_file_follow_multi(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	const char *src = "testdata/create_certs.sh";
+	const char *file = "testdata/follow.tmp";
+	const char *algos[] = { "SHA1", "SHA256" };
+	unsigned char *hashes[2];
+	unsigned int hash_lens[2];
+
+	off_t len = file_size(src);
+	munit_assert(len > 0);
+	unsigned char *buf = mem_alloc0(len);
+	munit_assert(file_read(src, (char *)buf, len) == len);
+
+	// hash the file while it is being written
+	munit_assert(file_write(file, "", 0) == 0);
+	follow_writer_t w = { .file = file, .buf = buf, .len = len };
+	pthread_t writer;
+	munit_assert(pthread_create(&writer, NULL, follow_writer_thread, &w) == 0);
+	int ret = ssl_hash_file_follow_multi(file, algos, 2, len, 1000, hashes, hash_lens);
+	pthread_join(writer, NULL);
+	munit_assert(ret == 0);
+
+	for (int i = 0; i < 2; i++) {
+		unsigned int expected_len;
+		unsigned char *expected = ssl_hash_buf(buf, len, &expected_len, algos[i]);
+		munit_assert_not_null(expected);
+		munit_assert_uint(hash_lens[i], ==, expected_len);
+		munit_assert_memory_equal(expected_len, hashes[i], expected);
+		mem_free0(expected);
+		mem_free0(hashes[i]);
+	}
+
+	// a file which does not grow to the expected size times out
+	munit_assert(ssl_hash_file_follow_multi(file, algos, 2, len + 1, 100, hashes, hash_lens) ==
+		     -1);
+
+	unlink(file);
+	mem_free0(buf);
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_ssl_hash_file_blocks(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	const char *file = "testdata/create_certs.sh";
+	const unsigned char salt[] = { 0xde, 0xad, 0xbe, 0xef };
+	const size_t block_size = 100, offset = 10;
+	unsigned int hash_len;
+	size_t n;
+
+	off_t len = file_size(file);
+	munit_assert(len > (off_t)(offset + 3 * block_size));
+	unsigned char *buf = mem_alloc0(sizeof(salt) + len);
+	munit_assert(file_read(file, (char *)buf + sizeof(salt), len) == len);
+
+	// range with a short last block
+	uint64_t range_len = len - offset - 1;
+	unsigned char **hashes = ssl_hash_file_blocks_new(
+		file, "SHA256", offset, range_len, block_size, salt, sizeof(salt), &hash_len, &n);
+	munit_assert_not_null(hashes);
+	munit_assert_size(n, ==, (range_len + block_size - 1) / block_size);
+
+	for (size_t i = 0; i < n; i++) {
+		// hash of salt || block
+		size_t pos = offset + i * block_size;
+		size_t block_len = MIN(block_size, offset + range_len - pos);
+		unsigned char *block = buf + pos;
+		memcpy(block, salt, sizeof(salt));
+		unsigned int expected_len;
+		unsigned char *expected =
+			ssl_hash_buf(block, sizeof(salt) + block_len, &expected_len, "SHA256");
+		munit_assert_not_null(expected);
+		munit_assert_uint(hash_len, ==, expected_len);
+		munit_assert_memory_equal(expected_len, hashes[i], expected);
+		mem_free0(expected);
+		mem_free0(hashes[i]);
+		// restore file content overwritten by the salt
+		munit_assert(file_read(file, (char *)buf + sizeof(salt), len) == len);
+	}
+	mem_free0(hashes);
+
+	// ranges exceeding the file are an error
+	munit_assert_null(ssl_hash_file_blocks_new(file, "SHA256", offset, len, block_size, NULL, 0,
+						   &hash_len, &n));
+
+	mem_free0(buf);
+	return MUNIT_OK;
+}
+
 static MunitResult
 test_ssl_aes_ecb_pad_success(UNUSED const MunitParameter params[], UNUSED void *data)
 {
@@ -1031,6 +1229,18 @@ static MunitTest tests[] = {
 	{ "test_ssl_verify_cert_null_untrusted_complete_chain",
 	  test_ssl_verify_cert_null_untrusted_complete_chain, setup, tear_down,
 	  MUNIT_TEST_OPTION_NONE, NULL },
+	{ "test_ssl_verify_cert_from_buf_trusted_chain",
+	  test_ssl_verify_cert_from_buf_trusted_chain, setup, tear_down, MUNIT_TEST_OPTION_NONE,
+	  NULL },
+	{ "test_ssl_verify_cert_from_buf_untrusted_chain",
+	  test_ssl_verify_cert_from_buf_untrusted_chain, setup, tear_down, MUNIT_TEST_OPTION_NONE,
+	  NULL },
+	{ "test_ssl_hash_file_multi", test_ssl_hash_file_multi, setup, tear_down,
+	  MUNIT_TEST_OPTION_NONE, NULL },
+	{ "test_ssl_hash_file_follow_multi", test_ssl_hash_file_follow_multi, setup, tear_down,
+	  MUNIT_TEST_OPTION_NONE, NULL },
+	{ "test_ssl_hash_file_blocks", test_ssl_hash_file_blocks, setup, tear_down,
+	  MUNIT_TEST_OPTION_NONE, NULL },
 	{ "test_ssl_aes_ecb_pad_success", test_ssl_aes_ecb_pad_success, setup, tear_down,
 	  MUNIT_TEST_OPTION_NONE, NULL },
 	{ "test_ssl_aes_ecb_pad_fail", test_ssl_aes_ecb_pad_fail, setup, tear_down,
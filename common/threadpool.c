@@ -0,0 +1,273 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+//#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
+
+#include "threadpool.h"
+#include "event.h"
+#include "macro.h"
+#include "mem.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+typedef struct threadpool_job {
+	void (*func)(void *data);
+	void (*done_cb)(void *data);
+	void *data;
+	struct threadpool_job *next;
+} threadpool_job_t;
+
+/* singly linked FIFO, which allows appending in O(1) */
+typedef struct threadpool_queue {
+	threadpool_job_t *head;
+	threadpool_job_t *tail;
+} threadpool_queue_t;
+
+struct threadpool {
+	pthread_t *threads;
+	unsigned int threads_len;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	threadpool_queue_t queued; // jobs waiting for a worker, protected by lock
+	threadpool_queue_t done;   // jobs waiting for done_cb, protected by lock
+	bool shutdown;
+
+	int event_fd;
+	event_io_t *event_io; // only registered while jobs are pending
+	unsigned int pending; // only accessed by the event loop thread
+};
+
+static void
+threadpool_queue_push(threadpool_queue_t *queue, threadpool_job_t *job)
+{
+	job->next = NULL;
+	if (queue->tail)
+		queue->tail->next = job;
+	else
+		queue->head = job;
+	queue->tail = job;
+}
+
+static threadpool_job_t *
+threadpool_queue_pop(threadpool_queue_t *queue)
+{
+	threadpool_job_t *job = queue->head;
+	if (job) {
+		queue->head = job->next;
+		if (!queue->head)
+			queue->tail = NULL;
+	}
+	return job;
+}
+
+static void
+threadpool_queue_free(threadpool_queue_t *queue)
+{
+	threadpool_job_t *job;
+	while ((job = threadpool_queue_pop(queue)))
+		mem_free0(job);
+}
+
+static void *
+threadpool_worker(void *arg)
+{
+	threadpool_t *pool = arg;
+
+	pthread_mutex_lock(&pool->lock);
+	while (true) {
+		while (!pool->shutdown && !pool->queued.head)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		if (pool->shutdown)
+			break;
+
+		threadpool_job_t *job = threadpool_queue_pop(&pool->queued);
+		pthread_mutex_unlock(&pool->lock);
+
+		job->func(job->data);
+
+		pthread_mutex_lock(&pool->lock);
+		bool signal = !pool->done.head;
+		threadpool_queue_push(&pool->done, job);
+		// the event loop drains the whole done queue on each wakeup
+		if (signal && eventfd_write(pool->event_fd, 1) < 0)
+			ERROR_ERRNO("Could not signal job completion");
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static void
+threadpool_done_cb(int fd, unsigned events, UNUSED event_io_t *io, void *data)
+{
+	threadpool_t *pool = data;
+	eventfd_t value;
+
+	IF_FALSE_RETURN(events & EVENT_IO_READ);
+
+	if (eventfd_read(fd, &value) < 0 && errno != EAGAIN)
+		WARN_ERRNO("Could not read completion eventfd");
+
+	pthread_mutex_lock(&pool->lock);
+	threadpool_queue_t done = pool->done;
+	pool->done.head = pool->done.tail = NULL;
+	pthread_mutex_unlock(&pool->lock);
+
+	threadpool_job_t *job;
+	while ((job = threadpool_queue_pop(&done))) {
+		pool->pending--;
+		if (job->done_cb)
+			job->done_cb(job->data);
+		mem_free0(job);
+	}
+
+	if (!pool->pending && pool->event_io) {
+		TRACE("Threadpool %p idle", (void *)pool);
+		event_remove_io(pool->event_io);
+		event_io_free(pool->event_io);
+		pool->event_io = NULL;
+	}
+}
+
+threadpool_t *
+threadpool_new(unsigned int threads)
+{
+	if (threads == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? (unsigned int)cpus : 1;
+	}
+
+	threadpool_t *pool = mem_new0(threadpool_t, 1);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+
+	pool->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (pool->event_fd < 0) {
+		ERROR_ERRNO("Could not create completion eventfd");
+		goto error;
+	}
+
+	// workers inherit the signal mask; keep all signals for the event loop
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	pool->threads = mem_new0(pthread_t, threads);
+	for (unsigned int i = 0; i < threads; i++) {
+		int ret = pthread_create(&pool->threads[i], NULL, threadpool_worker, pool);
+		if (ret) {
+			errno = ret;
+			ERROR_ERRNO("Could not create worker thread %u", i);
+			break;
+		}
+		pool->threads_len++;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	IF_TRUE_GOTO(pool->threads_len == 0, error);
+
+	DEBUG("Created threadpool %p with %u workers", (void *)pool, pool->threads_len);
+	return pool;
+
+error:
+	threadpool_free(pool);
+	return NULL;
+}
+
+void
+threadpool_free(threadpool_t *pool)
+{
+	IF_NULL_RETURN(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = true;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (unsigned int i = 0; i < pool->threads_len; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	if (pool->pending)
+		WARN("Dropping %u pending jobs of threadpool %p", pool->pending, (void *)pool);
+	threadpool_queue_free(&pool->queued);
+	threadpool_queue_free(&pool->done);
+
+	if (pool->event_io) {
+		event_remove_io(pool->event_io);
+		event_io_free(pool->event_io);
+	}
+	if (pool->event_fd >= 0)
+		close(pool->event_fd);
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	mem_free0(pool->threads);
+	mem_free0(pool);
+}
+
+int
+threadpool_add(threadpool_t *pool, void (*func)(void *data), void (*done_cb)(void *data),
+	       void *data)
+{
+	IF_NULL_RETVAL(pool, -1);
+	IF_NULL_RETVAL(func, -1);
+
+	if (!pool->event_io) {
+		pool->event_io =
+			event_io_new(pool->event_fd, EVENT_IO_READ, threadpool_done_cb, pool);
+		event_add_io(pool->event_io);
+	}
+
+	threadpool_job_t *job = mem_new0(threadpool_job_t, 1);
+	job->func = func;
+	job->done_cb = done_cb;
+	job->data = data;
+
+	pool->pending++;
+
+	pthread_mutex_lock(&pool->lock);
+	threadpool_queue_push(&pool->queued, job);
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+unsigned int
+threadpool_get_threads(const threadpool_t *pool)
+{
+	return pool ? pool->threads_len : 0;
+}
+
+unsigned int
+threadpool_get_pending(const threadpool_t *pool)
+{
+	return pool ? pool->pending : 0;
+}
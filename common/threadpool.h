@@ -0,0 +1,92 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file threadpool.h
+ *
+ * Implements a bounded pool of worker threads for CPU or I/O heavy jobs which
+ * would otherwise block the event loop. A job consists of a function which is
+ * executed in one of the worker threads and a completion callback which is
+ * called afterwards from the event loop of the thread that created the pool.
+ * Completions are signaled through an eventfd, which is only registered in the
+ * event loop while jobs are pending; thus, an idle pool does not keep
+ * event_loop() from returning.
+ *
+ * The job functions must not call into the event loop or other non thread-safe
+ * parts of the code base; everything else should be done in the completion
+ * callback.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+typedef struct threadpool threadpool_t;
+
+/**
+ * Creates a new pool with the given number of worker threads. The worker
+ * threads block all signals, so that these are still delivered through the
+ * event loop.
+ *
+ * @param threads Number of worker threads; 0 selects the number of online CPUs.
+ * @return Pointer to the new pool or NULL on error.
+ */
+threadpool_t *
+threadpool_new(unsigned int threads);
+
+/**
+ * Stops the worker threads after their current job and frees the pool. Jobs
+ * which have not been completed yet are dropped without calling their
+ * completion callback.
+ *
+ * @param pool The pool to be freed.
+ */
+void
+threadpool_free(threadpool_t *pool);
+
+/**
+ * Queues a job for execution in the pool.
+ *
+ * @param pool The pool.
+ * @param func Function executed in a worker thread.
+ * @param done_cb Optional callback which is called from the event loop after func has finished.
+ * @param data Data passed to func and done_cb.
+ * @return 0 on success, -1 on error.
+ */
+int
+threadpool_add(threadpool_t *pool, void (*func)(void *data), void (*done_cb)(void *data),
+	       void *data);
+
+/**
+ * Returns the number of worker threads of the pool.
+ */
+unsigned int
+threadpool_get_threads(const threadpool_t *pool);
+
+/**
+ * Returns the number of jobs which have been added but whose completion
+ * callback has not been called yet.
+ */
+unsigned int
+threadpool_get_pending(const threadpool_t *pool);
+
+#endif /* THREADPOOL_H */
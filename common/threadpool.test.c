@@ -0,0 +1,221 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+#include "munit.h"
+
+#include "threadpool.h"
+#include "event.h"
+#include "logf.h"
+#include "macro.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define TEST_THREADPOOL_THREADS 4
+#define TEST_THREADPOOL_JOBS 64
+
+typedef struct test_threadpool_job {
+	unsigned int n;
+	unsigned long result;
+	pthread_t worker;
+} test_threadpool_job_t;
+
+static unsigned int test_threadpool_done;
+static pthread_t test_threadpool_main;
+
+static pthread_mutex_t test_threadpool_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int test_threadpool_running;
+static unsigned int test_threadpool_running_max;
+
+static void *
+setup(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	logf_register(&logf_test_write, stderr);
+	event_init();
+	test_threadpool_done = 0;
+	test_threadpool_main = pthread_self();
+	return NULL;
+}
+
+static void
+tear_down(UNUSED void *fixture)
+{
+	event_reset();
+}
+
+static void
+test_threadpool_sum(void *data)
+{
+	test_threadpool_job_t *job = data;
+
+	job->worker = pthread_self();
+	job->result = 0;
+	for (unsigned long i = 1; i <= job->n; i++)
+		job->result += i;
+}
+
+static void
+test_threadpool_done_cb(void *data)
+{
+	test_threadpool_job_t *job = data;
+
+	// completions are delivered in the event loop thread
+	munit_assert_true(pthread_equal(pthread_self(), test_threadpool_main));
+	munit_assert_false(pthread_equal(job->worker, test_threadpool_main));
+	munit_assert_ulong(job->result, ==, (unsigned long)job->n * (job->n + 1) / 2);
+	test_threadpool_done++;
+}
+
+static MunitResult
+test_threadpool_jobs(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	static test_threadpool_job_t jobs[TEST_THREADPOOL_JOBS];
+
+	threadpool_t *pool = threadpool_new(TEST_THREADPOOL_THREADS);
+	munit_assert_not_null(pool);
+	munit_assert_uint(threadpool_get_threads(pool), ==, TEST_THREADPOOL_THREADS);
+
+	for (int i = 0; i < TEST_THREADPOOL_JOBS; i++) {
+		jobs[i].n = 1000 * i;
+		munit_assert_int(threadpool_add(pool, test_threadpool_sum, test_threadpool_done_cb,
+						&jobs[i]),
+				 ==, 0);
+	}
+	munit_assert_uint(threadpool_get_pending(pool), ==, TEST_THREADPOOL_JOBS);
+
+	// the loop returns as soon as the pool is idle again
+	event_loop();
+
+	munit_assert_uint(test_threadpool_done, ==, TEST_THREADPOOL_JOBS);
+	munit_assert_uint(threadpool_get_pending(pool), ==, 0);
+
+	threadpool_free(pool);
+	return MUNIT_OK;
+}
+
+static void
+test_threadpool_wait_for_all(UNUSED void *data)
+{
+	pthread_mutex_lock(&test_threadpool_lock);
+	test_threadpool_running++;
+	test_threadpool_running_max = MAX(test_threadpool_running_max, test_threadpool_running);
+	pthread_mutex_unlock(&test_threadpool_lock);
+
+	// wait (bounded) until all workers run concurrently
+	for (int i = 0; i < 1000; i++) {
+		pthread_mutex_lock(&test_threadpool_lock);
+		bool all = test_threadpool_running_max == TEST_THREADPOOL_THREADS;
+		pthread_mutex_unlock(&test_threadpool_lock);
+		if (all)
+			break;
+		usleep(1000);
+	}
+
+	pthread_mutex_lock(&test_threadpool_lock);
+	test_threadpool_running--;
+	pthread_mutex_unlock(&test_threadpool_lock);
+}
+
+static void
+test_threadpool_count_cb(UNUSED void *data)
+{
+	test_threadpool_done++;
+}
+
+static MunitResult
+test_threadpool_concurrency(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	threadpool_t *pool = threadpool_new(TEST_THREADPOOL_THREADS);
+	munit_assert_not_null(pool);
+
+	test_threadpool_running = test_threadpool_running_max = 0;
+	for (int i = 0; i < 2 * TEST_THREADPOOL_THREADS; i++)
+		threadpool_add(pool, test_threadpool_wait_for_all, test_threadpool_count_cb, NULL);
+
+	event_loop();
+
+	// never more jobs than workers run at the same time
+	munit_assert_uint(test_threadpool_running_max, ==, TEST_THREADPOOL_THREADS);
+	munit_assert_uint(test_threadpool_done, ==, 2 * TEST_THREADPOOL_THREADS);
+
+	threadpool_free(pool);
+	return MUNIT_OK;
+}
+
+static MunitResult
+test_threadpool_free_pending(UNUSED const MunitParameter params[], UNUSED void *data)
+{
+	static test_threadpool_job_t jobs[TEST_THREADPOOL_JOBS];
+
+	threadpool_t *pool = threadpool_new(1);
+	munit_assert_not_null(pool);
+
+	for (int i = 0; i < TEST_THREADPOOL_JOBS; i++) {
+		jobs[i].n = 1000;
+		threadpool_add(pool, test_threadpool_sum, test_threadpool_done_cb, &jobs[i]);
+	}
+
+	// pending jobs are dropped without completion callbacks
+	threadpool_free(pool);
+	munit_assert_uint(test_threadpool_done, ==, 0);
+
+	return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+	{
+		"/jobs",		/* name */
+		test_threadpool_jobs,	/* test */
+		setup,			/* setup */
+		tear_down,		/* tear_down */
+		MUNIT_TEST_OPTION_NONE, /* options */
+		NULL			/* parameters */
+	},
+	{
+		"/concurrency",		     /* name */
+		test_threadpool_concurrency, /* test */
+		setup,			     /* setup */
+		tear_down,		     /* tear_down */
+		MUNIT_TEST_OPTION_NONE,	     /* options */
+		NULL			     /* parameters */
+	},
+	{
+		"/free pending",	      /* name */
+		test_threadpool_free_pending, /* test */
+		setup,			      /* setup */
+		tear_down,		      /* tear_down */
+		MUNIT_TEST_OPTION_NONE,	      /* options */
+		NULL			      /* parameters */
+	},
+
+	// Mark the end of the array with an entry where the test function is NULL
+	{ NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite threadpool_suite = {
+	"/threadpool",		/* name */
+	tests,			/* tests */
+	NULL,			/* suites */
+	1,			/* iterations */
+	MUNIT_SUITE_OPTION_NONE /* options */
+};
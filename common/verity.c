@@ -46,27 +46,12 @@
 #include "loopdev.h"
 #include "cryptfs.h"
 #include "dm.h"
+#include "verity.h"
 
 #define UUID_LEN 37
 
 extern struct dm_cmd_table cmd_table[];
 
-/* https://gitlab.com/cryptsetup/cryptsetup/wikis/DMVerity#verity-superblock-format */
-typedef struct __attribute__((packed)) {
-	uint8_t signature[8];
-	uint32_t version;
-	uint32_t hash_type;
-	uint8_t uuid[16];
-	uint8_t algorithm[32];
-	uint32_t data_block_size;
-	uint32_t hash_block_size;
-	uint64_t data_blocks;
-	uint16_t salt_size;
-	uint8_t reserved1[6];
-	uint8_t salt[256];
-	uint8_t reserved2[168];
-} verity_sb_t;
-
 extern int errno;
 
 static int
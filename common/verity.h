@@ -24,6 +24,25 @@
 #ifndef VERITY_H
 #define VERITY_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/* https://gitlab.com/cryptsetup/cryptsetup/wikis/DMVerity#verity-superblock-format */
+typedef struct __attribute__((packed)) {
+	uint8_t signature[8];
+	uint32_t version;
+	uint32_t hash_type;
+	uint8_t uuid[16];
+	uint8_t algorithm[32];
+	uint32_t data_block_size;
+	uint32_t hash_block_size;
+	uint64_t data_blocks;
+	uint16_t salt_size;
+	uint8_t reserved1[6];
+	uint8_t salt[256];
+	uint8_t reserved2[168];
+} verity_sb_t;
+
 /**
  * @brief Returns the path for a dm-verity device
  *
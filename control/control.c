@@ -41,6 +41,7 @@
 #include "common/str.h"
 
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <termios.h>
 #include <unistd.h>
@@ -1012,6 +1013,18 @@ handle_resp:
 		protobuf_free_message((ProtobufCMessage *)resp);
 		goto handle_resp;
 	} break;
+	case DAEMON_TO_CONTROLLER__CODE__GUESTOS_DOWNLOAD_PROGRESS: {
+		GuestOSDownloadProgress *progress = resp->guestos_download_progress;
+		if (progress && progress->has_total)
+			INFO("Downloading %s (%s v%" PRIu64 "): %" PRIu64 "/%" PRIu64 " bytes",
+			     progress->image, progress->name, progress->version, progress->received,
+			     progress->total);
+		else if (progress)
+			INFO("Downloading %s (%s v%" PRIu64 "): %" PRIu64 " bytes", progress->image,
+			     progress->name, progress->version, progress->received);
+		protobuf_free_message((ProtobufCMessage *)resp);
+		goto handle_resp;
+	} break;
 
 	default:
 		// TODO for now just dump the response in text format
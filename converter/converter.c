@@ -154,8 +154,9 @@ write_guestos_config(docker_config_t *config, const char *root_image_file, const
 	// add image_sha1 and image_sha256 values
 	mount_root.has_image_size = true;
 	mount_root.image_size = file_size(root_image_file);
-	mount_root.image_sha1 = util_hash_sha_image_file_new(root_image_file);
-	mount_root.image_sha2_256 = util_hash_sha256_image_file_new(root_image_file);
+	if (util_hash_image_file_new(root_image_file, &mount_root.image_sha1,
+				     &mount_root.image_sha2_256) < 0)
+		WARN("Could not hash root image %s", root_image_file);
 
 	cfg.mounts[0] = &mount_root;
 
@@ -27,6 +27,7 @@
 #include "common/mem.h"
 #include "common/file.h"
 #include "common/proc.h"
+#include "common/ssl_util.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -35,16 +36,12 @@
 #include <sys/wait.h>
 #include <stdint.h>
 
-#include <openssl/evp.h>
-
 #define OPENSSLBIN_PATH "openssl"
 #define TAR_PATH "tar"
 #define MKSQUASHFS_PATH "mksquashfs"
 #define MKSQUASHFS_COMP "gzip"
 #define MKSQUASHFS_BSIZE "131072"
 
-#define SIGN_HASH_BUFFER_SIZE 4096
-
 #define PKIGENSCRIPT_PATH UTIL_PKI_PATH "ssig_pki_generator.sh"
 #define PKIGENCONF_PATH UTIL_PKI_PATH "ssig_pki_generator.conf"
 
@@ -97,41 +94,44 @@ convert_bin_to_hex_new(const uint8_t *bin, int length)
 	return hex;
 }
 
-static char *
-util_hash_image_file_new(const char *image_file, const EVP_MD *md)
+int
+util_hash_image_file_new(const char *image_file, char **sha1, char **sha256)
 {
-	FILE *fp = NULL;
-	EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-	EVP_DigestInit(ctx, md);
-
-	if (!(fp = fopen(image_file, "rb"))) {
-		ERROR_ERRNO("Error in file hasing, cannot open %s", image_file);
-		return NULL;
+	const char *hash_algos[] = { "SHA1", "SHA256" };
+	unsigned char *hashes[2];
+	unsigned int hash_lens[2];
+
+	// both digests are computed in a single pass over the image
+	if (ssl_hash_file_multi(image_file, hash_algos, 2, hashes, hash_lens) < 0) {
+		ERROR("Error in file hashing of %s", image_file);
+		return -1;
 	}
 
-	int len = 0;
-	unsigned char buf[SIGN_HASH_BUFFER_SIZE];
-
-	while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
-		EVP_DigestUpdate(ctx, buf, len);
-	}
-	fclose(fp);
+	if (sha1)
+		*sha1 = convert_bin_to_hex_new(hashes[0], hash_lens[0]);
+	if (sha256)
+		*sha256 = convert_bin_to_hex_new(hashes[1], hash_lens[1]);
 
-	EVP_DigestFinal(ctx, buf, NULL);
-	EVP_MD_CTX_free(ctx);
-	return convert_bin_to_hex_new(buf, EVP_MD_size(md));
-}
-
-char *
-util_hash_sha_image_file_new(const char *image_file)
-{
-	return util_hash_image_file_new(image_file, EVP_sha1());
+	mem_free0(hashes[0]);
+	mem_free0(hashes[1]);
+	return 0;
 }
 
 char *
 util_hash_sha256_image_file_new(const char *image_file)
 {
-	return util_hash_image_file_new(image_file, EVP_sha256());
+	const char *hash_algo = "SHA256";
+	unsigned char *hash;
+	unsigned int hash_len;
+
+	if (ssl_hash_file_multi(image_file, &hash_algo, 1, &hash, &hash_len) < 0) {
+		ERROR("Error in file hashing of %s", image_file);
+		return NULL;
+	}
+
+	char *hex = convert_bin_to_hex_new(hash, hash_len);
+	mem_free0(hash);
+	return hex;
 }
 
 int
@@ -36,8 +36,13 @@ b64_ntop(unsigned char const *src, size_t srclength, char *target, size_t targsi
 int
 b64_pton(char const *src, unsigned char *target, size_t targsize);
 
-char *
-util_hash_sha_image_file_new(const char *image_file);
+/**
+ * Computes the SHA1 and SHA256 digests of image_file in a single pass. The
+ * newly allocated hex strings are stored in sha1 and sha256 if not NULL.
+ * @return 0 on success, -1 on error.
+ */
+int
+util_hash_image_file_new(const char *image_file, char **sha1, char **sha256);
 
 char *
 util_hash_sha256_image_file_new(const char *image_file);
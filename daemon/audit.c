@@ -42,10 +42,13 @@
 #include "common/event.h"
 #include "common/fd.h"
 #include "common/nl.h"
+#include "common/hashmap.h"
+#include "common/hex.h"
+#include "common/seglog.h"
 
+#include <errno.h>
 #include <fcntl.h>
 #include <string.h>
-#include <sys/file.h>
 #include <stdio.h>
 #include <time.h>
 #include <linux/audit.h>
@@ -74,10 +77,15 @@
 
 #define AUDIT_LOGDIR "/data/audit"
 
+// records are stored in segment files of this size per log
+#define AUDIT_SEGMENT_SIZE (256 * 1024)
+
 uint64_t AUDIT_STORAGE = 0;
 
 static AUDIT_MODE LOGMODE = CONTAINER;
 
+static hashmap_t *audit_logs = NULL; // uuid string -> seglog_t *
+
 typedef struct {
 	char *key;
 	char *value;
@@ -124,33 +132,172 @@ audit_get_log_container(const uuid_t *uuid)
 	return c;
 }
 
-static char *
-audit_log_file_new(const char *uuid)
+static const char *
+audit_log_name(const char *uuid)
 {
-	if (C0 == LOGMODE)
-		return mem_printf("%s/%s.log", AUDIT_LOGDIR, AUDIT_DEFAULT_CONTAINER);
-	else
-		return mem_printf("%s/%s.log", AUDIT_LOGDIR, uuid);
+	return (C0 == LOGMODE) ? AUDIT_DEFAULT_CONTAINER : uuid;
 }
 
-static uint64_t
-audit_remaining_storage(const char *uuid)
+static AuditRecord *
+audit_record_corrupt_new(const char *raw_text)
 {
-	char *file = audit_log_file_new(uuid);
-	off_t size = file_size(file);
+	AuditRecord__Meta **meta = mem_new0(AuditRecord__Meta *, 1);
+	meta[0] = mem_new0(AuditRecord__Meta, 1);
+	audit_record__meta__init(meta[0]);
 
-	if (!file_exists(file)) {
-		mem_free0(file);
-		return AUDIT_STORAGE;
+	// store corrupt message as meta
+	meta[0]->key = mem_strdup("raw_text");
+	meta[0]->value = mem_strdup(raw_text);
+
+	char *type = mem_printf("%s.%s.%s.%s", audit_category_to_string(FSA),
+				audit_component_to_string(CMLD), audit_evclass_to_string(GENERIC),
+				"corrupt-record");
+
+	AuditRecord *record = audit_record_new(type, NULL, 1, meta);
+	mem_free0(type);
+	return record;
+}
+
+static int
+audit_log_append_record(seglog_t *log, const AuditRecord *record)
+{
+	uint8_t *packed = NULL;
+	uint32_t packed_len = protobuf_pack_message_new((ProtobufCMessage *)record, &packed);
+
+	int ret = seglog_append(log, packed, packed_len);
+	mem_free0(packed);
+	return ret;
+}
+
+/*
+ * Moves the records of a log file written by previous versions, which stored
+ * text format records separated by delimiter lines, to the segment log.
+ *
+ * The file is renamed first, so that only one of the processes sharing the log
+ * imports it, and the records are appended in a single operation on the log.
+ * If the import fails, the renamed file is kept for manual recovery instead of
+ * being imported again.
+ */
+static void
+audit_log_import_textfile(seglog_t *log, const char *filename)
+{
+	char *marker = mem_printf("%s.import", filename);
+	if (rename(filename, marker) < 0) {
+		// another process sharing the log took the file
+		if (errno != ENOENT)
+			ERROR_ERRNO("Failed to move audit log file %s for import", filename);
+		mem_free0(marker);
+		return;
 	}
-	mem_free0(file);
 
-	if (0 > size) {
-		ERROR_ERRNO("Failed to retrieve size of audit log file");
-		return 0;
+	off_t size = file_size(marker);
+	char *buf = size < 0 ? NULL : file_read_new(marker, size + 1);
+	if (!buf) {
+		WARN("Could not read audit log file %s for import", marker);
+		mem_free0(marker);
+		return;
+	}
+
+	struct iovec *recs = NULL;
+	size_t n = 0;
+	size_t delim_len = strlen(AUDIT_DELIMITER);
+	for (char *p = buf; *p;) {
+		// the delimiter only counts as such at the start of a line
+		char *end = p;
+		while ((end = strstr(end, AUDIT_DELIMITER)) && end != p && end[-1] != '\n')
+			end++;
+		size_t len = end ? (size_t)(end - p) : strlen(p);
+
+		if (len > 0) {
+			AuditRecord *record = (AuditRecord *)protobuf_message_new_from_buf(
+				(uint8_t *)p, len, &audit_record__descriptor);
+			if (!record) {
+				WARN("Failed to parse text protobuf message from file %s", marker);
+				char *raw = mem_strndup(p, len);
+				record = audit_record_corrupt_new(raw);
+				mem_free0(raw);
+			}
+			uint8_t *packed = NULL;
+			recs = mem_realloc(recs, (n + 1) * sizeof(struct iovec));
+			recs[n].iov_len =
+				protobuf_pack_message_new((ProtobufCMessage *)record, &packed);
+			recs[n++].iov_base = packed;
+			protobuf_free_message((ProtobufCMessage *)record);
+		}
+		p += end ? len + delim_len : len;
+	}
+	mem_free0(buf);
+
+	ssize_t imported = seglog_append_multi(log, recs, n);
+	for (size_t i = 0; i < n; i++)
+		mem_free0(recs[i].iov_base);
+	mem_free0(recs);
+
+	if (imported < 0 || (size_t)imported < n) {
+		ERROR("Imported only %zd of %zu audit records from %s, keeping it",
+		      MAX(imported, 0), n, marker);
+	} else {
+		INFO("Imported %zu audit records from %s", n, filename);
+		if (unlink(marker) < 0)
+			ERROR_ERRNO("Failed to remove audit log file %s", marker);
+	}
+	mem_free0(marker);
+}
+
+static seglog_t *
+audit_get_log(const char *uuid)
+{
+	const char *name = audit_log_name(uuid);
+
+	if (!audit_logs)
+		audit_logs = hashmap_new();
+
+	seglog_t *log = hashmap_get_str(audit_logs, name);
+	if (log)
+		return log;
+
+	char *dir = mem_printf("%s/%s", AUDIT_LOGDIR, name);
+	log = seglog_open(dir, AUDIT_SEGMENT_SIZE);
+	if (!log) {
+		ERROR("Failed to open audit log %s", dir);
+		mem_free0(dir);
+		return NULL;
 	}
+	mem_free0(dir);
+	hashmap_put_str(audit_logs, name, log);
 
-	if ((uint64_t)size > AUDIT_STORAGE) {
+	char *file = mem_printf("%s/%s.log", AUDIT_LOGDIR, name);
+	if (file_exists(file))
+		audit_log_import_textfile(log, file);
+	mem_free0(file);
+
+	return log;
+}
+
+void
+audit_close_log(const uuid_t *uuid)
+{
+	ASSERT(uuid);
+	IF_NULL_RETURN(audit_logs);
+
+	// in C0 mode all containers share the default log, which stays open
+	IF_TRUE_RETURN(C0 == LOGMODE);
+
+	seglog_t *log = hashmap_remove_str(audit_logs, uuid_string(uuid));
+	IF_NULL_RETURN(log);
+
+	TRACE("Closing audit log of %s", uuid_string(uuid));
+	seglog_close(log);
+}
+
+static uint64_t
+audit_remaining_storage(const char *uuid)
+{
+	seglog_t *log = audit_get_log(uuid);
+	IF_NULL_RETVAL(log, 0);
+
+	uint64_t size = seglog_get_size(log);
+	if (size > AUDIT_STORAGE) {
 		ERROR("Detected audit log overflow");
 		return 0;
 	}
@@ -194,211 +341,16 @@ out:
 	container_audit_set_processing_ack(c, false);
 }
 
-static AuditRecord *
-audit_record_from_textfile_new(const char *filename, bool purge)
-{
-	ASSERT(filename);
-
-	TRACE("audit record from textfile using log '%s'", filename);
-
-	FILE *file = fopen(filename, purge ? "r+" : "r");
-	if (!file) {
-		WARN_ERRNO("Could not fopen file \"%s\" for reading.", filename);
-		return NULL;
-	}
-
-	int fd = fileno(file);
-	if (fd < 0) {
-		WARN_ERRNO("Could not get fd for \"%s\" for reading.", filename);
-		fclose(file);
-		return NULL;
-	}
-
-	int audit_file_lock = flock(fd, LOCK_EX);
-	if (audit_file_lock < 0) {
-		ERROR_ERRNO("Failed to get lock on audit log file: %s", filename);
-		fclose(file);
-		return NULL;
-	}
-
-	struct stat s;
-	if (fstat(fd, &s) && 0 > s.st_size) {
-		ERROR("Failed to retrieve size of audit record log '%s'", filename);
-		fclose(file);
-		return NULL;
-	}
-
-	AuditRecord *record = NULL;
-	ssize_t size = s.st_size;
-
-	// read file up to delimiter
-	char *buf = mem_alloc0(size + 1);
-	size_t read = 0;
-	bool delim_found = false;
-
-	while (!delim_found && read < (size_t)size) {
-		ssize_t current = 0;
-		size_t n = 0;
-		char *line = NULL;
-
-		if (0 > (current = getline(&line, &n, file))) {
-			ERROR_ERRNO("Failed to read line from file");
-			fclose(file);
-			mem_free0(line);
-			goto out;
-		}
-
-		if (read + current > (size_t)size) {
-			ERROR("File was changed while reading");
-			fclose(file);
-			mem_free0(line);
-			goto out;
-		}
-
-		// if delimiter line was read, stop further processing
-		if (!strcmp(AUDIT_DELIMITER, line)) {
-			delim_found = true;
-			mem_free0(line);
-			continue;
-		}
-
-		memcpy(buf + read, line, current);
-		read += current;
-		mem_free0(line);
-	}
-
-	// parse record from file
-	if (0 == size) {
-		INFO("Read audit record with default values");
-		record = (AuditRecord *)mem_new0(AuditRecord, 1);
-		audit_record__init(record);
-		goto out;
-	} else {
-		record = (AuditRecord *)protobuf_message_new_from_buf((uint8_t *)buf, read,
-								      &audit_record__descriptor);
-	}
-
-	if (!record) {
-		WARN("Failed to parse text protobuf message (%s) from file \"%s\"."
-		     "Generating new record with corrupted data as raw_text",
-		     audit_record__descriptor.name ? audit_record__descriptor.name : "UNKNOWN",
-		     filename);
-
-		AuditRecord__Meta **meta = mem_new0(AuditRecord__Meta *, 1);
-		meta[0] = mem_new0(AuditRecord__Meta, 1);
-		audit_record__meta__init(meta[0]);
-
-		// store corrput message as meta
-		meta[0]->key = mem_strdup("raw_text");
-		meta[0]->value = mem_strndup(buf, read);
-
-		char *type = mem_printf("%s.%s.%s.%s", audit_category_to_string(FSA),
-					audit_component_to_string(CMLD),
-					audit_evclass_to_string(GENERIC), "corrupt-record");
-
-		record = audit_record_new(type, NULL, 1, meta);
-		mem_free0(type);
-	}
-
-	if (purge) {
-		// delete record from file
-		if (read + strlen(AUDIT_DELIMITER) == (size_t)size) {
-			TRACE("Audit log empty, removing file");
-			if (-1 == unlink(filename)) {
-				ERROR_ERRNO("Failed to remove audit log file");
-			}
-			goto out;
-		}
-
-		errno = 0;
-		rewind(file);
-		if (errno != 0) {
-			ERROR_ERRNO("Rewind for reading of file %s failed!", filename);
-			goto out;
-		}
-		size_t read_len;
-		if ((size_t)size != (read_len = fread(buf, sizeof(char), size, file))) {
-			ERROR("Failed to read audit log file into memory read %zu "
-			      "expected %zd, [eof: %d, ferror: %d]",
-			      read_len, size, feof(file), ferror(file));
-			goto out;
-		}
-
-		errno = 0;
-		rewind(file);
-		if (errno != 0) {
-			ERROR_ERRNO("Rewind for writing of file %s failed!", filename);
-			goto out;
-		}
-		size_t offset = read + strlen(AUDIT_DELIMITER);
-		size_t write_len = read_len - offset;
-		if (-1 == fd_write(fd, buf + offset, write_len)) {
-			ERROR_ERRNO("Failed to remove message from file: %s", filename);
-			goto out;
-		}
-		if (ftruncate(fd, write_len)) {
-			ERROR_ERRNO("Failed to truncate size of file: %s", filename);
-		}
-	}
-
-out:
-	if (buf)
-		mem_free0(buf);
-
-	if (audit_file_lock == 0 && flock(fd, LOCK_UN)) {
-		ERROR_ERRNO("Failed to release lock on audit log file: %s", filename);
-	}
-	fclose(file);
-
-	return (AuditRecord *)record;
-}
-
-static bool
-audit_log_check_delimiter(int fd)
-{
-	char buf[sizeof(AUDIT_DELIMITER)];
-	bool ret = false;
-
-	struct stat s;
-	IF_TRUE_RETVAL(fstat(fd, &s) != 0, true);
-	IF_TRUE_RETVAL(s.st_size <= 0, true);
-
-	off_t current = lseek(fd, 0, SEEK_CUR);
-
-	IF_TRUE_GOTO_WARN(-1 == lseek(fd, -strlen(AUDIT_DELIMITER), SEEK_END), out);
-	IF_TRUE_GOTO_WARN(-1 == fd_read(fd, buf, strlen(AUDIT_DELIMITER)), out);
-
-	buf[sizeof(AUDIT_DELIMITER) - 1] = '\0';
-
-	// if delimiter line was read, all is fine
-	if (!strcmp(AUDIT_DELIMITER, buf))
-		ret = true;
-out:
-	if (-1 == lseek(fd, current, SEEK_SET))
-		WARN_ERRNO("could not restore position!");
-
-	return ret;
-}
-
 static int
-audit_write_file(const uuid_t *uuid, const AuditRecord *msg)
+audit_write_log(const uuid_t *uuid, const AuditRecord *msg)
 {
-	int ret = -1;
-	int audit_file_lock = -1;
-	int fd = -1;
+	seglog_t *log = audit_get_log(uuid_string(uuid));
+	IF_NULL_RETVAL(log, -1);
 
-	if (!file_is_dir(AUDIT_LOGDIR) && dir_mkdir_p(AUDIT_LOGDIR, 0700)) {
-		ERROR("Failed to create logdir");
-		return -1;
-	}
-
-	char *file = audit_log_file_new(uuid_string(uuid));
-
-	char *msg_text;
-	size_t msg_len = protobuf_string_from_message(&msg_text, (ProtobufCMessage *)msg, NULL);
+	size_t msg_len = protobuf_c_message_get_packed_size((const ProtobufCMessage *)msg);
 
 	//TODO send error message
-	if (audit_remaining_storage(uuid_string(uuid)) < (msg_len + strlen(AUDIT_DELIMITER))) {
+	if (audit_remaining_storage(uuid_string(uuid)) < msg_len + SEGLOG_RECORD_HEADER_SIZE) {
 		container_t *c = cmld_container_get_by_uuid(uuid);
 
 		TRACE("Trying to notify container %s about stored audit events,"
@@ -409,81 +361,47 @@ audit_write_file(const uuid_t *uuid, const AuditRecord *msg)
 			ERROR("Failed to notify container about audit log overflow");
 		}
 		ERROR("Failed to store audit record: max. log size exceeded");
-		goto out;
-	}
-
-	TRACE("Logging audit record to file: %s", file);
-
-	int oflags = O_RDWR;
-	oflags |= file_exists(file) ? O_APPEND : (O_CREAT | O_TRUNC);
-
-	fd = open(file, oflags, 00600);
-	if (fd < 0) {
-		ERROR_ERRNO("Failed to open audit log file: %s", file);
-		goto out;
-	}
-
-	audit_file_lock = flock(fd, LOCK_EX);
-	if (audit_file_lock < 0) {
-		ERROR_ERRNO("Failed to get lock on audit log file: %s", file);
-		goto out;
-	}
-
-	if (!audit_log_check_delimiter(fd)) {
-		TRACE("Fixup audit delimiter to %s", file);
-		if (0 > fd_write(fd, AUDIT_DELIMITER, strlen(AUDIT_DELIMITER))) {
-			ERROR("Failed to fixup audit log file: %s", file);
-			goto out;
-		}
-	}
-
-	if (0 > fd_write(fd, msg_text, msg_len)) {
-		ERROR("Failed to log audit message to file: %s", file);
-		goto out;
-	}
-
-	if (0 > fd_write(fd, AUDIT_DELIMITER, strlen(AUDIT_DELIMITER))) {
-		ERROR("Failed to log audit message %s to file: %s", msg_text, file);
-		goto out;
+		return -1;
 	}
 
-	ret = 0;
+	TRACE("Logging audit record to log of %s", uuid_string(uuid));
 
-out:
-	if (audit_file_lock == 0 && flock(fd, LOCK_UN)) {
-		ERROR_ERRNO("Failed to release lock on audit log file: %s", file);
+	if (audit_log_append_record(log, msg) < 0) {
+		ERROR("Failed to log audit message to log of %s", uuid_string(uuid));
+		return -1;
 	}
-
-	close(fd);
-
-	// ensure audit log goes to disk
-	file_syncfs(file);
-
-	mem_free0(file);
-	mem_free0(msg_text);
-
-	return ret;
+	return 0;
 }
 
 static AuditRecord *
-audit_next_record_new(const container_t *container, bool purge)
+audit_next_record_new(const container_t *container)
 {
-	AuditRecord *r;
+	uint8_t *buf = NULL;
+	bool intact = false;
+	AuditRecord *record = NULL;
 
-	char *file = audit_log_file_new(uuid_string(container_get_uuid(container)));
-	TRACE("next record in log file '%s'", file);
+	seglog_t *log = audit_get_log(uuid_string(container_get_uuid(container)));
+	IF_NULL_RETVAL(log, NULL);
 
-	if (!file_exists(file)) {
-		ERROR("Failed to read audit record: no file");
-		mem_free0(file);
+	ssize_t len = seglog_read_new(log, &buf, &intact);
+	if (len < 0) {
+		ERROR("Failed to read audit record");
 		return NULL;
 	}
 
-	r = (AuditRecord *)audit_record_from_textfile_new(file, purge);
-
-	mem_free0(file);
+	if (intact)
+		record = (AuditRecord *)protobuf_unpack_message(&audit_record__descriptor, buf,
+								len);
+	if (!record) {
+		WARN("Failed to unpack stored audit record, generating new record with corrupted"
+		     " data as raw_text");
+		char *raw = convert_bin_to_hex_new(buf, len);
+		record = audit_record_corrupt_new(raw);
+		mem_free0(raw);
+	}
+	mem_free0(buf);
 
-	return r;
+	return record;
 }
 
 static int
@@ -498,7 +416,7 @@ audit_do_send_record(const container_t *c)
 	cmld_to_service_message__init(message_proto);
 	message_proto->code = CMLD_TO_SERVICE_MESSAGE__CODE__AUDIT_RECORD;
 
-	if (!(message_proto->audit_record = audit_next_record_new(c, false))) {
+	if (!(message_proto->audit_record = audit_next_record_new(c))) {
 		ERROR("Could not read next audit record");
 		goto out;
 	}
@@ -545,13 +463,11 @@ audit_send_next_stored(const container_t *c)
 		return -1;
 
 	TRACE("send_next_stored");
-	char *file = audit_log_file_new(uuid_string(container_get_uuid(c)));
+	seglog_t *log = audit_get_log(uuid_string(container_get_uuid(c)));
+	IF_NULL_RETVAL(log, -1);
 
-	TRACE("send_next_stored log file: %s", file);
-
-	if (!file_exists(file)) {
+	if (seglog_get_count(log) == 0) {
 		TRACE("Sent all stored audit messages");
-		mem_free0(file);
 
 		if (0 > container_audit_notify_complete(c)) {
 			ERROR("Failed to notify container that all records were sent");
@@ -563,7 +479,6 @@ audit_send_next_stored(const container_t *c)
 
 		return 0;
 	}
-	mem_free0(file);
 
 	return audit_do_send_record(c);
 }
@@ -604,14 +519,11 @@ audit_process_ack(const container_t *c, const char *ack)
 	if (crypto_match_hash(AUDIT_HASH_ALGO_LEN, container_audit_get_last_ack(c), ack)) {
 		TRACE("ACK hash matched last sent record %s", container_audit_get_last_ack(c));
 
-		AuditRecord *record = audit_next_record_new(c, true);
-
-		if (!record) {
+		seglog_t *log = audit_get_log(uuid_string(container_get_uuid(c)));
+		if (!log || seglog_consume(log) < 0) {
 			ERROR("Failed to delete audit record %s", ack);
 			return -1;
 		}
-
-		protobuf_free_message((ProtobufCMessage *)record);
 		TRACE("Cleaned up ack'ed record");
 
 		container_audit_set_last_ack(c, "");
@@ -631,7 +543,7 @@ audit_record_log(container_t *c, AuditRecord *record)
 	IF_NULL_RETVAL(record, -1);
 
 	if (c) {
-		if (0 != (ret = audit_write_file(container_get_uuid(c), record))) {
+		if (0 != (ret = audit_write_log(container_get_uuid(c), record))) {
 			ERROR("Failed to store audit log for container %s to file",
 			      uuid_string(container_get_uuid(c)));
 			goto out;
@@ -640,7 +552,7 @@ audit_record_log(container_t *c, AuditRecord *record)
 		TRACE("No audit logging container available, will log to file %s",
 		      AUDIT_DEFAULT_CONTAINER);
 		uuid_t *default_uuid = uuid_new(AUDIT_DEFAULT_CONTAINER);
-		if (0 != (ret = audit_write_file(default_uuid, record))) {
+		if (0 != (ret = audit_write_log(default_uuid, record))) {
 			ERROR("Failed to store audit log to file");
 			uuid_free(default_uuid);
 			goto out;
@@ -51,6 +51,13 @@ audit_log_event(const uuid_t *uuid, AUDIT_CATEGORY category, AUDIT_COMPONENT com
 int
 audit_process_ack(const container_t *audit, const char *ack);
 
+/**
+ * Closes the stored audit log of a removed container, the stored records are
+ * kept on disk.
+ */
+void
+audit_close_log(const uuid_t *uuid);
+
 int
 audit_init(uint32_t size);
 
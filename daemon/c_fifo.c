@@ -387,7 +387,7 @@ c_fifo_start_post_clone(void *fifop)
 		DEBUG("Appending %d to forwarder list", *mpid);
 		fifo->forwarder_list = list_append(fifo->forwarder_list, mpid);
 
-		// register at sigchild handler for helper forwarding clone
+		// register child watch for helper forwarding clone
 		char *forwarder_name = mem_printf("%s-forwarder", current_fifo);
 		container_wait_for_child(fifo->container, forwarder_name, *mpid);
 		mem_free0(forwarder_name);
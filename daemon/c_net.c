@@ -1320,7 +1320,7 @@ c_net_start_post_clone(void *netp)
 		_exit(0); // don't call atexit registered cleanup of main process
 	} else {
 		DEBUG("Setup of nis should be done by pid=%d", *c0_netns_pid);
-		// register at sigchild handler for helper clone in netns of c0
+		// register child watch for helper clone in netns of c0
 		container_wait_for_child(net->container, "c0-netns-helper", *c0_netns_pid);
 
 		/* setup uplink of cml */
@@ -1581,7 +1581,7 @@ c_net_cleanup_container(const c_net_t *net)
 		_exit(0); // don't call atexit registered cleanup of main process
 	} else {
 		DEBUG("Renaming of ifs should be done by pid=%d", c_netns_pid);
-		// register at sigchild handler for helper clone in netns of container
+		// register child watch for helper clone in netns of container
 		container_wait_for_child(net->container, "c-netns-rename-helper", c_netns_pid);
 	}
 
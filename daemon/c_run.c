@@ -294,61 +294,33 @@ c_run_write_exec_input(void *runp, char *exec_input, int session_fd)
 }
 
 static void
-c_run_sigchld_cb(UNUSED int signum, event_signal_t *sig, void *data)
+c_run_child_cb(pid_t pid, int status, event_child_watch_t *watch, void *data)
 {
 	c_run_session_t *session = data;
+	ASSERT(session);
 
 	c_run_t *run = session->run;
-	if (NULL == run) {
-		// cleanup of c_run subsystem already done just remove signal handler
-		TRACE("SIGCHLD handler called for already dead c_run session");
-		event_remove_signal(sig);
-		event_signal_free(sig);
-		return;
-	}
 
-	TRACE("SIGCHLD handler called for c_run injected process in container %s with PID %d",
-	      container_get_description(run->container), container_get_pid(run->container));
-	/* The exec loop is started in a new session having it's PID as PGID.
-	 * Therefore wait for this PGID. If a descendant process call setsid it doesn't
-	 * get reaped by this handler. This enables the user to inject processes who
-	 * continue running after the command injected by control exits */
-	pid_t exec_pid = session->active_exec_pid;
-	pid_t pid = 0;
-	int status = 0;
-	while ((pid = waitpid(session->active_exec_pid, &status, WNOHANG))) {
-		TRACE("Got exited child with PID: %d, exec pid: %d", pid, exec_pid);
-
-		//if (pid == exec_pid || pid == run->pty_master_read_pid || run->pty_master_write_pid) {
-		if (pid == exec_pid) {
-			TRACE("Injected process exited. Cleaning up.");
-			if (WIFEXITED(status)) {
-				INFO("Exec'ed process in container %s terminated (status=%d)",
-				     container_get_description(run->container),
-				     WEXITSTATUS(status));
-			} else if (WIFSIGNALED(status)) {
-				INFO("Injected process in container %s killed by signal %d",
-				     container_get_description(run->container), WTERMSIG(status));
-			} else {
-				continue;
-			}
-
-			/* remove the sigchld callback for this container from the event loop */
-			event_remove_signal(sig);
-			event_signal_free(sig);
-
-			/* Close sockets of the session */
-			run->sessions = list_remove(run->sessions, session);
-			c_run_session_cleanup(session);
-			c_run_session_free(session);
-			break;
-		} else {
-			DEBUG("Reaped a descendant process with PID %d of injected process in container %s",
-			      pid, container_get_description(run->container));
-		}
+	TRACE("Injected process with PID %d in container %s exited. Cleaning up.", pid,
+	      container_get_description(run->container));
+
+	if (WIFEXITED(status)) {
+		INFO("Exec'ed process in container %s terminated (status=%d)",
+		     container_get_description(run->container), WEXITSTATUS(status));
+	} else if (WIFSIGNALED(status)) {
+		INFO("Injected process in container %s killed by signal %d",
+		     container_get_description(run->container), WTERMSIG(status));
 	}
 
-	TRACE("No more childs to reap. Exiting handler.");
+	event_child_watch_free(watch);
+
+	/* already reaped, nothing left to kill */
+	session->active_exec_pid = -1;
+
+	/* Close sockets of the session */
+	run->sessions = list_remove(run->sessions, session);
+	c_run_session_cleanup(session);
+	c_run_session_free(session);
 }
 
 static int
@@ -673,9 +645,10 @@ c_run_exec_process(void *runp, int create_pty, char *cmd, ssize_t argc, char **a
 
 	IF_TRUE_GOTO(c_run_prepare_exec(session) < 0, error);
 
-	TRACE("Registering SIGCHLD handler for injected processes");
-	event_signal_t *sig = event_signal_new(SIGCHLD, c_run_sigchld_cb, session);
-	event_add_signal(sig);
+	TRACE("Registering child watch for injected process");
+	event_child_watch_t *watch =
+		event_child_watch_new(session->active_exec_pid, c_run_child_cb, session);
+	event_add_child_watch(watch);
 
 	return 0;
 
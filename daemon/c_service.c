@@ -39,6 +39,7 @@
 
 #include "common/event.h"
 #include "common/fd.h"
+#include "common/frame.h"
 #include "common/macro.h"
 #include "common/mem.h"
 #include "common/protobuf.h"
@@ -63,7 +64,7 @@ typedef struct c_service {
 	int sock;
 	int sock_connected; // socket to client which will get events
 	event_io_t *event_io_sock;
-	list_t *event_io_sock_connected_list; // list of clients
+	list_t *conn_list; // list of connected clients (frame_conn_t)
 	int clients;
 } c_service_t;
 
@@ -160,48 +161,53 @@ c_service_handle_received_message(c_service_t *service, int sock_client,
 	}
 }
 
+static void
+c_service_conn_close(c_service_t *service, frame_conn_t *conn)
+{
+	service->conn_list = list_remove(service->conn_list, conn);
+	service->clients--;
+	// check if we are/were the main service event receiver
+	// and give up our slot for new clients
+	if (frame_conn_get_fd(conn) == service->sock_connected)
+		service->sock_connected = -1;
+	frame_conn_free(conn);
+}
+
 /**
- * Invoked whenever the service writes (a protobuf ServiceToCmldMessage)
- * to the _connected_ socket.
+ * Invoked whenever the service has written a complete protobuf
+ * ServiceToCmldMessage to the _connected_ socket.
  */
 static void
-c_service_cb_receive_message(int fd, unsigned events, event_io_t *io, void *data)
+c_service_conn_recv_cb(frame_conn_t *conn, uint8_t *buf, uint32_t len, void *data)
 {
-	TRACE("Callback c_service_cb_receive_message has been invoked");
+	TRACE("Callback c_service_conn_recv_cb has been invoked");
 	ASSERT(data);
 	c_service_t *service = data;
 
-	if (events & EVENT_IO_READ) {
-		ServiceToCmldMessage *message = (ServiceToCmldMessage *)protobuf_recv_message(
-			fd, &service_to_cmld_message__descriptor);
-		// close connection if client EOF, or protocol parse error
-		IF_NULL_GOTO_TRACE(message, connection_err);
-
-		c_service_handle_received_message(service, fd, message);
-		protobuf_c_message_free_unpacked((ProtobufCMessage *)message, NULL);
+	ServiceToCmldMessage *message = (ServiceToCmldMessage *)protobuf_unpack_message(
+		&service_to_cmld_message__descriptor, buf, len);
+	if (!message) {
+		// close connection on protocol parse error
+		WARN("Failed to parse message from service; closing socket");
+		c_service_conn_close(service, conn);
+		return;
 	}
 
-	// also check EXCEPT flag
-	if (events & EVENT_IO_EXCEPT) {
-		WARN("Exception on connected socket to service; "
-		     "closing socket and deregistering c_service_cb_receive_message");
-		goto connection_err;
-	}
-	return;
+	c_service_handle_received_message(service, frame_conn_get_fd(conn), message);
+	protobuf_c_message_free_unpacked((ProtobufCMessage *)message, NULL);
+}
 
-connection_err:
-	service->event_io_sock_connected_list =
-		list_remove(service->event_io_sock_connected_list, io);
-	service->clients--;
-	event_remove_io(io);
-	event_io_free(io);
-	// check if we are/were the main service event receiver
-	// and give up our slot for new clients
-	if (fd == service->sock_connected)
-		service->sock_connected = -1;
-	if (close(fd) < 0)
-		WARN_ERRNO("Failed to close connected service socket");
-	return;
+/**
+ * Invoked if the service closed the _connected_ socket or an error occurred on it.
+ */
+static void
+c_service_conn_close_cb(frame_conn_t *conn, void *data)
+{
+	ASSERT(data);
+	c_service_t *service = data;
+
+	WARN("Exception on connected socket to service; closing socket");
+	c_service_conn_close(service, conn);
 }
 
 /**
@@ -234,12 +240,17 @@ c_service_cb_accept(int fd, unsigned events, event_io_t *io, void *data)
 	TRACE("Accepted connection %d from %s", service->sock_connected,
 	      container_get_description(service->container));
 
-	event_io_t *event =
-		event_io_new(client_sock, EVENT_IO_READ, &c_service_cb_receive_message, service);
-
-	event_add_io(event);
-	service->event_io_sock_connected_list =
-		list_append(service->event_io_sock_connected_list, event);
+	frame_conn_t *conn = frame_conn_new(client_sock, c_service_conn_recv_cb,
+					    c_service_conn_close_cb, service);
+	if (!conn) {
+		WARN("Could not set up service connection %d", client_sock);
+		if (service->sock_connected == client_sock)
+			service->sock_connected = -1;
+		close(client_sock);
+		service->clients--;
+		return;
+	}
+	service->conn_list = list_append(service->conn_list, conn);
 
 	// We leave service->sock open so the service instances could connect
 	// again in the future
@@ -277,7 +288,7 @@ c_service_new(compartment_t *compartment)
 	service->sock = -1;
 	service->sock_connected = -1;
 	service->event_io_sock = NULL;
-	service->event_io_sock_connected_list = NULL;
+	service->conn_list = NULL;
 	service->clients = 0;
 
 	return service;
@@ -301,16 +312,12 @@ c_service_cleanup(void *servicep, UNUSED bool is_rebooting)
 		}
 		service->sock = -1;
 	}
-	for (list_t *l = service->event_io_sock_connected_list; l; l = l->next) {
-		event_io_t *event_io_sock_connected = l->data;
-		event_remove_io(event_io_sock_connected);
-		if (close(event_io_get_fd(event_io_sock_connected) < 0)) {
-			WARN_ERRNO("Failed to close connected service socket");
-		}
-		event_io_free(event_io_sock_connected);
+	for (list_t *l = service->conn_list; l; l = l->next) {
+		frame_conn_t *conn = l->data;
+		frame_conn_free(conn);
 	}
-	list_delete(service->event_io_sock_connected_list);
-	service->event_io_sock_connected_list = NULL;
+	list_delete(service->conn_list);
+	service->conn_list = NULL;
 
 	if (service->sock_connected > 0)
 		service->sock_connected = -1;
@@ -45,8 +45,8 @@
 #include "container.h"
 #include "cmld.h"
 
-#define UID_RANGE 100000
-#define UID_RANGES_START 100000
+#define UID_RANGE CMLD_CONTAINER_UID_RANGE
+#define UID_RANGES_START CMLD_CONTAINER_UID_RANGES_START
 
 #define MAX_UID_RANGES ((int)((UINT_MAX - UID_RANGES_START) / UID_RANGE))
 
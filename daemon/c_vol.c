@@ -51,6 +51,7 @@
 #include "common/str.h"
 #include "common/dm.h"
 #include "common/event.h"
+#include "common/list.h"
 
 #include "cmld.h"
 #include "guestos.h"
@@ -58,6 +59,7 @@
 #include "lxcfs.h"
 #include "audit.h"
 #include "verity.h"
+#include "verity_registry.h"
 
 #include <unistd.h>
 #include <string.h>
@@ -70,6 +72,8 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <libgen.h>
+#include <inttypes.h>
+#include <pthread.h>
 
 #define MAKE_EXT4FS "mkfs.ext4"
 #define BTRFSTUNE "btrfstune"
@@ -81,6 +85,12 @@
 
 #define BUSYBOX_PATH "/bin/busybox"
 
+// maximum number of threads to prepare the block devices of images
+#define C_VOL_PREPARE_THREADS_MAX 8
+
+// interval in ms to report the background initialization of integrity tags
+#define C_VOL_INTEGRITY_INIT_INTERVAL 10000
+
 #ifndef FALLOC_FL_ZERO_RANGE
 #define FALLOC_FL_ZERO_RANGE 0x10
 #endif
@@ -94,6 +104,8 @@ typedef struct c_vol {
 	mount_t *mnt_setup;
 	cryptfs_mode_t mode;
 	bool corrupted_image;
+	event_timer_t *integrity_init_timer;
+	list_t *verity_refs; //!< root hashes of the acquired shared dm-verity devices
 } c_vol_t;
 
 /******************************************************************************/
@@ -669,42 +681,235 @@ c_vol_setup_busybox_install(void)
 	return proc_fork_and_execvp(argv);
 }
 
+/*
+ * An image of a mount entry whose block device stack, i.e., the image file and
+ * its loop, dm-verity and dm-crypt/dm-integrity devices, is prepared before
+ * the image is mounted.
+ */
+typedef struct c_vol_image {
+	c_vol_t *vol;
+	const mount_entry_t *mntent;
+	char *img;
+	char *dev; //!< device to be mounted or NULL if the image has no block device
+	int fd;	   //!< keeps the loop device of the image until it is mounted
+	bool new_image;
+	int ret;
+	// audit event of the preparation, which is logged by the main thread
+	const char *audit_evtype;
+	bool audit_success;
+	char *audit_label;
+} c_vol_image_t;
+
+static void
+c_vol_image_set_audit(c_vol_image_t *vi, const char *evtype, bool success, const char *label)
+{
+	vi->audit_evtype = evtype;
+	vi->audit_success = success;
+	mem_free0(vi->audit_label);
+	vi->audit_label = mem_strdup(label);
+}
+
+/*
+ * Returns true if the image of the mount entry is mounted from a block device.
+ */
+static bool
+c_vol_image_has_dev(const mount_entry_t *mntent)
+{
+	switch (mount_entry_get_type(mntent)) {
+	case MOUNT_TYPE_SHARED:
+	case MOUNT_TYPE_SHARED_RW:
+	case MOUNT_TYPE_DEVICE:
+	case MOUNT_TYPE_DEVICE_RW:
+	case MOUNT_TYPE_OVERLAY_RO:
+	case MOUNT_TYPE_OVERLAY_RW:
+	case MOUNT_TYPE_EMPTY:
+	case MOUNT_TYPE_COPY:
+		return strcmp(mount_entry_get_fs(mntent), "tmpfs") != 0;
+	default:
+		return false;
+	}
+}
+
+static bool
+c_vol_image_is_readonly(const mount_entry_t *mntent)
+{
+	switch (mount_entry_get_type(mntent)) {
+	case MOUNT_TYPE_SHARED:
+	case MOUNT_TYPE_DEVICE:
+	case MOUNT_TYPE_OVERLAY_RO:
+		return true;
+	default:
+		return false;
+	}
+}
+
 /**
- * Mount an image file. This function will take some time. So call it in a
- * thread or child process.
+ * Prepare the block device stack of an image. This function will take some
+ * time. It only works on the devices of its own image, so that it can run
+ * concurrently for different images, and must not log audit events.
+ * @param vi The image, whose device is set on success.
+ * @return -1 on error else 0.
+ */
+static int
+c_vol_prepare_image(c_vol_image_t *vi)
+{
+	int ret = -1;
+	c_vol_t *vol = vi->vol;
+	const mount_entry_t *mntent = vi->mntent;
+	char *img_meta = NULL, *dev_meta = NULL, *img_hash = NULL;
+	int fd_meta = -1;
+	bool encrypted = mount_entry_is_encrypted(mntent);
+	bool verity = mount_entry_get_verity_sha256(mntent) != NULL;
+
+	if (c_vol_check_image(vol, vi->img) < 0) {
+		vi->new_image = true;
+		if (c_vol_create_image(vol, vi->img, mntent) < 0) {
+			goto error;
+		}
+	}
+
+	if (mount_entry_get_type(mntent) == MOUNT_TYPE_EMPTY) {
+		img_meta = c_vol_meta_image_path_new(vol, mntent, NULL);
+		if (c_vol_check_image(vol, img_meta) < 0) {
+			vol->corrupted_image = true;
+			goto error;
+		}
+		mem_free0(img_meta);
+	}
+
+	if (verity) {
+		TRACE("Opening shared dm-verity device");
+		img_hash = c_vol_hash_image_path_new(vol, mntent);
+		IF_NULL_GOTO(img_hash, error);
+
+		vi->dev = verity_registry_open_new(mount_entry_get_verity_sha256(mntent), vi->img,
+						   img_hash, !cmld_is_hostedmode_active());
+		IF_NULL_GOTO(vi->dev, error);
+
+		// TODO timeout?
+		while (access(vi->dev, F_OK) < 0) {
+			NANOSLEEP(0, 100000000);
+			DEBUG("Waiting for %s", vi->dev);
+		}
+		DEBUG("Device %s is now available\n", vi->dev);
+
+	} else {
+		TRACE("Creating loopdev");
+		// dm-integrity below encrypted images writes even for read-only mounts
+		vi->dev = loopdev_create_new(&vi->fd, vi->img,
+					     c_vol_image_is_readonly(mntent) && !encrypted, 0);
+		IF_NULL_GOTO(vi->dev, error);
+	}
+
+	if (encrypted) {
+		TRACE("Creating encrypted image");
+		char *label, *crypt;
+
+		label = mem_printf("%s-%s", uuid_string(container_get_uuid(vol->container)),
+				   mount_entry_get_img(mntent));
+
+		if (!container_get_key(vol->container)) {
+			c_vol_image_set_audit(vi, "setup-crypted-volume-no-key", false, label);
+			ERROR("Trying to mount encrypted volume without key...");
+			mem_free0(label);
+			goto error;
+		}
+
+		crypt = cryptfs_get_device_path_new(label);
+		if (file_is_blk(crypt) || file_links_to_blk(crypt)) {
+			INFO("Using existing mapper device: %s", crypt);
+		} else {
+			DEBUG("Setting up cryptfs volume %s for %s (%s)", label, vi->dev,
+			      vol->mode == CRYPTFS_MODE_AUTHENC ? "AUTHENC" : "INTEGRITY_ENCRYPT");
+
+			img_meta = c_vol_meta_image_path_new(vol, mntent, NULL);
+			dev_meta = loopdev_create_new(&fd_meta, img_meta, 0, 0);
+
+			IF_NULL_GOTO(dev_meta, error);
+
+			mem_free0(crypt);
+			crypt = cryptfs_setup_volume_new(label, vi->dev,
+							 container_get_key(vol->container),
+							 dev_meta, vol->mode);
+
+			// release loopdev fd (crypt device should keep it open now)
+			close(fd_meta);
+			fd_meta = -1;
+			mem_free0(img_meta);
+
+			if (!crypt) {
+				c_vol_image_set_audit(vi, "setup-crypted-volume", false, label);
+				ERROR("Setting up cryptfs volume %s for %s failed", label, vi->dev);
+				mem_free0(label);
+				goto error;
+			}
+			c_vol_image_set_audit(vi, "setup-crypted-volume", true, label);
+		}
+
+		mem_free0(label);
+		mem_free0(vi->dev);
+		vi->dev = crypt;
+
+		// TODO: timeout?
+		while (access(vi->dev, F_OK) < 0) {
+			NANOSLEEP(0, 10000000)
+			DEBUG("Waiting for %s", vi->dev);
+		}
+	}
+
+	if (vi->new_image && mount_entry_get_type(mntent) == MOUNT_TYPE_OVERLAY_RW) {
+		if (c_vol_format_image(vi->dev, mount_entry_get_fs(mntent)) < 0) {
+			ERROR("Could not format image %s using %s", vi->img, vi->dev);
+			goto error;
+		}
+		DEBUG("Successfully formatted new image %s using %s", vi->img, vi->dev);
+	}
+
+	ret = 0;
+
+error:
+	if (dev_meta)
+		loopdev_free(dev_meta);
+	if (img_meta)
+		mem_free0(img_meta);
+	if (fd_meta >= 0)
+		close(fd_meta);
+	if (img_hash)
+		mem_free0(img_hash);
+	return ret;
+}
+
+/**
+ * Mount an image whose block device has been prepared by c_vol_prepare_image().
+ * Images are mounted one after another, as mount points may be nested.
  * @param vol The vol struct for the container.
  * @param root The directory where the root file system should be mounted.
- * @param mntent The information for this mount.
+ * @param vi The prepared image.
  * @return -1 on error else 0.
  */
 static int
-c_vol_mount_image(c_vol_t *vol, const char *root, const mount_entry_t *mntent)
+c_vol_mount_image(c_vol_t *vol, const char *root, c_vol_image_t *vi)
 {
 	int ret = -1;
-	char *img, *dev, *img_meta, *dev_meta, *dir, *img_hash;
-	int fd = 0, fd_meta = 0;
-	bool new_image = false;
+	const mount_entry_t *mntent = vi->mntent;
+	const char *img = vi->img;
+	const char *dev = vi->dev;
+	char *dir;
+	bool new_image = vi->new_image;
 	bool encrypted = mount_entry_is_encrypted(mntent);
 	bool overlay = false;
 	bool shiftids = false;
-	bool verity = mount_entry_get_verity_sha256(mntent) != NULL;
 	bool is_root = strcmp(mount_entry_get_dir(mntent), "/") == 0;
 	bool setup_mode = container_has_setup_mode(vol->container);
 
 	// default mountflags for most image types
 	unsigned long mountflags = setup_mode ? MS_NOATIME : MS_NOATIME | MS_NODEV;
 
-	img = dev = img_meta = dev_meta = dir = img_hash = NULL;
-
 	if (mount_entry_get_dir(mntent)[0] == '/')
 		dir = mem_printf("%s%s", root, mount_entry_get_dir(mntent));
 	else
 		dir = mem_printf("%s/%s", root, mount_entry_get_dir(mntent));
 
-	img = c_vol_image_path_new(vol, mntent);
-	if (!img)
-		goto error;
-
 	TRACE("Mount entry type: %d", mount_entry_get_type(mntent));
 
 	switch (mount_entry_get_type(mntent)) {
@@ -781,148 +986,17 @@ c_vol_mount_image(c_vol_t *vol, const char *root, const mount_entry_t *mntent)
 		}
 	}
 
-	if (c_vol_check_image(vol, img) < 0) {
-		new_image = true;
-		if (c_vol_create_image(vol, img, mntent) < 0) {
-			goto error;
-		}
-	}
-
-	if (mount_entry_get_type(mntent) == MOUNT_TYPE_EMPTY) {
-		char *img_meta = c_vol_meta_image_path_new(vol, mntent, NULL);
-		if (c_vol_check_image(vol, img_meta) < 0) {
-			vol->corrupted_image = true;
-			goto error;
-		}
-	}
-
-	if (verity) {
-		TRACE("Creating dm-verity device");
-		char *label = mem_printf("%s-%s", uuid_string(container_get_uuid(vol->container)),
-					 mount_entry_get_img(mntent));
-		char *verity_dev = verity_get_device_path_new(label);
-		if (file_is_blk(verity_dev) || file_links_to_blk(verity_dev)) {
-			INFO("Using existing mapper device: %s", verity_dev);
-		} else {
-			const char *root_hash = mount_entry_get_verity_sha256(mntent);
-			img_hash = c_vol_hash_image_path_new(vol, mntent);
-			IF_NULL_GOTO(img_hash, error);
-
-			if (verity_create_blk_dev(label, img, img_hash, root_hash,
-						  !cmld_is_hostedmode_active())) {
-				ERROR("Failed to open %s from %s as dm-verity device with hash-dev %s and hash %s",
-				      label, img, img_hash, root_hash);
-				mem_free0(label);
-				mem_free0(verity_dev);
-				goto error;
-			}
-
-			int control_fd = -1;
-			if ((control_fd = dm_open_control()) < 0) {
-				ERROR("Failed to open /dev/mapper/control\n");
-				mem_free0(label);
-				mem_free0(verity_dev);
-				goto error;
-			}
-
-			char *type = dm_get_target_type_new(control_fd, label);
-			if (!type) {
-				ERROR("Failed to get target type of %s\n", label);
-				mem_free0(label);
-				mem_free0(verity_dev);
-				goto error;
-			}
-			INFO("Type of %s is %s\n", label, type);
-			dm_close_control(control_fd);
-
-			// TODO audit_log_event?
-		}
-
-		dev = verity_dev;
-		mem_free0(label);
-
-		// TODO timeout?
-		while (access(dev, F_OK) < 0) {
-			NANOSLEEP(0, 100000000);
-			DEBUG("Waiting for %s", dev);
-		}
-		DEBUG("Device %s is now available\n", dev);
-
-	} else {
-		TRACE("Creating loopdev");
-		dev = loopdev_create_new(&fd, img, 0, 0);
-		IF_NULL_GOTO(dev, error);
-	}
-
-	if (encrypted) {
-		TRACE("Creating encrypted image");
-		char *label, *crypt;
-
-		label = mem_printf("%s-%s", uuid_string(container_get_uuid(vol->container)),
-				   mount_entry_get_img(mntent));
-
-		if (!container_get_key(vol->container)) {
-			audit_log_event(container_get_uuid(vol->container), FSA, CMLD,
-					CONTAINER_MGMT, "setup-crypted-volume-no-key",
-					uuid_string(container_get_uuid(vol->container)), 2, "label",
-					label);
-			ERROR("Trying to mount encrypted volume without key...");
-			mem_free0(label);
-			goto error;
-		}
-
-		crypt = cryptfs_get_device_path_new(label);
-		if (file_is_blk(crypt) || file_links_to_blk(crypt)) {
-			INFO("Using existing mapper device: %s", crypt);
-		} else {
-			DEBUG("Setting up cryptfs volume %s for %s (%s)", label, dev,
-			      vol->mode == CRYPTFS_MODE_AUTHENC ? "AUTHENC" : "INTEGRITY_ENCRYPT");
-
-			img_meta = c_vol_meta_image_path_new(vol, mntent, NULL);
-			dev_meta = loopdev_create_new(&fd_meta, img_meta, 0, 0);
-
-			IF_NULL_GOTO(dev_meta, error);
-
-			mem_free0(crypt);
-			crypt = cryptfs_setup_volume_new(
-				label, dev, container_get_key(vol->container), dev_meta, vol->mode);
-
-			// release loopdev fd (crypt device should keep it open now)
-			close(fd_meta);
-			mem_free0(img_meta);
-
-			if (!crypt) {
-				audit_log_event(container_get_uuid(vol->container), FSA, CMLD,
-						CONTAINER_MGMT, "setup-crypted-volume",
-						uuid_string(container_get_uuid(vol->container)), 2,
-						"label", label);
-				ERROR("Setting up cryptfs volume %s for %s failed", label, dev);
-				mem_free0(label);
-				goto error;
-			}
-			audit_log_event(container_get_uuid(vol->container), SSA, CMLD,
-					CONTAINER_MGMT, "setup-crypted-volume",
-					uuid_string(container_get_uuid(vol->container)), 2, "label",
-					label);
-		}
-
-		mem_free0(label);
-		mem_free0(dev);
-		dev = crypt;
-
-		// TODO: timeout?
-		while (access(dev, F_OK) < 0) {
-			NANOSLEEP(0, 10000000)
-			DEBUG("Waiting for %s", dev);
-		}
+	if (!dev) {
+		ERROR("No block device has been prepared for image %s", img);
+		goto error;
 	}
 
 	if (overlay) {
 		TRACE("Device to be mounted is an overlay device\n");
 		const char *upper_fstype = NULL;
 		const char *lower_fstype = NULL;
-		char *upper_dev = NULL;
-		char *lower_dev = NULL;
+		const char *upper_dev = NULL;
+		const char *lower_dev = NULL;
 		const char *mount_data = mount_entry_get_mount_data(mntent);
 
 		switch (mount_entry_get_type(mntent)) {
@@ -930,13 +1004,6 @@ c_vol_mount_image(c_vol_t *vol, const char *root, const mount_entry_t *mntent)
 			TRACE("Preparing MOUNT_TYPE_OVERLAY_RW");
 			upper_dev = dev;
 			upper_fstype = mount_entry_get_fs(mntent);
-			if (new_image) {
-				if (c_vol_format_image(dev, upper_fstype) < 0) {
-					ERROR("Could not format image %s using %s", img, dev);
-					goto error;
-				}
-				DEBUG("Successfully formatted new image %s using %s", img, dev);
-			}
 			if (!strcmp("btrfs", upper_fstype) && mount_data &&
 			    !strncmp("subvol", mount_data, 6)) {
 				c_vol_btrfs_create_subvol(dev, mount_data);
@@ -1056,22 +1123,8 @@ final_noshift:
 	ret = 0;
 
 error:
-	if (dev)
-		loopdev_free(dev);
-	if (dev_meta)
-		loopdev_free(dev_meta);
-	if (img)
-		mem_free0(img);
-	if (img_meta)
-		mem_free0(img_meta);
 	if (dir)
 		mem_free0(dir);
-	if (fd)
-		close(fd);
-	if (fd_meta)
-		close(fd_meta);
-	if (img_hash)
-		mem_free0(img_hash);
 	return ret;
 }
 
@@ -1214,10 +1267,131 @@ error:
  * Mount all image files.
  * This function is called in the rootns.
  */
+static void
+c_vol_image_free(c_vol_image_t *vi)
+{
+	if (vi->dev)
+		loopdev_free(vi->dev);
+	if (vi->fd >= 0)
+		close(vi->fd);
+	mem_free0(vi->img);
+	mem_free0(vi->audit_label);
+}
+
+/*
+ * Images whose block device stacks are prepared concurrently by a number of
+ * worker threads. Images of mount entries with the same image name share their
+ * device-mapper labels, so they are prepared by the same job in list order.
+ */
+typedef struct c_vol_prepare {
+	c_vol_image_t *images;
+	size_t count;
+	size_t *jobs; //!< index of the first image of each job
+	size_t n_jobs;
+	size_t next_job;
+	pthread_mutex_t lock;
+} c_vol_prepare_t;
+
+static void
+c_vol_prepare_job(c_vol_prepare_t *prep, size_t first)
+{
+	const char *name = mount_entry_get_img(prep->images[first].mntent);
+
+	for (size_t i = first; i < prep->count; i++) {
+		c_vol_image_t *vi = &prep->images[i];
+		if (!c_vol_image_has_dev(vi->mntent) ||
+		    strcmp(mount_entry_get_img(vi->mntent), name))
+			continue;
+		vi->ret = c_vol_prepare_image(vi);
+		if (vi->ret < 0)
+			break;
+	}
+}
+
+static void *
+c_vol_prepare_worker(void *data)
+{
+	c_vol_prepare_t *prep = data;
+
+	for (;;) {
+		pthread_mutex_lock(&prep->lock);
+		size_t job = prep->next_job++;
+		pthread_mutex_unlock(&prep->lock);
+
+		if (job >= prep->n_jobs)
+			break;
+		c_vol_prepare_job(prep, prep->jobs[job]);
+	}
+	return NULL;
+}
+
+/*
+ * Prepares the block devices of all images concurrently, so that the time
+ * this takes is close to that of the slowest image rather than the sum.
+ */
+static int
+c_vol_prepare_images(c_vol_t *vol, c_vol_image_t *images, size_t count)
+{
+	int ret = 0;
+	c_vol_prepare_t prep = { .images = images, .count = count };
+	prep.jobs = mem_new0(size_t, count);
+	pthread_mutex_init(&prep.lock, NULL);
+
+	for (size_t i = 0; i < count; i++) {
+		if (!c_vol_image_has_dev(images[i].mntent))
+			continue;
+		bool first = true;
+		for (size_t j = 0; j < i && first; j++) {
+			first = !c_vol_image_has_dev(images[j].mntent) ||
+				strcmp(mount_entry_get_img(images[i].mntent),
+				       mount_entry_get_img(images[j].mntent));
+		}
+		if (first)
+			prep.jobs[prep.n_jobs++] = i;
+	}
+
+	// the calling thread works on the jobs as well
+	size_t n_threads = prep.n_jobs > 1 ? MIN(prep.n_jobs, C_VOL_PREPARE_THREADS_MAX) - 1 : 0;
+	pthread_t *threads = mem_new0(pthread_t, MAX(n_threads, 1));
+	size_t started = 0;
+	for (; started < n_threads; started++) {
+		if (pthread_create(&threads[started], NULL, c_vol_prepare_worker, &prep)) {
+			WARN("Could not create thread to prepare images, continuing with %zu",
+			     started + 1);
+			break;
+		}
+	}
+	DEBUG("Preparing %zu images of container %s in %zu threads", prep.n_jobs,
+	      container_get_name(vol->container), started + 1);
+	c_vol_prepare_worker(&prep);
+	for (size_t i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	for (size_t i = 0; i < count; i++) {
+		c_vol_image_t *vi = &images[i];
+		if (vi->audit_evtype)
+			audit_log_event(container_get_uuid(vol->container),
+					vi->audit_success ? SSA : FSA, CMLD, CONTAINER_MGMT,
+					vi->audit_evtype,
+					uuid_string(container_get_uuid(vol->container)), 2, "label",
+					vi->audit_label);
+		if (vi->ret < 0) {
+			ERROR("Could not prepare image %s", vi->img);
+			ret = -1;
+		}
+	}
+
+	pthread_mutex_destroy(&prep.lock);
+	mem_free0(threads);
+	mem_free0(prep.jobs);
+	return ret;
+}
+
 static int
 c_vol_mount_images(c_vol_t *vol)
 {
-	size_t i, n;
+	size_t i, n, n_setup, count;
+	int ret = -1;
 
 	ASSERT(vol);
 
@@ -1226,14 +1400,31 @@ c_vol_mount_images(c_vol_t *vol)
 	// in setup mode mount container images under {root}/setup subfolder
 	char *c_root = mem_printf("%s%s", vol->root, (setup_mode) ? "/setup" : "");
 
-	if (setup_mode) {
-		n = mount_get_count(vol->mnt_setup);
-		for (i = 0; i < n; i++) {
-			const mount_entry_t *mntent;
+	n_setup = setup_mode ? mount_get_count(vol->mnt_setup) : 0;
+	n = mount_get_count(vol->mnt);
+	count = n_setup + n;
+
+	// images may need an additional loop device for their meta or hash data
+	loopdev_pool_fill(2 * count);
+
+	c_vol_image_t *images = mem_new0(c_vol_image_t, MAX(count, 1));
+	for (i = 0; i < count; i++) {
+		c_vol_image_t *vi = &images[i];
+		vi->vol = vol;
+		vi->mntent = (i < n_setup) ? mount_get_entry(vol->mnt_setup, i) :
+					     mount_get_entry(vol->mnt, i - n_setup);
+		vi->fd = -1;
+		vi->img = c_vol_image_path_new(vol, vi->mntent);
+		if (!vi->img)
+			goto err;
+	}
 
-			mntent = mount_get_entry(vol->mnt_setup, i);
+	if (c_vol_prepare_images(vol, images, count) < 0)
+		goto err;
 
-			if (c_vol_mount_image(vol, vol->root, mntent) < 0) {
+	if (setup_mode) {
+		for (i = 0; i < n_setup; i++) {
+			if (c_vol_mount_image(vol, vol->root, &images[i]) < 0) {
 				goto err;
 			}
 		}
@@ -1243,23 +1434,23 @@ c_vol_mount_images(c_vol_t *vol)
 			DEBUG_ERRNO("Could not mkdir %s", c_root);
 	}
 
-	n = mount_get_count(vol->mnt);
-	for (i = 0; i < n; i++) {
-		const mount_entry_t *mntent;
-
-		mntent = mount_get_entry(vol->mnt, i);
-
-		if (c_vol_mount_image(vol, c_root, mntent) < 0) {
+	for (i = n_setup; i < count; i++) {
+		if (c_vol_mount_image(vol, c_root, &images[i]) < 0) {
 			goto err;
 		}
 	}
-	mem_free0(c_root);
-	return 0;
+	ret = 0;
 err:
-	c_vol_umount_all(vol);
-	c_vol_cleanup_dm(vol);
+	if (ret < 0) {
+		c_vol_umount_all(vol);
+		c_vol_cleanup_dm(vol);
+	}
+	// mounted loop devices are kept by the kernel, the others are cleared on close
+	for (i = 0; i < count; i++)
+		c_vol_image_free(&images[i]);
+	mem_free0(images);
 	mem_free0(c_root);
-	return -1;
+	return ret;
 }
 
 static bool
@@ -1356,6 +1547,22 @@ c_vol_verify_mount_entries(const c_vol_t *vol)
 	ASSERT(vol);
 
 	int n = mount_get_count(vol->mnt);
+
+	// hash all images which are checked thoroughly below concurrently
+	const mount_entry_t **thorough_entries = mem_new0(const mount_entry_t *, n);
+	size_t n_thorough = 0;
+	for (int i = 0; i < n; i++) {
+		const mount_entry_t *mntent = mount_get_entry(vol->mnt, i);
+		if ((mount_entry_get_type(mntent) == MOUNT_TYPE_SHARED ||
+		     mount_entry_get_type(mntent) == MOUNT_TYPE_SHARED_RW ||
+		     mount_entry_get_type(mntent) == MOUNT_TYPE_OVERLAY_RO) &&
+		    !mount_entry_get_verity_sha256(mntent) &&
+		    guestos_check_mount_image_block(vol->os, mntent, false) == CHECK_IMAGE_GOOD)
+			thorough_entries[n_thorough++] = mntent;
+	}
+	guestos_hash_mount_images_block(vol->os, thorough_entries, n_thorough);
+	mem_free0(thorough_entries);
+
 	for (int i = 0; i < n; i++) {
 		const mount_entry_t *mntent;
 		mntent = mount_get_entry(vol->mnt, i);
@@ -1408,6 +1615,18 @@ c_vol_verify_mount_entries_bg(const c_vol_t *vol)
 			         * block access, and check the whole image in
 				 * background
 				 */
+				if (guestos_check_mount_image_cached(vol->os, mntent)) {
+					DEBUG("dm-verity active for image %s, "
+					      "already verified unchanged image.",
+					      mount_entry_get_img(mntent));
+					audit_log_event(
+						container_get_uuid(vol->container), SSA, CMLD,
+						CONTAINER_MGMT, "verify-image",
+						uuid_string(container_get_uuid(vol->container)), 2,
+						"name", mount_entry_get_img(mntent));
+					continue;
+				}
+
 				pid_t pid = fork();
 				if (pid < 0) {
 					ERROR_ERRNO("Can not fork child for integrity check!");
@@ -1484,6 +1703,100 @@ c_vol_set_dm_mode(c_vol_t *vol)
 	mem_free0(not_stacked_file);
 }
 
+/*
+ * Reports the progress of the integrity tag initialization of all encrypted
+ * volumes of the container. Returns true if it is still running for any of them.
+ */
+static bool
+c_vol_integrity_init_report(c_vol_t *vol)
+{
+	ASSERT(vol);
+
+	bool running = false;
+	size_t n = mount_get_count(vol->mnt);
+	for (size_t i = 0; i < n; i++) {
+		const mount_entry_t *mntent = mount_get_entry(vol->mnt, i);
+		if (!mount_entry_is_encrypted(mntent))
+			continue;
+
+		char *label = mem_printf("%s-%s", uuid_string(container_get_uuid(vol->container)),
+					 mount_entry_get_img(mntent));
+		uint64_t done, total;
+		if (cryptfs_get_integrity_init_progress(label, &done, &total) == 1) {
+			INFO("Initializing integrity tags of volume %s: %" PRIu64 "%%", label,
+			     total ? done * 100 / total : 0);
+			running = true;
+		}
+		mem_free0(label);
+	}
+	return running;
+}
+
+static void
+c_vol_integrity_init_timer_free(c_vol_t *vol)
+{
+	IF_NULL_RETURN(vol->integrity_init_timer);
+
+	event_remove_timer(vol->integrity_init_timer);
+	event_timer_free(vol->integrity_init_timer);
+	vol->integrity_init_timer = NULL;
+}
+
+static void
+c_vol_integrity_init_timer_cb(UNUSED event_timer_t *timer, void *data)
+{
+	c_vol_t *vol = data;
+	ASSERT(vol);
+
+	if (c_vol_integrity_init_report(vol))
+		return;
+
+	INFO("Integrity tags of all volumes of container %s initialized",
+	     container_get_name(vol->container));
+	audit_log_event(container_get_uuid(vol->container), SSA, CMLD, CONTAINER_MGMT,
+			"integrity-init-complete", uuid_string(container_get_uuid(vol->container)),
+			0);
+	c_vol_integrity_init_timer_free(vol);
+}
+
+/*
+ * Takes references on the shared dm-verity devices of all images the container
+ * is going to mount, so that they are kept as long as the container runs.
+ */
+static void
+c_vol_verity_acquire_mount(c_vol_t *vol, const mount_t *mnt)
+{
+	for (size_t i = 0; i < mount_get_count(mnt); i++) {
+		const char *root_hash = mount_entry_get_verity_sha256(mount_get_entry(mnt, i));
+		if (!root_hash || verity_registry_acquire(root_hash) < 0)
+			continue;
+		vol->verity_refs = list_append(vol->verity_refs, mem_strdup(root_hash));
+	}
+}
+
+static void
+c_vol_verity_acquire(c_vol_t *vol)
+{
+	// references are kept over a reboot of the container
+	if (vol->verity_refs)
+		return;
+
+	if (container_has_setup_mode(vol->container))
+		c_vol_verity_acquire_mount(vol, vol->mnt_setup);
+	c_vol_verity_acquire_mount(vol, vol->mnt);
+}
+
+static void
+c_vol_verity_release(c_vol_t *vol)
+{
+	for (list_t *l = vol->verity_refs; l; l = l->next) {
+		verity_registry_release(l->data);
+		mem_free0(l->data);
+	}
+	list_delete(vol->verity_refs);
+	vol->verity_refs = NULL;
+}
+
 /******************************************************************************/
 
 static void *
@@ -1536,6 +1849,9 @@ c_vol_free(void *volp)
 	if (vol->root)
 		mem_free0(vol->root);
 
+	c_vol_integrity_init_timer_free(vol);
+	c_vol_verity_release(vol);
+
 	mem_free0(vol);
 }
 
@@ -1668,6 +1984,9 @@ c_vol_start_pre_clone(void *volp)
 	// set device mapper mode for data integrity and encryption
 	c_vol_set_dm_mode(vol);
 
+	// the child process sets up or reuses the shared dm-verity devices
+	c_vol_verity_acquire(vol);
+
 	return 0;
 }
 
@@ -1677,6 +1996,14 @@ c_vol_start_post_clone(void *volp)
 	c_vol_t *vol = volp;
 	ASSERT(vol);
 
+	// the container may already use volumes whose integrity tags are still initialized
+	if (!vol->integrity_init_timer && c_vol_integrity_init_report(vol)) {
+		vol->integrity_init_timer =
+			event_timer_new(C_VOL_INTEGRITY_INIT_INTERVAL, EVENT_TIMER_REPEAT_FOREVER,
+					c_vol_integrity_init_timer_cb, vol);
+		event_add_timer(vol->integrity_init_timer);
+	}
+
 	// check image integrity lazy in background for verity enabled images
 	if (c_vol_verify_mount_entries_bg(vol))
 		return 0;
@@ -2049,12 +2376,18 @@ c_vol_cleanup(void *volp, bool is_rebooting)
 	c_vol_t *vol = volp;
 	ASSERT(vol);
 
+	c_vol_integrity_init_timer_free(vol);
+
 	if (c_vol_umount_all(vol))
 		WARN("Could not umount all images properly");
 
 	// keep dm crypt/integrity device up for reboot
 	if (!is_rebooting && c_vol_cleanup_dm(vol))
 		WARN("Could not remove mounts properly");
+
+	// shared dm-verity devices are removed once no other container uses them
+	if (!is_rebooting)
+		c_vol_verity_release(vol);
 }
 
 static compartment_module_t c_vol_module = {
@@ -36,6 +36,7 @@
 #include "common/event.h"
 #include "common/logf.h"
 #include "common/list.h"
+#include "common/array.h"
 #include "common/file.h"
 #include "common/sock.h"
 #include "common/mem.h"
@@ -49,6 +50,7 @@
 #include "device_id.h"
 #include "control.h"
 #include "guestos_mgr.h"
+#include "download.h"
 #include "guestos.h"
 #include "scd.h"
 #include "tss.h"
@@ -60,6 +62,7 @@
 #include "time.h"
 #include "container_config.h"
 #include "container.h"
+#include "container_registry.h"
 #include "input.h"
 #include "oci.h"
 #include "crypto.h"
@@ -112,8 +115,8 @@ static const char *cmld_path = DEFAULT_BASE_PATH;
 static const char *cmld_container_path = NULL;
 static const char *cmld_wrapped_keys_path = NULL;
 
-static list_t *cmld_containers_list = NULL; // usually first element is c0
-static list_t *cmld_units_list = NULL;
+static array_t *cmld_containers = NULL; // usually first element is c0
+static array_t *cmld_units = NULL;
 
 static control_t *cmld_control_gui = NULL;
 static control_t *cmld_control_cml = NULL;
@@ -159,6 +162,31 @@ cmld_init_stage_container(void);
 
 /******************************************************************************/
 
+/*
+ * cmld_containers keeps the order of containers (c0 first) while the
+ * container registry provides the hash indexes for lookups.
+ */
+static void
+cmld_containers_append(container_t *container)
+{
+	cmld_containers = array_append(cmld_containers, container);
+	container_registry_add(container);
+}
+
+static void
+cmld_containers_prepend(container_t *container)
+{
+	cmld_containers = array_prepend(cmld_containers, container);
+	container_registry_add(container);
+}
+
+static void
+cmld_containers_remove(container_t *container)
+{
+	container_registry_remove(container);
+	array_remove(cmld_containers, container);
+}
+
 container_t *
 cmld_containers_get_c0()
 {
@@ -174,8 +202,8 @@ cmld_container_get_c_root_netns()
 	container_t *found = NULL;
 	container_t *found_c0 = NULL;
 
-	for (list_t *l = cmld_containers_list; l; l = l->next) {
-		container_t *container = l->data;
+	for (unsigned int i = 0; i < array_length(cmld_containers); i++) {
+		container_t *container = array_get(cmld_containers, i);
 		if (!container_has_netns(container)) {
 			if (container == cmld_containers_get_c0()) {
 				found_c0 = container;
@@ -194,40 +222,43 @@ cmld_container_get_by_uuid(const uuid_t *uuid)
 {
 	ASSERT(uuid);
 
-	for (list_t *l = cmld_containers_list; l; l = l->next)
-		if (uuid_equals(container_get_uuid(l->data), uuid))
-			return l->data;
-
-	return NULL;
+	return container_registry_get_by_uuid(uuid);
 }
 
 container_t *
 cmld_container_get_by_uid(int uid)
 {
-	for (list_t *l = cmld_containers_list; l; l = l->next) {
-		container_t *c = l->data;
-		if ((uid >= container_get_uid(c)) && (uid < container_get_uid(c) + UID_MAX))
-			return c;
+	IF_TRUE_RETVAL_TRACE(uid < 0, NULL);
+
+	if (uid < UID_MAX) {
+		// ids of the root user namespace, first container without userns (usually c0)
+		for (unsigned int i = 0; i < array_length(cmld_containers); i++) {
+			container_t *c = array_get(cmld_containers, i);
+			if (container_get_uid(c) == 0)
+				return c;
+		}
+		return NULL;
 	}
-	return NULL;
+
+	IF_TRUE_RETVAL_TRACE(uid < CMLD_CONTAINER_UID_RANGES_START, NULL);
+
+	int uid_start = uid - ((uid - CMLD_CONTAINER_UID_RANGES_START) % CMLD_CONTAINER_UID_RANGE);
+	IF_TRUE_RETVAL_TRACE(uid >= uid_start + UID_MAX, NULL);
+
+	return container_registry_get_by_uid_start(uid_start);
 }
 
 container_t *
 cmld_container_get_by_pid(int pid)
 {
-	for (list_t *l = cmld_containers_list; l; l = l->next) {
-		container_t *c = l->data;
-		if (container_contains_pid(c, pid))
-			return c;
-	}
-	return NULL;
+	return container_registry_get_by_pid(pid);
 }
 
 static bool
 cmld_containers_are_all_stopped(void)
 {
-	for (list_t *l = cmld_containers_list; l; l = l->next) {
-		container_t *c = l->data;
+	for (unsigned int i = 0; i < array_length(cmld_containers); i++) {
+		container_t *c = array_get(cmld_containers, i);
 		if (container_get_state(c) != COMPARTMENT_STATE_STOPPED)
 			return false;
 		else
@@ -278,8 +309,8 @@ cmld_containers_stop(void (*on_all_stopped)(int), int value)
 	stop_data->on_all_stopped = on_all_stopped;
 	stop_data->value = value;
 
-	for (list_t *l = cmld_containers_list; l; l = l->next) {
-		container_t *container = l->data;
+	for (unsigned int i = 0; i < array_length(cmld_containers); i++) {
+		container_t *container = array_get(cmld_containers, i);
 		if (cmld_container_stop(container) == 0) {
 			/* Register observer to wait for completed container_stop */
 			if (!container_register_observer(container, &cmld_container_stop_cb,
@@ -295,13 +326,13 @@ cmld_containers_stop(void (*on_all_stopped)(int), int value)
 int
 cmld_containers_get_count(void)
 {
-	return list_length(cmld_containers_list);
+	return array_length(cmld_containers);
 }
 
 container_t *
 cmld_container_get_by_index(int index)
 {
-	return list_nth_data(cmld_containers_list, index);
+	return array_get(cmld_containers, index);
 }
 
 const char *
@@ -567,7 +598,7 @@ out:
 void
 cmld_containers_add(container_t *container)
 {
-	cmld_containers_list = list_append(cmld_containers_list, container);
+	cmld_containers_append(container);
 }
 
 static container_t *
@@ -645,7 +676,7 @@ cmld_reload_container_internal(const uuid_t *uuid, const char *path, container_c
 		DEBUG("Removing outdated created container %s for config update",
 		      container_get_name(c_current));
 
-		cmld_containers_list = list_remove(cmld_containers_list, c_current);
+		cmld_containers_remove(c_current);
 		if (cb) {
 			// delayed free to allow all observers to finish up
 			container_finish_observers(c_current, cmld_container_delayed_free,
@@ -656,7 +687,7 @@ cmld_reload_container_internal(const uuid_t *uuid, const char *path, container_c
 	}
 
 	DEBUG("Loaded config for container %s", container_get_name(c));
-	cmld_containers_list = list_append(cmld_containers_list, c);
+	cmld_containers_append(c);
 
 	/*
 	 * register observer for automatic config reload again
@@ -905,11 +936,28 @@ cmld_audit_compartment_state_cb(container_t *container, container_callback_t *cb
 	}
 }
 
+static void
+cmld_container_registry_cb(container_t *container, container_callback_t *cb, UNUSED void *data)
+{
+	ASSERT(container);
+	ASSERT(cb);
+
+	/* keep uid range and pid namespace indexes current */
+	container_registry_update(container);
+
+	if (container_get_state(container) == COMPARTMENT_STATE_STOPPED)
+		container_unregister_observer(container, cb);
+}
+
 static void
 cmld_container_register_observers(container_t *container)
 {
 	/* register callbacks which should be present while the container is running
 	 * ATTENTION: All these callbacks MUST deregister themselves as soon as the container is stopped */
+	if (!container_register_observer(container, &cmld_container_registry_cb, NULL)) {
+		ERROR("Could not register container registry observer callback for %s",
+		      container_get_description(container));
+	}
 	if (!container_register_observer(container, &cmld_container_boot_complete_cb, NULL)) {
 		ERROR("Could not register container boot complete observer callback for %s",
 		      container_get_description(container));
@@ -1100,13 +1148,13 @@ cmld_container_ctrl_with_smartcard(container_t *container, const char *passwd,
 int
 cmld_units_get_count(void)
 {
-	return list_length(cmld_units_list);
+	return array_length(cmld_units);
 }
 
 unit_t *
 cmld_unit_get_by_index(int index)
 {
-	return list_nth_data(cmld_units_list, index);
+	return array_get(cmld_units, index);
 }
 
 unit_t *
@@ -1114,9 +1162,11 @@ cmld_unit_get_by_uuid(const uuid_t *uuid)
 {
 	ASSERT(uuid);
 
-	for (list_t *l = cmld_units_list; l; l = l->next)
-		if (uuid_equals(unit_get_uuid(l->data), uuid))
-			return l->data;
+	for (unsigned int i = 0; i < array_length(cmld_units); i++) {
+		unit_t *unit = array_get(cmld_units, i);
+		if (uuid_equals(unit_get_uuid(unit), uuid))
+			return unit;
+	}
 
 	return NULL;
 }
@@ -1161,8 +1211,8 @@ cmld_c0_boot_complete_cb(container_t *container, container_callback_t *cb, UNUSE
 		// swap boot order
 		a_b_update_set_boot_order();
 
-		for (list_t *l = cmld_containers_list; l; l = l->next) {
-			container_t *container = l->data;
+		for (unsigned int i = 0; i < array_length(cmld_containers); i++) {
+			container_t *container = array_get(cmld_containers, i);
 			if (container_get_allow_autostart(container)) {
 				INFO("Autostarting container %s in background",
 				     container_get_name(container));
@@ -1205,9 +1255,10 @@ cmld_shutdown_container_cb(container_t *container, container_callback_t *cb, UNU
 	DEBUG("Device shutdown: container %s went down, checking others before shutdown",
 	      container_get_description(container));
 
-	for (list_t *l = cmld_containers_list; l; l = l->next) {
-		if (!(container_get_state(l->data) == COMPARTMENT_STATE_STOPPED ||
-		      container_get_state(l->data) == COMPARTMENT_STATE_ZOMBIE)) {
+	for (unsigned int i = 0; i < array_length(cmld_containers); i++) {
+		container_t *c = array_get(cmld_containers, i);
+		if (!(container_get_state(c) == COMPARTMENT_STATE_STOPPED ||
+		      container_get_state(c) == COMPARTMENT_STATE_ZOMBIE)) {
 			DEBUG("Device shutdown: There are still running containers, can't shut down");
 			return;
 		}
@@ -1250,20 +1301,20 @@ cmld_shutdown_c0_cb(container_t *c0, container_callback_t *cb, UNUSED void *data
 	 *   needs not to be done for c0, as this observer callback call tells that it is either already
 	 *   dead or in shutting down state
 	 */
-	for (list_t *l = cmld_containers_list; l; l = l->next) {
-		if (!(container_get_state(l->data) == COMPARTMENT_STATE_STOPPED ||
-		      container_get_state(l->data) == COMPARTMENT_STATE_ZOMBIE)) {
+	for (unsigned int i = 0; i < array_length(cmld_containers); i++) {
+		container_t *c = array_get(cmld_containers, i);
+		if (!(container_get_state(c) == COMPARTMENT_STATE_STOPPED ||
+		      container_get_state(c) == COMPARTMENT_STATE_ZOMBIE)) {
 			shutdown_now = false;
-			if (!container_register_observer(l->data, &cmld_shutdown_container_cb,
-							 NULL)) {
+			if (!container_register_observer(c, &cmld_shutdown_container_cb, NULL)) {
 				ERROR("Could not register observer shutdown callback for %s",
-				      container_get_description(l->data));
+				      container_get_description(c));
 			}
-			if (l->data != c0 &&
-			    !(container_get_state(l->data) == COMPARTMENT_STATE_SHUTTING_DOWN)) {
+			if (c != c0 &&
+			    !(container_get_state(c) == COMPARTMENT_STATE_SHUTTING_DOWN)) {
 				DEBUG("Device shutdown: There is another running container:%s. Shut it down first",
-				      container_get_description(l->data));
-				cmld_container_stop(l->data);
+				      container_get_description(c));
+				cmld_container_stop(c);
 			}
 		}
 	}
@@ -1328,8 +1379,8 @@ cmld_init_c0(const char *path, const char *c0os)
 			      cmld_get_device_host_dns(), NULL, NULL, NULL, NULL, NULL, NULL, init,
 			      init_argv, NULL, 0, NULL, CONTAINER_TOKEN_TYPE_NONE, false, false);
 
-	/* store c0 as first element of the cmld_containers_list */
-	cmld_containers_list = list_prepend(cmld_containers_list, new_c0);
+	/* store c0 as first element of cmld_containers */
+	cmld_containers_prepend(new_c0);
 
 	mem_free0(c0_images_folder);
 
@@ -1696,7 +1747,12 @@ cmld_init_stage_container(void)
 
 	char *guestos_path = mem_printf("%s/%s", cmld_path, CMLD_PATH_GUESTOS_DIR);
 	bool allow_locally_signed = device_config_get_locally_signed_images(device_config);
-	if (guestos_mgr_init(guestos_path, allow_locally_signed) < 0 && !cmld_hostedmode)
+	uint32_t verify_workers = device_config_get_image_verify_workers(device_config);
+	download_set_parallel_ranges(device_config_get_download_parallel_ranges(device_config));
+	download_set_rate_limit((uint64_t)device_config_get_download_rate_limit(device_config) *
+				1024);
+	if (guestos_mgr_init(guestos_path, allow_locally_signed, verify_workers) < 0 &&
+	    !cmld_hostedmode)
 		FATAL("Could not load guest operating systems");
 	mem_free0(guestos_path);
 	INFO("guestos initialized.");
@@ -1735,12 +1791,12 @@ cmld_init_stage_container(void)
 void
 cmld_init_stage_unit_notify(unit_t *unit)
 {
-	if (!list_find(cmld_units_list, unit))
-		cmld_units_list = list_append(cmld_units_list, unit);
+	if (!array_contains(cmld_units, unit))
+		cmld_units = array_append(cmld_units, unit);
 
 	bool units_pending = false;
-	for (list_t *l = cmld_units_list; l; l = l->next) {
-		unit_t *u = l->data;
+	for (unsigned int i = 0; i < array_length(cmld_units); i++) {
+		unit_t *u = array_get(cmld_units, i);
 		if (unit_get_state(u) != COMPARTMENT_STATE_RUNNING) {
 			units_pending = true;
 			break;
@@ -1787,7 +1843,7 @@ cmld_container_create_from_config(const uint8_t *config, size_t config_len, uint
 							      CMLD_STORAGE_FREE_THRESHOLD),
 				    err);
 
-		cmld_containers_list = list_append(cmld_containers_list, c);
+		cmld_containers_append(c);
 		/*
 		 * register an observer for automatic config reload
 		 * CAUTION: This callback destroys the previous container object.
@@ -1836,9 +1892,10 @@ cmld_container_destroy_cb(container_t *container, container_callback_t *cb, UNUS
 	}
 
 	/* cleanup container */
-	cmld_containers_list = list_remove(cmld_containers_list, container);
+	cmld_containers_remove(container);
 	audit_log_event(container_get_uuid(container), SSA, CMLD, CONTAINER_MGMT,
 			"container-remove", uuid_string(container_get_uuid(container)), 0);
+	audit_close_log(container_get_uuid(container));
 
 	if (cb) {
 		// delayed free to allow all observers to finish up
@@ -2058,13 +2115,14 @@ cmld_netif_phys_add_by_mac(const uint8_t mac[MAC_ADDR_LEN])
 void
 cmld_cleanup(void)
 {
-	for (list_t *l = cmld_containers_list; l; l = l->next) {
-		container_t *container = l->data;
+	for (unsigned int i = 0; i < array_length(cmld_containers); i++) {
+		container_t *container = array_get(cmld_containers, i);
 		container_free(container);
 	}
-	list_delete(cmld_containers_list);
+	array_free(cmld_containers);
+	container_registry_clear();
 
-	list_delete(cmld_units_list);
+	array_free(cmld_units);
 
 	if (cmld_control_gui)
 		control_free(cmld_control_gui);
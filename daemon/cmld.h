@@ -55,6 +55,14 @@
 
 #define UID_MAX 65536
 
+/*
+ * uid ranges of containers with a user namespace start at
+ * CMLD_CONTAINER_UID_RANGES_START and are aligned to CMLD_CONTAINER_UID_RANGE;
+ * each range spans UID_MAX ids.
+ */
+#define CMLD_CONTAINER_UID_RANGE 100000
+#define CMLD_CONTAINER_UID_RANGES_START 100000
+
 /**
  * Enum represents different commands to control a container
  */
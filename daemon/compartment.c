@@ -151,6 +151,7 @@ typedef struct {
 typedef struct {
 	pid_t pid;
 	char *name;
+	compartment_t *compartment;
 } compartment_helper_child_t;
 /**
  * These are used for synchronizing the compartment start between parent
@@ -243,11 +244,12 @@ compartment_module_get_mod_instance_by_name(const compartment_t *compartment, co
 }
 
 static compartment_helper_child_t *
-compartment_helper_child_new(char *name, pid_t pid)
+compartment_helper_child_new(compartment_t *compartment, char *name, pid_t pid)
 {
 	compartment_helper_child_t *child = mem_new0(compartment_helper_child_t, 1);
 	child->name = mem_strdup(name ? name : "generic");
 	child->pid = pid;
+	child->compartment = compartment;
 
 	return child;
 }
@@ -669,29 +671,15 @@ compartment_cleanup(compartment_t *compartment, bool is_rebooting)
 	compartment->pid_early = -1;
 }
 
-void
-compartment_sigchld_handle_helpers(compartment_t *compartment, event_signal_t *sig)
+/*
+ * Completes a stop or reboot as soon as the init process and all
+ * helper children of the compartment have been reaped.
+ */
+static void
+compartment_check_cleanup_done(compartment_t *compartment)
 {
-	int status = 0;
-
-	for (list_t *l = compartment->helper_child_list; l;) {
-		list_t *next = l->next;
-		compartment_helper_child_t *child = l->data;
-		if (proc_waitpid(child->pid, &status, WNOHANG) == child->pid) {
-			DEBUG("Reaped helper child %s (pid=%d) for compartment %s", child->name,
-			      child->pid, compartment_get_description(compartment));
-			compartment->helper_child_list =
-				list_unlink(compartment->helper_child_list, l);
-			compartment_helper_child_free(child);
-		}
-		l = next;
-	}
-
 	if (!compartment->helper_child_list && compartment->is_doing_cleanup) {
 		DEBUG("CLEANUP DONE, all pending helpers reaped!");
-		/* remove the sigchld callback for this compartment from the event loop */
-		event_remove_signal(sig);
-		event_signal_free(sig);
 		compartment->is_doing_cleanup = false;
 		compartment_state_t state = compartment->is_rebooting ?
 						    COMPARTMENT_STATE_REBOOTING :
@@ -701,125 +689,91 @@ compartment_sigchld_handle_helpers(compartment_t *compartment, event_signal_t *s
 	}
 }
 
-void
-compartment_sigchld_cb(UNUSED int signum, event_signal_t *sig, void *data)
+static void
+compartment_helper_child_cb(pid_t pid, UNUSED int status, event_child_watch_t *watch, void *data)
 {
-	ASSERT(data);
+	compartment_helper_child_t *child = data;
+	ASSERT(child);
+
+	compartment_t *compartment = child->compartment;
+
+	DEBUG("Reaped helper child %s (pid=%d) for compartment %s", child->name, pid,
+	      compartment_get_description(compartment));
+
+	event_child_watch_free(watch);
+	compartment->helper_child_list = list_remove(compartment->helper_child_list, child);
+	compartment_helper_child_free(child);
 
+	compartment_check_cleanup_done(compartment);
+}
+
+static void
+compartment_init_child_cb(pid_t pid, int status, event_child_watch_t *watch, void *data)
+{
 	compartment_t *compartment = data;
+	ASSERT(compartment);
 
-	TRACE("SIGCHLD handler called for compartment %s with PID %d",
-	      compartment_get_description(compartment), compartment->pid);
+	TRACE("Child watch called for compartment %s with PID %d",
+	      compartment_get_description(compartment), pid);
 
-	if (compartment->pid == -1) {
-		TRACE("All processes of container %s already reaped, check for remaining helpers.",
-		      compartment_get_description(compartment));
+	event_child_watch_free(watch);
 
-		compartment_sigchld_handle_helpers(compartment, sig);
+	if (pid != compartment->pid) {
+		DEBUG("Reaped stale init process with PID %d for compartment %s", pid,
+		      compartment_get_description(compartment));
+		compartment_check_cleanup_done(compartment);
 		return;
 	}
 
-	/* In the start function the childs init process gets set a process group which has
-	 * the same pgid as its pid. We wait for all processes belonging to our compartment's
-	 * process group, but only change the compartments state to stopped if the init exited */
-	pid_t pid = 0;
-	int status = 0;
-	if ((pid = proc_waitpid(-(compartment->pid), &status, WNOHANG)) != 0) {
-		if (pid == compartment->pid) {
-			if (WIFEXITED(status)) {
-				INFO("Container %s terminated (init process exited with status=%d)",
-				     compartment_get_description(compartment), WEXITSTATUS(status));
-				compartment->exit_status = WEXITSTATUS(status);
-			} else if (WIFSIGNALED(status)) {
-				INFO("Container %s killed by signal %d",
-				     compartment_get_description(compartment), WTERMSIG(status));
-				/* Since Kernel 3.4 reboot inside pid namspaces
-				 * are signaled by SIGHUP (see manpage REBOOT(2)) */
-				if (WTERMSIG(status) == SIGHUP) {
-					compartment->is_rebooting = true;
-				}
-			} else {
-				return;
-			}
-			/* cleanup and set states accordingly to notify observers */
-			compartment_cleanup(compartment, compartment->is_rebooting);
-			compartment->is_doing_cleanup = true;
-
-		} else if (pid == -1) {
-			if (errno == ECHILD) {
-				DEBUG("Process group of compartment %s terminated completely",
-				      compartment_get_description(compartment));
-			} else {
-				WARN_ERRNO("waitpid failed for compartment %s",
-					   compartment_get_description(compartment));
-			}
-		} else {
-			DEBUG("Reaped a child with PID %d for compartment %s", pid,
-			      compartment_get_description(compartment));
+	if (WIFEXITED(status)) {
+		INFO("Container %s terminated (init process exited with status=%d)",
+		     compartment_get_description(compartment), WEXITSTATUS(status));
+		compartment->exit_status = WEXITSTATUS(status);
+	} else if (WIFSIGNALED(status)) {
+		INFO("Container %s killed by signal %d", compartment_get_description(compartment),
+		     WTERMSIG(status));
+		/* Since Kernel 3.4 reboot inside pid namspaces
+		 * are signaled by SIGHUP (see manpage REBOOT(2)) */
+		if (WTERMSIG(status) == SIGHUP) {
+			compartment->is_rebooting = true;
 		}
-	}
-
-	// check for compartment itself again, e.g., before execv
-	if (compartment->pid > 0 &&
-	    compartment->pid == proc_waitpid(compartment->pid, &status, WNOHANG)) {
-		INFO("Compartment %s reaped before beeing part of pg",
+	} else {
+		WARN("Could not get exit status of compartment %s",
 		     compartment_get_description(compartment));
-		if (WIFEXITED(status)) {
-			INFO("Early Container %s terminated (init process exited with status=%d)",
-			     compartment_get_description(compartment), WEXITSTATUS(status));
-			compartment->exit_status = WEXITSTATUS(status);
-		} else if (WIFSIGNALED(status)) {
-			INFO("Early Container %s killed by signal %d",
-			     compartment_get_description(compartment), WTERMSIG(status));
-		} else {
-			return;
-		}
-		compartment_cleanup(compartment, false);
-		compartment->is_doing_cleanup = true;
 	}
 
-	// reap any open helper child and set state accordingly
-	compartment_sigchld_handle_helpers(compartment, sig);
+	/* cleanup and set states accordingly to notify observers */
+	compartment_cleanup(compartment, compartment->is_rebooting);
+	compartment->is_doing_cleanup = true;
 
-	TRACE("No more children to reap. Callback exiting...");
+	// state is set as soon as all helper children are reaped
+	compartment_check_cleanup_done(compartment);
 }
 
-void
-compartment_sigchld_early_cb(UNUSED int signum, event_signal_t *sig, void *data)
+static void
+compartment_early_child_cb(pid_t pid, int status, event_child_watch_t *watch, void *data)
 {
 	compartment_t *compartment = data;
 	ASSERT(compartment);
 
-	pid_t pid = 0;
-	int status = 0;
-
-	TRACE("SIGCHLD handler called for compartment %s early start child with PID %d",
-	      compartment_get_description(compartment), compartment->pid_early);
+	TRACE("Reaped early compartment child process: %d", pid);
+	event_child_watch_free(watch);
 
-	if (compartment->pid_early &&
-	    (pid = proc_waitpid(compartment->pid_early, &status, WNOHANG)) > 0) {
-		TRACE("Reaped early compartment child process: %d", pid);
-		/* remove the sigchld callback for this early child from the event loop */
-		event_remove_signal(sig);
-		event_signal_free(sig);
+	if (compartment->pid_early == pid)
 		compartment->pid_early = -1;
-		// cleanup if early child returned with an error
-		if ((WIFEXITED(status) && WEXITSTATUS(status)) || WIFSIGNALED(status)) {
-			if (compartment->pid == -1)
-				compartment_cleanup(compartment, false);
 
-			INFO("exit status: %d, %d", WEXITSTATUS(status), status);
+	// cleanup if early child returned with an error
+	if ((WIFEXITED(status) && WEXITSTATUS(status)) || WIFSIGNALED(status)) {
+		if (compartment->pid == -1)
+			compartment_cleanup(compartment, false);
 
-			if ((WIFEXITED(status) &&
-			     WEXITSTATUS(status) == COMPARTMENT_ERROR_VOL_CORRUPTED))
-				compartment_set_state(compartment, COMPARTMENT_STATE_ZOMBIE);
-			else
-				compartment_set_state(compartment, COMPARTMENT_STATE_STOPPED);
-		}
-	}
+		INFO("exit status: %d, %d", WEXITSTATUS(status), status);
 
-	// reap any open helper child and set state accordingly
-	compartment_sigchld_handle_helpers(compartment, sig);
+		if ((WIFEXITED(status) && WEXITSTATUS(status) == COMPARTMENT_ERROR_VOL_CORRUPTED))
+			compartment_set_state(compartment, COMPARTMENT_STATE_ZOMBIE);
+		else
+			compartment_set_state(compartment, COMPARTMENT_STATE_STOPPED);
+	}
 }
 
 static int
@@ -1157,13 +1111,13 @@ compartment_start_timeout_cb(event_timer_t *timer, void *data)
 	 * If this is not the case then simply remove the timer and do nothing
 	 * Note that we do NOT have a problem with repeated compartment starts
 	 * and overlapping start timeouts since the start_timer is cleared in
-	 * compartment_cleanup which is called by the SIGCHLD handler as soon
+	 * compartment_cleanup which is called by the child watch as soon
 	 * as the compartment goes down. */
 	if (compartment_get_state(compartment) == COMPARTMENT_STATE_BOOTING) {
 		WARN("Reached compartment start timeout for compartment %s and the compartment is still booting."
 		     " Killing it...",
 		     compartment_get_description(compartment));
-		/* kill compartment. SIGCHLD cb handles the cleanup and state change */
+		/* kill compartment. child watch handles the cleanup and state change */
 		compartment_kill(compartment);
 	}
 
@@ -1211,7 +1165,7 @@ compartment_start_post_clone_cb(int fd, unsigned events, event_io_t *io, void *d
 
 	if (msg == COMPARTMENT_START_SYNC_MSG_ERROR) {
 		WARN("Received error message from child process");
-		return; // the child exits on its own and we cleanup in the sigchld handler
+		return; // the child exits on its own and we cleanup in the child watch
 	}
 
 	/********************************************************/
@@ -1344,11 +1298,12 @@ compartment_start_post_clone_early_cb(int fd, unsigned events, event_io_t *io, v
 		event_io_new(fd, EVENT_IO_READ, &compartment_start_post_clone_cb, compartment);
 	event_add_io(sync_sock_parent_event);
 
-	/* register SIGCHILD handler which sets the state and
+	/* register child watch which sets the state and
 	 * calls the appropriate cleanup functions if the child
 	 * dies */
-	event_signal_t *sig = event_signal_new(SIGCHLD, compartment_sigchld_cb, compartment);
-	event_add_signal(sig);
+	event_child_watch_t *watch =
+		event_child_watch_new(compartment->pid, compartment_init_child_cb, compartment);
+	event_add_child_watch(watch);
 
 	/*********************************************************/
 	/* POST CLONE HOOKS */
@@ -1472,8 +1427,9 @@ compartment_start(compartment_t *compartment)
 	event_add_io(sync_sock_parent_event);
 
 	// handler for early start child process which dies after double fork
-	event_signal_t *sig = event_signal_new(SIGCHLD, compartment_sigchld_early_cb, compartment);
-	event_add_signal(sig);
+	event_child_watch_t *watch =
+		event_child_watch_new(compartment_pid, compartment_early_child_cb, compartment);
+	event_add_child_watch(watch);
 
 	for (list_t *l = compartment->module_instance_list; l; l = l->next) {
 		compartment_module_instance_t *c_mod = l->data;
@@ -1596,10 +1552,10 @@ compartment_stop(compartment_t *compartment)
 
 	// When the stop command was emitted, the TrustmeService tries to shut down the compartment
 	// i.g. to terminate the compartment's init process.
-	// we need to wait for the SIGCHLD signal for which we have a callback registered, which
+	// we need to wait for the init process to exit, which is handled by its child watch that
 	// does the cleanup and sets the state of the compartment to stopped.
 	if (ret == 0)
-		DEBUG("Stop compartment successfully emitted. Wait for child process to terminate (SICHLD)");
+		DEBUG("Stop compartment successfully emitted. Wait for child process to terminate");
 
 	return ret;
 }
@@ -1901,7 +1857,16 @@ compartment_wait_for_child(compartment_t *compartment, char *name, pid_t pid)
 {
 	ASSERT(compartment);
 
-	compartment_helper_child_t *child = compartment_helper_child_new(name, pid);
+	compartment_helper_child_t *child = compartment_helper_child_new(compartment, name, pid);
+
+	// only a watched helper may delay the cleanup, as nothing else would remove it
+	event_child_watch_t *watch = event_child_watch_new(pid, compartment_helper_child_cb, child);
+	if (event_add_child_watch(watch) < 0) {
+		WARN("Could not watch helper child '%s' (%d)", name, pid);
+		event_child_watch_free(watch);
+		compartment_helper_child_free(child);
+		return;
+	}
 	compartment->helper_child_list = list_append(compartment->helper_child_list, child);
 
 	DEBUG("Helpers registered:");
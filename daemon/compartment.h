@@ -493,7 +493,7 @@ bool
 compartment_get_allow_system_time(compartment_t *compartment);
 
 /**
- * Registers child at compartments sigchld handler
+ * Registers a child watch for a helper child of the compartment
  *
  * If spawning any helper process during startup of a compartment, use
  * this function to assure that the spawned helper is reaped properly.
@@ -0,0 +1,309 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+//#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
+
+#include "container_registry.h"
+
+#include "common/macro.h"
+#include "common/mem.h"
+#include "common/list.h"
+#include "common/hashmap.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+typedef struct container_registry_entry {
+	container_t *container;
+	int uid_start;	 //!< indexed uid range start, 0 if not indexed
+	pid_t pid;	 //!< init pid the pidns index was computed for
+	uint64_t pidns;	 //!< indexed pid namespace inode, 0 if not indexed
+	bool pending;	 //!< container is up but not completely indexed yet
+} container_registry_entry_t;
+
+static hashmap_t *container_registry_entries = NULL; // container_t * -> entry
+static hashmap_t *container_registry_by_uuid = NULL;
+static hashmap_t *container_registry_by_uid = NULL;
+static hashmap_t *container_registry_by_pidns = NULL;
+static list_t *container_registry_pending_list = NULL;
+
+static uint64_t
+container_registry_pidns_by_pid(pid_t pid)
+{
+	char ns_file[64];
+	struct stat s;
+
+	snprintf(ns_file, sizeof(ns_file), "/proc/%d/ns/pid", pid);
+	IF_TRUE_RETVAL_TRACE(stat(ns_file, &s) == -1, 0);
+
+	return s.st_ino;
+}
+
+static container_registry_entry_t *
+container_registry_get_entry(const container_t *container)
+{
+	return hashmap_get(container_registry_entries, &container, sizeof(container));
+}
+
+static void
+container_registry_set_pending(container_registry_entry_t *e, bool pending)
+{
+	IF_TRUE_RETURN_TRACE(e->pending == pending);
+
+	if (pending)
+		container_registry_pending_list =
+			list_append(container_registry_pending_list, e);
+	else
+		container_registry_pending_list =
+			list_remove(container_registry_pending_list, e);
+	e->pending = pending;
+}
+
+typedef struct {
+	uint64_t key;
+	const container_registry_entry_t *skip;
+	container_registry_entry_t *found;
+} container_registry_find_t;
+
+static void
+container_registry_find_uid_cb(void *value, void *data)
+{
+	container_registry_entry_t *e = value;
+	container_registry_find_t *f = data;
+
+	if (!f->found && e != f->skip && e->uid_start > 0 && (uint64_t)e->uid_start == f->key)
+		f->found = e;
+}
+
+static void
+container_registry_find_pidns_cb(void *value, void *data)
+{
+	container_registry_entry_t *e = value;
+	container_registry_find_t *f = data;
+
+	if (!f->found && e != f->skip && e->pidns && e->pidns == f->key)
+		f->found = e;
+}
+
+/*
+ * Drops key from map if it is held by e and hands it over to another
+ * container which shares the same key, e.g., the host pid namespace.
+ */
+static void
+container_registry_unindex(hashmap_t *map, uint64_t key, container_registry_entry_t *e,
+			   void (*find_cb)(void *, void *))
+{
+	IF_FALSE_RETURN_TRACE(hashmap_get_u64(map, key) == e->container);
+
+	hashmap_remove_u64(map, key);
+
+	container_registry_find_t f = { .key = key, .skip = e, .found = NULL };
+	hashmap_foreach(container_registry_entries, find_cb, &f);
+	if (f.found)
+		hashmap_put_u64(map, key, f.found->container);
+}
+
+static void
+container_registry_index(hashmap_t *map, uint64_t key, container_t *container)
+{
+	// first come, first served, as with the former linear list walk
+	if (!hashmap_contains(map, &key, sizeof(key)))
+		hashmap_put_u64(map, key, container);
+}
+
+static void
+container_registry_entry_update(container_registry_entry_t *e)
+{
+	container_t *c = e->container;
+	compartment_state_t state = container_get_state(c);
+	bool stopped = (state == COMPARTMENT_STATE_STOPPED);
+
+	int uid_start = stopped ? 0 : container_get_uid(c);
+	if (uid_start != e->uid_start) {
+		if (e->uid_start > 0)
+			container_registry_unindex(container_registry_by_uid,
+						   (uint64_t)e->uid_start, e,
+						   container_registry_find_uid_cb);
+		e->uid_start = uid_start;
+		if (e->uid_start > 0)
+			container_registry_index(container_registry_by_uid,
+						 (uint64_t)e->uid_start, c);
+	}
+
+	pid_t pid = stopped ? -1 : container_get_pid(c);
+	if (pid != e->pid || (pid > 0 && !e->pidns)) {
+		if (e->pidns)
+			container_registry_unindex(container_registry_by_pidns, e->pidns, e,
+						   container_registry_find_pidns_cb);
+		e->pid = pid;
+		e->pidns = (pid > 0) ? container_registry_pidns_by_pid(pid) : 0;
+		if (e->pidns)
+			container_registry_index(container_registry_by_pidns, e->pidns, c);
+	}
+
+	container_registry_set_pending(e, !stopped && !e->pidns);
+
+	TRACE("Registry entry for %s: uid_start=%d, pid=%d, pidns=%" PRIu64 " pending=%d",
+	      container_get_description(c), e->uid_start, e->pid, e->pidns, e->pending);
+}
+
+/*
+ * Called on lookup misses only. Indexes containers which have
+ * been started but whose init pid was not known on their last update.
+ */
+static void
+container_registry_refresh_pending(void)
+{
+	for (list_t *l = container_registry_pending_list; l;) {
+		container_registry_entry_t *e = l->data;
+		l = l->next; // entry may unlink itself
+		container_registry_entry_update(e);
+	}
+}
+
+void
+container_registry_add(container_t *container)
+{
+	ASSERT(container);
+
+	if (!container_registry_entries) {
+		container_registry_entries = hashmap_new();
+		container_registry_by_uuid = hashmap_new();
+		container_registry_by_uid = hashmap_new();
+		container_registry_by_pidns = hashmap_new();
+	}
+
+	IF_TRUE_RETURN_TRACE(container_registry_get_entry(container));
+
+	container_registry_entry_t *e = mem_new0(container_registry_entry_t, 1);
+	e->container = container;
+	e->pid = -1;
+
+	hashmap_put(container_registry_entries, &container, sizeof(container), e);
+	hashmap_put_str(container_registry_by_uuid, uuid_string(container_get_uuid(container)),
+			container);
+
+	container_registry_entry_update(e);
+}
+
+void
+container_registry_remove(container_t *container)
+{
+	ASSERT(container);
+
+	container_registry_entry_t *e = container_registry_get_entry(container);
+	IF_NULL_RETURN_TRACE(e);
+
+	const char *uuid = uuid_string(container_get_uuid(container));
+	if (hashmap_get_str(container_registry_by_uuid, uuid) == container)
+		hashmap_remove_str(container_registry_by_uuid, uuid);
+
+	hashmap_remove(container_registry_entries, &container, sizeof(container));
+
+	if (e->uid_start > 0)
+		container_registry_unindex(container_registry_by_uid, (uint64_t)e->uid_start, e,
+					   container_registry_find_uid_cb);
+	if (e->pidns)
+		container_registry_unindex(container_registry_by_pidns, e->pidns, e,
+					   container_registry_find_pidns_cb);
+
+	container_registry_set_pending(e, false);
+	mem_free0(e);
+}
+
+void
+container_registry_update(container_t *container)
+{
+	ASSERT(container);
+
+	container_registry_entry_t *e = container_registry_get_entry(container);
+	IF_NULL_RETURN_TRACE(e);
+
+	container_registry_entry_update(e);
+}
+
+container_t *
+container_registry_get_by_uuid(const uuid_t *uuid)
+{
+	ASSERT(uuid);
+	return hashmap_get_str(container_registry_by_uuid, uuid_string(uuid));
+}
+
+container_t *
+container_registry_get_by_uid_start(int uid_start)
+{
+	IF_TRUE_RETVAL_TRACE(uid_start <= 0, NULL);
+
+	container_t *c = hashmap_get_u64(container_registry_by_uid, (uint64_t)uid_start);
+	if (!c && container_registry_pending_list) {
+		container_registry_refresh_pending();
+		c = hashmap_get_u64(container_registry_by_uid, (uint64_t)uid_start);
+	}
+	return c;
+}
+
+container_t *
+container_registry_get_by_pid(pid_t pid)
+{
+	IF_TRUE_RETVAL_TRACE(pid <= 0, NULL);
+
+	uint64_t pidns = container_registry_pidns_by_pid(pid);
+	IF_TRUE_RETVAL_TRACE(pidns == 0, NULL);
+
+	container_t *c = hashmap_get_u64(container_registry_by_pidns, pidns);
+	if (!c && container_registry_pending_list) {
+		container_registry_refresh_pending();
+		c = hashmap_get_u64(container_registry_by_pidns, pidns);
+	}
+	return c;
+}
+
+unsigned int
+container_registry_get_count(void)
+{
+	return hashmap_size(container_registry_entries);
+}
+
+static void
+container_registry_free_entry_cb(void *value, UNUSED void *data)
+{
+	mem_free0(value);
+}
+
+void
+container_registry_clear(void)
+{
+	hashmap_foreach(container_registry_entries, container_registry_free_entry_cb, NULL);
+	hashmap_free(container_registry_entries);
+	hashmap_free(container_registry_by_uuid);
+	hashmap_free(container_registry_by_uid);
+	hashmap_free(container_registry_by_pidns);
+	list_delete(container_registry_pending_list);
+
+	container_registry_entries = NULL;
+	container_registry_by_uuid = NULL;
+	container_registry_by_uid = NULL;
+	container_registry_by_pidns = NULL;
+	container_registry_pending_list = NULL;
+}
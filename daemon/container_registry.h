@@ -0,0 +1,97 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file container_registry.h
+ *
+ * Hash indexes over the containers managed by cmld. Containers are indexed
+ * by their UUID, by the start of their uid range in the root user namespace
+ * and by the inode of the pid namespace of their init process.
+ *
+ * The uid and pid namespace indexes depend on the runtime state of a container.
+ * They have to be refreshed by calling container_registry_update() on state
+ * transitions. Lookups which miss additionally refresh containers which are
+ * on their way up but not completely indexed yet, e.g., in setup mode.
+ */
+
+#ifndef CONTAINER_REGISTRY_H
+#define CONTAINER_REGISTRY_H
+
+#include "container.h"
+
+#include "common/uuid.h"
+
+#include <sys/types.h>
+
+/**
+ * Adds a container to the registry and indexes it by its current state.
+ */
+void
+container_registry_add(container_t *container);
+
+/**
+ * Removes a container from all indexes of the registry.
+ */
+void
+container_registry_remove(container_t *container);
+
+/**
+ * Refreshes the uid range and pid namespace index of a registered container.
+ * Should be called on every state transition of the container.
+ */
+void
+container_registry_update(container_t *container);
+
+/**
+ * Returns the container with the given UUID or NULL if there is none.
+ */
+container_t *
+container_registry_get_by_uuid(const uuid_t *uuid);
+
+/**
+ * Returns the container which owns a user namespace uid range starting at uid_start.
+ * Containers without a user namespace (uid_start == 0) are not indexed.
+ */
+container_t *
+container_registry_get_by_uid_start(int uid_start);
+
+/**
+ * Returns the container whose init process lives in the same
+ * pid namespace as pid or NULL if there is none.
+ */
+container_t *
+container_registry_get_by_pid(pid_t pid);
+
+/**
+ * Returns the number of registered containers.
+ */
+unsigned int
+container_registry_get_count(void);
+
+/**
+ * Drops all indexes. The containers themselves are not freed.
+ */
+void
+container_registry_clear(void);
+
+#endif /* CONTAINER_REGISTRY_H */
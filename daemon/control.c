@@ -43,8 +43,10 @@
 #include "common/uuid.h"
 #include "common/event.h"
 #include "common/fd.h"
+#include "common/frame.h"
 #include "common/logf.h"
 #include "common/list.h"
+#include "common/array.h"
 #include "common/network.h"
 #include "common/reboot.h"
 #include "common/file.h"
@@ -53,11 +55,21 @@
 #include "common/proc.h"
 #include "common/sock-sd.h"
 
+#include <errno.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include <google/protobuf-c/protobuf-c-text.h>
 
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
 // maximum no. of connections waiting to be accepted on the listening socket
 #define CONTROL_SOCK_LISTEN_BACKLOG 8
 
@@ -66,10 +78,23 @@
 
 #define LOGGER_ENTRY_MAX_LEN (5 * 1024)
 
+// field numbers from control.proto used to send log files without copying
+#define CONTROL_PROTO_DAEMON_TO_CONTROLLER_LOG_MESSAGE 12
+#define CONTROL_PROTO_LOG_MESSAGE_NAME 1
+#define CONTROL_PROTO_LOG_MESSAGE_MSG 2
+#define CONTROL_PROTO_DAEMON_TO_CONTROLLER_LOG_CHUNK 14
+#define CONTROL_PROTO_LOG_CHUNK_DATA 3
+
+// bounds for the chunk size of streamed GET_LAST_LOG transfers
+#define CONTROL_LOG_STREAM_CHUNK_DEFAULT (256 * 1024)
+#define CONTROL_LOG_STREAM_CHUNK_MIN (4 * 1024)
+#define CONTROL_LOG_STREAM_CHUNK_MAX (4 * 1024 * 1024)
+
 struct control {
 	int sock; // listen socket fd
 	bool privileged;
-	list_t *event_io_sock_connected_list; // list of clients
+	list_t *conn_list;   // list of connected clients (frame_conn_t)
+	list_t *log_streams; // list of running GET_LAST_LOG transfers (control_log_stream_t)
 };
 
 static list_t *control_list = NULL;
@@ -80,6 +105,87 @@ struct log_cb_data {
 	bool remove_logs;
 };
 
+/**
+ * Sends a DaemonToController message with a LogMessage whose msg is taken
+ * directly from the given range of the log file, without reading the file into
+ * memory. The log_message field is appended to the packed message manually, so
+ * that the file content can be passed to sendfile().
+ */
+static ssize_t
+control_send_log_fragment(int fd, const DaemonToController *out, const char *name, int file_fd,
+			  off_t offset, uint32_t len)
+{
+	uint8_t *out_packed = NULL;
+	uint32_t out_len = protobuf_pack_message_new((ProtobufCMessage *)out, &out_packed);
+	size_t name_len = strlen(name);
+
+	// LogMessage: name field, then the header of the msg field read from file
+	uint8_t *log_head = mem_alloc(2 * PROTOBUF_FIELD_HEADER_MAX + name_len);
+	size_t log_head_len =
+		protobuf_pack_field_header(log_head, CONTROL_PROTO_LOG_MESSAGE_NAME, name_len);
+	memcpy(log_head + log_head_len, name, name_len);
+	log_head_len += name_len;
+	log_head_len += protobuf_pack_field_header(log_head + log_head_len,
+						   CONTROL_PROTO_LOG_MESSAGE_MSG, len);
+
+	uint8_t *head = mem_alloc(out_len + PROTOBUF_FIELD_HEADER_MAX + log_head_len);
+	size_t head_len = out_len;
+	if (out_len)
+		memcpy(head, out_packed, out_len);
+	head_len += protobuf_pack_field_header(head + head_len,
+					       CONTROL_PROTO_DAEMON_TO_CONTROLLER_LOG_MESSAGE,
+					       log_head_len + len);
+	memcpy(head + head_len, log_head, log_head_len);
+	head_len += log_head_len;
+
+	ssize_t ret = protobuf_send_packed_with_file(fd, head, head_len, file_fd, offset, len);
+
+	mem_free0(head);
+	mem_free0(log_head);
+	mem_free0(out_packed);
+	return ret;
+}
+
+/**
+ * Sends a DaemonToController message with a LogChunk whose data is taken
+ * directly from the given range of the log file with sendfile(). The chunk is
+ * packed with empty data, the actual data field is appended manually and
+ * replaces it, as the last occurrence of a field wins when unpacking.
+ */
+static ssize_t
+control_send_log_chunk_file(int fd, const DaemonToController *out, const LogChunk *chunk,
+			    int file_fd, off_t offset, uint32_t len)
+{
+	uint8_t *out_packed = NULL;
+	uint32_t out_len = protobuf_pack_message_new((ProtobufCMessage *)out, &out_packed);
+	uint8_t *chunk_packed = NULL;
+	uint32_t chunk_len = protobuf_pack_message_new((ProtobufCMessage *)chunk, &chunk_packed);
+
+	uint8_t data_head[PROTOBUF_FIELD_HEADER_MAX];
+	size_t data_head_len =
+		protobuf_pack_field_header(data_head, CONTROL_PROTO_LOG_CHUNK_DATA, len);
+
+	uint8_t *head = mem_alloc(out_len + PROTOBUF_FIELD_HEADER_MAX + chunk_len + data_head_len);
+	size_t head_len = out_len;
+	if (out_len)
+		memcpy(head, out_packed, out_len);
+	head_len += protobuf_pack_field_header(head + head_len,
+					       CONTROL_PROTO_DAEMON_TO_CONTROLLER_LOG_CHUNK,
+					       chunk_len + data_head_len + len);
+	if (chunk_len)
+		memcpy(head + head_len, chunk_packed, chunk_len);
+	head_len += chunk_len;
+	memcpy(head + head_len, data_head, data_head_len);
+	head_len += data_head_len;
+
+	ssize_t ret = protobuf_send_packed_with_file(fd, head, head_len, file_fd, offset, len);
+
+	mem_free0(head);
+	mem_free0(chunk_packed);
+	mem_free0(out_packed);
+	return ret;
+}
+
 /**
  * @brief callback for the dir_foreach function sending a file as LogMessage to the Controller
  * @path: Expects path string without trailing "/" at the end
@@ -103,9 +209,6 @@ control_send_file_as_log_message_cb(const char *path, const char *file, void *da
 		return 0;
 	}
 
-	LogMessage message = LOG_MESSAGE__INIT;
-
-	message.name = mem_strdup(file);
 	DaemonToController out = DAEMON_TO_CONTROLLER__INIT;
 	if (cmld_get_device_uuid()) {
 		TRACE("Setting uuid: %s", cmld_get_device_uuid());
@@ -115,62 +218,41 @@ control_send_file_as_log_message_cb(const char *path, const char *file, void *da
 	DEBUG("Opening and sending %s", file_path);
 
 	int ret = 1;
-	char *file_buf = file_read_new(file_path, (size_t)file_size(file_path));
+	int file_fd = open(file_path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
 
-	if (file_buf) {
-		int max_fragment_size = PROTOBUF_MAX_MESSAGE_SIZE - PROTOBUF_MAX_OVERHEAD;
-		int sent = 0;
-		int size = strlen(file_buf);
+	if (file_fd >= 0 && !fstat(file_fd, &st)) {
+		off_t max_fragment_size = PROTOBUF_MAX_MESSAGE_SIZE - PROTOBUF_MAX_OVERHEAD;
+		off_t sent = 0;
+		off_t size = st.st_size;
 
 		while (0 < size - sent) {
-			fflush(stdout);
-			fflush(stderr);
-
 			// send fragments if size exceeds fragment_size
-			int tosend = size - sent;
+			off_t tosend = size - sent;
 			if (tosend > max_fragment_size) {
 				out.code = DAEMON_TO_CONTROLLER__CODE__LOG_MESSAGE_FRAGMENT;
-				message.msg =
-					(char *)mem_strndup(file_buf + sent, max_fragment_size);
-
-				DEBUG("Sending fragment of logfile %s, sent: %d, remaining: %d",
-				      file_path, sent, size - sent);
-
-				out.log_message = &message;
-				if (protobuf_send_message(cbdata->fd, (ProtobufCMessage *)&out) <
-				    0) {
-					ERROR_ERRNO("Could not finish sending %s", file_path);
-					// do not return -1, because this would stopp log retrieval entirely.
-					// only because this file failed, this does not mean the others won't succeed.
-					ret = 0;
-					mem_free0(message.msg);
-					break;
-				}
-
-				sent += max_fragment_size;
-				mem_free0(message.msg);
+				tosend = max_fragment_size;
+				DEBUG("Sending fragment of logfile %s, sent: %jd, remaining: %jd",
+				      file_path, (intmax_t)sent, (intmax_t)(size - sent));
 			} else {
-				DEBUG("Sending final fragment of logfile %s, sent: %d, remaining: %d",
-				      file_path, sent, size - sent);
 				out.code = DAEMON_TO_CONTROLLER__CODE__LOG_MESSAGE_FINAL;
-				message.msg = (char *)mem_strndup(file_buf + sent, size - sent);
-
-				out.log_message = &message;
-				if (protobuf_send_message(cbdata->fd, (ProtobufCMessage *)&out) <
-				    0) {
-					ERROR_ERRNO("Could not finish sending %s", file_path);
-					// do not return -1, because this would stopp log retrieval entirely.
-					// only because this file failed, this does not mean the others won't succeed.
-					ret = 0;
-					mem_free0(message.msg);
-					break;
-				}
+				DEBUG("Sending final fragment of logfile %s, "
+				      "sent: %jd, remaining: %jd",
+				      file_path, (intmax_t)sent, (intmax_t)(size - sent));
+			}
 
-				sent += strlen(message.msg);
-				mem_free0(message.msg);
+			if (control_send_log_fragment(cbdata->fd, &out, file, file_fd, sent,
+						      tosend) < 0) {
+				ERROR_ERRNO("Could not finish sending %s", file_path);
+				// do not return -1, because this would stopp log retrieval
+				// entirely. only because this file failed, this does not mean
+				// the others won't succeed.
+				ret = 0;
+				break;
 			}
+			sent += tosend;
 		}
-		mem_free0(file_buf);
+		close(file_fd);
 
 		// Only remove the file, if its was sent successfully.
 		if ((ret == 1) && cbdata->remove_logs) {
@@ -197,7 +279,9 @@ control_send_file_as_log_message_cb(const char *path, const char *file, void *da
 			}
 		}
 	} else {
-		WARN("File %s could not be read to buffer.", file_path);
+		WARN_ERRNO("File %s could not be opened.", file_path);
+		if (file_fd >= 0)
+			close(file_fd);
 		// do not return -1, because this would stopp log retrieval entirely.
 		// only because this file failed, this does not mean the others won't succeed.
 		ret = 0;
@@ -212,6 +296,449 @@ control_send_file_as_log_message_cb(const char *path, const char *file, void *da
 	return ret;
 }
 
+/*
+ * State of a streamed GET_LAST_LOG transfer. Chunks are produced from the
+ * connection's drain callback, i.e. only when the client keeps up reading,
+ * so a transfer never holds more than a few chunks in memory and other
+ * control traffic is served in between.
+ */
+typedef struct control_log_stream {
+	control_t *control;
+	frame_conn_t *conn;
+	char *device_uuid;
+
+	char **files; // sorted names of the log files to be sent
+	size_t files_len;
+	size_t file_idx;
+	int file_fd;
+	off_t file_size;
+	off_t offset;
+
+	char *resume_name;
+	off_t resume_offset;
+	uint32_t chunk_size;
+	LogStreamParams__Compression compression;
+	uint8_t *buf;
+
+	bool remove_logs;
+	int lock_fd;
+	list_t *current_logs;
+	list_t *sent_logs; // paths of sent logs, removed once the output queue has drained
+	int files_sent;
+	bool finished; // the final response is queued
+} control_log_stream_t;
+
+static bool
+control_log_compression_supported(LogStreamParams__Compression compression)
+{
+	switch (compression) {
+	case LOG_STREAM_PARAMS__COMPRESSION__NONE:
+		return true;
+#ifdef WITH_ZLIB
+	case LOG_STREAM_PARAMS__COMPRESSION__GZIP:
+		return true;
+#endif
+#ifdef WITH_ZSTD
+	case LOG_STREAM_PARAMS__COMPRESSION__ZSTD:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+/**
+ * Compresses a log chunk as a self-contained gzip member or zstd frame,
+ * so that each chunk can be decompressed on its own when resuming.
+ *
+ * @return newly allocated buffer with the compressed data or NULL on error.
+ */
+static uint8_t *
+control_log_compress_new(LogStreamParams__Compression compression, const uint8_t *src, size_t len,
+			 size_t *out_len)
+{
+	uint8_t *dst = NULL;
+
+	switch (compression) {
+#ifdef WITH_ZLIB
+	case LOG_STREAM_PARAMS__COMPRESSION__GZIP: {
+		z_stream strm = { 0 };
+		// windowBits + 16 selects the gzip format
+		if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+				 Z_DEFAULT_STRATEGY) != Z_OK)
+			return NULL;
+		size_t bound = deflateBound(&strm, len);
+		dst = mem_alloc(bound);
+		strm.next_in = (Bytef *)src;
+		strm.avail_in = len;
+		strm.next_out = dst;
+		strm.avail_out = bound;
+		if (deflate(&strm, Z_FINISH) != Z_STREAM_END) {
+			WARN("Failed to gzip log chunk");
+			mem_free0(dst);
+		} else {
+			*out_len = strm.total_out;
+		}
+		deflateEnd(&strm);
+	} break;
+#endif
+#ifdef WITH_ZSTD
+	case LOG_STREAM_PARAMS__COMPRESSION__ZSTD: {
+		size_t bound = ZSTD_compressBound(len);
+		dst = mem_alloc(bound);
+		size_t ret = ZSTD_compress(dst, bound, src, len, ZSTD_CLEVEL_DEFAULT);
+		if (ZSTD_isError(ret)) {
+			WARN("Failed to zstd compress log chunk: %s", ZSTD_getErrorName(ret));
+			mem_free0(dst);
+		} else {
+			*out_len = ret;
+		}
+	} break;
+#endif
+	default:
+		WARN("Unsupported log compression %d", compression);
+		(void)src;
+		(void)len;
+		(void)out_len;
+	}
+
+	return dst;
+}
+
+static int
+control_log_stream_collect_cb(UNUSED const char *path, const char *file, void *data)
+{
+	control_log_stream_t *stream = data;
+
+	// current logfile link and lock file shall not be processed.
+	char *file_path = mem_printf("%s/%s", LOGFILE_DIR, file);
+	bool skip = file_is_link(file_path) || strstr(file, ".current") ||
+		    strstr(file, ".lock-delete-old");
+	mem_free0(file_path);
+	IF_TRUE_RETVAL(skip, 0);
+
+	// files before the resume point have already been transferred
+	if (stream->resume_name && strcmp(file, stream->resume_name) < 0)
+		return 0;
+
+	stream->files = mem_renew(char *, stream->files, stream->files_len + 1);
+	stream->files[stream->files_len++] = mem_strdup(file);
+	return 1;
+}
+
+static int
+control_log_stream_cmp_names(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void
+control_log_stream_free(control_log_stream_t *stream)
+{
+	frame_conn_set_drain_cb(stream->conn, NULL, NULL);
+	stream->control->log_streams = list_remove(stream->control->log_streams, stream);
+
+	if (stream->file_fd >= 0)
+		close(stream->file_fd);
+	if (stream->lock_fd >= 0)
+		logf_lock_release(LOGFILE_DIR, stream->lock_fd);
+	logf_log_files_list_free(stream->current_logs);
+	for (list_t *l = stream->sent_logs; l; l = l->next)
+		mem_free0(l->data);
+	list_delete(stream->sent_logs);
+
+	for (size_t i = 0; i < stream->files_len; i++)
+		mem_free0(stream->files[i]);
+	mem_free0(stream->files);
+	mem_free0(stream->resume_name);
+	mem_free0(stream->device_uuid);
+	mem_free0(stream->buf);
+	mem_free0(stream);
+}
+
+static void
+control_log_stream_file_done(control_log_stream_t *stream)
+{
+	const char *name = stream->files[stream->file_idx];
+
+	close(stream->file_fd);
+	stream->file_fd = -1;
+	stream->file_idx++;
+	stream->files_sent++;
+
+	// Only remove the file, if its was sent successfully.
+	IF_FALSE_RETURN(stream->remove_logs);
+
+	char *file_path = mem_printf("%s/%s", LOGFILE_DIR, name);
+	bool is_current_log = false;
+	for (list_t *l = stream->current_logs; l; l = l->next) {
+		if (l->data && !strcmp(l->data, file_path)) {
+			is_current_log = true;
+			break;
+		}
+	}
+	if (is_current_log)
+		mem_free0(file_path);
+	else
+		stream->sent_logs = list_append(stream->sent_logs, file_path);
+}
+
+/*
+ * Removes the logs which have been sent completely. Called once all queued
+ * chunks have been written to the socket, so that a log is retained if the
+ * transfer is aborted before.
+ */
+static void
+control_log_stream_remove_sent(control_log_stream_t *stream)
+{
+	for (list_t *l = stream->sent_logs; l; l = l->next) {
+		char *file_path = l->data;
+		if (remove(file_path))
+			ERROR_ERRNO("Failed to remove %s", file_path);
+		else
+			DEBUG("Removed log file %s", file_path);
+		mem_free0(file_path);
+	}
+	list_delete(stream->sent_logs);
+	stream->sent_logs = NULL;
+}
+
+/**
+ * Sends the next chunk of the transfer.
+ *
+ * @return 1 if a chunk was sent, 0 if all files are done, -1 on error.
+ */
+static int
+control_log_stream_send_chunk(control_log_stream_t *stream)
+{
+	while (stream->file_fd < 0) {
+		IF_TRUE_RETVAL(stream->file_idx >= stream->files_len, 0);
+
+		const char *name = stream->files[stream->file_idx];
+		char *file_path = mem_printf("%s/%s", LOGFILE_DIR, name);
+		struct stat st;
+
+		stream->file_fd = open(file_path, O_RDONLY | O_CLOEXEC);
+		if (stream->file_fd < 0 || fstat(stream->file_fd, &st)) {
+			// this file failed, which does not mean the others won't succeed.
+			WARN_ERRNO("File %s could not be opened.", file_path);
+			if (stream->file_fd >= 0)
+				close(stream->file_fd);
+			stream->file_fd = -1;
+			stream->file_idx++;
+		} else {
+			// a log file which is still written to is sent up to its current size
+			stream->file_size = st.st_size;
+			stream->offset = 0;
+			if (stream->resume_name && !strcmp(name, stream->resume_name))
+				stream->offset = MIN(stream->resume_offset, stream->file_size);
+			DEBUG("Streaming logfile %s from offset %jd (size %jd)", file_path,
+			      (intmax_t)stream->offset, (intmax_t)stream->file_size);
+		}
+		mem_free0(file_path);
+	}
+
+	size_t len = MIN((off_t)stream->chunk_size, stream->file_size - stream->offset);
+	bool last = stream->offset + (off_t)len >= stream->file_size;
+
+	LogChunk chunk = LOG_CHUNK__INIT;
+	chunk.name = stream->files[stream->file_idx];
+	chunk.offset = stream->offset;
+	chunk.has_raw_len = true;
+	chunk.raw_len = len;
+	chunk.has_last = true;
+	chunk.last = last;
+
+	DaemonToController out = DAEMON_TO_CONTROLLER__INIT;
+	out.code = DAEMON_TO_CONTROLLER__CODE__LOG_CHUNK;
+	out.device_uuid = stream->device_uuid;
+
+	ssize_t n = len;
+	ssize_t ret;
+	if (stream->compression == LOG_STREAM_PARAMS__COMPRESSION__NONE) {
+		// the data is passed to sendfile() and never copied to userspace
+		ret = control_send_log_chunk_file(frame_conn_get_fd(stream->conn), &out, &chunk,
+						  stream->file_fd, stream->offset, len);
+	} else {
+		n = len ? pread(stream->file_fd, stream->buf, len, stream->offset) : 0;
+		if (n < 0) {
+			ERROR_ERRNO("Could not read %s", chunk.name);
+			return -1;
+		}
+		// the file shrunk in between, end it here
+		if ((size_t)n < len) {
+			chunk.raw_len = n;
+			chunk.last = last = true;
+		}
+		chunk.data.data = stream->buf;
+		chunk.data.len = n;
+
+		uint8_t *compressed = NULL;
+		if (n > 0) {
+			size_t compressed_len = 0;
+			compressed = control_log_compress_new(stream->compression, stream->buf, n,
+							      &compressed_len);
+			if (compressed) {
+				chunk.has_compression = true;
+				chunk.compression = stream->compression;
+				chunk.data.data = compressed;
+				chunk.data.len = compressed_len;
+			}
+		}
+
+		out.log_chunk = &chunk;
+		ret = protobuf_send_message(frame_conn_get_fd(stream->conn),
+					    (ProtobufCMessage *)&out);
+		mem_free0(compressed);
+	}
+	if (ret < 0) {
+		ERROR("Could not send chunk of %s", chunk.name);
+		return -1;
+	}
+
+	stream->offset += n;
+	if (last)
+		control_log_stream_file_done(stream);
+
+	return 1;
+}
+
+static void
+control_log_stream_drain_cb(frame_conn_t *conn, void *data)
+{
+	control_log_stream_t *stream = data;
+	int ret = 1;
+
+	// everything queued so far, including the last chunk of each sent log, is written
+	if (frame_conn_get_queued(conn) == 0)
+		control_log_stream_remove_sent(stream);
+
+	if (stream->finished) {
+		if (frame_conn_get_queued(conn) == 0)
+			control_log_stream_free(stream);
+		return;
+	}
+
+	// produce chunks until the output queue is filled up again
+	while (ret > 0 && frame_conn_get_queued(conn) < FRAME_CONN_DRAIN_THRESHOLD)
+		ret = control_log_stream_send_chunk(stream);
+	IF_TRUE_RETURN(ret > 0);
+
+	DaemonToController out = DAEMON_TO_CONTROLLER__INIT;
+	out.code = DAEMON_TO_CONTROLLER__CODE__RESPONSE;
+	out.has_response = true;
+	if (ret == 0 && stream->files_sent > 0) {
+		TRACE("%d logs were streamed.", stream->files_sent);
+		out.response = DAEMON_TO_CONTROLLER__RESPONSE__CMD_OK;
+	} else {
+		ERROR("Streaming log files from %s failed after %d files.", LOGFILE_DIR,
+		      stream->files_sent);
+		out.response = DAEMON_TO_CONTROLLER__RESPONSE__CMD_FAILED;
+	}
+	if (protobuf_send_message(frame_conn_get_fd(conn), (ProtobufCMessage *)&out) < 0) {
+		ERROR_ERRNO("Could not finish send LOG_END message");
+		control_log_stream_free(stream);
+		return;
+	}
+
+	// the sent logs are removed once the output queue has drained
+	stream->finished = true;
+	if (frame_conn_get_queued(conn) == 0) {
+		control_log_stream_remove_sent(stream);
+		control_log_stream_free(stream);
+	}
+}
+
+/**
+ * Starts a chunked GET_LAST_LOG transfer on the given client connection.
+ * The transfer ends with a RESPONSE message as for the non-streamed variant.
+ *
+ * @param lock_fd the lock on the log folder if the sent logs should be removed,
+ *	  -1 otherwise; the stream takes ownership of the lock
+ * @return 0 if the transfer was started, -1 otherwise.
+ */
+static int
+control_log_stream_start(control_t *control, frame_conn_t *conn, const LogStreamParams *params,
+			 int lock_fd)
+{
+	for (list_t *l = control->log_streams; l; l = l->next) {
+		control_log_stream_t *other = l->data;
+		if (other->conn == conn) {
+			WARN("A log transfer is already running on this connection");
+			if (lock_fd >= 0)
+				logf_lock_release(LOGFILE_DIR, lock_fd);
+			return -1;
+		}
+	}
+
+	control_log_stream_t *stream = mem_new0(control_log_stream_t, 1);
+	stream->control = control;
+	stream->conn = conn;
+	stream->file_fd = -1;
+	stream->lock_fd = lock_fd;
+	if (cmld_get_device_uuid())
+		stream->device_uuid = mem_strdup(cmld_get_device_uuid());
+
+	stream->chunk_size = params->has_chunk_size ? params->chunk_size :
+						      CONTROL_LOG_STREAM_CHUNK_DEFAULT;
+	stream->chunk_size = MAX(stream->chunk_size, CONTROL_LOG_STREAM_CHUNK_MIN);
+	stream->chunk_size = MIN(stream->chunk_size, CONTROL_LOG_STREAM_CHUNK_MAX);
+
+	stream->compression = params->has_compression ? params->compression :
+							LOG_STREAM_PARAMS__COMPRESSION__NONE;
+	if (!control_log_compression_supported(stream->compression)) {
+		WARN("Log compression %d not supported, sending uncompressed chunks",
+		     stream->compression);
+		stream->compression = LOG_STREAM_PARAMS__COMPRESSION__NONE;
+	}
+	// uncompressed chunks are sent from the file without a buffer
+	if (stream->compression != LOG_STREAM_PARAMS__COMPRESSION__NONE)
+		stream->buf = mem_alloc(stream->chunk_size);
+
+	if (params->resume_name) {
+		stream->resume_name = mem_strdup(params->resume_name);
+		stream->resume_offset = params->has_resume_offset ? params->resume_offset : 0;
+	}
+
+	// register first, so that the stream is released if anything below fails
+	control->log_streams = list_append(control->log_streams, stream);
+
+	if (lock_fd >= 0) {
+		stream->current_logs = logf_get_current_log_files_new(LOGFILE_DIR);
+		stream->remove_logs = true;
+	}
+
+	if (dir_foreach(LOGFILE_DIR, &control_log_stream_collect_cb, stream) < 0)
+		goto error;
+	qsort(stream->files, stream->files_len, sizeof(char *), control_log_stream_cmp_names);
+
+	INFO("Streaming %zu log files in chunks of %u bytes (compression %d)", stream->files_len,
+	     stream->chunk_size, stream->compression);
+	frame_conn_set_drain_cb(conn, control_log_stream_drain_cb, stream);
+	return 0;
+
+error:
+	control_log_stream_free(stream);
+	return -1;
+}
+
+/**
+ * Aborts the log transfer on the given connection, if any, e.g. if the client
+ * disconnected. Files which have not been sent completely are retained.
+ */
+static void
+control_log_stream_abort(control_t *control, frame_conn_t *conn)
+{
+	for (list_t *l = control->log_streams; l; l = l->next) {
+		control_log_stream_t *stream = l->data;
+		if (stream->conn == conn) {
+			INFO("Aborting log transfer after %d files", stream->files_sent);
+			control_log_stream_free(stream);
+			return;
+		}
+	}
+}
+
 /**
  * The usual identity map between two corresponding C and protobuf enums.
  */
@@ -458,21 +985,21 @@ control_get_container_by_uuid_string(const char *uuid_str)
  * Returns a list of containers for all given UUIDs, or a list with all
  * available containers if the given UUID list is empty.
  */
-static list_t *
+static array_t *
 control_build_container_list_from_uuids(size_t n_uuids, char **uuids)
 {
-	list_t *containers = NULL;
+	array_t *containers = array_new();
 	if (n_uuids > 0) { // uuid list given in incoming message
 		for (size_t i = 0; i < n_uuids; i++) {
 			container_t *container = control_get_container_by_uuid_string(uuids[i]);
 			if (container != NULL)
-				containers = list_append(containers, container);
+				containers = array_append(containers, container);
 		}
 	} else { // empty uuid list, return status for all containers
 		n_uuids = cmld_containers_get_count();
 		for (size_t i = 0; i < n_uuids; i++) {
 			container_t *container = cmld_container_get_by_index(i);
-			containers = list_append(containers, container);
+			containers = array_append(containers, container);
 		}
 	}
 	return containers;
@@ -500,21 +1027,21 @@ control_get_unit_by_uuid_string(const char *uuid_str)
  * Returns a list of units for all given UUIDs, or a list with all
  * available units if the given UUID list is empty.
  */
-static list_t *
+static array_t *
 control_build_unit_list_from_uuids(size_t n_uuids, char **uuids)
 {
-	list_t *units = NULL;
+	array_t *units = array_new();
 	if (n_uuids > 0) { // uuid list given in incoming message
 		for (size_t i = 0; i < n_uuids; i++) {
 			unit_t *unit = control_get_unit_by_uuid_string(uuids[i]);
 			if (unit != NULL)
-				units = list_append(units, unit);
+				units = array_append(units, unit);
 		}
 	} else { // empty uuid list, return status for all units
 		n_uuids = cmld_units_get_count();
 		for (size_t i = 0; i < n_uuids; i++) {
 			unit_t *unit = cmld_unit_get_by_index(i);
-			units = list_append(units, unit);
+			units = array_append(units, unit);
 		}
 	}
 	return units;
@@ -655,6 +1182,24 @@ control_send_message(control_message_t message, int fd)
 	return protobuf_send_message(fd, (ProtobufCMessage *)&out);
 }
 
+int
+control_send_guestos_download_progress(int fd, const char *name, uint64_t version,
+				       const char *image, uint64_t received, uint64_t total)
+{
+	GuestOSDownloadProgress progress = GUEST_OSDOWNLOAD_PROGRESS__INIT;
+	progress.name = (char *)name;
+	progress.version = version;
+	progress.image = (char *)image;
+	progress.received = received;
+	progress.has_total = total > 0;
+	progress.total = total;
+
+	DaemonToController out = DAEMON_TO_CONTROLLER__INIT;
+	out.code = DAEMON_TO_CONTROLLER__CODE__GUESTOS_DOWNLOAD_PROGRESS;
+	out.guestos_download_progress = &progress;
+	return protobuf_send_message(fd, (ProtobufCMessage *)&out);
+}
+
 /**
  * Handles list_guestos_configs cmd.
  * Used in both priv and unpriv control handlers.
@@ -1092,7 +1637,7 @@ control_handle_message(control_t *control, const ControllerToDaemon *msg, int fd
 		}
 
 		// container
-		for (size_t i = 0; i < n; i++) {
+		for (size_t i = 0; i < n_container; i++) {
 			container_t *container = cmld_container_get_by_index(i);
 			const char *uuid = uuid_string(container_get_uuid(container));
 			results[n_unit + i] = mem_strdup(uuid);
@@ -1116,28 +1661,28 @@ control_handle_message(control_t *control, const ControllerToDaemon *msg, int fd
 	case CONTROLLER_TO_DAEMON__COMMAND__GET_CONTAINER_STATUS: {
 		bool include_units = (msg->n_container_uuids > 0) ? true : false;
 		// assemble list of relevant units + containers and allocate memory for result
-		list_t *containers = control_build_container_list_from_uuids(msg->n_container_uuids,
-									     msg->container_uuids);
-		list_t *units = NULL;
-		size_t n_container = list_length(containers);
+		array_t *containers = control_build_container_list_from_uuids(
+			msg->n_container_uuids, msg->container_uuids);
+		array_t *units = NULL;
+		size_t n_container = array_length(containers);
 		size_t n_unit = 0;
 		if (include_units || (msg->has_system_services && msg->system_services)) {
 			units = control_build_unit_list_from_uuids(msg->n_container_uuids,
 								   msg->container_uuids);
-			n_unit += list_length(units);
+			n_unit += array_length(units);
 		}
 		size_t n = n_unit + n_container;
 		ContainerStatus **results = mem_new(ContainerStatus *, n);
 
 		// fill result with data from container
 		for (size_t i = 0; i < n_unit; i++) {
-			unit_t *unit = list_nth_data(units, i);
+			unit_t *unit = array_get(units, i);
 			results[i] = control_unit_status_new(unit);
 		}
 
 		// fill result with data from container
 		for (size_t i = 0; i < n_container; i++) {
-			container_t *container = list_nth_data(containers, i);
+			container_t *container = array_get(containers, i);
 			results[n_unit + i] = control_container_status_new(container);
 		}
 
@@ -1151,8 +1696,8 @@ control_handle_message(control_t *control, const ControllerToDaemon *msg, int fd
 		}
 
 		// collect garbage
-		list_delete(units);
-		list_delete(containers);
+		array_free(units);
+		array_free(containers);
 		for (size_t i = 0; i < n; i++)
 			control_container_status_free(results[i]);
 		mem_free0(results);
@@ -1160,16 +1705,16 @@ control_handle_message(control_t *control, const ControllerToDaemon *msg, int fd
 
 	case CONTROLLER_TO_DAEMON__COMMAND__GET_CONTAINER_CONFIG: {
 		// assemble list of relevant containers and allocate memory for result
-		list_t *containers = control_build_container_list_from_uuids(msg->n_container_uuids,
-									     msg->container_uuids);
-		size_t n = list_length(containers);
+		array_t *containers = control_build_container_list_from_uuids(
+			msg->n_container_uuids, msg->container_uuids);
+		size_t n = array_length(containers);
 		ContainerConfig **results = mem_new0(ContainerConfig *, n);
 		char **result_uuids = mem_new(char *, n);
 
 		size_t number_of_configs = 0;
 		// fill result with data from container
 		for (size_t i = 0; i < n; i++) {
-			container_t *container = list_nth_data(containers, i);
+			container_t *container = array_get(containers, i);
 			if (!container) {
 				FATAL("Got NULL container pointer!");
 			}
@@ -1205,9 +1750,10 @@ control_handle_message(control_t *control, const ControllerToDaemon *msg, int fd
 				int vnet_config_len = list_length(vnet_runtime_cfg_list);
 				ContainerVnetConfig **vnet_configs =
 					mem_new0(ContainerVnetConfig *, vnet_config_len);
-				for (int i = 0; i < vnet_config_len; ++i) {
-					container_vnet_cfg_t *vnet_cfg =
-						list_nth_data(vnet_runtime_cfg_list, i);
+				list_t *vnet_elem = vnet_runtime_cfg_list;
+				for (int i = 0; i < vnet_config_len;
+				     ++i, vnet_elem = vnet_elem->next) {
+					container_vnet_cfg_t *vnet_cfg = vnet_elem->data;
 					vnet_configs[i] = mem_new0(ContainerVnetConfig, 1);
 					container_vnet_config__init(vnet_configs[i]);
 					vnet_configs[i]->if_name = mem_strdup(vnet_cfg->vnet_name);
@@ -1255,7 +1801,7 @@ control_handle_message(control_t *control, const ControllerToDaemon *msg, int fd
 		}
 
 		// collect garbage
-		list_delete(containers);
+		array_free(containers);
 		for (size_t i = 0; i < number_of_configs; i++) {
 			mem_free0(result_uuids[i]);
 			if (results[i] != NULL)
@@ -1273,13 +1819,37 @@ control_handle_message(control_t *control, const ControllerToDaemon *msg, int fd
 
 		int dir_ret = 0;
 		bool remove_logs = (!msg->has_remove_logs) ? false : msg->remove_logs;
+		int lock_fd = -1;
 
 		if (remove_logs) {
-			int lock_fd = logf_lock_apply(LOGFILE_DIR);
+			// a running transfer holds the lock, do not block the event loop on it
+			lock_fd = logf_lock_try_apply(LOGFILE_DIR);
 			if (lock_fd < 0) {
+				if (errno == EWOULDBLOCK) {
+					INFO("Log files are being transferred already, "
+					     "rejecting request");
+					out.response = DAEMON_TO_CONTROLLER__RESPONSE__CMD_BUSY;
+				}
+				if (protobuf_send_message(fd, (ProtobufCMessage *)&out) < 0)
+					ERROR_ERRNO("Could not send LOG_END message");
 				break;
 			}
+		}
 
+		if (msg->log_stream_params) {
+			frame_conn_t *conn = frame_conn_get_by_fd(fd);
+			// the RESPONSE is sent by the stream once it is done
+			if (conn && !control_log_stream_start(control, conn, msg->log_stream_params,
+							      lock_fd))
+				break;
+			if (!conn && lock_fd >= 0)
+				logf_lock_release(LOGFILE_DIR, lock_fd);
+			if (protobuf_send_message(fd, (ProtobufCMessage *)&out) < 0)
+				ERROR_ERRNO("Could not send LOG_END message");
+			break;
+		}
+
+		if (remove_logs) {
 			list_t *current_logs = logf_get_current_log_files_new(LOGFILE_DIR);
 
 			struct log_cb_data cbdata = { .fd = fd,
@@ -1742,9 +2312,10 @@ control_handle_message(control_t *control, const ControllerToDaemon *msg, int fd
 		size_t n = list_length(link_list);
 		char **results = mem_new(char *, n);
 
-		for (size_t i = 0; i < n; i++) {
-			char *link_line = list_nth_data(link_list, i);
-			results[i] = mem_strdup(link_line);
+		size_t idx = 0;
+		for (list_t *l = link_list; l; l = l->next) {
+			char *link_line = l->data;
+			results[idx++] = mem_strdup(link_line);
 		}
 
 		out.n_container_ifaces = n;
@@ -1864,50 +2435,54 @@ control_handle_message(control_t *control, const ControllerToDaemon *msg, int fd
 }
 
 /**
- * Event callback for incoming data that receives a ControllerToDaemon message (local)
+ * Callback for a complete message received on a client connection.
  *
  * The handle_message function will be called to handle the received message.
  *
- * @param fd	    file descriptor of the client connection
- *		    from which the incoming message is read
- * @param events    event flags
- * @param io	    pointer to associated event_io_t struct
+ * @param conn	    the framed client connection
+ * @param buf	    the packed ControllerToDaemon message
+ * @param len	    length of the packed message
  * @param data	    pointer to this control_t struct
  */
 static void
-control_cb_recv_message_local(int fd, unsigned events, event_io_t *io, void *data)
+control_conn_recv_cb(frame_conn_t *conn, uint8_t *buf, uint32_t len, void *data)
 {
 	control_t *control = data;
-	/*
-	 * always check READ flag first, since also if the peer called close()
-	 * and there is pending data on the socet the READ and EXCEPT flags are set.
-	 * Thus, we have to read pending date before handling the EXCEPT event.
-	 */
-	if (events & EVENT_IO_READ) {
-		ControllerToDaemon *msg = (ControllerToDaemon *)protobuf_recv_message(
-			fd, &controller_to_daemon__descriptor);
-		// close connection if client EOF, or protocol parse error
-		IF_NULL_GOTO_TRACE(msg, connection_err);
-		control_handle_message(control, msg, fd);
-		TRACE("Handled control connection %d", fd);
-		protobuf_free_message((ProtobufCMessage *)msg);
-	}
-	// also check EXCEPT flag
-	if (events & EVENT_IO_EXCEPT) {
-		INFO("Control client closed connection; disconnecting control socket.");
-		goto connection_err;
+	int fd = frame_conn_get_fd(conn);
+
+	ControllerToDaemon *msg = (ControllerToDaemon *)protobuf_unpack_message(
+		&controller_to_daemon__descriptor, buf, len);
+	if (!msg) {
+		// close connection on protocol parse error
+		WARN("Failed to parse message on control connection %d; disconnecting", fd);
+		cmld_container_ctrl_with_input_abort();
+		control_log_stream_abort(control, conn);
+		control->conn_list = list_remove(control->conn_list, conn);
+		frame_conn_free(conn);
+		return;
 	}
-	return;
 
-connection_err:
+	control_handle_message(control, msg, fd);
+	TRACE("Handled control connection %d", fd);
+	protobuf_free_message((ProtobufCMessage *)msg);
+}
+
+/**
+ * Callback for a client connection which was closed by the peer or failed.
+ *
+ * @param conn	    the framed client connection
+ * @param data	    pointer to this control_t struct
+ */
+static void
+control_conn_close_cb(frame_conn_t *conn, void *data)
+{
+	control_t *control = data;
+
+	INFO("Control client closed connection; disconnecting control socket.");
 	cmld_container_ctrl_with_input_abort();
-	event_remove_io(io);
-	event_io_free(io);
-	if (close(fd) < 0)
-		WARN_ERRNO("Failed to close connected control socket");
-	control->event_io_sock_connected_list =
-		list_remove(control->event_io_sock_connected_list, io);
-	return;
+	control_log_stream_abort(control, conn);
+	control->conn_list = list_remove(control->conn_list, conn);
+	frame_conn_free(conn);
 }
 
 /**
@@ -1943,13 +2518,16 @@ control_cb_accept(int fd, unsigned events, event_io_t *io, void *data)
 	}
 	TRACE("Accepted control connection %d", cfd);
 
-	fd_make_non_blocking(cfd);
-
-	event_io_t *event =
-		event_io_new(cfd, EVENT_IO_READ, control_cb_recv_message_local, control);
+	frame_conn_t *conn =
+		frame_conn_new(cfd, control_conn_recv_cb, control_conn_close_cb, control);
+	if (!conn) {
+		WARN("Could not set up control connection %d", cfd);
+		close(cfd);
+		return;
+	}
 	TRACE("local control client connected on fd=%d", cfd);
 
-	event_add_io(event);
+	control->conn_list = list_append(control->conn_list, conn);
 }
 
 control_t *
@@ -1988,17 +2566,16 @@ void
 control_free(control_t *control)
 {
 	ASSERT(control);
-	for (list_t *l = control->event_io_sock_connected_list; l; l = l->next) {
-		event_io_t *event_io_sock_connected = l->data;
-		event_remove_io(event_io_sock_connected);
-		shutdown(event_io_get_fd(event_io_sock_connected), SHUT_RDWR);
-		if (close(event_io_get_fd(event_io_sock_connected) < 0)) {
-			WARN_ERRNO("Failed to close connected control socket");
-		}
-		event_io_free(event_io_sock_connected);
+	while (control->log_streams)
+		control_log_stream_free(control->log_streams->data);
+
+	for (list_t *l = control->conn_list; l; l = l->next) {
+		frame_conn_t *conn = l->data;
+		shutdown(frame_conn_get_fd(conn), SHUT_RDWR);
+		frame_conn_free(conn);
 	}
-	list_delete(control->event_io_sock_connected_list);
-	control->event_io_sock_connected_list = NULL;
+	list_delete(control->conn_list);
+	control->conn_list = NULL;
 
 	control_list = list_remove(control_list, control);
 
@@ -36,6 +36,7 @@
 #define CONTROL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /**
  * Data structure containing the variables associated to a control socket.
@@ -145,4 +146,12 @@ control_get_client_sock(control_t *control);
 int
 control_send_message(control_message_t message, int fd);
 
+/**
+ * Sends the progress of a GuestOS image download to the specified fd.
+ * @param total the size of the image or 0 if not known
+ */
+int
+control_send_guestos_download_progress(int fd, const char *name, uint64_t version,
+				       const char *image, uint64_t received, uint64_t total);
+
 #endif /* CONTROL_H */
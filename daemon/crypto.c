@@ -28,12 +28,17 @@
 
 #include "common/event.h"
 #include "common/file.h"
+#include "common/frame.h"
+#include "common/hashmap.h"
 #include "common/hex.h"
+#include "common/list.h"
 #include "common/macro.h"
 #include "common/mem.h"
 #include "common/protobuf.h"
 #include "common/sock.h"
 
+#include <inttypes.h>
+#include <string.h>
 #include <unistd.h>
 
 // clang-format off
@@ -48,29 +53,126 @@
 // clang-format on
 extern char *scd_sock_path; // defined in scd.c
 
-static TokenToDaemon *
-crypto_send_recv_block(const DaemonToToken *out)
+/*
+ * Crypto requests are multiplexed over two long-lived connections to the scd
+ * instead of connecting for each request. Asynchronous requests share a framed
+ * connection on which any number of requests may be in flight; responses are
+ * matched to their tasks by request_id. Blocking requests use a separate
+ * connection, so that they never have to skip over asynchronous responses.
+ * Both connections are (re-)established lazily, e.g., after an scd restart.
+ *
+ * Children of cmld, e.g., the early child of a starting container, inherit both
+ * connections. Each process thus uses them only if it has established them
+ * itself, otherwise two processes could read each other's responses.
+ */
+static frame_conn_t *crypto_conn = NULL;
+static pid_t crypto_conn_pid = -1; //!< process which connected crypto_conn
+static hashmap_t *crypto_pending = NULL; // request_id -> crypto_callback_task_t
+static int crypto_block_sock = -1;
+static pid_t crypto_block_pid = -1; //!< process which connected crypto_block_sock
+static uint32_t crypto_request_id = 0;
+
+static uint32_t
+crypto_request_id_next(void)
 {
-	ASSERT(out);
+	// 0 is reserved for untagged requests
+	if (++crypto_request_id == 0)
+		crypto_request_id = 1;
+	return crypto_request_id;
+}
 
-	int sock = sock_unix_create_and_connect(SOCK_SEQPACKET, scd_sock_path);
-	if (sock < 0) {
-		ERROR_ERRNO("Failed to connect to scd control socket %s", scd_sock_path);
-		return NULL;
+/*
+ * Drops a blocking connection inherited from the parent process, so that the
+ * next request connects a private one.
+ */
+static void
+crypto_block_check_owner(void)
+{
+	if (crypto_block_sock < 0 || crypto_block_pid == getpid())
+		return;
+
+	TRACE("Dropping blocking scd connection inherited from process %d", crypto_block_pid);
+	close(crypto_block_sock);
+	crypto_block_sock = -1;
+	crypto_request_id = 0;
+}
+
+/*
+ * Drops the asynchronous connection and the requests pending on it inherited
+ * from the parent process, so that the next request connects a private one.
+ * The parent still serves both, thus only the socket is closed, the event loop
+ * registration and the request callbacks are left alone.
+ */
+static void
+crypto_conn_check_owner(void)
+{
+	if (!crypto_conn || crypto_conn_pid == getpid())
+		return;
+
+	TRACE("Dropping scd connection inherited from process %d", crypto_conn_pid);
+	close(frame_conn_get_fd(crypto_conn));
+	crypto_conn = NULL;
+	if (crypto_pending) {
+		hashmap_free(crypto_pending);
+		crypto_pending = NULL;
 	}
+}
 
-	TRACE("crypto_send_recv_block: connected to sock %d", sock);
+static int
+crypto_block_send(DaemonToToken *out)
+{
+	crypto_block_check_owner();
 
-	if (protobuf_send_message(sock, (ProtobufCMessage *)out) < 0) {
-		ERROR("Failed to send message to scd on sock %d", sock);
-		close(sock);
-		return NULL;
+	if (crypto_block_sock < 0) {
+		crypto_block_sock =
+			sock_unix_create_and_connect(SOCK_SEQPACKET | SOCK_CLOEXEC, scd_sock_path);
+		if (crypto_block_sock < 0) {
+			ERROR_ERRNO("Failed to connect to scd control socket %s", scd_sock_path);
+			return -1;
+		}
+		crypto_block_pid = getpid();
+		TRACE("crypto_block_send: connected to sock %d", crypto_block_sock);
 	}
+	if (protobuf_send_message(crypto_block_sock, (ProtobufCMessage *)out) < 0) {
+		WARN("Failed to send message to scd on sock %d", crypto_block_sock);
+		close(crypto_block_sock);
+		crypto_block_sock = -1;
+		return -1;
+	}
+	return 0;
+}
+
+static TokenToDaemon *
+crypto_send_recv_block(DaemonToToken *out)
+{
+	ASSERT(out);
+
+	crypto_block_check_owner();
+
+	out->has_request_id = true;
+	out->request_id = crypto_request_id_next();
+
+	// the scd may have been restarted since the last request, thus retry once
+	bool sent = false;
+	for (int attempt = 0; !sent && attempt < 2; attempt++)
+		sent = crypto_block_send(out) == 0;
+	IF_FALSE_RETVAL(sent, NULL);
 
 	TokenToDaemon *msg = NULL;
-	msg = (TokenToDaemon *)protobuf_recv_message(sock, &token_to_daemon__descriptor);
-	close(sock);
-	return msg;
+	while ((msg = (TokenToDaemon *)protobuf_recv_message(crypto_block_sock,
+							     &token_to_daemon__descriptor))) {
+		if (!msg->has_request_id || msg->request_id == out->request_id)
+			return msg;
+
+		// a stale response of a request which failed before
+		WARN("Dropping response for request %u from scd", msg->request_id);
+		protobuf_free_message((ProtobufCMessage *)msg);
+	}
+
+	ERROR("Failed to receive response from scd on sock %d", crypto_block_sock);
+	close(crypto_block_sock);
+	crypto_block_sock = -1;
+	return NULL;
 }
 
 bool
@@ -136,8 +238,12 @@ crypto_verify_result_from_proto(TokenToDaemon__Code code)
 }
 
 typedef struct crypto_callback_task {
+	uint32_t request_id;
+	bool generic; // result is reported to the control connection resp_fd
+	int resp_fd;
 	crypto_hash_callback_t hash_complete;
 	crypto_hash_buf_callback_t hash_buf_complete;
+	crypto_hash_multi_callback_t hash_multi_complete;
 	crypto_verify_callback_t verify_complete;
 	crypto_verify_buf_callback_t verify_buf_complete;
 	void *data;
@@ -145,6 +251,8 @@ typedef struct crypto_callback_task {
 	unsigned char *hash_buf;
 	size_t hash_buf_len;
 	crypto_hashalgo_t hash_algo;
+	crypto_hashalgo_t *hash_algos; // for multi hash requests
+	size_t hash_algos_len;
 	char *verify_data_file;
 	char *verify_sig_file;
 	char *verify_cert_file;
@@ -156,6 +264,15 @@ typedef struct crypto_callback_task {
 	size_t verify_cert_buf_len;
 } crypto_callback_task_t;
 
+static crypto_callback_task_t *
+crypto_callback_generic_task_new(int resp_fd)
+{
+	crypto_callback_task_t *task = mem_new0(crypto_callback_task_t, 1);
+	task->generic = true;
+	task->resp_fd = resp_fd;
+	return task;
+}
+
 static crypto_callback_task_t *
 crypto_callback_hash_task_new(crypto_hash_callback_t cb, void *data, const char *hash_file,
 			      crypto_hashalgo_t hash_algo)
@@ -168,6 +285,21 @@ crypto_callback_hash_task_new(crypto_hash_callback_t cb, void *data, const char
 	return task;
 }
 
+static crypto_callback_task_t *
+crypto_callback_hash_multi_task_new(crypto_hash_multi_callback_t cb, void *data,
+				    const char *hash_file, const crypto_hashalgo_t *hash_algos,
+				    size_t hash_algos_len)
+{
+	crypto_callback_task_t *task = mem_new0(crypto_callback_task_t, 1);
+	task->hash_multi_complete = cb;
+	task->data = data;
+	task->hash_file = mem_strdup(hash_file);
+	task->hash_algos = mem_new0(crypto_hashalgo_t, hash_algos_len);
+	memcpy(task->hash_algos, hash_algos, hash_algos_len * sizeof(crypto_hashalgo_t));
+	task->hash_algos_len = hash_algos_len;
+	return task;
+}
+
 static crypto_callback_task_t *
 crypto_callback_hash_buf_task_new(crypto_hash_buf_callback_t cb, void *data,
 				  const unsigned char *hash_buf, size_t hash_buf_len,
@@ -229,6 +361,8 @@ crypto_callback_task_free(crypto_callback_task_t *task)
 		mem_free0(task->hash_file);
 	if (task->hash_buf)
 		mem_free0(task->hash_buf);
+	if (task->hash_algos)
+		mem_free0(task->hash_algos);
 	if (task->verify_data_file)
 		mem_free0(task->verify_data_file);
 	if (task->verify_sig_file)
@@ -244,149 +378,238 @@ crypto_callback_task_free(crypto_callback_task_t *task)
 	mem_free0(task);
 }
 
+/*
+ * Reports the hashes of a multi hash response to the callback of task, or
+ * NULL if msg is NULL or does not contain a hash for each requested algorithm.
+ */
 static void
-crypto_cb(int fd, unsigned events, event_io_t *io, void *data)
+crypto_task_hash_multi_complete(crypto_callback_task_t *task, const TokenToDaemon *msg)
 {
-	crypto_callback_task_t *task = data;
-	ASSERT(task);
+	if (!msg || msg->n_hash_values != task->hash_algos_len) {
+		if (msg)
+			ERROR("Got %zu hash values for %zu algorithms in CRYPTO_HASH_OK response!",
+			      msg->n_hash_values, task->hash_algos_len);
+		task->hash_multi_complete(NULL, task->hash_file, task->hash_algos,
+					  task->hash_algos_len, task->data);
+		return;
+	}
 
-	TRACE("Received message crypto msg from SCD");
+	char **hashes = mem_new0(char *, task->hash_algos_len);
+	for (size_t i = 0; i < task->hash_algos_len; i++) {
+		hashes[i] = convert_bin_to_hex_new(msg->hash_values[i].data,
+						   msg->hash_values[i].len);
+		TRACE("Received hash %zu for file %s: %s", i, task->hash_file, hashes[i]);
+	}
 
-	// TODO outsource socket/fd/events handling
-	if (events & EVENT_IO_READ) {
-		// use protobuf for communication with scd
-		TokenToDaemon *msg =
-			(TokenToDaemon *)protobuf_recv_message(fd, &token_to_daemon__descriptor);
-		if (!msg) {
-			ERROR("Failed to receive message although EVENT_IO_READ was set. Aborting crypto_cb.");
-			goto cleanup;
-		}
-		switch (msg->code) {
-		// deal with CRYPTO_HASH_* cases
-		case TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK:
-			TRACE("Received HASH_OK message, ");
-			if (msg->has_hash_value) {
-				char *hash = convert_bin_to_hex_new(msg->hash_value.data,
-								    msg->hash_value.len);
-
-				TRACE("Received hash for file %s: %s",
-				      task->hash_file ? task->hash_file : "<empty>", hash);
-				if (task->hash_complete)
-					task->hash_complete(hash, task->hash_file, task->hash_algo,
-							    task->data);
-				if (task->hash_buf_complete)
-					task->hash_buf_complete(hash, task->hash_buf,
-								task->hash_buf_len, task->hash_algo,
-								task->data);
-				if (hash != NULL) {
-					mem_free0(hash);
-				}
-				break;
-			}
-			ERROR("Missing hash_value in CRYPTO_HASH_OK response!"); // fallthrough
-		case TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR:
-			task->hash_complete(NULL, task->hash_file, task->hash_algo, task->data);
-			if (task->hash_complete)
-				task->hash_complete(NULL, task->hash_file, task->hash_algo,
-						    task->data);
-			if (task->hash_buf_complete)
-				task->hash_buf_complete(NULL, task->hash_buf, task->hash_buf_len,
-							task->hash_algo, task->data);
-			break;
+	task->hash_multi_complete((const char *const *)hashes, task->hash_file, task->hash_algos,
+				  task->hash_algos_len, task->data);
 
-		// deal with CRYPTO_VERIFY_* cases
-		case TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_GOOD:
-		case TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_ERROR:
-		case TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_BAD_SIGNATURE:
-		case TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_BAD_CERTIFICATE:
-		case TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_LOCALLY_SIGNED:
-			if (task->verify_complete) {
-				task->verify_complete(crypto_verify_result_from_proto(msg->code),
-						      task->verify_data_file, task->verify_sig_file,
-						      task->verify_cert_file, task->hash_algo,
-						      task->data);
-			} else if (task->verify_buf_complete) {
-				task->verify_buf_complete(
-					crypto_verify_result_from_proto(msg->code),
-					task->verify_data_buf, task->verify_data_buf_len,
-					task->verify_sig_buf, task->verify_sig_buf_len,
-					task->verify_cert_buf, task->verify_cert_buf_len,
-					task->hash_algo, task->data);
-			}
-			break;
-		default:
-			ERROR("TokenToDaemon command %d unknown or not implemented yet", msg->code);
-			break;
-		}
-		protobuf_free_message((ProtobufCMessage *)msg);
-	} else {
-		ERROR("Failed to receive message: EVENT_IO_EXCEPT. Aborting crypto_cb");
-	}
-cleanup:
-	event_remove_io(io);
-	event_io_free(io);
-	crypto_callback_task_free(task);
-	close(fd);
+	for (size_t i = 0; i < task->hash_algos_len; i++)
+		mem_free0(hashes[i]);
+	mem_free0(hashes);
 }
 
+/*
+ * Reports the response of the scd to the callback of the corresponding task.
+ * If msg is NULL, the request failed without a response, e.g. since the
+ * connection to the scd was lost.
+ */
 static void
-crypto_generic_cb(int fd, unsigned events, event_io_t *io, void *data)
+crypto_task_complete(crypto_callback_task_t *task, const TokenToDaemon *msg)
 {
-	ASSERT(data);
-
-	int *resp_fd = data;
-
-	if (events & EVENT_IO_READ) {
-		// use protobuf for communication with scd
-		TokenToDaemon *msg =
-			(TokenToDaemon *)protobuf_recv_message(fd, &token_to_daemon__descriptor);
-		if (!msg) {
-			ERROR("Failed to receive message although EVENT_IO_READ was set. Aborting crypto generic callback.");
-			goto cleanup;
-		}
-		switch (msg->code) {
+	if (task->generic) {
+		switch (msg ? (int)msg->code : -1) {
 		case TOKEN_TO_DAEMON__CODE__DEVICE_PROV_ERROR:
-			control_send_message(CONTROL_RESPONSE_DEVICE_PROVISIONING_ERROR, *resp_fd);
+			control_send_message(CONTROL_RESPONSE_DEVICE_PROVISIONING_ERROR,
+					     task->resp_fd);
 			break;
+		case -1:
 		case TOKEN_TO_DAEMON__CODE__DEVICE_CERT_ERROR:
-			control_send_message(CONTROL_RESPONSE_DEVICE_CERT_ERROR, *resp_fd);
+			control_send_message(CONTROL_RESPONSE_DEVICE_CERT_ERROR, task->resp_fd);
 			break;
 		case TOKEN_TO_DAEMON__CODE__DEVICE_CERT_OK:
-			control_send_message(CONTROL_RESPONSE_DEVICE_CERT_OK, *resp_fd);
+			control_send_message(CONTROL_RESPONSE_DEVICE_CERT_OK, task->resp_fd);
 			break;
 		case TOKEN_TO_DAEMON__CODE__CMD_UNKNOWN:
-			control_send_message(CONTROL_RESPONSE_CMD_UNSUPPORTED, *resp_fd);
+			control_send_message(CONTROL_RESPONSE_CMD_UNSUPPORTED, task->resp_fd);
 			break;
 		default:
 			ERROR("TokenToDaemon command %d unknown or not implemented yet", msg->code);
 			break;
 		}
-		protobuf_free_message((ProtobufCMessage *)msg);
+		return;
+	}
+
+	TokenToDaemon__Code code = msg ? msg->code :
+			   (task->hash_complete || task->hash_buf_complete ||
+			    task->hash_multi_complete) ?
+					 TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR :
+					 TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_ERROR;
+
+	switch (code) {
+	// deal with CRYPTO_HASH_* cases
+	case TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK:
+		TRACE("Received HASH_OK message, ");
+		if (task->hash_multi_complete) {
+			crypto_task_hash_multi_complete(task, msg);
+			break;
+		}
+		if (msg->has_hash_value) {
+			char *hash =
+				convert_bin_to_hex_new(msg->hash_value.data, msg->hash_value.len);
+
+			TRACE("Received hash for file %s: %s",
+			      task->hash_file ? task->hash_file : "<empty>", hash);
+			if (task->hash_complete)
+				task->hash_complete(hash, task->hash_file, task->hash_algo,
+						    task->data);
+			if (task->hash_buf_complete)
+				task->hash_buf_complete(hash, task->hash_buf, task->hash_buf_len,
+							task->hash_algo, task->data);
+			if (hash != NULL) {
+				mem_free0(hash);
+			}
+			break;
+		}
+		ERROR("Missing hash_value in CRYPTO_HASH_OK response!"); // fallthrough
+	case TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR:
+		if (task->hash_multi_complete)
+			crypto_task_hash_multi_complete(task, NULL);
+		if (task->hash_complete)
+			task->hash_complete(NULL, task->hash_file, task->hash_algo, task->data);
+		if (task->hash_buf_complete)
+			task->hash_buf_complete(NULL, task->hash_buf, task->hash_buf_len,
+						task->hash_algo, task->data);
+		break;
+
+	// deal with CRYPTO_VERIFY_* cases
+	case TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_GOOD:
+	case TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_ERROR:
+	case TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_BAD_SIGNATURE:
+	case TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_BAD_CERTIFICATE:
+	case TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_LOCALLY_SIGNED:
+		if (task->verify_complete) {
+			task->verify_complete(crypto_verify_result_from_proto(code),
+					      task->verify_data_file, task->verify_sig_file,
+					      task->verify_cert_file, task->hash_algo, task->data);
+		} else if (task->verify_buf_complete) {
+			task->verify_buf_complete(crypto_verify_result_from_proto(code),
+						  task->verify_data_buf, task->verify_data_buf_len,
+						  task->verify_sig_buf, task->verify_sig_buf_len,
+						  task->verify_cert_buf, task->verify_cert_buf_len,
+						  task->hash_algo, task->data);
+		}
+		break;
+	default:
+		ERROR("TokenToDaemon command %d unknown or not implemented yet", code);
+		break;
+	}
+}
+
+static void
+crypto_pending_collect_cb(void *value, void *data)
+{
+	list_t **tasks = data;
+	*tasks = list_append(*tasks, value);
+}
+
+/*
+ * Fails all requests which are still pending on the asynchronous connection.
+ */
+static void
+crypto_pending_fail_all(void)
+{
+	list_t *tasks = NULL;
+
+	IF_NULL_RETURN(crypto_pending);
+
+	// callbacks may issue new requests, thus detach the pending map first
+	hashmap_foreach(crypto_pending, crypto_pending_collect_cb, &tasks);
+	hashmap_free(crypto_pending);
+	crypto_pending = NULL;
+
+	for (list_t *l = tasks; l; l = l->next) {
+		crypto_callback_task_t *task = l->data;
+		WARN("Request %u to scd failed without response", task->request_id);
+		crypto_task_complete(task, NULL);
+		crypto_callback_task_free(task);
+	}
+	list_delete(tasks);
+}
+
+static void
+crypto_conn_recv_cb(frame_conn_t *conn, uint8_t *buf, uint32_t len, UNUSED void *data)
+{
+	TokenToDaemon *msg =
+		(TokenToDaemon *)protobuf_unpack_message(&token_to_daemon__descriptor, buf, len);
+	if (!msg) {
+		ERROR("Failed to parse message from scd on fd %d; disconnecting",
+		      frame_conn_get_fd(conn));
+		crypto_conn = NULL;
+		frame_conn_free(conn);
+		crypto_pending_fail_all();
+		return;
+	}
+
+	crypto_callback_task_t *task = NULL;
+	if (msg->has_request_id && crypto_pending)
+		task = hashmap_remove_u64(crypto_pending, msg->request_id);
+
+	if (task) {
+		TRACE("Received response for crypto request %u from SCD", task->request_id);
+		crypto_task_complete(task, msg);
+		crypto_callback_task_free(task);
 	} else {
-		ERROR("Failed to receive message: EVENT_IO_EXCEPT. Aborting crypto generic cb");
+		WARN("Received response %d for unknown crypto request from SCD", msg->code);
 	}
-cleanup:
-	event_remove_io(io);
-	event_io_free(io);
-	mem_free0(resp_fd);
-	close(fd);
+	protobuf_free_message((ProtobufCMessage *)msg);
 }
 
-static int
-crypto_send_msg(const DaemonToToken *out, crypto_callback_task_t *task)
+static void
+crypto_conn_close_cb(frame_conn_t *conn, UNUSED void *data)
 {
-	ASSERT(out);
-	ASSERT(task);
+	INFO("scd closed crypto connection %d", frame_conn_get_fd(conn));
+	crypto_conn = NULL;
+	frame_conn_free(conn);
+	crypto_pending_fail_all();
+}
+
+static frame_conn_t *
+crypto_conn_get(void)
+{
+	crypto_conn_check_owner();
+	IF_TRUE_RETVAL(crypto_conn, crypto_conn);
 
-	int sock = sock_unix_create_and_connect(SOCK_SEQPACKET | SOCK_NONBLOCK, scd_sock_path);
+	int sock = sock_unix_create_and_connect(SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+						scd_sock_path);
 	if (sock < 0) {
 		ERROR_ERRNO("Failed to connect to scd control socket %s", scd_sock_path);
-		return -1;
+		return NULL;
+	}
+
+	crypto_conn = frame_conn_new(sock, crypto_conn_recv_cb, crypto_conn_close_cb, NULL);
+	if (!crypto_conn) {
+		close(sock);
+		return NULL;
 	}
 
-	TRACE("crypto_send_msg: connected to sock %d", sock);
-	event_io_t *event = event_io_new(sock, EVENT_IO_READ, crypto_cb, task);
-	event_add_io(event);
+	crypto_conn_pid = getpid();
+	TRACE("crypto: connected to scd on sock %d", sock);
+	return crypto_conn;
+}
+
+static int
+crypto_send_msg(DaemonToToken *out, crypto_callback_task_t *task)
+{
+	ASSERT(out);
+	ASSERT(task);
+
+	frame_conn_t *conn = crypto_conn_get();
+	IF_NULL_RETVAL(conn, -1);
+
+	task->request_id = crypto_request_id_next();
+	out->has_request_id = true;
+	out->request_id = task->request_id;
 
 	/*
 	char *string = protobuf_c_text_to_string((ProtobufCMessage *) out, NULL);
@@ -396,37 +619,28 @@ crypto_send_msg(const DaemonToToken *out, crypto_callback_task_t *task)
 	mem_free0(string);
 	*/
 
-	if (protobuf_send_message(sock, (ProtobufCMessage *)out) < 0) {
-		event_remove_io(event);
-		event_io_free(event);
+	if (protobuf_send_message(frame_conn_get_fd(conn), (ProtobufCMessage *)out) < 0) {
+		ERROR("Failed to send crypto request %u to scd", task->request_id);
 		return -1;
 	}
+
+	if (!crypto_pending)
+		crypto_pending = hashmap_new();
+	hashmap_put_u64(crypto_pending, task->request_id, task);
+
+	TRACE("crypto_send_msg: sent request %u, %u pending", task->request_id,
+	      hashmap_size(crypto_pending));
 	return 0;
 }
 
 static int
-crypto_generic_send_msg(const DaemonToToken *out, int resp_fd)
+crypto_generic_send_msg(DaemonToToken *out, int resp_fd)
 {
 	ASSERT(out);
 
-	int sock = sock_unix_create_and_connect(SOCK_SEQPACKET | SOCK_NONBLOCK, scd_sock_path);
-	if (sock < 0) {
-		ERROR_ERRNO("Failed to connect to scd control socket %s for crypto_generic",
-			    scd_sock_path);
-		return -1;
-	}
-
-	int *fd = mem_new0(int, 1);
-	*fd = resp_fd;
-
-	TRACE("crypto_generic_send_msg: connected to sock %d", sock);
-	event_io_t *event = event_io_new(sock, EVENT_IO_READ, crypto_generic_cb, fd);
-	event_add_io(event);
-
-	if (protobuf_send_message(sock, (ProtobufCMessage *)out) < 0) {
-		event_remove_io(event);
-		event_io_free(event);
-		mem_free0(fd);
+	crypto_callback_task_t *task = crypto_callback_generic_task_new(resp_fd);
+	if (crypto_send_msg(out, task) < 0) {
+		crypto_callback_task_free(task);
 		return -1;
 	}
 	return 0;
@@ -456,6 +670,57 @@ crypto_hash_file(const char *file, crypto_hashalgo_t hashalgo, crypto_hash_callb
 	return 0;
 }
 
+static int
+crypto_hash_file_multi_internal(const char *file, const crypto_hashalgo_t *hashalgos, size_t n,
+				const uint64_t *follow_size, crypto_hash_multi_callback_t cb,
+				void *data)
+{
+	ASSERT(file);
+	ASSERT(hashalgos);
+	ASSERT(n > 0);
+	ASSERT(cb);
+
+	crypto_callback_task_t *task =
+		crypto_callback_hash_multi_task_new(cb, data, file, hashalgos, n);
+
+	DaemonToToken out = DAEMON_TO_TOKEN__INIT;
+	out.code = DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE_MULTI;
+	out.hash_file = task->hash_file;
+	out.n_hash_algos = n;
+	out.hash_algos = mem_new0(HashAlgo, n);
+	for (size_t i = 0; i < n; i++)
+		out.hash_algos[i] = crypto_hashalgo_to_proto(hashalgos[i]);
+	if (follow_size) {
+		out.has_hash_follow_size = true;
+		out.hash_follow_size = *follow_size;
+	}
+
+	TRACE("Requesting scd to hash file at %s with %zu algorithms%s", task->hash_file, n,
+	      follow_size ? " while it is written" : "");
+
+	int ret = 0;
+	if (crypto_send_msg(&out, task) < 0) {
+		crypto_callback_task_free(task);
+		ret = -1;
+	}
+	mem_free0(out.hash_algos);
+	return ret;
+}
+
+int
+crypto_hash_file_multi(const char *file, const crypto_hashalgo_t *hashalgos, size_t n,
+		       crypto_hash_multi_callback_t cb, void *data)
+{
+	return crypto_hash_file_multi_internal(file, hashalgos, n, NULL, cb, data);
+}
+
+int
+crypto_hash_file_follow_multi(const char *file, uint64_t size, const crypto_hashalgo_t *hashalgos,
+			      size_t n, crypto_hash_multi_callback_t cb, void *data)
+{
+	return crypto_hash_file_multi_internal(file, hashalgos, n, &size, cb, data);
+}
+
 int
 crypto_hash_buf(const unsigned char *buf, size_t buf_len, crypto_hashalgo_t hashalgo,
 		crypto_hash_buf_callback_t cb, void *data)
@@ -553,6 +818,25 @@ crypto_verify_buf(unsigned char *data_buf, size_t data_buf_len, unsigned char *s
 	return 0;
 }
 
+static char *
+crypto_hash_file_response_to_hex_new(const TokenToDaemon *msg, const char *file)
+{
+	switch (msg->code) {
+	// deal with CRYPTO_HASH_* cases
+	case TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK:
+		if (msg->has_hash_value)
+			return convert_bin_to_hex_new(msg->hash_value.data, msg->hash_value.len);
+		ERROR("Missing hash_value in CRYPTO_HASH_OK response for file %s", file);
+		break;
+	case TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR:
+		ERROR("Hashing file %s failed!", file);
+		break;
+	default:
+		ERROR("Invalid TokenToDaemon command %d when hashing file %s", msg->code, file);
+	}
+	return NULL;
+}
+
 char *
 crypto_hash_file_block_new(const char *file, crypto_hashalgo_t hashalgo)
 {
@@ -570,20 +854,281 @@ crypto_hash_file_block_new(const char *file, crypto_hashalgo_t hashalgo)
 
 	IF_NULL_RETVAL(msg, NULL);
 
+	ret = crypto_hash_file_response_to_hex_new(msg, file);
+	protobuf_free_message((ProtobufCMessage *)msg);
+	return ret;
+}
+
+/*
+ * Sends n requests built by request_cb on the blocking connection, keeping up
+ * to max_inflight of them in flight, and passes each response to response_cb.
+ * The scd handles the requests of a connection concurrently in its worker pool.
+ * If response_cb returns false, no further requests are sent, but the responses
+ * of requests already in flight are still received.
+ */
+typedef void (*crypto_block_request_cb_t)(size_t i, DaemonToToken *out, void *data);
+typedef bool (*crypto_block_response_cb_t)(size_t i, const TokenToDaemon *msg, void *data);
+
+static int
+crypto_send_recv_block_pipelined(size_t n, unsigned int max_inflight,
+				 crypto_block_request_cb_t request_cb,
+				 crypto_block_response_cb_t response_cb, void *data)
+{
+	ASSERT(max_inflight > 0);
+
+	int ret = -1;
+	uint32_t *request_ids = mem_new0(uint32_t, n); // 0 if not in flight
+	size_t next = 0;
+	unsigned int inflight = 0;
+	bool stop = false;
+
+	crypto_block_check_owner();
+
+	while (inflight > 0 || (!stop && next < n)) {
+		for (; !stop && next < n && inflight < max_inflight; next++, inflight++) {
+			DaemonToToken out = DAEMON_TO_TOKEN__INIT;
+			request_cb(next, &out, data);
+			out.has_request_id = true;
+			out.request_id = request_ids[next] = crypto_request_id_next();
+			IF_TRUE_GOTO(crypto_block_send(&out) < 0, out);
+		}
+
+		TokenToDaemon *msg = (TokenToDaemon *)protobuf_recv_message(
+			crypto_block_sock, &token_to_daemon__descriptor);
+		if (!msg) {
+			ERROR("Failed to receive response from scd on sock %d", crypto_block_sock);
+			close(crypto_block_sock);
+			crypto_block_sock = -1;
+			goto out;
+		}
+
+		size_t i;
+		for (i = 0; i < next; i++) {
+			if (request_ids[i] && msg->has_request_id &&
+			    msg->request_id == request_ids[i])
+				break;
+		}
+		if (i == next) {
+			// a stale response of a request which failed before
+			WARN("Dropping response for request %u from scd", msg->request_id);
+		} else {
+			request_ids[i] = 0;
+			inflight--;
+			if (!response_cb(i, msg, data))
+				stop = true;
+		}
+		protobuf_free_message((ProtobufCMessage *)msg);
+	}
+	ret = 0;
+
+out:
+	mem_free0(request_ids);
+	return ret;
+}
+
+typedef struct crypto_hash_files_block {
+	const char *const *files;
+	const crypto_hashalgo_t *hashalgos;
+	char **hashes;
+} crypto_hash_files_block_t;
+
+static void
+crypto_hash_files_block_request_cb(size_t i, DaemonToToken *out, void *data)
+{
+	crypto_hash_files_block_t *task = data;
+
+	out->code = DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE;
+	out->has_hash_algo = true;
+	out->hash_algo = crypto_hashalgo_to_proto(task->hashalgos[i]);
+	out->hash_file = (char *)task->files[i];
+	TRACE("Requesting scd to hash file at %s", task->files[i]);
+}
+
+static bool
+crypto_hash_files_block_response_cb(size_t i, const TokenToDaemon *msg, void *data)
+{
+	crypto_hash_files_block_t *task = data;
+
+	task->hashes[i] = crypto_hash_file_response_to_hex_new(msg, task->files[i]);
+	return true;
+}
+
+char **
+crypto_hash_files_block_new(const char *const *files, const crypto_hashalgo_t *hashalgos,
+			    size_t n, unsigned int max_inflight)
+{
+	ASSERT(files);
+	ASSERT(hashalgos);
+
+	crypto_hash_files_block_t task = { .files = files,
+					   .hashalgos = hashalgos,
+					   .hashes = mem_new0(char *, n) };
+
+	crypto_send_recv_block_pipelined(n, max_inflight, crypto_hash_files_block_request_cb,
+					 crypto_hash_files_block_response_cb, &task);
+	return task.hashes;
+}
+
+typedef struct crypto_hash_file_ranges {
+	const char *file;
+	crypto_hashalgo_t hashalgo;
+	const uint64_t *offsets;
+	const uint64_t *lens;
+	uint32_t block_size;
+	const uint8_t *salt;
+	size_t salt_len;
+	crypto_hash_ranges_callback_t cb;
+	void *data;
+} crypto_hash_file_ranges_t;
+
+static void
+crypto_hash_file_ranges_request_cb(size_t i, DaemonToToken *out, void *data)
+{
+	crypto_hash_file_ranges_t *task = data;
+
+	out->code = DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE_BLOCKS;
+	out->has_hash_algo = true;
+	out->hash_algo = crypto_hashalgo_to_proto(task->hashalgo);
+	out->hash_file = (char *)task->file;
+	out->has_hash_offset = true;
+	out->hash_offset = task->offsets[i];
+	out->has_hash_length = true;
+	out->hash_length = task->lens[i];
+	out->has_hash_block_size = true;
+	out->hash_block_size = task->block_size;
+	if (task->salt_len) {
+		out->has_hash_salt = true;
+		out->hash_salt.data = (uint8_t *)task->salt;
+		out->hash_salt.len = task->salt_len;
+	}
+}
+
+static bool
+crypto_hash_file_ranges_response_cb(size_t i, const TokenToDaemon *msg, void *data)
+{
+	crypto_hash_file_ranges_t *task = data;
+	uint8_t *hashes = NULL;
+	size_t hash_len = 0;
+	bool ret;
+
+	if (msg->code != TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK || msg->n_hash_values == 0) {
+		ERROR("Hashing blocks at %" PRIu64 " of file %s failed!", task->offsets[i],
+		      task->file);
+		goto out;
+	}
+
+	// pass the digests of all blocks of the range as one buffer
+	hash_len = msg->hash_values[0].len;
+	hashes = mem_alloc0(hash_len * msg->n_hash_values);
+	for (size_t j = 0; j < msg->n_hash_values; j++) {
+		if (msg->hash_values[j].len != hash_len) {
+			ERROR("Inconsistent block hashes for file %s", task->file);
+			mem_free0(hashes);
+			goto out;
+		}
+		memcpy(hashes + j * hash_len, msg->hash_values[j].data, hash_len);
+	}
+
+out:
+	ret = task->cb(i, hashes, hash_len, hashes ? msg->n_hash_values : 0, task->data);
+	if (hashes)
+		mem_free0(hashes);
+	return ret;
+}
+
+int
+crypto_hash_file_ranges_block(const char *file, crypto_hashalgo_t hashalgo,
+			      const uint64_t *offsets, const uint64_t *lens, size_t n,
+			      uint32_t block_size, const uint8_t *salt, size_t salt_len,
+			      unsigned int max_inflight, crypto_hash_ranges_callback_t cb,
+			      void *data)
+{
+	ASSERT(file);
+	ASSERT(offsets);
+	ASSERT(lens);
+	ASSERT(cb);
+
+	crypto_hash_file_ranges_t task = { .file = file,
+					   .hashalgo = hashalgo,
+					   .offsets = offsets,
+					   .lens = lens,
+					   .block_size = block_size,
+					   .salt = salt,
+					   .salt_len = salt_len,
+					   .cb = cb,
+					   .data = data };
+
+	return crypto_send_recv_block_pipelined(n, max_inflight,
+						crypto_hash_file_ranges_request_cb,
+						crypto_hash_file_ranges_response_cb, &task);
+}
+
+char *
+crypto_hash_buf_block_new(const unsigned char *buf, size_t buf_len, crypto_hashalgo_t hashalgo)
+{
+	ASSERT(buf);
+	char *ret = NULL;
+
+	DaemonToToken out = DAEMON_TO_TOKEN__INIT;
+	out.code = DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_BUF;
+	out.has_hash_algo = true;
+	out.hash_algo = crypto_hashalgo_to_proto(hashalgo);
+	out.has_hash_buf = true;
+	out.hash_buf.data = (uint8_t *)buf;
+	out.hash_buf.len = buf_len;
+
+	TokenToDaemon *msg = crypto_send_recv_block(&out);
+	IF_NULL_RETVAL(msg, NULL);
+
 	switch (msg->code) {
 	// deal with CRYPTO_HASH_* cases
 	case TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK:
 		if (msg->has_hash_value) {
 			ret = convert_bin_to_hex_new(msg->hash_value.data, msg->hash_value.len);
 		} else {
-			ERROR("Missing hash_value in CRYPTO_HASH_OK response for file %s", file);
+			ERROR("Missing hash_value in CRYPTO_HASH_OK response for buf");
 		}
 		break;
 	case TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR:
-		ERROR("Hashing file %s failed!", file);
+		ERROR("Hashing buf of len %zu failed!", buf_len);
 		break;
 	default:
-		ERROR("Invalid TokenToDaemon command %d when hashing file %s", msg->code, file);
+		ERROR("Invalid TokenToDaemon command %d when hashing buf", msg->code);
+	}
+	protobuf_free_message((ProtobufCMessage *)msg);
+	return ret;
+}
+
+char *
+crypto_hmac_buf_block_new(const unsigned char *buf, size_t buf_len, crypto_hashalgo_t hashalgo)
+{
+	ASSERT(buf);
+	char *ret = NULL;
+
+	DaemonToToken out = DAEMON_TO_TOKEN__INIT;
+	out.code = DAEMON_TO_TOKEN__CODE__CRYPTO_HMAC_BUF;
+	out.has_hash_algo = true;
+	out.hash_algo = crypto_hashalgo_to_proto(hashalgo);
+	out.has_hash_buf = true;
+	out.hash_buf.data = (uint8_t *)buf;
+	out.hash_buf.len = buf_len;
+
+	TokenToDaemon *msg = crypto_send_recv_block(&out);
+	IF_NULL_RETVAL(msg, NULL);
+
+	switch (msg->code) {
+	case TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK:
+		if (msg->has_hash_value) {
+			ret = convert_bin_to_hex_new(msg->hash_value.data, msg->hash_value.len);
+		} else {
+			ERROR("Missing hash_value in CRYPTO_HASH_OK response for hmac");
+		}
+		break;
+	case TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR:
+		ERROR("Computing hmac of buf of len %zu failed!", buf_len);
+		break;
+	default:
+		ERROR("Invalid TokenToDaemon command %d when computing hmac", msg->code);
 	}
 	protobuf_free_message((ProtobufCMessage *)msg);
 	return ret;
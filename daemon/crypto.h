@@ -25,6 +25,8 @@
 #define CRYPTO_H
 
 #include "stdbool.h"
+#include <stddef.h>
+#include <stdint.h>
 
 /**
  * Choice of supported hash algorithms.
@@ -37,6 +39,15 @@ typedef enum crypto_hashalgo { SHA1, SHA256, SHA512 } crypto_hashalgo_t;
 typedef void (*crypto_hash_callback_t)(const char *hash_string, const char *hash_file,
 				       crypto_hashalgo_t hash_algo, void *data);
 
+/**
+ * Callback function for receiving the results of a multi hash operation. (file)
+ * hash_strings holds one hash per algorithm in hash_algos or is NULL on error.
+ */
+typedef void (*crypto_hash_multi_callback_t)(const char *const *hash_strings,
+					     const char *hash_file,
+					     const crypto_hashalgo_t *hash_algos, size_t n,
+					     void *data);
+
 /**
  * Callback function for receiving the result of a hash operation. (buffer)
  */
@@ -57,6 +68,39 @@ int
 crypto_hash_file(const char *file, crypto_hashalgo_t hashalgo, crypto_hash_callback_t cb,
 		 void *data);
 
+/**
+ * Requests the scd to hash the given file with several hash algorithms in a
+ * single pass over the file and report the hashes to the given callback.
+ *
+ * @param file the file to hash
+ * @param hashalgos the hash algorithms to use
+ * @param n the number of hash algorithms
+ * @param cb the callback to receive the result
+ * @param data custom data parameter to pass to the callback
+ * @return 0 if the hash request was sent and the callback is expected to be called, -1 otherwise
+ */
+int
+crypto_hash_file_multi(const char *file, const crypto_hashalgo_t *hashalgos, size_t n,
+		       crypto_hash_multi_callback_t cb, void *data);
+
+/**
+ * Like crypto_hash_file_multi(), but for a file which is still being written,
+ * e.g., by a download. The scd hashes the data as it arrives, so that the hashes
+ * are reported as soon as the file has reached the given size. Removing the
+ * file aborts the request.
+ *
+ * @param file the file to hash
+ * @param size the final size of the file
+ * @param hashalgos the hash algorithms to use
+ * @param n the number of hash algorithms
+ * @param cb the callback to receive the result
+ * @param data custom data parameter to pass to the callback
+ * @return 0 if the hash request was sent and the callback is expected to be called, -1 otherwise
+ */
+int
+crypto_hash_file_follow_multi(const char *file, uint64_t size, const crypto_hashalgo_t *hashalgos,
+			      size_t n, crypto_hash_multi_callback_t cb, void *data);
+
 /**
  * Requests the scd to hash the given buffer and report the hash to the given callback.
  *
@@ -80,6 +124,72 @@ crypto_hash_buf(const unsigned char *buf, size_t buf_len, crypto_hashalgo_t hash
 char *
 crypto_hash_file_block_new(const char *file, crypto_hashalgo_t hashalgo);
 
+/**
+ * Requests the scd to hash the given files, keeping up to max_inflight requests
+ * in flight so that the scd hashes them concurrently, and waits for all results.
+ *
+ * @param files the files to hash
+ * @param hashalgos the hash algorithm to use for each file
+ * @param n the number of files
+ * @param max_inflight the maximum number of concurrent requests
+ * @return newly allocated array of n newly allocated hash strings, an entry is
+ * NULL if hashing the corresponding file failed
+ */
+char **
+crypto_hash_files_block_new(const char *const *files, const crypto_hashalgo_t *hashalgos,
+			    size_t n, unsigned int max_inflight);
+
+/**
+ * Callback for crypto_hash_file_ranges_block() delivering the digests of the
+ * blocks of the i-th range.
+ *
+ * @param i the index of the range
+ * @param hashes the n_hashes concatenated block digests of hash_len bytes,
+ * or NULL on error
+ * @return false to stop sending requests for further ranges
+ */
+typedef bool (*crypto_hash_ranges_callback_t)(size_t i, const uint8_t *hashes, size_t hash_len,
+					      size_t n_hashes, void *data);
+
+/**
+ * Requests the scd to hash each block of block_size bytes of the n ranges
+ * [offsets[i], offsets[i] + lens[i]) of file individually, prefixed with salt
+ * if given. Up to max_inflight requests are kept in flight so that the scd
+ * hashes the ranges concurrently; the digests are delivered via cb (blocking).
+ *
+ * @return 0 if a response has been delivered for each requested range, -1 on error
+ */
+int
+crypto_hash_file_ranges_block(const char *file, crypto_hashalgo_t hashalgo,
+			      const uint64_t *offsets, const uint64_t *lens, size_t n,
+			      uint32_t block_size, const uint8_t *salt, size_t salt_len,
+			      unsigned int max_inflight, crypto_hash_ranges_callback_t cb,
+			      void *data);
+
+/**
+ * Requests the scd to hash the given buffer, wait for the result and directly return it.
+ *
+ * @param buf the buffer to hash
+ * @param buf_len the size of the buffer to hash
+ * @param hashalgo the hash algorithm to use
+ * @return pointer to a newly allocated string with the hash value, or NULL on error
+ */
+char *
+crypto_hash_buf_block_new(const unsigned char *buf, size_t buf_len, crypto_hashalgo_t hashalgo);
+
+/**
+ * Requests the scd to compute the hmac of the given buffer with its device local
+ * hmac key, wait for the result and directly return it. As the key never leaves
+ * the scd, the hmac protects data stored by the cmld against modifications.
+ *
+ * @param buf the buffer to authenticate
+ * @param buf_len the size of the buffer
+ * @param hashalgo the hash algorithm to use for the hmac
+ * @return pointer to a newly allocated string with the hmac, or NULL on error
+ */
+char *
+crypto_hmac_buf_block_new(const unsigned char *buf, size_t buf_len, crypto_hashalgo_t hashalgo);
+
 /**
  * Result of a signature verification.
  */
@@ -235,3 +235,30 @@ device_config_get_audit_size(const device_config_t *config)
 
 	return config->cfg->audit_size;
 }
+
+uint32_t
+device_config_get_image_verify_workers(const device_config_t *config)
+{
+	ASSERT(config);
+	ASSERT(config->cfg);
+
+	return config->cfg->image_verify_workers;
+}
+
+uint32_t
+device_config_get_download_parallel_ranges(const device_config_t *config)
+{
+	ASSERT(config);
+	ASSERT(config->cfg);
+
+	return config->cfg->download_parallel_ranges;
+}
+
+uint32_t
+device_config_get_download_rate_limit(const device_config_t *config)
+{
+	ASSERT(config);
+	ASSERT(config->cfg);
+
+	return config->cfg->download_rate_limit;
+}
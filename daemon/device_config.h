@@ -89,6 +89,18 @@ device_config_get_signed_configs(const device_config_t *config);
 uint64_t
 device_config_get_audit_size(const device_config_t *config);
 
+uint32_t
+device_config_get_image_verify_workers(const device_config_t *config);
+
+uint32_t
+device_config_get_download_parallel_ranges(const device_config_t *config);
+
+/**
+ * Returns the bandwidth limit for image downloads in KiB/s, 0 for no limit.
+ */
+uint32_t
+device_config_get_download_rate_limit(const device_config_t *config);
+
 bool
 device_config_get_tpm_enabled(const device_config_t *config);
 #endif /* DEVICE_H */
@@ -27,10 +27,12 @@
 #include "common/mem.h"
 #include "common/event.h"
 #include "common/file.h"
+#include "common/http_download.h"
 
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 #include <signal.h>
 #include <unistd.h>
 
@@ -41,14 +43,39 @@ struct download {
 	char *url;
 	char *file;
 	download_callback_t on_complete;
+	download_progress_callback_t on_progress;
 	void *data;
+	bool resume;
 	pid_t wget_pid;
+	http_download_t *http; // in-process download of http:// URLs
+	// hashing while downloading
+	crypto_hashalgo_t *hash_algos;
+	size_t n_hashes;
+	uint64_t hash_size;
+	char **hashes;	   // digests, NULL if not (yet) available
+	bool hash_pending; // a hash request is in flight at the scd
+	bool dl_done;	   // the download helper has terminated
+	bool dl_success;
 };
 
+static unsigned int download_parallel_ranges = 1;
+
+void
+download_set_parallel_ranges(unsigned int ranges)
+{
+	download_parallel_ranges = MAX(ranges, 1u);
+}
+
+void
+download_set_rate_limit(uint64_t bytes_per_sec)
+{
+	http_download_set_rate_limit(bytes_per_sec);
+}
+
 download_t *
 download_new(const char *url, const char *file, download_callback_t on_complete, void *data)
 {
-	download_t *dl = mem_new(download_t, 1);
+	download_t *dl = mem_new0(download_t, 1);
 	dl->url = mem_strdup(url);
 	dl->file = mem_strdup(file);
 	dl->on_complete = on_complete;
@@ -60,65 +87,214 @@ void
 download_free(download_t *dl)
 {
 	IF_NULL_RETURN(dl);
+	ASSERT(!dl->hash_pending);
+	if (dl->http)
+		http_download_free(dl->http);
 	mem_free0(dl->url);
 	mem_free0(dl->file);
+	if (dl->hashes) {
+		for (size_t i = 0; i < dl->n_hashes; i++)
+			mem_free0(dl->hashes[i]);
+		mem_free0(dl->hashes);
+	}
+	if (dl->hash_algos)
+		mem_free0(dl->hash_algos);
 	mem_free0(dl);
 }
 
+/*
+ * Reports the result once both the download helper and hashing are done.
+ */
+static void
+download_complete_if_done(download_t *dl)
+{
+	IF_FALSE_RETURN(dl->dl_done && !dl->hash_pending);
+
+	if (dl->hashes && !dl->dl_success) {
+		for (size_t i = 0; i < dl->n_hashes; i++)
+			mem_free0(dl->hashes[i]);
+		mem_free0(dl->hashes);
+	}
+	dl->on_complete(dl, dl->dl_success, dl->data);
+}
+
+/*
+ * Records the result of the download itself, the file is removed on failure if
+ * it is still being hashed.
+ */
 static void
-download_sigchld_cb(UNUSED int signum, event_signal_t *sig, void *data)
+download_set_done(download_t *dl, bool success)
+{
+	dl->dl_done = true;
+	dl->dl_success = success;
+	if (dl->hash_pending && !success) {
+		// the partial file is useless, removing it aborts hashing at the scd
+		if (unlink(dl->file) < 0 && errno != ENOENT)
+			WARN_ERRNO("Could not remove partial download %s", dl->file);
+	}
+	download_complete_if_done(dl);
+}
+
+static void
+download_child_cb(pid_t pid, int status, event_child_watch_t *watch, void *data)
 {
 	download_t *dl = data;
 	ASSERT(dl);
-	pid_t wget_pid = dl->wget_pid;
-	pid_t pid = 0;
-	int status = 0;
-	DEBUG("SIGCHLD handler called for wget (PID=%d)", wget_pid);
-	if (wget_pid <= 0) {
-		DEBUG("wget PID not yet set; returning");
-		return;
+
+	bool success = false;
+	if (status == -1) {
+		WARN("Could not get exit status of download helper (PID=%d)", pid);
+	} else if (WIFEXITED(status)) {
+		DEBUG("wget terminated with status=%d", WEXITSTATUS(status));
+		success = !WEXITSTATUS(status);
+	} else if (WIFSIGNALED(status)) {
+		DEBUG("wget killed by signal %d", WTERMSIG(status));
 	}
-	bool remove = false;
-	while ((pid = waitpid(wget_pid, &status, WNOHANG))) {
-		if (pid == wget_pid) {
-			bool success = false;
-			if (WIFEXITED(status)) {
-				DEBUG("wget terminated with status=%d", WEXITSTATUS(status));
-				success = !WEXITSTATUS(status);
-			} else if (WIFSIGNALED(status)) {
-				DEBUG("wget killed by signal %d", WTERMSIG(status));
-			} else {
-				continue;
-			}
-			remove = true;
-			dl->on_complete(dl, success, dl->data);
-		} else if (pid == 0) {
-			DEBUG("waitpid child(ren) (PID %d) exist without state change", wget_pid);
-			break;
-		} else if (pid == -1) {
-			if (errno == ECHILD)
-				DEBUG("Process group of wget terminated completely");
-			else
-				WARN_ERRNO("waitpid failed for wget");
-			remove = true;
-			break;
-		} else {
-			DEBUG("Reaped a child with PID %d for wget", pid);
-		}
+
+	event_child_watch_free(watch);
+
+	download_set_done(dl, success);
+}
+
+static int
+download_start_wget(download_t *dl, bool resume, bool hash);
+
+static void
+download_http_complete_cb(http_download_t *http, bool success, void *data)
+{
+	download_t *dl = data;
+	ASSERT(dl);
+
+	// e.g., redirected to https://, which is left to wget, nothing has been received yet
+	if (!success && http_download_is_redirect_unsupported(http)) {
+		DEBUG("Falling back to wget to download %s", dl->url);
+		// a hash of the file which is already pending keeps following it
+		if (download_start_wget(dl, dl->resume && file_size(dl->file) > 0, false) == 0)
+			return;
+	}
+	download_set_done(dl, success);
+}
+
+static void
+download_http_progress_cb(UNUSED http_download_t *http, uint64_t received, uint64_t total,
+			  void *data)
+{
+	download_t *dl = data;
+	ASSERT(dl);
+
+	if (dl->on_progress)
+		dl->on_progress(dl, received, total, dl->data);
+}
+
+static void
+download_hash_cb(const char *const *hash_strings, UNUSED const char *hash_file,
+		 UNUSED const crypto_hashalgo_t *hash_algos, size_t n, void *data)
+{
+	download_t *dl = data;
+	ASSERT(dl);
+
+	dl->hash_pending = false;
+	if (hash_strings) {
+		dl->hashes = mem_new0(char *, n);
+		for (size_t i = 0; i < n; i++)
+			dl->hashes[i] = mem_strdup(hash_strings[i]);
+		DEBUG("Hashed %s while downloading", dl->file);
+	} else {
+		DEBUG("Hashing %s while downloading failed", dl->file);
 	}
-	if (remove) {
-		event_remove_signal(sig);
-		event_signal_free(sig);
+	download_complete_if_done(dl);
+}
+
+static bool
+download_prepare_hash(download_t *dl)
+{
+	IF_TRUE_RETVAL(dl->n_hashes == 0, false);
+
+	// the scd follows the file from the start, so it must exist beforehand
+	int fd = open(dl->file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 00666);
+	if (fd < 0) {
+		WARN_ERRNO("Could not create %s, not hashing it while downloading", dl->file);
+		return false;
 	}
+	close(fd);
+	return true;
 }
 
-int
-download_start(download_t *dl)
+static void
+download_start_hash(download_t *dl)
+{
+	if (crypto_hash_file_follow_multi(dl->file, dl->hash_size, dl->hash_algos, dl->n_hashes,
+					  download_hash_cb, dl) < 0) {
+		WARN("Could not request hashing %s while downloading", dl->file);
+		return;
+	}
+	dl->hash_pending = true;
+}
+
+void
+download_set_hash(download_t *dl, const crypto_hashalgo_t *hashalgos, size_t n, uint64_t size)
 {
 	ASSERT(dl);
+	ASSERT(hashalgos);
+	ASSERT(dl->n_hashes == 0);
+
+	dl->hash_algos = mem_new0(crypto_hashalgo_t, n);
+	memcpy(dl->hash_algos, hashalgos, n * sizeof(crypto_hashalgo_t));
+	dl->n_hashes = n;
+	dl->hash_size = size;
+}
+
+void
+download_set_resume(download_t *dl, bool resume)
+{
+	ASSERT(dl);
+	dl->resume = resume;
+}
+
+void
+download_set_progress_cb(download_t *dl, download_progress_callback_t on_progress)
+{
+	ASSERT(dl);
+	dl->on_progress = on_progress;
+}
+
+const char *const *
+download_get_hashes(const download_t *dl)
+{
+	ASSERT(dl);
+	return (const char *const *)dl->hashes;
+}
+
+static int
+download_start_http(download_t *dl)
+{
+	bool resume = dl->resume && file_size(dl->file) > 0;
+	// the scd follows the file from its start, which only works for a single range
+	bool hash = !resume && download_parallel_ranges <= 1 && download_prepare_hash(dl);
+
+	if (!dl->http)
+		dl->http = http_download_new(dl->url, dl->file, download_parallel_ranges,
+					     download_http_complete_cb, download_http_progress_cb,
+					     dl);
+	IF_NULL_RETVAL(dl->http, -1);
+
+	if (http_download_start(dl->http, resume) < 0) {
+		ERROR("Could not start download of %s", dl->url);
+		return -1;
+	}
+	if (hash)
+		download_start_hash(dl);
+	return 0;
+}
+
+static int
+download_start_wget(download_t *dl, bool resume, bool hash)
+{
 	pid_t pid = fork();
 
-	char *const argv[] = { WGET_PATH, "-O", dl->file, dl->url, NULL };
+	char *const argv_resume[] = { WGET_PATH, "-c", "-O", dl->file, dl->url, NULL };
+	char *const argv_new[] = { WGET_PATH, "-O", dl->file, dl->url, NULL };
+	char *const *argv = resume ? argv_resume : argv_new;
 	bool do_file_copy = strlen(dl->url) > 7 && !strncmp(dl->url, "file://", 7);
 
 	switch (pid) {
@@ -143,13 +319,38 @@ download_start(download_t *dl)
 	default:
 		DEBUG("Started download helper (%s) with PID %d",
 		      do_file_copy ? "file_copy" : "wget", pid);
+		event_child_watch_t *watch = event_child_watch_new(pid, download_child_cb, dl);
+		if (event_add_child_watch(watch) < 0) {
+			ERROR("Could not watch download helper (PID=%d)", pid);
+			event_child_watch_free(watch);
+			kill(pid, SIGKILL);
+			waitpid(pid, NULL, 0);
+			return -1;
+		}
 		dl->wget_pid = pid;
-		event_signal_t *sig = event_signal_new(SIGCHLD, download_sigchld_cb, dl);
-		event_add_signal(sig);
+		// the helper is only reaped by the event loop, i.e., after the request is sent
+		if (hash)
+			download_start_hash(dl);
 		return 0;
 	}
 }
 
+int
+download_start(download_t *dl)
+{
+	ASSERT(dl);
+
+	dl->dl_done = false;
+	dl->dl_success = false;
+
+	if (http_download_url_is_supported(dl->url))
+		return download_start_http(dl);
+
+	bool resume = dl->resume && file_size(dl->file) > 0;
+	bool hash = !resume && download_prepare_hash(dl);
+	return download_start_wget(dl, resume, hash);
+}
+
 const char *
 download_get_url(const download_t *dl)
 {
@@ -26,10 +26,14 @@
 
 /**
  * @file downloader.h Defines an API to download files.
- * Uses 'wget' for now to do the actual work.
+ * http:// URLs are downloaded in-process by the http_download module, other
+ * URLs by a 'wget' helper process, file:// URLs are copied.
  */
 
+#include "crypto.h"
+
 #include <stdbool.h>
+#include <stdint.h>
 
 /**
  * A structure representing a download.
@@ -41,6 +45,28 @@ typedef struct download download_t;
  */
 typedef void (*download_callback_t)(download_t *dl, bool success, void *data);
 
+/**
+ * Callback type for functions called to report the progress of a download.
+ * The total size is 0 if it is not known (yet).
+ */
+typedef void (*download_progress_callback_t)(download_t *dl, uint64_t received, uint64_t total,
+					     void *data);
+
+/**
+ * Sets the maximum number of connections used to download parts of a single
+ * file over HTTP in parallel. Files downloaded with more than one connection
+ * are not hashed while downloading (see download_set_hash()).
+ */
+void
+download_set_parallel_ranges(unsigned int ranges);
+
+/**
+ * Limits the bandwidth used by all HTTP downloads together.
+ * @param bytes_per_sec the limit in bytes per second, 0 for no limit
+ */
+void
+download_set_rate_limit(uint64_t bytes_per_sec);
+
 /**
  * Instantiates a new download that will, once started, download from the given URL
  * to the given file and call the given callback on completion passing the data parameter.
@@ -68,6 +94,43 @@ download_free(download_t *dl);
 int
 download_start(download_t *dl);
 
+/**
+ * Lets the download continue an existing partial file instead of starting
+ * from scratch. Must be called before download_start().
+ */
+void
+download_set_resume(download_t *dl, bool resume);
+
+/**
+ * Sets a callback to report the progress of the download, which is passed the
+ * data parameter given to download_new(). Progress is only reported for
+ * downloads over HTTP. Must be called before download_start().
+ */
+void
+download_set_progress_cb(download_t *dl, download_progress_callback_t on_progress);
+
+/**
+ * Lets the scd hash the downloaded file while it is being written, so that its
+ * digests are available as soon as the download is complete, without reading
+ * the file again. The completion callback is only called once the hashes have
+ * been computed, too. A resumed download is not hashed. Must be called before
+ * download_start().
+ * @param dl the download instance
+ * @param hashalgos the hash algorithms to use
+ * @param n the number of hash algorithms
+ * @param size the expected size of the downloaded file
+ */
+void
+download_set_hash(download_t *dl, const crypto_hashalgo_t *hashalgos, size_t n, uint64_t size);
+
+/**
+ * Returns the digests of the downloaded file in the order of the hash algorithms
+ * given to download_set_hash(), or NULL if they are not available, e.g., because
+ * hashing failed or the file was not completely written.
+ */
+const char *const *
+download_get_hashes(const download_t *dl);
+
 /**
  * Returns the URL of the given download instance.
  */
@@ -27,6 +27,11 @@
 #include "download.h"
 #include "cmld.h"
 #include "crypto.h"
+#include "hash_cache.h"
+#include "image_chunks.h"
+#include "image_delta.h"
+#include "image_store.h"
+#include "guestos_mgr.h"
 #include "a_b_update/a_b_update.h"
 #include "tss.h"
 
@@ -35,10 +40,13 @@
 #include "common/dir.h"
 #include "common/file.h"
 #include "common/sock.h"
+#include "common/event.h"
 
 #include <fcntl.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 #include <inttypes.h>
@@ -65,6 +73,9 @@ struct guestos {
 
 #define GUESTOS_FLASH_BACKUP_DIR "os_update_bak"
 
+// maximum number of images which are verified concurrently, 0 for online CPUs
+static unsigned int guestos_verify_workers = 0;
+
 /******************************************************************************/
 
 char *
@@ -196,7 +207,9 @@ typedef void (*check_mount_image_complete_cb)(guestos_check_mount_image_result_t
 typedef struct check_mount_image {
 	guestos_t *os;
 	mount_entry_t *e;
-	char *img_path; // free me after use
+	char *img_path;	      // free me after use
+	struct stat img_stat; // status of the image before it has been hashed
+	bool cache;	      // whether the digests may be cached
 	check_mount_image_complete_cb cb;
 	void *data;
 } check_mount_image_t;
@@ -205,7 +218,7 @@ static check_mount_image_t *
 check_mount_image_new(guestos_t *os, mount_entry_t *e, char *img_path,
 		      check_mount_image_complete_cb cb, void *data)
 {
-	check_mount_image_t *task = mem_new(check_mount_image_t, 1);
+	check_mount_image_t *task = mem_new0(check_mount_image_t, 1);
 	task->os = os;
 	task->e = e;
 	task->cb = cb;
@@ -222,36 +235,55 @@ check_mount_image_free(check_mount_image_t *task)
 	mem_free0(task);
 }
 
+// digests computed by the non-blocking image check and while downloading an image
+static const crypto_hashalgo_t guestos_image_hash_algos[] = { SHA1, SHA256 };
+#define GUESTOS_IMAGE_HASH_ALGOS_N                                                                 \
+	(sizeof(guestos_image_hash_algos) / sizeof(guestos_image_hash_algos[0]))
+
+/*
+ * Checks the digests of an image, computed with guestos_image_hash_algos,
+ * against the mount entry.
+ */
+static bool
+guestos_match_mount_image_hashes(const mount_entry_t *e, const char *const *hash_strings)
+{
+	return mount_entry_match_sha1(e, hash_strings[0]) &&
+	       mount_entry_match_sha256(e, hash_strings[1]);
+}
+
 static void
-check_mount_image_cb_sha256(const char *hash_string, UNUSED const char *hash_file,
-			    UNUSED crypto_hashalgo_t hash_algo, void *data)
+check_mount_image_cb_hashes(const char *const *hash_strings, UNUSED const char *hash_file,
+			    UNUSED const crypto_hashalgo_t *hash_algos, UNUSED size_t n, void *data)
 {
 	check_mount_image_t *task = data;
 	ASSERT(task);
 
-	bool match = mount_entry_match_sha256(task->e, hash_string);
+	bool match = hash_strings && guestos_match_mount_image_hashes(task->e, hash_strings);
+	if (match && task->cache) {
+		// later checks, e.g., on container start, are served from the cache
+		for (size_t i = 0; i < GUESTOS_IMAGE_HASH_ALGOS_N; i++)
+			hash_cache_put(task->img_path, &task->img_stat, guestos_image_hash_algos[i],
+				       hash_strings[i]);
+	}
 	task->cb(match ? CHECK_IMAGE_GOOD : CHECK_IMAGE_HASH_MISMATCH, task->os, task->e,
 		 task->data);
 
 	check_mount_image_free(task);
 }
 
-static void
-check_mount_image_cb_sha1(const char *hash_string, UNUSED const char *hash_file,
-			  UNUSED crypto_hashalgo_t hash_algo, void *data)
+void
+guestos_set_verify_workers(unsigned int workers)
 {
-	check_mount_image_t *task = data;
-	ASSERT(task);
+	guestos_verify_workers = workers;
+}
 
-	bool match = mount_entry_match_sha1(task->e, hash_string);
-	if (match) {
-		// compute next hash
-		crypto_hash_file(task->img_path, SHA256, check_mount_image_cb_sha256, task);
-		return;
-	}
-	task->cb(CHECK_IMAGE_HASH_MISMATCH, task->os, task->e, task->data);
+static unsigned int
+guestos_get_verify_workers(void)
+{
+	IF_TRUE_RETVAL(guestos_verify_workers > 0, guestos_verify_workers);
 
-	check_mount_image_free(task);
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? (unsigned int)cpus : 1;
 }
 
 static uint8_t *
@@ -280,6 +312,74 @@ err:
 	return NULL;
 }
 
+static void
+guestos_measure_chunks_root(const char *img_path, const char *root)
+{
+	int root_bin_len;
+	uint8_t *root_bin = convert_hex_to_bin_new(root, &root_bin_len);
+	if (root_bin) {
+		tss_ml_append((char *)img_path, root_bin, root_bin_len, TSS_SHA256);
+		mem_free0(root_bin);
+	}
+}
+
+/*
+ * Checks the hashes of the image at img_path against the mount entry. If
+ * cached_only is set, only digests from the hash cache are considered and the
+ * check fails if there are none. Digests which match the signed config are
+ * appended to the measurement log. Images with a chunks root hash are verified
+ * chunk-wise, resuming a previously interrupted verification.
+ */
+static bool
+guestos_check_mount_image_chunks(const char *img_path, const mount_entry_t *e, bool cached_only)
+{
+	image_chunks_t *chunks = image_chunks_new(img_path, e);
+	IF_NULL_RETVAL(chunks, false);
+
+	bool match;
+	if (cached_only)
+		match = image_chunks_is_verified(chunks);
+	else
+		match = image_chunks_verify_block(chunks, 0, mount_entry_get_size(e),
+						  guestos_get_verify_workers(), NULL) == 0;
+	// will only be executed if all chunks match the signed root hash
+	if (match)
+		guestos_measure_chunks_root(img_path, image_chunks_get_root(chunks));
+
+	image_chunks_free(chunks);
+	return match;
+}
+
+static bool
+guestos_check_mount_image_hash(const char *img_path, const mount_entry_t *e, bool cached_only)
+{
+	bool match = false;
+
+	if (mount_entry_get_chunks_root_sha256(e))
+		return guestos_check_mount_image_chunks(img_path, e, cached_only);
+
+	if (mount_entry_get_sha256(e) == NULL) { // fallback to sha1
+		char *sha1 = cached_only ? hash_cache_get_new(img_path, SHA1) :
+					   hash_cache_hash_file_block_new(img_path, SHA1);
+		IF_NULL_RETVAL(sha1, false);
+		match = mount_entry_match_sha1(e, sha1);
+		mem_free0(sha1);
+	} else {
+		char *sha256 = cached_only ? hash_cache_get_new(img_path, SHA256) :
+					     hash_cache_hash_file_block_new(img_path, SHA256);
+		IF_NULL_RETVAL(sha256, false);
+		match = mount_entry_match_sha256(e, sha256);
+		if (match) { // will only be executed if hash matches to signed config
+			int sha256_bin_len;
+			uint8_t *sha256_bin = convert_hex_to_bin_new(sha256, &sha256_bin_len);
+			tss_ml_append((char *)img_path, sha256_bin, sha256_bin_len, TSS_SHA256);
+			mem_free0(sha256_bin);
+		}
+		mem_free0(sha256);
+	}
+	return match;
+}
+
 guestos_check_mount_image_result_t
 guestos_check_mount_image_block(const guestos_t *os, const mount_entry_t *e, bool thorough)
 {
@@ -325,33 +425,87 @@ guestos_check_mount_image_block(const guestos_t *os, const mount_entry_t *e, boo
 		mem_free0(hash_img_path);
 	}
 
-	if (thorough) {
-		bool match = false;
-		if (mount_entry_get_sha256(e) == NULL) { // fallback to sha1
-			char *sha1 = crypto_hash_file_block_new(img_path, SHA1);
-			match = mount_entry_match_sha1(e, sha1);
-			mem_free0(sha1);
-		} else {
-			char *sha256 = crypto_hash_file_block_new(img_path, SHA256);
-			match = mount_entry_match_sha256(e, sha256);
-			if (match) { // will only be executed if hash matches to signed config
-				int sha256_bin_len;
-				uint8_t *sha256_bin =
-					convert_hex_to_bin_new(sha256, &sha256_bin_len);
-				tss_ml_append(img_path, sha256_bin, sha256_bin_len, TSS_SHA256);
-				mem_free0(sha256_bin);
-			}
-			mem_free0(sha256);
-		}
-		if (!match)
-			res = CHECK_IMAGE_HASH_MISMATCH;
-	}
+	if (thorough && !guestos_check_mount_image_hash(img_path, e, false))
+		res = CHECK_IMAGE_HASH_MISMATCH;
 
 cleanup:
 	mem_free0(img_path);
 	return res;
 }
 
+bool
+guestos_check_mount_image_cached(const guestos_t *os, const mount_entry_t *e)
+{
+	ASSERT(os);
+	ASSERT(e);
+
+	char *img_path = mem_printf("%s/%s.img", guestos_get_dir(os), mount_entry_get_img(e));
+	bool ret = guestos_check_mount_image_block(os, e, false) == CHECK_IMAGE_GOOD &&
+		   guestos_check_mount_image_hash(img_path, e, true);
+
+	mem_free0(img_path);
+	return ret;
+}
+
+static bool
+guestos_mount_entry_is_image(const mount_entry_t *e)
+{
+	enum mount_type t = mount_entry_get_type(e);
+	return t == MOUNT_TYPE_SHARED || t == MOUNT_TYPE_FLASH || t == MOUNT_TYPE_OVERLAY_RO ||
+	       t == MOUNT_TYPE_SHARED_RW || t == MOUNT_TYPE_STORE_ONLY;
+}
+
+/*
+ * Hashes the images of the given mount entries concurrently and stores their
+ * digests in the hash cache, so that the subsequent hash checks in
+ * guestos_check_mount_image_hash() are served from the cache. The image of
+ * entries[i] belongs to oses[i].
+ */
+static void
+guestos_hash_images_block(const guestos_t *const *oses, const mount_entry_t *const *entries,
+			  size_t n)
+{
+	IF_TRUE_RETURN(n == 0);
+
+	char **img_paths = mem_new0(char *, n);
+	crypto_hashalgo_t *hash_algos = mem_new0(crypto_hashalgo_t, n);
+	size_t n_files = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		// chunk-wise verified images are not hashed as a whole
+		if (mount_entry_get_chunks_root_sha256(entries[i]))
+			continue;
+		img_paths[n_files] = mem_printf("%s/%s.img", guestos_get_dir(oses[i]),
+						mount_entry_get_img(entries[i]));
+		// same algorithm as used by guestos_check_mount_image_hash()
+		hash_algos[n_files] = mount_entry_get_sha256(entries[i]) ? SHA256 : SHA1;
+		n_files++;
+	}
+
+	hash_cache_hash_files_block((const char *const *)img_paths, hash_algos, n_files,
+				    guestos_get_verify_workers());
+
+	for (size_t i = 0; i < n_files; i++)
+		mem_free0(img_paths[i]);
+	mem_free0(img_paths);
+	mem_free0(hash_algos);
+}
+
+void
+guestos_hash_mount_images_block(const guestos_t *os, const mount_entry_t *const *entries,
+				size_t n)
+{
+	ASSERT(os);
+	IF_TRUE_RETURN(n == 0);
+
+	const guestos_t **oses = mem_new0(const guestos_t *, n);
+	for (size_t i = 0; i < n; i++)
+		oses[i] = os;
+
+	guestos_hash_images_block(oses, entries, n);
+	mem_free0(oses);
+}
+
 bool
 guestos_images_are_complete(guestos_t *os, bool thorough)
 {
@@ -369,25 +523,127 @@ guestos_images_are_complete(guestos_t *os, bool thorough)
 	guestos_fill_mount(os, mnt);	   // append mounts to be checked
 	guestos_fill_mount_setup(os, mnt); // append setup mode mounts to be check
 	size_t n = mount_get_count(mnt);
+	const mount_entry_t **entries = mem_new0(const mount_entry_t *, n);
+	size_t n_images = 0;
 	for (size_t i = 0; i < n; i++) {
 		mount_entry_t *e = mount_get_entry(mnt, i);
-		enum mount_type t = mount_entry_get_type(e);
-		if (t != MOUNT_TYPE_SHARED && t != MOUNT_TYPE_FLASH && t != MOUNT_TYPE_OVERLAY_RO &&
-		    t != MOUNT_TYPE_SHARED_RW && t != MOUNT_TYPE_STORE_ONLY)
+		if (!guestos_mount_entry_is_image(e))
 			continue;
-		if (guestos_check_mount_image_block(os, e, thorough) != CHECK_IMAGE_GOOD) {
+		if (guestos_check_mount_image_block(os, e, false) != CHECK_IMAGE_GOOD) {
 			res = false;
-			break;
+			goto out;
+		}
+		entries[n_images++] = e;
+	}
+
+	if (thorough) {
+		// hash all images concurrently, the checks below use the cached digests
+		guestos_hash_mount_images_block(os, entries, n_images);
+		for (size_t i = 0; i < n_images; i++) {
+			if (guestos_check_mount_image_block(os, entries[i], true) !=
+			    CHECK_IMAGE_GOOD) {
+				res = false;
+				break;
+			}
 		}
 	}
+	// share the verified images with other GuestOSes
+	for (size_t i = 0; thorough && res && i < n_images; i++) {
+		char *img_path = mem_printf("%s/%s.img", guestos_get_dir(os),
+					    mount_entry_get_img(entries[i]));
+		image_store_add(mount_entry_get_sha256(entries[i]), img_path);
+		mem_free0(img_path);
+	}
 
+out:
 	// cache result
 	os->complete = res;
 
+	mem_free0(entries);
 	mount_free(mnt);
 	return res;
 }
 
+static void
+check_mount_image_chunks_child_cb(pid_t pid, int status, event_child_watch_t *watch, void *data)
+{
+	check_mount_image_t *task = data;
+	ASSERT(task);
+
+	event_child_watch_free(watch);
+
+	guestos_check_mount_image_result_t res = CHECK_IMAGE_ERROR;
+	if (WIFEXITED(status) && WEXITSTATUS(status) == CHECK_IMAGE_GOOD) {
+		// the child does not measure, as it shares the connection to tpm2d with cmld
+		guestos_measure_chunks_root(task->img_path,
+					    mount_entry_get_chunks_root_sha256(task->e));
+		res = CHECK_IMAGE_GOOD;
+	} else if (WIFEXITED(status) && WEXITSTATUS(status) == CHECK_IMAGE_HASH_MISMATCH) {
+		res = CHECK_IMAGE_HASH_MISMATCH;
+	} else if (WIFEXITED(status)) {
+		ERROR("Chunk-wise check of image %s failed", task->img_path);
+	} else {
+		ERROR("Chunk-wise check of image %s (pid %d) did not complete", task->img_path,
+		      pid);
+	}
+	task->cb(res, task->os, task->e, task->data);
+
+	check_mount_image_free(task);
+}
+
+/*
+ * Verifies the chunks of an image without measuring them and tells a
+ * corrupted chunk apart from an error during the verification.
+ */
+static guestos_check_mount_image_result_t
+guestos_verify_mount_image_chunks(const char *img_path, const mount_entry_t *e)
+{
+	image_chunks_t *chunks = image_chunks_new(img_path, e);
+	IF_NULL_RETVAL(chunks, CHECK_IMAGE_ERROR);
+
+	ssize_t bad_chunk = -1;
+	int ret = image_chunks_verify_block(chunks, 0, mount_entry_get_size(e),
+					    guestos_get_verify_workers(), &bad_chunk);
+	image_chunks_free(chunks);
+
+	if (ret == 0)
+		return CHECK_IMAGE_GOOD;
+	return bad_chunk >= 0 ? CHECK_IMAGE_HASH_MISMATCH : CHECK_IMAGE_ERROR;
+}
+
+/*
+ * The chunk-wise verification blocks until all chunks have been hashed, thus
+ * it is done in a watched child, as the thorough checks of c_vol do.
+ */
+static void
+check_mount_image_chunks(check_mount_image_t *task)
+{
+	DEBUG("Checking image %s (thorough, chunk-wise in child)", task->img_path);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		ERROR_ERRNO("Could not fork child to check image %s", task->img_path);
+		goto err;
+	} else if (pid == 0) {
+		event_reset();
+		// the result is passed as exit status
+		_exit(guestos_verify_mount_image_chunks(task->img_path, task->e));
+	}
+
+	event_child_watch_t *watch =
+		event_child_watch_new(pid, check_mount_image_chunks_child_cb, task);
+	if (event_add_child_watch(watch) < 0) {
+		ERROR("Could not watch child %d checking image %s", pid, task->img_path);
+		event_child_watch_free(watch);
+		kill(pid, SIGKILL);
+		goto err;
+	}
+	return;
+err:
+	task->cb(CHECK_IMAGE_ERROR, task->os, task->e, task->data);
+	check_mount_image_free(task);
+}
+
 /**
  * Performs a thorough check on the integrity of a mount image and deliver the
  * result via the given callback.
@@ -414,10 +670,23 @@ guestos_check_mount_image(guestos_t *os, mount_entry_t *e, check_mount_image_com
 
 	const char *img_name = mount_entry_get_img(e);
 	char *img_path = mem_printf("%s/%s.img", guestos_get_dir(os), img_name);
+	check_mount_image_t *task = check_mount_image_new(os, e, img_path, cb, data);
+
+	if (mount_entry_get_chunks_root_sha256(e)) {
+		check_mount_image_chunks(task);
+		mem_free0(img_path);
+		return;
+	}
+
 	DEBUG("Checking image %s (thorough, non-blocking)", img_path);
 
-	check_mount_image_t *task = check_mount_image_new(os, e, img_path, cb, data);
-	crypto_hash_file(img_path, SHA1, check_mount_image_cb_sha1, task);
+	task->cache = stat(img_path, &task->img_stat) == 0;
+	// compute both hashes in a single pass over the image
+	if (crypto_hash_file_multi(img_path, guestos_image_hash_algos, GUESTOS_IMAGE_HASH_ALGOS_N,
+				   check_mount_image_cb_hashes, task) < 0) {
+		check_mount_image_free(task);
+		cb(CHECK_IMAGE_ERROR, os, e, data);
+	}
 
 	mem_free0(img_path);
 }
@@ -444,16 +713,28 @@ struct iterate_images {
 	iterate_images_callback_t iter_cb;
 	// callbacks to report back final result to caller
 	iterate_images_on_complete_cb_t on_complete;
+	guestos_images_download_progress_cb_t on_progress;
 	void *complete_data;
+	// check
+	unsigned int inflight; // number of checks in progress
+	bool failed;	       // a bad image has been found
+	bool scheduling;       // inside iterate_images_schedule_checks()
 	// download
 	unsigned int dl_attempts;
 	unsigned int dl_count;
 	bool dl_started;
+	bool dl_restart;   // a downloaded image was bad, do not resume it
+	bool dl_delta;	   // the image is reconstructed from a delta against the base version
+	bool delta_failed; // the reconstructed image was bad, download it in full
+	bool dl_store;	   // the image has been linked from the image store
+	bool store_failed; // the stored image was bad, do not link it again
+	image_delta_t *delta;
 };
 
 static iterate_images_t *
 iterate_images_new(guestos_t *os, mount_t *mnt, size_t n, iterate_images_callback_t iter_cb,
-		   iterate_images_on_complete_cb_t complete_cb, void *complete_data)
+		   iterate_images_on_complete_cb_t complete_cb,
+		   guestos_images_download_progress_cb_t progress_cb, void *complete_data)
 {
 	iterate_images_t *task = mem_new(iterate_images_t, 1);
 	task->os = os;
@@ -462,10 +743,20 @@ iterate_images_new(guestos_t *os, mount_t *mnt, size_t n, iterate_images_callbac
 	task->i = 0;
 	task->iter_cb = iter_cb;
 	task->on_complete = complete_cb;
+	task->on_progress = progress_cb;
 	task->complete_data = complete_data;
+	task->inflight = 0;
+	task->failed = false;
+	task->scheduling = false;
 	task->dl_attempts = 0;
 	task->dl_count = 0;
 	task->dl_started = false;
+	task->dl_restart = false;
+	task->dl_delta = false;
+	task->delta_failed = false;
+	task->dl_store = false;
+	task->store_failed = false;
+	task->delta = NULL;
 	return task;
 }
 
@@ -473,6 +764,7 @@ static void
 iterate_images_free(iterate_images_t *task)
 {
 	IF_NULL_RETURN(task);
+	image_delta_free(task->delta);
 	mount_free(task->mnt);
 	mem_free0(task);
 }
@@ -489,6 +781,21 @@ iterate_images_cb_check_image(guestos_check_mount_image_result_t res,
 	task->iter_cb(task, res, e);
 }
 
+/**
+ * Advance task->i to the next relevant (i.e. for SHARED or FLASH type) GuestOS image.
+ *
+ * @return true if a next image was found, false otherwise.
+ */
+static bool
+iterate_images_find_next(iterate_images_t *task)
+{
+	for (; task->i < task->n; task->i++) {
+		if (guestos_mount_entry_is_image(mount_get_entry(task->mnt, task->i)))
+			return true;
+	}
+	return false;
+}
+
 /**
  * Trigger image check for the next relevant (i.e. for SHARED or FLASH type) GuestOS image.
  *
@@ -497,20 +804,13 @@ iterate_images_cb_check_image(guestos_check_mount_image_result_t res,
 static bool
 iterate_images_trigger_check(iterate_images_t *task)
 {
-	// look for next SHARED or FLASH type image
-	while (task->i < task->n) {
+	if (iterate_images_find_next(task)) {
 		mount_entry_t *e = mount_get_entry(task->mnt, task->i);
-		enum mount_type t = mount_entry_get_type(e);
-		if (t == MOUNT_TYPE_SHARED || t == MOUNT_TYPE_FLASH || t == MOUNT_TYPE_OVERLAY_RO ||
-		    t == MOUNT_TYPE_SHARED_RW || t == MOUNT_TYPE_STORE_ONLY) {
-			DEBUG("Found next image %s.img for GuestOS %s v%" PRIu64
-			      ", triggering check.",
-			      mount_entry_get_img(e), guestos_get_name(task->os),
-			      guestos_get_version(task->os));
-			guestos_check_mount_image(task->os, e, iterate_images_cb_check_image, task);
-			return true;
-		}
-		++task->i;
+		DEBUG("Found next image %s.img for GuestOS %s v%" PRIu64 ", triggering check.",
+		      mount_entry_get_img(e), guestos_get_name(task->os),
+		      guestos_get_version(task->os));
+		guestos_check_mount_image(task->os, e, iterate_images_cb_check_image, task);
+		return true;
 	}
 	DEBUG("No more images to check for GuestOS %s v%" PRIu64 ", stopping iteration.",
 	      guestos_get_name(task->os), guestos_get_version(task->os));
@@ -525,13 +825,15 @@ iterate_images_trigger_check(iterate_images_t *task)
  * @param   os the GuestOS
  * @param   iter_cb the callback called for each GuestOS image
  * @param   complete_cb the callback to report the final result
+ * @param   progress_cb the callback to report the download progress or NULL
  * @param   complete_data data parameter passed to the final result callback
  * @return  true if iteration was started (iter_cb should be called at least once),
  *	    false otherwise (e.g. when there are no images to iterate over)
  */
 static bool
 iterate_images_start(guestos_t *os, iterate_images_callback_t iter_cb,
-		     iterate_images_on_complete_cb_t on_complete, void *complete_data)
+		     iterate_images_on_complete_cb_t on_complete,
+		     guestos_images_download_progress_cb_t progress_cb, void *complete_data)
 {
 	ASSERT(os);
 
@@ -549,7 +851,7 @@ iterate_images_start(guestos_t *os, iterate_images_callback_t iter_cb,
 	}
 
 	iterate_images_t *task =
-		iterate_images_new(os, mnt, n, iter_cb, on_complete, complete_data);
+		iterate_images_new(os, mnt, n, iter_cb, on_complete, progress_cb, complete_data);
 	if (iterate_images_trigger_check(task))
 		return true;
 
@@ -560,34 +862,65 @@ iterate_images_start(guestos_t *os, iterate_images_callback_t iter_cb,
 
 // CHECK IMAGES
 
+/**
+ * Trigger checks of the remaining GuestOS images until the configured number of
+ * verification workers is busy, unless a bad image has already been found.
+ * Once all triggered checks are done, the aggregated result is reported via the
+ * check_complete callback and the task is freed.
+ */
+static void
+iterate_images_schedule_checks(iterate_images_t *task)
+{
+	unsigned int workers = guestos_get_verify_workers();
+
+	// checks which fail early complete synchronously, only count them down then
+	task->scheduling = true;
+	while (!task->failed && task->inflight < workers && iterate_images_find_next(task)) {
+		mount_entry_t *e = mount_get_entry(task->mnt, task->i++);
+		DEBUG("Found next image %s.img for GuestOS %s v%" PRIu64
+		      ", triggering check (%u in progress).",
+		      mount_entry_get_img(e), guestos_get_name(task->os),
+		      guestos_get_version(task->os), task->inflight);
+		task->inflight++;
+		guestos_check_mount_image(task->os, e, iterate_images_cb_check_image, task);
+	}
+	task->scheduling = false;
+
+	IF_TRUE_RETURN_TRACE(task->inflight > 0);
+
+	if (!task->failed)
+		INFO("GuestOS %s v%" PRIu64 " is complete, all images are good.",
+		     guestos_get_name(task->os), guestos_get_version(task->os));
+
+	// all checks done: notify caller
+	if (task->on_complete.check_complete)
+		task->on_complete.check_complete(!task->failed, task->os, task->complete_data);
+
+	// cleanup
+	iterate_images_free(task);
+}
+
 static void
 iterate_images_cb_check(iterate_images_t *task, guestos_check_mount_image_result_t res,
 			mount_entry_t *e)
 {
 	ASSERT(task);
+	ASSERT(task->inflight > 0);
 
-	bool good = (res == CHECK_IMAGE_GOOD);
-	if (good) {
+	task->inflight--;
+	if (res == CHECK_IMAGE_GOOD) {
 		DEBUG("GuestOS %s v%" PRIu64 " image %s.img is GOOD, proceeding ...",
 		      guestos_get_name(task->os), guestos_get_version(task->os),
 		      mount_entry_get_img(e));
-		task->i++;
-		if (iterate_images_trigger_check(task))
-			return;
-		INFO("GuestOS %s v%" PRIu64 " is complete, all images are good.",
-		     guestos_get_name(task->os), guestos_get_version(task->os));
 	} else {
 		DEBUG("GuestOS %s v%" PRIu64 " image %s.img is BAD, stopping ...",
 		      guestos_get_name(task->os), guestos_get_version(task->os),
 		      mount_entry_get_img(e));
+		task->failed = true;
 	}
 
-	// bad or last image: notify caller
-	if (task->on_complete.check_complete)
-		task->on_complete.check_complete(good, task->os, task->complete_data);
-
-	// cleanup
-	iterate_images_free(task);
+	if (!task->scheduling)
+		iterate_images_schedule_checks(task);
 }
 
 void
@@ -595,21 +928,19 @@ guestos_images_check(guestos_t *os, guestos_images_check_complete_cb_t cb, void
 {
 	ASSERT(os);
 	ASSERT(cb);
-	INFO("Checking images of GuestOS %s v%" PRIu64 " (thorough)", guestos_get_name(os),
-	     guestos_get_version(os));
-	// prepare image iteration
-	if (!iterate_images_start(os, iterate_images_cb_check,
-				  (iterate_images_on_complete_cb_t){ .check_complete = cb },
-				  data)) {
-		DEBUG("No images to check for GuestOS %s v%" PRIu64, guestos_get_name(os),
-		      guestos_get_version(os));
-		// notify caller and free
-		if (cb)
-			cb(true, os, data);
-	}
-}
+	INFO("Checking images of GuestOS %s v%" PRIu64 " (thorough, up to %u in parallel)",
+	     guestos_get_name(os), guestos_get_version(os), guestos_get_verify_workers());
 
-// DOWNLOAD IMAGES
+	mount_t *mnt = mount_new(); // need to get "mounts" to get image URLs... feels wrong
+	guestos_fill_mount(os, mnt);
+
+	// check all images concurrently, the result is reported once all are done
+	iterate_images_t *task =
+		iterate_images_new(os, mnt, mount_get_count(mnt), iterate_images_cb_check,
+				   (iterate_images_on_complete_cb_t){ .check_complete = cb }, NULL,
+				   data);
+	iterate_images_schedule_checks(task);
+}
 
 bool
 guestos_images_are_downloading(const guestos_t *os)
@@ -630,9 +961,40 @@ iterate_images_cb_download_complete(download_t *dl, bool success, void *data);
 static void
 iterate_images_cb_download_hash_complete(download_t *dl, bool success, void *data);
 
+static void
+iterate_images_cb_download_delta_complete(download_t *dl, bool success, void *data);
+
+static void
+iterate_images_cb_delta_applied(image_delta_t *delta, bool success, void *data);
+
+/*
+ * Images which are verified by whole-file digests are hashed while they are
+ * downloaded, chunk-wise verified images are checked separately.
+ */
+static bool
+guestos_mount_entry_hash_on_download(const mount_entry_t *e)
+{
+	return !mount_entry_get_chunks_root_sha256(e);
+}
+
+static void
+iterate_images_cb_download_progress(download_t *dl, uint64_t received, uint64_t total,
+				    void *data)
+{
+	iterate_images_t *task = data;
+	ASSERT(task);
+
+	if (!task->on_progress)
+		return;
+
+	const char *img_name = strrchr(download_get_file(dl), '/');
+	img_name = img_name ? img_name + 1 : download_get_file(dl);
+	task->on_progress(task->os, img_name, received, total, task->complete_data);
+}
+
 static bool
 iterate_image_do_trigger_download(const char *img_name, iterate_images_t *task,
-				  download_callback_t dl_cb)
+				  download_callback_t dl_cb, bool hash)
 {
 	const char *hardware_name = guestos_hardware_get_name();
 	if (!hardware_name) {
@@ -682,6 +1044,15 @@ iterate_image_do_trigger_download(const char *img_name, iterate_images_t *task,
 	// invoke downloader
 	DEBUG("Downloading %s to %s (attempt=%u).", img_url, img_path, task->dl_attempts);
 	download_t *dl = download_new(img_url, img_path, dl_cb, task);
+	download_set_progress_cb(dl, iterate_images_cb_download_progress);
+	// continue a download interrupted before, unless its result turned out to be bad
+	download_set_resume(dl, !task->dl_restart);
+	if (hash) {
+		// hash the image while downloading, so that it does not need to be read again
+		mount_entry_t *e = mount_get_entry(task->mnt, task->i);
+		download_set_hash(dl, guestos_image_hash_algos, GUESTOS_IMAGE_HASH_ALGOS_N,
+				  mount_entry_get_size(e));
+	}
 	mem_free0(img_url);
 	mem_free0(img_path);
 	mem_free0(update_base_url_pp);
@@ -693,6 +1064,98 @@ iterate_image_do_trigger_download(const char *img_name, iterate_images_t *task,
 	return true;
 }
 
+/*
+ * Matches the chunks of the image of mount entry e against the image of the same
+ * name of the installed base version named in the GuestOS config, if any.
+ */
+static image_delta_t *
+iterate_images_delta_new(iterate_images_t *task, const mount_entry_t *e)
+{
+	uint64_t base_version = guestos_config_get_delta_base_version(task->os->cfg);
+	if (base_version == 0 || task->delta_failed)
+		return NULL;
+
+	guestos_t *base =
+		guestos_mgr_get_by_version(guestos_get_name(task->os), base_version, false);
+	if (!base) {
+		DEBUG("Delta base version %" PRIu64 " of GuestOS %s is not installed", base_version,
+		      guestos_get_name(task->os));
+		return NULL;
+	}
+
+	image_delta_t *delta = NULL;
+	mount_t *mnt = mount_new();
+	guestos_fill_mount(base, mnt);
+	mount_entry_t *base_e = mount_get_entry_by_img(mnt, mount_entry_get_img(e));
+	if (base_e) {
+		char *base_path =
+			mem_printf("%s/%s.img", guestos_get_dir(base), mount_entry_get_img(base_e));
+		char *img_path =
+			mem_printf("%s/%s.img", guestos_get_dir(task->os), mount_entry_get_img(e));
+		delta = image_delta_new(base_e, base_path, e, img_path);
+		mem_free0(base_path);
+		mem_free0(img_path);
+	}
+	mount_free(mnt);
+	return delta;
+}
+
+/*
+ * Links the image of mount entry e from the image store if it is stored already.
+ * Otherwise, downloads the image, or only its delta against the base version if
+ * possible, from which the image is then reconstructed.
+ */
+static bool
+iterate_images_trigger_image_download(iterate_images_t *task, mount_entry_t *e)
+{
+	const char *sha256 = mount_entry_get_sha256(e);
+	char *img_path = mem_printf("%s/%s.img", guestos_get_dir(task->os), mount_entry_get_img(e));
+	task->dl_store = !task->store_failed && image_store_link(sha256, img_path);
+	if (!task->dl_store) {
+		// the image file is written, which must not affect other GuestOSes
+		image_store_release(sha256, img_path);
+	}
+	mem_free0(img_path);
+	if (task->dl_store)
+		return iterate_images_trigger_check(task);
+
+	image_delta_free(task->delta);
+	task->delta = iterate_images_delta_new(task, e);
+	task->dl_delta = task->delta != NULL;
+
+	if (task->delta) {
+		bool res;
+		if (image_delta_get_size(task->delta) == 0) {
+			// all chunks are found in the base image
+			res = !image_delta_apply(task->delta, NULL, iterate_images_cb_delta_applied,
+						 task);
+		} else {
+			char *delta_name = mem_printf(
+				"%s-%" PRIu64 ".delta", mount_entry_get_img(e),
+				guestos_config_get_delta_base_version(task->os->cfg));
+			res = iterate_image_do_trigger_download(
+				delta_name, task, iterate_images_cb_download_delta_complete, false);
+			mem_free0(delta_name);
+		}
+		if (res)
+			return true;
+
+		WARN("Could not reconstruct %s.img from delta, downloading it in full",
+		     mount_entry_get_img(e));
+		image_delta_free(task->delta);
+		task->delta = NULL;
+		task->dl_delta = false;
+		task->delta_failed = true;
+	}
+
+	char *img_name = mem_printf("%s.img", mount_entry_get_img(e));
+	bool res = iterate_image_do_trigger_download(img_name, task,
+						     iterate_images_cb_download_complete,
+						     guestos_mount_entry_hash_on_download(e));
+	mem_free0(img_name);
+	return res;
+}
+
 static bool
 iterate_images_trigger_download(iterate_images_t *task)
 {
@@ -716,16 +1179,35 @@ iterate_images_trigger_download(iterate_images_t *task)
 		// if no meta image download_complete handeler is trigger by download_hash_complete
 		cb = iterate_images_cb_download_hash_complete;
 	} else {
-		img_name = mem_printf("%s.img", mount_entry_get_img(e));
 		// if no meta image is set directly trigger download_complete handeler
-		cb = iterate_images_cb_download_complete;
+		return iterate_images_trigger_image_download(task, e);
 	}
-	res = iterate_image_do_trigger_download(img_name, task, cb);
+	res = iterate_image_do_trigger_download(img_name, task, cb, false);
 
 	mem_free0(img_name);
 	return res;
 }
 
+/*
+ * Retries the download of the current image after a failure, or reports the
+ * failure to the caller once the download attempts are exhausted.
+ */
+static void
+iterate_images_retry_download(iterate_images_t *task)
+{
+	if (iterate_images_trigger_download(task))
+		return;
+
+	task->os->downloading = false;
+
+	// notify caller
+	if (task->on_complete.download_complete)
+		task->on_complete.download_complete(false, task->dl_count, task->os,
+						    task->complete_data);
+	// cleanup
+	iterate_images_free(task);
+}
+
 static void
 iterate_images_cb_download_hash_complete(download_t *dl, bool success, void *data)
 {
@@ -739,10 +1221,7 @@ iterate_images_cb_download_hash_complete(download_t *dl, bool success, void *dat
 
 		// do trigger download of real image
 		mount_entry_t *e = mount_get_entry(task->mnt, task->i);
-		char *img_name = mem_printf("%s.img", mount_entry_get_img(e));
-		res = iterate_image_do_trigger_download(img_name, task,
-							iterate_images_cb_download_complete);
-		mem_free0(img_name);
+		res = iterate_images_trigger_image_download(task, e);
 		IF_FALSE_GOTO_WARN(res, err);
 	} else {
 		WARN("Download of %s failed!", download_get_url(dl));
@@ -753,19 +1232,87 @@ iterate_images_cb_download_hash_complete(download_t *dl, bool success, void *dat
 	return;
 
 err:
-	if (!iterate_images_trigger_download(task)) {
-		task->os->downloading = false;
+	iterate_images_retry_download(task);
+	download_free(dl);
+}
 
-		// notify caller
-		if (task->on_complete.download_complete)
-			task->on_complete.download_complete(false, task->dl_count, task->os,
-							    task->complete_data);
-		// cleanup
-		iterate_images_free(task);
+static void
+iterate_images_cb_download_delta_complete(download_t *dl, bool success, void *data)
+{
+	iterate_images_t *task = data;
+	ASSERT(task);
+
+	if (success) {
+		INFO("Download of %s succeeded!", download_get_url(dl));
+		if (!image_delta_apply(task->delta, download_get_file(dl),
+				       iterate_images_cb_delta_applied, task)) {
+			download_free(dl);
+			return;
+		}
+		task->delta_failed = true;
+	} else {
+		// the delta is downloaded again, resuming the partial file
+		WARN("Download of %s failed!", download_get_url(dl));
 	}
+	iterate_images_retry_download(task);
 	download_free(dl);
 }
 
+static void
+iterate_images_cb_delta_applied(UNUSED image_delta_t *delta, bool success, void *data)
+{
+	iterate_images_t *task = data;
+	ASSERT(task);
+	ASSERT(task->delta == delta);
+
+	image_delta_free(task->delta);
+	task->delta = NULL;
+
+	mount_entry_t *e = mount_get_entry(task->mnt, task->i);
+	if (success) {
+		INFO("Reconstructed %s.img of GuestOS %s v%" PRIu64 " from delta",
+		     mount_entry_get_img(e), guestos_get_name(task->os),
+		     guestos_get_version(task->os));
+		bool res = iterate_images_trigger_check(task);
+		ASSERT(res);
+		return;
+	}
+
+	WARN("Reconstruction of %s.img failed, downloading it in full", mount_entry_get_img(e));
+	task->delta_failed = true;
+	iterate_images_retry_download(task);
+}
+
+/*
+ * Checks the image downloaded for the current mount entry against the digests
+ * computed while downloading it, instead of reading it again.
+ */
+static void
+iterate_images_check_downloaded(iterate_images_t *task, const char *const *hashes)
+{
+	mount_entry_t *e = mount_get_entry(task->mnt, task->i);
+	char *img_path = mem_printf("%s/%s.img", guestos_get_dir(task->os), mount_entry_get_img(e));
+
+	// the digests cover the file as it has been written by the completed download,
+	// they are only cached if it has not been touched since then
+	struct stat s;
+	bool cache = stat(img_path, &s) == 0;
+
+	guestos_check_mount_image_result_t res =
+		guestos_check_mount_image_block(task->os, e, false);
+	if (res == CHECK_IMAGE_GOOD && !guestos_match_mount_image_hashes(e, hashes))
+		res = CHECK_IMAGE_HASH_MISMATCH;
+
+	if (res == CHECK_IMAGE_GOOD && cache) {
+		// later checks, e.g., on container start, are served from the cache
+		for (size_t i = 0; i < GUESTOS_IMAGE_HASH_ALGOS_N; i++)
+			hash_cache_put(img_path, &s, guestos_image_hash_algos[i], hashes[i]);
+	}
+	mem_free0(img_path);
+
+	task->iter_cb(task, res, e);
+}
+
 static void
 iterate_images_cb_download_complete(download_t *dl, bool success, void *data)
 {
@@ -774,20 +1321,17 @@ iterate_images_cb_download_complete(download_t *dl, bool success, void *data)
 
 	if (success) {
 		INFO("Download of %s succeeded!", download_get_url(dl));
+		const char *const *hashes = download_get_hashes(dl);
+		if (hashes) {
+			iterate_images_check_downloaded(task, hashes);
+			download_free(dl);
+			return;
+		}
 		bool res = iterate_images_trigger_check(task);
 		ASSERT(res);
 	} else {
 		WARN("Download of %s failed!", download_get_url(dl));
-		if (!iterate_images_trigger_download(task)) {
-			task->os->downloading = false;
-
-			// notify caller
-			if (task->on_complete.download_complete)
-				task->on_complete.download_complete(false, task->dl_count, task->os,
-								    task->complete_data);
-			// cleanup
-			iterate_images_free(task);
-		}
+		iterate_images_retry_download(task);
 	}
 	download_free(dl);
 }
@@ -804,6 +1348,16 @@ iterate_images_cb_download_check(iterate_images_t *task, guestos_check_mount_ima
 		      guestos_get_name(task->os), guestos_get_version(task->os),
 		      mount_entry_get_img(e));
 		task->dl_attempts = 0; // reset dl_attempt counter
+		task->dl_restart = false;
+		task->dl_delta = false;
+		task->delta_failed = false;
+		task->dl_store = false;
+		task->store_failed = false;
+		// share the verified image with other GuestOSes
+		char *img_path = mem_printf("%s/%s.img", guestos_get_dir(task->os),
+					    mount_entry_get_img(e));
+		image_store_add(mount_entry_get_sha256(e), img_path);
+		mem_free0(img_path);
 		if (task->dl_started) {
 			task->dl_count++;
 			task->dl_started = false;
@@ -818,6 +1372,16 @@ iterate_images_cb_download_check(iterate_images_t *task, guestos_check_mount_ima
 		DEBUG("GuestOS %s v%" PRIu64 " image %s.img is BAD, triggering download ...",
 		      guestos_get_name(task->os), guestos_get_version(task->os),
 		      mount_entry_get_img(e));
+		if (task->dl_started)
+			task->dl_restart = true;
+		// fall back to the full image if the reconstructed one is bad
+		if (task->dl_delta)
+			task->delta_failed = true;
+		// drop a corrupted stored image
+		if (task->dl_store) {
+			image_store_remove(mount_entry_get_sha256(e));
+			task->store_failed = true;
+		}
 		task->dl_started = true;
 		if (iterate_images_trigger_download(task))
 			return;
@@ -834,7 +1398,8 @@ iterate_images_cb_download_check(iterate_images_t *task, guestos_check_mount_ima
 }
 
 bool
-guestos_images_download(guestos_t *os, guestos_images_download_complete_cb_t cb, void *data)
+guestos_images_download(guestos_t *os, guestos_images_download_complete_cb_t cb,
+			guestos_images_download_progress_cb_t progress_cb, void *data)
 {
 	ASSERT(os);
 	//ASSERT(cb);
@@ -855,7 +1420,7 @@ guestos_images_download(guestos_t *os, guestos_images_download_complete_cb_t cb,
 	os->downloading = true;
 	if (!iterate_images_start(os, iterate_images_cb_download_check,
 				  (iterate_images_on_complete_cb_t){ .download_complete = cb },
-				  data)) {
+				  progress_cb, data)) {
 		DEBUG("No images to download for GuestOS %s v%" PRIu64, guestos_get_name(os),
 		      guestos_get_version(os));
 
@@ -1124,6 +1689,9 @@ guestos_purge(guestos_t *os)
 		char *img_path = mem_printf("%s/%s.img", dir, img_name);
 		char *img_hash_path = mem_printf("%s/%s.hash.img", dir, img_name);
 
+		// a shared image remains in the image store until it is purged
+		image_store_release(mount_entry_get_sha256(e), img_path);
+
 		if (file_exists(img_path) && unlink(img_path) < 0) {
 			WARN_ERRNO("Failed to erase file %s", img_path);
 		}
@@ -129,6 +129,39 @@ typedef enum guestos_check_mount_image_result {
 guestos_check_mount_image_result_t
 guestos_check_mount_image_block(const guestos_t *os, const mount_entry_t *e, bool thorough);
 
+/**
+ * Checks whether a mount image has been verified before and is unchanged since,
+ * using only the digests from the hash cache (blocking, but without hashing).
+ * As for a thorough check, the digest is appended to the measurement log.
+ *
+ * @param os the guestos to which the mount entry belongs to
+ * @param e the mount entry for the image to be checked
+ * @return true if the cached digests of the image are correct
+ */
+bool
+guestos_check_mount_image_cached(const guestos_t *os, const mount_entry_t *e);
+
+/**
+ * Sets the maximum number of images which are verified concurrently.
+ *
+ * @param workers the maximum number of concurrent checks, 0 for the number of online CPUs
+ */
+void
+guestos_set_verify_workers(unsigned int workers);
+
+/**
+ * Hashes the images of the given mount entries of a GuestOS concurrently (blocking)
+ * and caches their digests, so that subsequent thorough checks of the images,
+ * e.g., by guestos_check_mount_image_block(), do not need to hash them again.
+ *
+ * @param os the GuestOS the mount entries belong to
+ * @param entries the mount entries whose images to hash
+ * @param n the number of mount entries
+ */
+void
+guestos_hash_mount_images_block(const guestos_t *os, const mount_entry_t *const *entries,
+				size_t n);
+
 /**
  * Check the required image files for the given GuestOS and return the result (blocking).
  * The image files exists and have correct size, and for a thorough check their hashes
@@ -148,7 +181,8 @@ typedef void (*guestos_images_check_complete_cb_t)(bool complete, guestos_t *os,
 
 /**
  * Thoroughly check the required image files for the given GuestOS (includes hash comparison)
- * and deliver the result via the given callback.
+ * and deliver the result via the given callback. The images are checked concurrently,
+ * bounded by the number set with guestos_set_verify_workers().
  *
  * @param os the GuestOS instance whose images to verify
  * @param cb callback to deliver the result back to the caller (canNOT be NULL)
@@ -164,17 +198,27 @@ guestos_images_check(guestos_t *os, guestos_images_check_complete_cb_t cb, void
 typedef void (*guestos_images_download_complete_cb_t)(bool complete, unsigned int count,
 						      guestos_t *os, void *data);
 
+/**
+ * Callback type for guestos_images_download() to report the progress of downloading a single
+ * image file. The total size is 0 if it is not known (yet).
+ */
+typedef void (*guestos_images_download_progress_cb_t)(guestos_t *os, const char *img_name,
+						      uint64_t received, uint64_t total,
+						      void *data);
+
 /**
  * Check the required image files for the given GuestOS and download the missing/broken images.
  *
  * @param os the GuestOS instance whose images to verify and download
  * @param cb callback to deliver the result back to the caller (can be NULL if result is irrelevant)
- * @param data data parameter passed to the callback
+ * @param progress_cb callback to report the download progress (can be NULL)
+ * @param data data parameter passed to the callbacks
  * @return true if image download is triggered or false if not
  *
  */
 bool
-guestos_images_download(guestos_t *os, guestos_images_download_complete_cb_t cb, void *data);
+guestos_images_download(guestos_t *os, guestos_images_download_complete_cb_t cb,
+			guestos_images_download_progress_cb_t progress_cb, void *data);
 
 /**
  * Check the given GuestOS is currently downloading images.
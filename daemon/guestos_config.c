@@ -183,6 +183,12 @@ guestos_config_fill_mount_internal(GuestOSMount **mounts, size_t n_mounts, mount
 			mount_entry_set_mount_data(e, m->mount_data);
 		if (m->image_verity_sha256)
 			mount_entry_set_verity_sha256(e, m->image_verity_sha256);
+		if (m->image_chunks_root_sha256) {
+			mount_entry_set_chunk_size(e, m->image_chunk_size);
+			mount_entry_set_chunk_sha256(e, m->image_chunk_sha256,
+						     m->n_image_chunk_sha256);
+			mount_entry_set_chunks_root_sha256(e, m->image_chunks_root_sha256);
+		}
 	}
 }
 
@@ -327,3 +333,18 @@ guestos_config_get_update_base_url(const guestos_config_t *cfg)
 	ASSERT(cfg);
 	return cfg->update_base_url;
 }
+
+#ifdef CC_MODE
+uint64_t
+guestos_config_get_delta_base_version(UNUSED const guestos_config_t *cfg)
+{
+	return 0;
+}
+#else
+uint64_t
+guestos_config_get_delta_base_version(const guestos_config_t *cfg)
+{
+	ASSERT(cfg);
+	return cfg->has_delta_base_version ? cfg->delta_base_version : 0;
+}
+#endif /* CC_MODE */
@@ -167,4 +167,10 @@ guestos_config_get_feature_install_guest(const guestos_config_t *cfg);
 const char *
 guestos_config_get_update_base_url(const guestos_config_t *cfg);
 
+/**
+ * Returns the version of the GuestOS the images may be reconstructed from or 0 if none.
+ */
+uint64_t
+guestos_config_get_delta_base_version(const guestos_config_t *cfg);
+
 #endif /* GUESTOS_CONFIG_H */
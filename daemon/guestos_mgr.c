@@ -29,6 +29,7 @@
 #include "cmld.h"
 #include "crypto.h"
 #include "download.h"
+#include "image_store.h"
 
 #include "common/macro.h"
 #include "common/list.h"
@@ -43,6 +44,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <string.h>
 
 #define GUESTOS_MGR_VERIFY_HASH_ALGO SHA512
 #define GUESTOS_MGR_FILE_MOVE_BLOCKSIZE 4096
@@ -59,6 +61,8 @@
 #define SCD_TOKEN_DIR DEFAULT_BASE_PATH "/tokens"
 #define LOCALCA_ROOT_CERT SCD_TOKEN_DIR "/localca_rootca.cert"
 #define TRUSTED_CA_STORE SCD_TOKEN_DIR "/ca"
+// content-addressed store of the images, below the GuestOS dir
+#define GUESTOS_MGR_IMAGE_STORE_DIR ".image_store"
 
 static list_t *guestos_list = NULL;
 
@@ -78,7 +82,7 @@ guestos_mgr_load_operatingsystems_cb(const char *path, const char *name, UNUSED
 	guestos_verify_result_t guestos_verified = GUESTOS_UNSIGNED;
 
 	char *dir = mem_printf("%s/%s", path, name);
-	if (!file_is_dir(dir)) {
+	if (!file_is_dir(dir) || !strcmp(name, GUESTOS_MGR_IMAGE_STORE_DIR)) {
 		goto cleanup;
 	}
 
@@ -239,8 +243,59 @@ guestos_mgr_is_this_guestos_kernel_used_by_boot_option(UNUSED guestos_t *os)
 
 /******************************************************************************/
 
+// names of the GuestOSes whose images are still to be hashed in the background
+static list_t *guestos_mgr_hash_pending = NULL;
+
+static void
+guestos_mgr_hash_images_next(void);
+
+static void
+guestos_mgr_hash_images_cb(bool complete, guestos_t *os, UNUSED void *data)
+{
+	DEBUG("Hashed images of GuestOS %s v%" PRIu64 " in the background (%s)",
+	      guestos_get_name(os), guestos_get_version(os), complete ? "good" : "incomplete");
+	guestos_mgr_hash_images_next();
+}
+
+static void
+guestos_mgr_hash_images_next(void)
+{
+	while (guestos_mgr_hash_pending) {
+		list_t *head = guestos_mgr_hash_pending;
+		char *name = head->data;
+		guestos_mgr_hash_pending = list_unlink(guestos_mgr_hash_pending, head);
+		guestos_t *os = guestos_mgr_get_latest_by_name(name, true);
+		mem_free0(name);
+		if (os) {
+			guestos_images_check(os, guestos_mgr_hash_images_cb, NULL);
+			return;
+		}
+	}
+}
+
+/*
+ * Checks the images of the latest version of each GuestOS in the background, so
+ * that the image checks on container start are served from the hash cache. The
+ * GuestOSes are checked one after another, thus at most the configured number
+ * of verification workers is busy.
+ */
+static void
+guestos_mgr_hash_images(void)
+{
+	for (list_t *l = guestos_list; l; l = l->next) {
+		const char *name = guestos_get_name(l->data);
+		bool pending = false;
+		for (list_t *p = guestos_mgr_hash_pending; p && !pending; p = p->next)
+			pending = !strcmp(p->data, name);
+		if (!pending)
+			guestos_mgr_hash_pending =
+				list_append(guestos_mgr_hash_pending, mem_strdup(name));
+	}
+	guestos_mgr_hash_images_next();
+}
+
 int
-guestos_mgr_init(const char *path, bool allow_locally_signed)
+guestos_mgr_init(const char *path, bool allow_locally_signed, unsigned int verify_workers)
 {
 	ASSERT(path);
 	ASSERT(!guestos_basepath);
@@ -250,8 +305,17 @@ guestos_mgr_init(const char *path, bool allow_locally_signed)
 
 	guestos_basepath = mem_strdup(path);
 	guestos_mgr_allow_locally_signed = allow_locally_signed;
+	guestos_set_verify_workers(verify_workers);
+
+	char *store_path = mem_printf("%s/%s", path, GUESTOS_MGR_IMAGE_STORE_DIR);
+	if (image_store_init(store_path) < 0)
+		WARN("Could not initialize image store, images are not deduplicated");
+	mem_free0(store_path);
 
-	return guestos_mgr_load_operatingsystems();
+	IF_TRUE_RETVAL(guestos_mgr_load_operatingsystems() < 0, -1);
+
+	guestos_mgr_hash_images();
+	return 0;
 }
 
 int
@@ -286,6 +350,7 @@ guestos_mgr_delete(guestos_t *os)
 	guestos_purge(os);
 	guestos_list = list_remove(guestos_list, os);
 	guestos_free(os);
+	image_store_purge();
 
 	return 0;
 }
@@ -307,6 +372,7 @@ guestos_mgr_purge_obsolete(void)
 		}
 		l = next;
 	}
+	image_store_purge();
 }
 
 /******************************************************************************/
@@ -356,6 +422,22 @@ out:
 	mem_free0(resp_fd);
 }
 
+static void
+download_progress_cb(guestos_t *os, const char *img_name, uint64_t received, uint64_t total,
+		     void *data)
+{
+	int *resp_fd = data;
+	ASSERT(resp_fd);
+
+	if (*resp_fd < 0)
+		return;
+
+	if (control_send_guestos_download_progress(*resp_fd, guestos_get_name(os),
+						   guestos_get_version(os), img_name, received,
+						   total) < 0)
+		TRACE("Could not send download progress to fd=%d", *resp_fd);
+}
+
 /**
  * Downloads, if necessary, the images for the latest (by version) available GuestOS with the given name.
  * @param name name of the GuestOS
@@ -381,7 +463,8 @@ guestos_mgr_download_latest(const char *name, int resp_fd)
 			      guestos_get_name(os), guestos_get_version(os));
 			goto out;
 		}
-		if (!guestos_images_download(os, download_complete_cb, cb_resp_fd)) {
+		if (!guestos_images_download(os, download_complete_cb, download_progress_cb,
+					    cb_resp_fd)) {
 			WARN("Cannot download images for GuestOS %s since no device update base URL"
 			     " was configured!",
 			     guestos_get_name(os));
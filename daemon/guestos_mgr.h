@@ -43,12 +43,15 @@ typedef struct guestos guestos_mgr_t;
  * Initialize the operating system list by loading all information from storage.
  * This function verifies each guestos configuration file as part of
  * TSF.CML.SecureCompartmentInit at boottime of the CML subsystem.
+ * The images of all GuestOSes are hashed concurrently to speed up the image checks
+ * on container start.
  *
  * @param path The directory where operating systems are stored.
  * @param allow_locally_signed enable images which are signed by a locally generated CA
+ * @param verify_workers maximum number of images verified concurrently, 0 for online CPUs
  */
 int
-guestos_mgr_init(const char *path, bool allow_locally_signed);
+guestos_mgr_init(const char *path, bool allow_locally_signed, unsigned int verify_workers);
 
 /**
  * Add an operating system WITHOUT checking its signature. The verification
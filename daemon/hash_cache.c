@@ -0,0 +1,626 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+//#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
+
+#include "hash_cache.h"
+#include "hash_cache.pb-c.h"
+#include "cmld.h"
+
+#include "common/macro.h"
+#include "common/mem.h"
+#include "common/file.h"
+#include "common/hashmap.h"
+#include "common/protobuf.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HASH_CACHE_FILE_NAME "hash_cache"
+#define HASH_CACHE_LOCK_FILE_NAME "hash_cache.lock"
+// the cache only holds a few entries per GuestOS image
+#define HASH_CACHE_FILE_MAX_SIZE (1024 * 1024)
+#define HASH_CACHE_ALGOS (SHA512 + 1)
+
+typedef struct hash_cache_key {
+	uint64_t dev;
+	uint64_t ino;
+} hash_cache_key_t;
+
+typedef struct hash_cache_entry {
+	hash_cache_key_t key;
+	uint64_t size;
+	struct timespec mtime;
+	struct timespec ctime;
+	char *hash[HASH_CACHE_ALGOS]; //!< hex digests indexed by crypto_hashalgo_t
+	char *chunks_root;	      //!< root hash of the chunk manifest
+	uint8_t *chunks_verified;     //!< bitmap of verified chunks
+	size_t chunks_verified_len;
+} hash_cache_entry_t;
+
+static hashmap_t *hash_cache_entries = NULL; // hash_cache_key_t -> hash_cache_entry_t
+/*
+ * Identifies the cache file the entries have been loaded from. Forked children,
+ * e.g., the background image checks of c_vol, write their results to the file.
+ */
+static struct stat hash_cache_file_stat;
+
+static char *
+hash_cache_file_new(void)
+{
+	return mem_printf("%s/%s", cmld_get_cmld_dir(), HASH_CACHE_FILE_NAME);
+}
+
+/*
+ * Serializes the modifications of the cache file by cmld and its children. Each
+ * writer re-reads the cache file after taking the lock and applies its change
+ * on top of it, so that no other writer's entries are lost by the rename.
+ * Returns the fd holding the lock or -1 on error.
+ */
+static int
+hash_cache_lock(void)
+{
+	char *lock_file = mem_printf("%s/%s", cmld_get_cmld_dir(), HASH_CACHE_LOCK_FILE_NAME);
+	int fd = open(lock_file, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		WARN_ERRNO("Could not open hash cache lock file %s", lock_file);
+		goto out;
+	}
+	while (flock(fd, LOCK_EX) < 0) {
+		if (errno == EINTR)
+			continue;
+		WARN_ERRNO("Could not lock hash cache lock file %s", lock_file);
+		close(fd);
+		fd = -1;
+		break;
+	}
+out:
+	mem_free0(lock_file);
+	return fd;
+}
+
+static void
+hash_cache_unlock(int fd)
+{
+	// closing the last reference to the open file releases the lock
+	close(fd);
+}
+
+static void
+hash_cache_entry_free(hash_cache_entry_t *entry)
+{
+	for (int i = 0; i < HASH_CACHE_ALGOS; i++) {
+		if (entry->hash[i])
+			mem_free0(entry->hash[i]);
+	}
+	if (entry->chunks_root)
+		mem_free0(entry->chunks_root);
+	if (entry->chunks_verified)
+		mem_free0(entry->chunks_verified);
+	mem_free0(entry);
+}
+
+static hash_cache_entry_t *
+hash_cache_entry_new(const struct stat *s)
+{
+	hash_cache_entry_t *entry = mem_new0(hash_cache_entry_t, 1);
+	entry->key.dev = s->st_dev;
+	entry->key.ino = s->st_ino;
+	entry->size = s->st_size;
+	entry->mtime = s->st_mtim;
+	entry->ctime = s->st_ctim;
+	return entry;
+}
+
+/*
+ * An entry is stale if the file has been modified. Any write or metadata change
+ * updates the ctime of a file, which, in contrast to the mtime, cannot be set
+ * from userspace.
+ */
+static bool
+hash_cache_entry_is_valid(const hash_cache_entry_t *entry, const struct stat *s)
+{
+	return entry->size == (uint64_t)s->st_size &&
+	       entry->mtime.tv_sec == s->st_mtim.tv_sec &&
+	       entry->mtime.tv_nsec == s->st_mtim.tv_nsec &&
+	       entry->ctime.tv_sec == s->st_ctim.tv_sec &&
+	       entry->ctime.tv_nsec == s->st_ctim.tv_nsec;
+}
+
+static bool
+hash_cache_stat_equals(const struct stat *a, const struct stat *b)
+{
+	return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size &&
+	       a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec &&
+	       a->st_ctim.tv_sec == b->st_ctim.tv_sec && a->st_ctim.tv_nsec == b->st_ctim.tv_nsec;
+}
+
+static void
+hash_cache_entry_insert(hash_cache_entry_t *entry)
+{
+	hash_cache_entry_t *old =
+		hashmap_put(hash_cache_entries, &entry->key, sizeof(entry->key), entry);
+	if (old)
+		hash_cache_entry_free(old);
+}
+
+static void
+hash_cache_entry_free_cb(void *value, UNUSED void *data)
+{
+	hash_cache_entry_free(value);
+}
+
+static void
+hash_cache_clear(void)
+{
+	if (hash_cache_entries) {
+		hashmap_foreach(hash_cache_entries, hash_cache_entry_free_cb, NULL);
+		hashmap_free(hash_cache_entries);
+	}
+	hash_cache_entries = hashmap_new();
+}
+
+static void
+hash_cache_load_entries(const HashCache *cache)
+{
+	for (size_t i = 0; i < cache->n_entries; i++) {
+		const HashCacheEntry *e = cache->entries[i];
+		hash_cache_entry_t *entry = mem_new0(hash_cache_entry_t, 1);
+		entry->key.dev = e->dev;
+		entry->key.ino = e->ino;
+		entry->size = e->size;
+		entry->mtime.tv_sec = e->mtime_sec;
+		entry->mtime.tv_nsec = e->mtime_nsec;
+		entry->ctime.tv_sec = e->ctime_sec;
+		entry->ctime.tv_nsec = e->ctime_nsec;
+		entry->hash[SHA1] = e->sha1 ? mem_strdup(e->sha1) : NULL;
+		entry->hash[SHA256] = e->sha256 ? mem_strdup(e->sha256) : NULL;
+		entry->hash[SHA512] = e->sha512 ? mem_strdup(e->sha512) : NULL;
+		if (e->chunks_root && e->has_chunks_verified) {
+			entry->chunks_root = mem_strdup(e->chunks_root);
+			entry->chunks_verified_len = e->chunks_verified.len;
+			entry->chunks_verified = mem_alloc0(e->chunks_verified.len);
+			memcpy(entry->chunks_verified, e->chunks_verified.data,
+			       e->chunks_verified.len);
+		}
+		hash_cache_entry_insert(entry);
+	}
+}
+
+/*
+ * Compares two hex encoded hmacs in constant time, so that the time needed for
+ * rejecting a forged cache file does not leak the correct hmac.
+ */
+static bool
+hash_cache_hmac_equals(const char *a, const char *b)
+{
+	size_t len = strlen(a);
+	IF_TRUE_RETVAL(len != strlen(b), false);
+
+	unsigned char diff = 0;
+	for (size_t i = 0; i < len; i++)
+		diff |= a[i] ^ b[i];
+	return diff == 0;
+}
+
+/*
+ * (Re-)loads the cache file if it has been changed since it has been loaded or
+ * written the last time. An invalid cache file results in an empty cache.
+ */
+static void
+hash_cache_load(void)
+{
+	struct stat s;
+	uint8_t *buf = NULL;
+	HashCacheFile *cache_file = NULL;
+	HashCache *cache = NULL;
+	char *hmac = NULL;
+
+	char *file = hash_cache_file_new();
+
+	if (stat(file, &s) < 0) {
+		TRACE("No hash cache file %s", file);
+		if (!hash_cache_entries)
+			hash_cache_entries = hashmap_new();
+		goto out;
+	}
+	if (hash_cache_entries && s.st_dev == hash_cache_file_stat.st_dev &&
+	    s.st_ino == hash_cache_file_stat.st_ino && s.st_size == hash_cache_file_stat.st_size &&
+	    s.st_mtim.tv_sec == hash_cache_file_stat.st_mtim.tv_sec &&
+	    s.st_mtim.tv_nsec == hash_cache_file_stat.st_mtim.tv_nsec)
+		goto out;
+
+	hash_cache_clear();
+	hash_cache_file_stat = s;
+
+	if (s.st_size <= 0 || s.st_size > HASH_CACHE_FILE_MAX_SIZE) {
+		WARN("Ignoring hash cache file %s of size %zd", file, (ssize_t)s.st_size);
+		goto out;
+	}
+
+	buf = mem_alloc(s.st_size);
+	if (file_read(file, (char *)buf, s.st_size) != s.st_size) {
+		WARN("Could not read hash cache file %s", file);
+		goto out;
+	}
+
+	cache_file = (HashCacheFile *)protobuf_unpack_message(&hash_cache_file__descriptor, buf,
+							      s.st_size);
+	if (!cache_file) {
+		WARN("Ignoring malformed hash cache file %s", file);
+		goto out;
+	}
+
+	hmac = crypto_hmac_buf_block_new(cache_file->cache.data, cache_file->cache.len, SHA256);
+	if (!hmac || !hash_cache_hmac_equals(hmac, cache_file->hmac_sha256)) {
+		WARN("Authentication of hash cache file %s failed, dropping cache", file);
+		goto out;
+	}
+
+	cache = (HashCache *)protobuf_unpack_message(&hash_cache__descriptor,
+						     cache_file->cache.data,
+						     cache_file->cache.len);
+	if (!cache) {
+		WARN("Ignoring malformed hash cache in %s", file);
+		goto out;
+	}
+
+	hash_cache_load_entries(cache);
+	DEBUG("Loaded %u entries from hash cache file %s", hashmap_size(hash_cache_entries), file);
+
+out:
+	if (cache)
+		protobuf_free_message((ProtobufCMessage *)cache);
+	if (cache_file)
+		protobuf_free_message((ProtobufCMessage *)cache_file);
+	if (hmac)
+		mem_free0(hmac);
+	if (buf)
+		mem_free0(buf);
+	mem_free0(file);
+}
+
+static void
+hash_cache_collect_cb(void *value, void *data)
+{
+	hash_cache_entry_t *entry = value;
+	HashCache *cache = data;
+
+	HashCacheEntry *e = mem_new0(HashCacheEntry, 1);
+	hash_cache_entry__init(e);
+	e->dev = entry->key.dev;
+	e->ino = entry->key.ino;
+	e->size = entry->size;
+	e->mtime_sec = entry->mtime.tv_sec;
+	e->mtime_nsec = entry->mtime.tv_nsec;
+	e->ctime_sec = entry->ctime.tv_sec;
+	e->ctime_nsec = entry->ctime.tv_nsec;
+	e->sha1 = entry->hash[SHA1];
+	e->sha256 = entry->hash[SHA256];
+	e->sha512 = entry->hash[SHA512];
+	if (entry->chunks_root) {
+		e->chunks_root = entry->chunks_root;
+		e->has_chunks_verified = true;
+		e->chunks_verified.data = entry->chunks_verified;
+		e->chunks_verified.len = entry->chunks_verified_len;
+	}
+
+	cache->entries[cache->n_entries++] = e;
+}
+
+/*
+ * Writes the cache to a temporary file which is then renamed, so that readers
+ * never see a partially written cache. Must be called with the cache lock held
+ * and the cache (re-)loaded under it.
+ */
+static void
+hash_cache_save(void)
+{
+	HashCache cache = HASH_CACHE__INIT;
+	HashCacheFile cache_file = HASH_CACHE_FILE__INIT;
+	uint8_t *packed_cache = NULL, *packed_file = NULL;
+	char *file = hash_cache_file_new();
+	char *tmp_file = mem_printf("%s.%d.tmp", file, getpid());
+
+	cache.entries = mem_new0(HashCacheEntry *, hashmap_size(hash_cache_entries));
+	hashmap_foreach(hash_cache_entries, hash_cache_collect_cb, &cache);
+	uint32_t cache_len = protobuf_pack_message_new((ProtobufCMessage *)&cache, &packed_cache);
+
+	cache_file.cache.data = packed_cache;
+	cache_file.cache.len = cache_len;
+	cache_file.hmac_sha256 = crypto_hmac_buf_block_new(packed_cache, cache_len, SHA256);
+	if (!cache_file.hmac_sha256) {
+		WARN("Could not authenticate hash cache, not saving");
+		goto out;
+	}
+
+	uint32_t file_len =
+		protobuf_pack_message_new((ProtobufCMessage *)&cache_file, &packed_file);
+	if (file_write(tmp_file, (char *)packed_file, file_len) != (int)file_len) {
+		WARN("Could not write hash cache file %s", tmp_file);
+		unlink(tmp_file);
+		goto out;
+	}
+	if (rename(tmp_file, file) < 0) {
+		WARN_ERRNO("Could not replace hash cache file %s", file);
+		unlink(tmp_file);
+		goto out;
+	}
+	if (stat(file, &hash_cache_file_stat) < 0)
+		WARN_ERRNO("Could not stat hash cache file %s", file);
+
+	TRACE("Saved %zu entries to hash cache file %s", cache.n_entries, file);
+out:
+	for (size_t i = 0; i < cache.n_entries; i++)
+		mem_free0(cache.entries[i]);
+	mem_free0(cache.entries);
+	if (cache_file.hmac_sha256)
+		mem_free0(cache_file.hmac_sha256);
+	if (packed_cache)
+		mem_free0(packed_cache);
+	if (packed_file)
+		mem_free0(packed_file);
+	mem_free0(tmp_file);
+	mem_free0(file);
+}
+
+/*
+ * Returns the valid cache entry of file, or NULL if there is none. A stale
+ * entry of a file which has changed in the meantime is dropped.
+ */
+static hash_cache_entry_t *
+hash_cache_lookup(const char *file)
+{
+	struct stat s;
+	IF_TRUE_RETVAL_TRACE(stat(file, &s) < 0, NULL);
+
+	hash_cache_load();
+
+	hash_cache_key_t key = { .dev = s.st_dev, .ino = s.st_ino };
+	hash_cache_entry_t *entry = hashmap_get(hash_cache_entries, &key, sizeof(key));
+	IF_NULL_RETVAL_TRACE(entry, NULL);
+
+	if (!hash_cache_entry_is_valid(entry, &s)) {
+		DEBUG("Dropping stale hash cache entry of %s", file);
+		hashmap_remove(hash_cache_entries, &key, sizeof(key));
+		hash_cache_entry_free(entry);
+		return NULL;
+	}
+	return entry;
+}
+
+/*
+ * Returns the valid cache entry of file, a new one is added if there is none.
+ * The status before has to be taken before the file has been read to compute
+ * the value which is going to be stored. If the file has changed since then,
+ * no entry is returned as the value may not reflect the current content.
+ */
+static hash_cache_entry_t *
+hash_cache_lookup_or_add(const char *file, const struct stat *before)
+{
+	struct stat s;
+	IF_TRUE_RETVAL_TRACE(stat(file, &s) < 0, NULL);
+
+	if (!hash_cache_stat_equals(&s, before)) {
+		WARN("%s changed while it was read, not caching its digest", file);
+		return NULL;
+	}
+
+	hash_cache_load();
+
+	hash_cache_key_t key = { .dev = s.st_dev, .ino = s.st_ino };
+	hash_cache_entry_t *entry = hashmap_get(hash_cache_entries, &key, sizeof(key));
+	if (!entry || !hash_cache_entry_is_valid(entry, &s)) {
+		entry = hash_cache_entry_new(&s);
+		hash_cache_entry_insert(entry);
+	}
+	return entry;
+}
+
+char *
+hash_cache_get_new(const char *file, crypto_hashalgo_t hashalgo)
+{
+	ASSERT(file);
+	ASSERT(hashalgo < HASH_CACHE_ALGOS);
+
+	hash_cache_entry_t *entry = hash_cache_lookup(file);
+	IF_NULL_RETVAL_TRACE(entry, NULL);
+	IF_NULL_RETVAL_TRACE(entry->hash[hashalgo], NULL);
+
+	DEBUG("Using cached digest of %s", file);
+	return mem_strdup(entry->hash[hashalgo]);
+}
+
+void
+hash_cache_put(const char *file, const struct stat *before, crypto_hashalgo_t hashalgo,
+	       const char *hash)
+{
+	ASSERT(file);
+	ASSERT(before);
+	ASSERT(hash);
+	ASSERT(hashalgo < HASH_CACHE_ALGOS);
+
+	int lock = hash_cache_lock();
+	IF_TRUE_RETURN(lock < 0);
+
+	hash_cache_entry_t *entry = hash_cache_lookup_or_add(file, before);
+	if (!entry || (entry->hash[hashalgo] && !strcmp(entry->hash[hashalgo], hash)))
+		goto out;
+
+	if (entry->hash[hashalgo])
+		mem_free0(entry->hash[hashalgo]);
+	entry->hash[hashalgo] = mem_strdup(hash);
+
+	hash_cache_save();
+out:
+	hash_cache_unlock(lock);
+}
+
+uint8_t *
+hash_cache_get_chunks_new(const char *file, const char *root, size_t *len)
+{
+	ASSERT(file);
+	ASSERT(root);
+	ASSERT(len);
+
+	hash_cache_entry_t *entry = hash_cache_lookup(file);
+	IF_NULL_RETVAL_TRACE(entry, NULL);
+	IF_NULL_RETVAL_TRACE(entry->chunks_root, NULL);
+	IF_TRUE_RETVAL_TRACE(strcmp(entry->chunks_root, root), NULL);
+
+	uint8_t *verified = mem_alloc0(entry->chunks_verified_len);
+	memcpy(verified, entry->chunks_verified, entry->chunks_verified_len);
+	*len = entry->chunks_verified_len;
+	return verified;
+}
+
+void
+hash_cache_put_chunks(const char *file, const struct stat *before, const char *root,
+		      const uint8_t *verified, size_t len)
+{
+	ASSERT(file);
+	ASSERT(before);
+	ASSERT(root);
+	ASSERT(verified);
+
+	int lock = hash_cache_lock();
+	IF_TRUE_RETURN(lock < 0);
+
+	hash_cache_entry_t *entry = hash_cache_lookup_or_add(file, before);
+	if (!entry)
+		goto out;
+
+	if (entry->chunks_root)
+		mem_free0(entry->chunks_root);
+	if (entry->chunks_verified)
+		mem_free0(entry->chunks_verified);
+	entry->chunks_root = mem_strdup(root);
+	entry->chunks_verified = mem_alloc0(len);
+	memcpy(entry->chunks_verified, verified, len);
+	entry->chunks_verified_len = len;
+
+	hash_cache_save();
+out:
+	hash_cache_unlock(lock);
+}
+
+void
+hash_cache_relink(const char *file, const struct stat *before, int nlink_delta)
+{
+	ASSERT(file);
+	ASSERT(before);
+
+	struct stat s;
+	IF_TRUE_RETURN_TRACE(stat(file, &s) < 0);
+
+	// only the link count, and thus the ctime, may have changed in the meantime
+	if (s.st_dev != before->st_dev || s.st_ino != before->st_ino ||
+	    s.st_size != before->st_size || s.st_mtim.tv_sec != before->st_mtim.tv_sec ||
+	    s.st_mtim.tv_nsec != before->st_mtim.tv_nsec ||
+	    (long)s.st_nlink != (long)before->st_nlink + nlink_delta) {
+		DEBUG("%s has changed beyond its link count, dropping its hash cache entry", file);
+		return;
+	}
+
+	int lock = hash_cache_lock();
+	IF_TRUE_RETURN(lock < 0);
+
+	hash_cache_load();
+
+	hash_cache_key_t key = { .dev = before->st_dev, .ino = before->st_ino };
+	hash_cache_entry_t *entry = hashmap_get(hash_cache_entries, &key, sizeof(key));
+	if (entry && hash_cache_entry_is_valid(entry, before)) {
+		entry->ctime = s.st_ctim;
+		hash_cache_save();
+	}
+
+	hash_cache_unlock(lock);
+}
+
+char *
+hash_cache_hash_file_block_new(const char *file, crypto_hashalgo_t hashalgo)
+{
+	char *hash = hash_cache_get_new(file, hashalgo);
+	if (hash)
+		return hash;
+
+	struct stat s;
+	IF_TRUE_RETVAL_TRACE(stat(file, &s) < 0, NULL);
+
+	hash = crypto_hash_file_block_new(file, hashalgo);
+	if (hash)
+		hash_cache_put(file, &s, hashalgo, hash);
+
+	return hash;
+}
+
+void
+hash_cache_hash_files_block(const char *const *files, const crypto_hashalgo_t *hashalgos,
+			    size_t n, unsigned int max_inflight)
+{
+	ASSERT(files);
+	ASSERT(hashalgos);
+	IF_TRUE_RETURN(n == 0);
+
+	const char **missing = mem_new0(const char *, n);
+	crypto_hashalgo_t *missing_algos = mem_new0(crypto_hashalgo_t, n);
+	struct stat *missing_stats = mem_new0(struct stat, n);
+	size_t n_missing = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		char *hash = hash_cache_get_new(files[i], hashalgos[i]);
+		if (hash) {
+			mem_free0(hash);
+			continue;
+		}
+		if (stat(files[i], &missing_stats[n_missing]) < 0) {
+			WARN_ERRNO("Could not stat %s", files[i]);
+			continue;
+		}
+		missing[n_missing] = files[i];
+		missing_algos[n_missing++] = hashalgos[i];
+	}
+
+	if (n_missing > 0) {
+		DEBUG("Hashing %zu uncached files with up to %u concurrent requests", n_missing,
+		      max_inflight);
+		char **hashes = crypto_hash_files_block_new(missing, missing_algos, n_missing,
+							    max_inflight);
+		for (size_t i = 0; i < n_missing; i++) {
+			if (!hashes[i])
+				continue;
+			hash_cache_put(missing[i], &missing_stats[i], missing_algos[i], hashes[i]);
+			mem_free0(hashes[i]);
+		}
+		mem_free0(hashes);
+	}
+
+	mem_free0(missing);
+	mem_free0(missing_algos);
+	mem_free0(missing_stats);
+}
@@ -0,0 +1,132 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file hash_cache.h
+ *
+ * Persistent cache of image file digests computed by the scd. Entries are keyed
+ * by device and inode of a file and are only valid as long as its size, mtime
+ * and ctime are unchanged, so that modified files are hashed again.
+ *
+ * The cache is stored under the cmld dir together with an hmac over its
+ * content, which is computed by the scd with a device local key. A cache file
+ * whose hmac does not verify is discarded, as are the chunk verification
+ * bitmaps it contains.
+ */
+
+#ifndef HASH_CACHE_H
+#define HASH_CACHE_H
+
+#include "crypto.h"
+
+#include <sys/stat.h>
+
+/**
+ * Returns the cached digest of file, or NULL if there is no valid entry.
+ * A stale entry of a file which has changed in the meantime is dropped.
+ *
+ * @param file the file whose digest is looked up
+ * @param hashalgo the hash algorithm of the digest
+ * @return newly allocated hex string of the digest or NULL
+ */
+char *
+hash_cache_get_new(const char *file, crypto_hashalgo_t hashalgo);
+
+/**
+ * Stores the digest of file in the cache and writes the cache to disk. Nothing
+ * is stored if the file has changed since its status before has been taken.
+ *
+ * @param file the file which has been hashed
+ * @param before the status of the file taken before it has been hashed
+ * @param hashalgo the hash algorithm of the digest
+ * @param hash hex string of the digest
+ */
+void
+hash_cache_put(const char *file, const struct stat *before, crypto_hashalgo_t hashalgo,
+	       const char *hash);
+
+/**
+ * Returns the progress of a chunked verification of file, i.e., a bitmap of
+ * the chunks which have been verified against the chunk manifest with the
+ * given root hash, or NULL if there is no valid entry for this manifest.
+ *
+ * @param file the file whose chunks are verified
+ * @param root hex string of the root hash of the chunk manifest
+ * @param len receives the length of the bitmap in bytes
+ * @return newly allocated bitmap or NULL
+ */
+uint8_t *
+hash_cache_get_chunks_new(const char *file, const char *root, size_t *len);
+
+/**
+ * Stores the progress of a chunked verification of file in the cache and writes
+ * the cache to disk. Nothing is stored if the file has changed since its status
+ * before has been taken.
+ *
+ * @param file the file whose chunks are verified
+ * @param before the status of the file taken before its chunks have been hashed
+ * @param root hex string of the root hash of the chunk manifest
+ * @param verified bitmap of the verified chunks
+ * @param len the length of the bitmap in bytes
+ */
+void
+hash_cache_put_chunks(const char *file, const struct stat *before, const char *root,
+		      const uint8_t *verified, size_t len);
+
+/**
+ * Keeps the cache entry of a file valid after a hard link to it has been
+ * created or removed, which changes its ctime but not its content. Nothing is
+ * carried over if the file has changed in any other way, including its link
+ * count differing from the one expected after the change.
+ * @param file a path of the file after the change
+ * @param before the status of the file taken right before the change
+ * @param nlink_delta the change of the link count, i.e., 1 or -1
+ */
+void
+hash_cache_relink(const char *file, const struct stat *before, int nlink_delta);
+
+/**
+ * Returns the digest of file from the cache or, on a miss, requests the scd to
+ * hash the file (blocking) and caches the result.
+ *
+ * @param file the file to hash
+ * @param hashalgo the hash algorithm to use
+ * @return newly allocated hex string of the digest or NULL on error
+ */
+char *
+hash_cache_hash_file_block_new(const char *file, crypto_hashalgo_t hashalgo);
+
+/**
+ * Makes sure the cache holds the digests of the given files. Files without a
+ * valid entry are hashed by the scd concurrently (blocking) and cached.
+ *
+ * @param files the files to hash
+ * @param hashalgos the hash algorithm to use for each file
+ * @param n the number of files
+ * @param max_inflight the maximum number of concurrent hash requests to the scd
+ */
+void
+hash_cache_hash_files_block(const char *const *files, const crypto_hashalgo_t *hashalgos,
+			    size_t n, unsigned int max_inflight);
+
+#endif /* HASH_CACHE_H */
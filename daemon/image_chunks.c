@@ -0,0 +1,561 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+//#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
+
+#include "image_chunks.h"
+#include "crypto.h"
+#include "hash_cache.h"
+
+#include "common/macro.h"
+#include "common/mem.h"
+#include "common/file.h"
+#include "common/hex.h"
+#include "common/verity.h"
+
+#include <endian.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#define IMAGE_CHUNKS_HASH_LEN 32 // SHA256
+// largest block the scd hashes at once
+#define IMAGE_CHUNKS_MAX_BLOCK_SIZE (64 * 1024 * 1024)
+// chunks verified between two updates of the progress in the hash cache
+#define IMAGE_CHUNKS_BATCH 64
+#define IMAGE_CHUNKS_VERITY_MIN_BLOCK_SIZE 512
+#define IMAGE_CHUNKS_VERITY_MAX_BLOCK_SIZE (1024 * 1024)
+#define IMAGE_CHUNKS_VERITY_MAX_LEVELS 63
+
+struct image_chunks {
+	char *img_path;
+	char *root;	     //!< hex string of the root hash
+	uint64_t size;	     //!< size of the image in bytes
+	uint32_t block_size; //!< size of the individually hashed blocks
+	uint64_t chunk_len;  //!< size of a chunk, a multiple of block_size
+	size_t n_chunks;
+	size_t digests_stride; //!< distance of the digests of two consecutive chunks
+	uint8_t *digests;      //!< expected block digests, NULL until loaded
+	uint8_t *manifest;     //!< buffer holding the digests
+	char *hash_img_path;   //!< verity hash tree, NULL if the chunks are listed in the config
+	verity_sb_t sb;
+	uint8_t *verified; //!< bitmap of verified chunks
+	size_t verified_len;
+	const mount_entry_t *e;
+	struct stat img_stat; //!< status of the image before it has been read
+};
+
+static bool
+image_chunks_is_chunk_verified(const image_chunks_t *chunks, size_t i)
+{
+	return chunks->verified[i / 8] & (1 << (i % 8));
+}
+
+static void
+image_chunks_set_chunk_verified(image_chunks_t *chunks, size_t i)
+{
+	chunks->verified[i / 8] |= (1 << (i % 8));
+}
+
+static uint64_t
+image_chunks_get_chunk_offset(const image_chunks_t *chunks, size_t i)
+{
+	return (uint64_t)i * chunks->chunk_len;
+}
+
+static uint64_t
+image_chunks_get_chunk_len(const image_chunks_t *chunks, size_t i)
+{
+	return MIN(chunks->chunk_len, chunks->size - image_chunks_get_chunk_offset(chunks, i));
+}
+
+static bool
+image_chunks_is_pow2(uint32_t x)
+{
+	return x && !(x & (x - 1));
+}
+
+static char *
+image_chunks_hash_img_path_new(const char *img_path)
+{
+	size_t len = strlen(img_path);
+	if (len < 4 || strcmp(img_path + len - 4, ".img")) {
+		ERROR("Image %s has no .img suffix", img_path);
+		return NULL;
+	}
+	return mem_printf("%.*s.hash.img", (int)(len - 4), img_path);
+}
+
+/*
+ * Sets up the chunks from the dm-verity superblock of the hash tree of the image.
+ */
+static int
+image_chunks_init_verity(image_chunks_t *chunks)
+{
+	const char *verity_sha256 = mount_entry_get_verity_sha256(chunks->e);
+	if (!verity_sha256 || strcasecmp(verity_sha256, chunks->root)) {
+		ERROR("Chunks root of image %s does not match its dm-verity root hash",
+		      chunks->img_path);
+		return -1;
+	}
+
+	chunks->hash_img_path = image_chunks_hash_img_path_new(chunks->img_path);
+	IF_NULL_RETVAL(chunks->hash_img_path, -1);
+
+	verity_sb_t *sb = &chunks->sb;
+	if (file_read(chunks->hash_img_path, (char *)sb, sizeof(verity_sb_t)) !=
+	    sizeof(verity_sb_t)) {
+		ERROR("Failed to read dm-verity superblock of %s", chunks->hash_img_path);
+		return -1;
+	}
+
+	uint32_t data_block_size = le32toh(sb->data_block_size);
+	uint32_t hash_block_size = le32toh(sb->hash_block_size);
+	uint64_t data_blocks = le64toh(sb->data_blocks);
+
+	if (memcmp(sb->signature, "verity\0\0", sizeof(sb->signature)) ||
+	    le32toh(sb->version) != 1 || le32toh(sb->hash_type) != 1 ||
+	    strncmp((char *)sb->algorithm, "sha256", sizeof(sb->algorithm)) ||
+	    le16toh(sb->salt_size) > sizeof(sb->salt)) {
+		ERROR("Unsupported dm-verity superblock in %s", chunks->hash_img_path);
+		return -1;
+	}
+	if (!image_chunks_is_pow2(data_block_size) || !image_chunks_is_pow2(hash_block_size) ||
+	    data_block_size < IMAGE_CHUNKS_VERITY_MIN_BLOCK_SIZE ||
+	    data_block_size > IMAGE_CHUNKS_VERITY_MAX_BLOCK_SIZE ||
+	    hash_block_size < IMAGE_CHUNKS_VERITY_MIN_BLOCK_SIZE ||
+	    hash_block_size > IMAGE_CHUNKS_VERITY_MAX_BLOCK_SIZE) {
+		ERROR("Invalid dm-verity block sizes in %s", chunks->hash_img_path);
+		return -1;
+	}
+	if (data_blocks < 2 || data_blocks != chunks->size / data_block_size ||
+	    chunks->size % data_block_size) {
+		ERROR("dm-verity data blocks in %s do not match size of image %s",
+		      chunks->hash_img_path, chunks->img_path);
+		return -1;
+	}
+
+	// a chunk covers the data blocks whose digests make up one leaf hash block
+	uint64_t per_block = hash_block_size / IMAGE_CHUNKS_HASH_LEN;
+	chunks->block_size = data_block_size;
+	chunks->chunk_len = per_block * data_block_size;
+	chunks->n_chunks = (data_blocks + per_block - 1) / per_block;
+	chunks->digests_stride = hash_block_size;
+
+	return 0;
+}
+
+/*
+ * Sets up the chunks listed in the config.
+ */
+static int
+image_chunks_init_config(image_chunks_t *chunks)
+{
+	size_t count;
+	mount_entry_get_chunk_sha256(chunks->e, &count);
+	uint32_t chunk_size = mount_entry_get_chunk_size(chunks->e);
+
+	if (chunk_size == 0 || chunk_size > IMAGE_CHUNKS_MAX_BLOCK_SIZE) {
+		ERROR("Invalid chunk size %" PRIu32 " of image %s", chunk_size, chunks->img_path);
+		return -1;
+	}
+
+	// a chunk is hashed as a single block
+	chunks->block_size = chunk_size;
+	chunks->chunk_len = chunk_size;
+	chunks->n_chunks = (chunks->size + chunk_size - 1) / chunk_size;
+	chunks->digests_stride = IMAGE_CHUNKS_HASH_LEN;
+
+	if (count != chunks->n_chunks) {
+		ERROR("Image %s has %zu chunks, but %zu chunk hashes are given", chunks->img_path,
+		      chunks->n_chunks, count);
+		return -1;
+	}
+	return 0;
+}
+
+image_chunks_t *
+image_chunks_new(const char *img_path, const mount_entry_t *e)
+{
+	ASSERT(img_path);
+	ASSERT(e);
+
+	const char *root = mount_entry_get_chunks_root_sha256(e);
+	IF_NULL_RETVAL(root, NULL);
+
+	// taken before any chunk is read, the progress is only stored while it is unchanged
+	struct stat img_stat;
+	if (stat(img_path, &img_stat) < 0 || img_stat.st_size <= 0) {
+		ERROR("Failed to get size of image %s", img_path);
+		return NULL;
+	}
+
+	image_chunks_t *chunks = mem_new0(image_chunks_t, 1);
+	chunks->img_path = mem_strdup(img_path);
+	chunks->img_stat = img_stat;
+	chunks->root = mem_strdup(root);
+	chunks->size = img_stat.st_size;
+	chunks->e = e;
+
+	size_t count;
+	mount_entry_get_chunk_sha256(e, &count);
+	if ((count ? image_chunks_init_config(chunks) : image_chunks_init_verity(chunks)) < 0)
+		goto err;
+
+	size_t len = 0;
+	chunks->verified_len = (chunks->n_chunks + 7) / 8;
+	chunks->verified = hash_cache_get_chunks_new(img_path, root, &len);
+	if (chunks->verified && len != chunks->verified_len) {
+		WARN("Discarding verification progress of image %s with invalid size", img_path);
+		mem_free0(chunks->verified);
+	}
+	if (!chunks->verified)
+		chunks->verified = mem_alloc0(chunks->verified_len);
+
+	DEBUG("Image %s has %zu chunks of %" PRIu64 " bytes (root %s)", img_path, chunks->n_chunks,
+	      chunks->chunk_len, root);
+	return chunks;
+err:
+	image_chunks_free(chunks);
+	return NULL;
+}
+
+void
+image_chunks_free(image_chunks_t *chunks)
+{
+	IF_NULL_RETURN(chunks);
+
+	mem_free0(chunks->img_path);
+	mem_free0(chunks->root);
+	if (chunks->hash_img_path)
+		mem_free0(chunks->hash_img_path);
+	if (chunks->manifest)
+		mem_free0(chunks->manifest);
+	if (chunks->verified)
+		mem_free0(chunks->verified);
+	mem_free0(chunks);
+}
+
+size_t
+image_chunks_get_count(const image_chunks_t *chunks)
+{
+	ASSERT(chunks);
+	return chunks->n_chunks;
+}
+
+const char *
+image_chunks_get_root(const image_chunks_t *chunks)
+{
+	ASSERT(chunks);
+	return chunks->root;
+}
+
+bool
+image_chunks_is_verified(const image_chunks_t *chunks)
+{
+	ASSERT(chunks);
+
+	for (size_t i = 0; i < chunks->n_chunks; i++) {
+		if (!image_chunks_is_chunk_verified(chunks, i))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Loads the chunk digests listed in the config and checks them against the root hash.
+ */
+static int
+image_chunks_load_config(image_chunks_t *chunks)
+{
+	size_t count;
+	char **hashes = mount_entry_get_chunk_sha256(chunks->e, &count);
+
+	uint8_t *manifest = mem_alloc0(count * IMAGE_CHUNKS_HASH_LEN);
+	for (size_t i = 0; i < count; i++) {
+		if (strlen(hashes[i]) != 2 * IMAGE_CHUNKS_HASH_LEN ||
+		    convert_hex_to_bin(hashes[i], strlen(hashes[i]),
+				       manifest + i * IMAGE_CHUNKS_HASH_LEN,
+				       IMAGE_CHUNKS_HASH_LEN)) {
+			ERROR("Invalid hash of chunk %zu of image %s", i, chunks->img_path);
+			goto err;
+		}
+	}
+
+	char *root = crypto_hash_buf_block_new(manifest, count * IMAGE_CHUNKS_HASH_LEN, SHA256);
+	bool match = crypto_match_hash(IMAGE_CHUNKS_HASH_LEN, chunks->root, root);
+	if (root)
+		mem_free0(root);
+	if (!match) {
+		ERROR("Chunk hashes of image %s do not match the chunks root hash",
+		      chunks->img_path);
+		goto err;
+	}
+
+	chunks->manifest = manifest;
+	chunks->digests = manifest;
+	return 0;
+err:
+	mem_free0(manifest);
+	return -1;
+}
+
+typedef struct {
+	uint8_t *digests;
+	size_t n;
+} image_chunks_tree_t;
+
+static bool
+image_chunks_tree_cb(UNUSED size_t i, const uint8_t *hashes, size_t hash_len, size_t n_hashes,
+		     void *data)
+{
+	image_chunks_tree_t *tree = data;
+
+	if (!hashes || hash_len != IMAGE_CHUNKS_HASH_LEN || n_hashes != tree->n)
+		return false;
+
+	tree->digests = mem_alloc(n_hashes * hash_len);
+	memcpy(tree->digests, hashes, n_hashes * hash_len);
+	return true;
+}
+
+/*
+ * Loads the dm-verity hash tree and authenticates each of its blocks up to the
+ * root hash. The leaf level then holds the digests of the data blocks.
+ */
+static int
+image_chunks_load_verity(image_chunks_t *chunks)
+{
+	int ret = -1;
+	uint8_t *tree = NULL;
+	image_chunks_tree_t digests = { .digests = NULL, .n = 0 };
+
+	uint64_t hash_block_size = le32toh(chunks->sb.hash_block_size);
+	uint64_t per_block = hash_block_size / IMAGE_CHUNKS_HASH_LEN;
+	uint8_t *salt = chunks->sb.salt;
+	size_t salt_len = le16toh(chunks->sb.salt_size);
+
+	// number of hash blocks of each level, level 0 holds the data block digests
+	uint64_t level_blocks[IMAGE_CHUNKS_VERITY_MAX_LEVELS];
+	int levels = 0;
+	uint64_t blocks = le64toh(chunks->sb.data_blocks);
+	do {
+		if (levels == IMAGE_CHUNKS_VERITY_MAX_LEVELS) {
+			ERROR("dm-verity hash tree of %s has too many levels",
+			      chunks->hash_img_path);
+			return -1;
+		}
+		blocks = (blocks + per_block - 1) / per_block;
+		level_blocks[levels++] = blocks;
+	} while (blocks > 1);
+
+	// levels are stored top level first behind the superblock
+	uint64_t level_start[IMAGE_CHUNKS_VERITY_MAX_LEVELS];
+	uint64_t tree_blocks = 0;
+	for (int l = levels - 1; l >= 0; l--) {
+		level_start[l] = 1 + tree_blocks;
+		tree_blocks += level_blocks[l];
+	}
+
+	uint64_t tree_size = (1 + tree_blocks) * hash_block_size;
+	if (tree_size > INT_MAX || (uint64_t)file_size(chunks->hash_img_path) < tree_size) {
+		ERROR("Invalid size of dm-verity hash tree %s", chunks->hash_img_path);
+		return -1;
+	}
+
+	tree = mem_alloc(tree_size);
+	if (file_read(chunks->hash_img_path, (char *)tree, tree_size) != (int)tree_size) {
+		ERROR("Failed to read dm-verity hash tree %s", chunks->hash_img_path);
+		goto out;
+	}
+
+	// let the scd hash all blocks of the tree at once
+	uint64_t offset = hash_block_size;
+	uint64_t len = tree_blocks * hash_block_size;
+	digests.n = tree_blocks;
+	if (crypto_hash_file_ranges_block(chunks->hash_img_path, SHA256, &offset, &len, 1,
+					  hash_block_size, salt, salt_len, 1,
+					  image_chunks_tree_cb, &digests) < 0 ||
+	    !digests.digests) {
+		ERROR("Failed to hash dm-verity hash tree %s", chunks->hash_img_path);
+		goto out;
+	}
+
+	uint8_t root[IMAGE_CHUNKS_HASH_LEN];
+	if (strlen(chunks->root) != 2 * IMAGE_CHUNKS_HASH_LEN ||
+	    convert_hex_to_bin(chunks->root, strlen(chunks->root), root, sizeof(root))) {
+		ERROR("Invalid chunks root hash of image %s", chunks->img_path);
+		goto out;
+	}
+
+#define TREE_DIGEST(block) (digests.digests + ((block)-1) * IMAGE_CHUNKS_HASH_LEN)
+	if (memcmp(TREE_DIGEST(level_start[levels - 1]), root, IMAGE_CHUNKS_HASH_LEN)) {
+		ERROR("dm-verity hash tree %s does not match the root hash", chunks->hash_img_path);
+		goto out;
+	}
+	for (int l = levels - 2; l >= 0; l--) {
+		const uint8_t *parent = tree + level_start[l + 1] * hash_block_size;
+		for (uint64_t k = 0; k < level_blocks[l]; k++) {
+			const uint8_t *expected = parent + k * IMAGE_CHUNKS_HASH_LEN;
+			if (memcmp(TREE_DIGEST(level_start[l] + k), expected,
+				   IMAGE_CHUNKS_HASH_LEN)) {
+				ERROR("Block %" PRIu64 " of level %d of dm-verity hash tree %s"
+				      " is corrupted",
+				      k, l, chunks->hash_img_path);
+				goto out;
+			}
+		}
+	}
+#undef TREE_DIGEST
+
+	DEBUG("Authenticated dm-verity hash tree %s with %d levels", chunks->hash_img_path, levels);
+	chunks->manifest = tree;
+	chunks->digests = tree + level_start[0] * hash_block_size;
+	tree = NULL;
+	ret = 0;
+out:
+	if (tree)
+		mem_free0(tree);
+	if (digests.digests)
+		mem_free0(digests.digests);
+	return ret;
+}
+
+typedef struct {
+	image_chunks_t *chunks;
+	const size_t *indices; //!< chunk indices of the requested ranges
+	size_t verified;
+	ssize_t bad_chunk;
+	bool failed;
+} image_chunks_batch_t;
+
+static bool
+image_chunks_batch_cb(size_t i, const uint8_t *hashes, size_t hash_len, size_t n_hashes,
+		      void *data)
+{
+	image_chunks_batch_t *batch = data;
+	image_chunks_t *chunks = batch->chunks;
+	size_t chunk = batch->indices[i];
+	uint64_t offset = image_chunks_get_chunk_offset(chunks, chunk);
+	uint64_t len = image_chunks_get_chunk_len(chunks, chunk);
+
+	if (!hashes || hash_len != IMAGE_CHUNKS_HASH_LEN ||
+	    n_hashes != (len + chunks->block_size - 1) / chunks->block_size) {
+		ERROR("Failed to hash chunk %zu of image %s", chunk, chunks->img_path);
+		batch->failed = true;
+		return false;
+	}
+
+	if (memcmp(hashes, chunks->digests + chunk * chunks->digests_stride, n_hashes * hash_len)) {
+		ERROR("Chunk %zu (bytes %" PRIu64 "-%" PRIu64 ") of image %s is corrupted", chunk,
+		      offset, offset + len - 1, chunks->img_path);
+		batch->bad_chunk = chunk;
+		return false;
+	}
+
+	TRACE("Verified chunk %zu of image %s", chunk, chunks->img_path);
+	image_chunks_set_chunk_verified(chunks, chunk);
+	batch->verified++;
+	return true;
+}
+
+int
+image_chunks_verify_block(image_chunks_t *chunks, uint64_t offset, uint64_t len,
+			  unsigned int workers, ssize_t *bad_chunk)
+{
+	ASSERT(chunks);
+
+	if (bad_chunk)
+		*bad_chunk = -1;
+
+	IF_TRUE_RETVAL(len == 0, 0);
+	if (offset >= chunks->size || len > chunks->size - offset) {
+		ERROR("Range %" PRIu64 "+%" PRIu64 " exceeds image %s", offset, len,
+		      chunks->img_path);
+		return -1;
+	}
+
+	size_t first = offset / chunks->chunk_len;
+	size_t last = (offset + len - 1) / chunks->chunk_len;
+
+	size_t *pending = mem_new0(size_t, last - first + 1);
+	size_t n_pending = 0;
+	for (size_t i = first; i <= last; i++) {
+		if (!image_chunks_is_chunk_verified(chunks, i))
+			pending[n_pending++] = i;
+	}
+	DEBUG("Verifying %zu of %zu chunks of image %s", n_pending, last - first + 1,
+	      chunks->img_path);
+
+	int ret = 0;
+	if (n_pending > 0 && !chunks->digests) {
+		if ((chunks->hash_img_path ? image_chunks_load_verity(chunks) :
+					     image_chunks_load_config(chunks)) < 0) {
+			ret = -1;
+			goto out;
+		}
+	}
+
+	// data blocks are salted like the blocks of the dm-verity hash tree
+	const uint8_t *salt = chunks->hash_img_path ? chunks->sb.salt : NULL;
+	size_t salt_len = chunks->hash_img_path ? le16toh(chunks->sb.salt_size) : 0;
+
+	uint64_t offsets[IMAGE_CHUNKS_BATCH];
+	uint64_t lens[IMAGE_CHUNKS_BATCH];
+	for (size_t done = 0; done < n_pending;) {
+		size_t n = MIN(n_pending - done, (size_t)IMAGE_CHUNKS_BATCH);
+		for (size_t i = 0; i < n; i++) {
+			offsets[i] = image_chunks_get_chunk_offset(chunks, pending[done + i]);
+			lens[i] = image_chunks_get_chunk_len(chunks, pending[done + i]);
+		}
+
+		image_chunks_batch_t batch = { .chunks = chunks,
+					       .indices = pending + done,
+					       .verified = 0,
+					       .bad_chunk = -1,
+					       .failed = false };
+		int res = crypto_hash_file_ranges_block(chunks->img_path, SHA256, offsets, lens, n,
+							chunks->block_size, salt, salt_len, workers,
+							image_chunks_batch_cb, &batch);
+
+		// the progress is stored in between batches, as storing the hash
+		// cache uses the scd connection of the requests in flight
+		if (batch.verified > 0)
+			hash_cache_put_chunks(chunks->img_path, &chunks->img_stat, chunks->root,
+					      chunks->verified, chunks->verified_len);
+
+		if (res < 0 || batch.failed || batch.bad_chunk >= 0) {
+			if (bad_chunk)
+				*bad_chunk = batch.bad_chunk;
+			ret = -1;
+			goto out;
+		}
+		done += n;
+	}
+
+out:
+	mem_free0(pending);
+	return ret;
+}
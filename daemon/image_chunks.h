@@ -0,0 +1,104 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file image_chunks.h
+ *
+ * Chunk-wise verification of GuestOS image files. The image is split into
+ * chunks whose SHA256 digests are authenticated by a root hash from the signed
+ * GuestOS config. The chunk digests are either listed in the config (the root
+ * is the SHA256 over the concatenated binary chunk digests) or are taken from
+ * the dm-verity hash tree of the image (<image>.hash.img), in which case the
+ * root is the verity root hash and a chunk covers the data blocks of one leaf
+ * hash block.
+ *
+ * Chunks are hashed concurrently by the scd. The set of verified chunks is
+ * kept in the hash cache, so that an interrupted verification resumes with the
+ * remaining chunks, and a corrupted chunk is reported with its byte range.
+ */
+
+#ifndef IMAGE_CHUNKS_H
+#define IMAGE_CHUNKS_H
+
+#include "mount.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct image_chunks image_chunks_t;
+
+/**
+ * Creates the chunk layout of the image at img_path as described by the
+ * mount entry e and loads the verification progress from the hash cache.
+ * The chunk digests are only loaded and authenticated against the root hash
+ * once chunks are actually verified.
+ *
+ * @param img_path path of the image file
+ * @param e mount entry of the image with a chunks root hash
+ * @return the new chunk layout or NULL on error
+ */
+image_chunks_t *
+image_chunks_new(const char *img_path, const mount_entry_t *e);
+
+/**
+ * Frees the chunk layout.
+ */
+void
+image_chunks_free(image_chunks_t *chunks);
+
+/**
+ * Returns the number of chunks of the image.
+ */
+size_t
+image_chunks_get_count(const image_chunks_t *chunks);
+
+/**
+ * Returns the hex string of the root hash the chunks are verified against.
+ */
+const char *
+image_chunks_get_root(const image_chunks_t *chunks);
+
+/**
+ * Returns true if all chunks of the image have already been verified.
+ */
+bool
+image_chunks_is_verified(const image_chunks_t *chunks);
+
+/**
+ * Verifies all chunks overlapping the byte range [offset, offset + len) of
+ * the image which have not been verified yet, keeping up to workers requests
+ * in flight at the scd. The progress is stored in the hash cache.
+ *
+ * @param chunks the chunk layout of the image
+ * @param offset the offset of the range in bytes
+ * @param len the length of the range in bytes
+ * @param workers the maximum number of chunks hashed concurrently
+ * @param bad_chunk if not NULL, receives the index of a corrupted chunk or -1
+ * @return 0 if all chunks of the range are valid, -1 otherwise
+ */
+int
+image_chunks_verify_block(image_chunks_t *chunks, uint64_t offset, uint64_t len,
+			  unsigned int workers, ssize_t *bad_chunk);
+
+#endif /* IMAGE_CHUNKS_H */
@@ -0,0 +1,265 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+//#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
+
+#include "image_delta.h"
+
+#include "common/chunk_delta.h"
+#include "common/macro.h"
+#include "common/mem.h"
+#include "common/event.h"
+#include "common/fd.h"
+#include "common/file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct image_delta {
+	char *base_path;
+	char *img_path;
+	char *delta_path;
+	chunk_delta_t *chunks;
+	pid_t pid;
+	event_child_watch_t *watch;
+	image_delta_callback_t cb;
+	void *data;
+};
+
+/*
+ * Returns the chunk digests of e if they are listed in the config and match its size.
+ */
+static char **
+image_delta_get_chunks(const mount_entry_t *e, size_t *count)
+{
+	uint32_t chunk_size = mount_entry_get_chunk_size(e);
+	IF_TRUE_RETVAL(!mount_entry_get_chunks_root_sha256(e) || chunk_size == 0, NULL);
+
+	char **hashes = mount_entry_get_chunk_sha256(e, count);
+	IF_TRUE_RETVAL(!hashes || *count == 0, NULL);
+
+	uint64_t size = mount_entry_get_size(e);
+	if (*count != (size + chunk_size - 1) / chunk_size) {
+		WARN("Chunks of image %s do not match its size", mount_entry_get_img(e));
+		return NULL;
+	}
+	return hashes;
+}
+
+image_delta_t *
+image_delta_new(const mount_entry_t *base, const char *base_path, const mount_entry_t *e,
+		const char *img_path)
+{
+	ASSERT(base);
+	ASSERT(base_path);
+	ASSERT(e);
+	ASSERT(img_path);
+
+	size_t base_count, count;
+	char **base_hashes = image_delta_get_chunks(base, &base_count);
+	char **hashes = image_delta_get_chunks(e, &count);
+	IF_TRUE_RETVAL(!base_hashes || !hashes, NULL);
+
+	uint32_t chunk_size = mount_entry_get_chunk_size(e);
+	uint64_t base_size = mount_entry_get_size(base);
+	if (mount_entry_get_chunk_size(base) != chunk_size) {
+		DEBUG("Chunk size of image %s differs from base image, no delta possible",
+		      mount_entry_get_img(e));
+		return NULL;
+	}
+	if (file_size(base_path) != (off_t)base_size) {
+		DEBUG("Base image %s is missing or incomplete, no delta possible", base_path);
+		return NULL;
+	}
+
+	chunk_delta_t *chunks = chunk_delta_new(base_hashes, base_count, base_size, hashes, count,
+						mount_entry_get_size(e), chunk_size);
+	IF_NULL_RETVAL(chunks, NULL);
+
+	image_delta_t *delta = mem_new0(image_delta_t, 1);
+	delta->base_path = mem_strdup(base_path);
+	delta->img_path = mem_strdup(img_path);
+	delta->chunks = chunks;
+	delta->pid = -1;
+
+	DEBUG("Image %s: %zu of %zu chunks found in base image, delta of %" PRIu64 " bytes",
+	      mount_entry_get_img(e), chunk_delta_get_reused(chunks), count,
+	      chunk_delta_get_size(chunks));
+	return delta;
+}
+
+void
+image_delta_free(image_delta_t *delta)
+{
+	IF_NULL_RETURN(delta);
+
+	if (delta->watch) {
+		event_remove_child_watch(delta->watch);
+		event_child_watch_free(delta->watch);
+		kill(delta->pid, SIGKILL);
+		waitpid(delta->pid, NULL, 0);
+		if (delta->delta_path)
+			unlink(delta->delta_path);
+	}
+	mem_free0(delta->base_path);
+	mem_free0(delta->img_path);
+	mem_free0(delta->delta_path);
+	chunk_delta_free(delta->chunks);
+	mem_free0(delta);
+}
+
+uint64_t
+image_delta_get_size(const image_delta_t *delta)
+{
+	ASSERT(delta);
+	return chunk_delta_get_size(delta->chunks);
+}
+
+/*
+ * Writes the new image to a temporary file, which replaces the image file once it is
+ * complete, so that stale cached digests of the image file are not applied to it.
+ * Runs in the child process.
+ */
+static int
+image_delta_reconstruct(const image_delta_t *delta)
+{
+	int ret = -1;
+	int base_fd = -1, delta_fd = -1, out_fd = -1;
+	char *tmp_path = mem_printf("%s.tmp", delta->img_path);
+
+	base_fd = open(delta->base_path, O_RDONLY | O_CLOEXEC);
+	if (base_fd < 0) {
+		ERROR_ERRNO("Could not open base image %s", delta->base_path);
+		goto out;
+	}
+	if (delta->delta_path) {
+		delta_fd = open(delta->delta_path, O_RDONLY | O_CLOEXEC);
+		if (delta_fd < 0) {
+			ERROR_ERRNO("Could not open delta %s", delta->delta_path);
+			goto out;
+		}
+	}
+	out_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 00644);
+	if (out_fd < 0) {
+		ERROR_ERRNO("Could not create %s", tmp_path);
+		goto out;
+	}
+
+	if (chunk_delta_write(delta->chunks, base_fd, delta_fd, out_fd) < 0) {
+		ERROR("Could not write %s", tmp_path);
+		goto out;
+	}
+
+	if (fsync(out_fd) < 0) {
+		ERROR_ERRNO("Could not sync %s", tmp_path);
+		goto out;
+	}
+	if (rename(tmp_path, delta->img_path) < 0) {
+		ERROR_ERRNO("Could not rename %s to %s", tmp_path, delta->img_path);
+		goto out;
+	}
+	ret = 0;
+out:
+	if (ret < 0 && out_fd >= 0)
+		unlink(tmp_path);
+	if (out_fd >= 0)
+		close(out_fd);
+	if (delta_fd >= 0)
+		close(delta_fd);
+	if (base_fd >= 0)
+		close(base_fd);
+	mem_free0(tmp_path);
+	return ret;
+}
+
+static void
+image_delta_child_cb(pid_t pid, int status, event_child_watch_t *watch, void *data)
+{
+	image_delta_t *delta = data;
+	ASSERT(delta);
+
+	bool success = status != -1 && WIFEXITED(status) && !WEXITSTATUS(status);
+	DEBUG("Reconstruction of %s (PID=%d) %s", delta->img_path, pid,
+	      success ? "succeeded" : "failed");
+
+	event_child_watch_free(watch);
+	delta->watch = NULL;
+	delta->pid = -1;
+	if (delta->delta_path && unlink(delta->delta_path) < 0 && errno != ENOENT)
+		WARN_ERRNO("Could not remove delta %s", delta->delta_path);
+
+	delta->cb(delta, success, delta->data);
+}
+
+int
+image_delta_apply(image_delta_t *delta, const char *delta_path, image_delta_callback_t cb,
+		  void *data)
+{
+	ASSERT(delta);
+	ASSERT(cb);
+	ASSERT(!delta->watch);
+
+	uint64_t delta_size = chunk_delta_get_size(delta->chunks);
+	if (delta_size > 0 && (!delta_path || file_size(delta_path) != (off_t)delta_size)) {
+		WARN("Delta for %s does not have the expected size of %" PRIu64 " bytes",
+		     delta->img_path, delta_size);
+		if (delta_path)
+			unlink(delta_path);
+		return -1;
+	}
+	mem_free0(delta->delta_path);
+	delta->delta_path = delta_path ? mem_strdup(delta_path) : NULL;
+
+	pid_t pid = fork();
+	switch (pid) {
+	case -1:
+		ERROR_ERRNO("Could not fork to reconstruct %s", delta->img_path);
+		return -1;
+	case 0:
+		_exit(image_delta_reconstruct(delta) < 0 ? 1 : 0);
+	default:
+		INFO("Reconstructing %s from %s (PID=%d)", delta->img_path, delta->base_path, pid);
+		event_child_watch_t *watch =
+			event_child_watch_new(pid, image_delta_child_cb, delta);
+		if (event_add_child_watch(watch) < 0) {
+			ERROR("Could not watch reconstruction of %s (PID=%d)", delta->img_path,
+			      pid);
+			event_child_watch_free(watch);
+			kill(pid, SIGKILL);
+			waitpid(pid, NULL, 0);
+			if (delta->delta_path)
+				unlink(delta->delta_path);
+			return -1;
+		}
+		delta->pid = pid;
+		delta->cb = cb;
+		delta->data = data;
+		delta->watch = watch;
+		return 0;
+	}
+}
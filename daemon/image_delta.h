@@ -0,0 +1,95 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file image_delta.h
+ *
+ * Reconstruction of a GuestOS image from the image of the same name of an
+ * installed base version and a delta file. Both images must list their chunk
+ * digests in the GuestOS config with the same chunk size. Every chunk of the
+ * new image whose digest is also found among the chunks of the base image is
+ * copied from the base image; the delta file contains the remaining chunks,
+ * concatenated in the order of the new image.
+ *
+ * The reconstructed image is not verified here, it has to be checked against
+ * the signed chunks root hash like a downloaded one.
+ */
+
+#ifndef IMAGE_DELTA_H
+#define IMAGE_DELTA_H
+
+#include "mount.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct image_delta image_delta_t;
+
+/**
+ * Callback type for image_delta_apply() to report whether the image has been
+ * written completely.
+ */
+typedef void (*image_delta_callback_t)(image_delta_t *delta, bool success, void *data);
+
+/**
+ * Matches the chunks of the image described by e against the chunks of the
+ * base image.
+ *
+ * @param base mount entry of the image in the base version
+ * @param base_path path of the base image file
+ * @param e mount entry of the new image
+ * @param img_path path the new image is written to
+ * @return the delta or NULL if the images are not chunked compatibly
+ */
+image_delta_t *
+image_delta_new(const mount_entry_t *base, const char *base_path, const mount_entry_t *e,
+		const char *img_path);
+
+/**
+ * Frees the delta, a reconstruction in progress is killed.
+ */
+void
+image_delta_free(image_delta_t *delta);
+
+/**
+ * Returns the size of the delta file, i.e., the number of bytes of the new
+ * image which are not found in the base image.
+ */
+uint64_t
+image_delta_get_size(const image_delta_t *delta);
+
+/**
+ * Writes the new image from the base image and the given delta file in a child
+ * process and calls cb once it is done. The delta file is removed afterwards.
+ *
+ * @param delta the delta
+ * @param delta_path the delta file or NULL if its size is 0
+ * @param cb callback to report the result
+ * @param data data parameter passed to the callback
+ * @return 0 if the reconstruction has been started, -1 otherwise
+ */
+int
+image_delta_apply(image_delta_t *delta, const char *delta_path, image_delta_callback_t cb,
+		  void *data);
+
+#endif /* IMAGE_DELTA_H */
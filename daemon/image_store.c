@@ -0,0 +1,222 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+//#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
+
+#include "image_store.h"
+#include "hash_cache.h"
+
+#include "common/macro.h"
+#include "common/mem.h"
+#include "common/dir.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IMAGE_STORE_SHA256_LEN 64
+
+static char *image_store_path = NULL;
+
+int
+image_store_init(const char *path)
+{
+	ASSERT(path);
+	ASSERT(!image_store_path);
+
+	if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+		ERROR_ERRNO("Could not create image store %s", path);
+		return -1;
+	}
+	image_store_path = mem_strdup(path);
+	return 0;
+}
+
+/*
+ * Returns the path of the stored image with the given digest, or NULL if the
+ * store is not initialized or the digest is malformed.
+ */
+static char *
+image_store_file_new(const char *sha256)
+{
+	IF_NULL_RETVAL(image_store_path, NULL);
+	IF_NULL_RETVAL(sha256, NULL);
+
+	if (strlen(sha256) != IMAGE_STORE_SHA256_LEN)
+		return NULL;
+	char *file = mem_printf("%s/%s", image_store_path, sha256);
+	// the store is keyed by lower case digests
+	for (char *c = file + strlen(image_store_path) + 1; *c; c++) {
+		if (!isxdigit((unsigned char)*c)) {
+			mem_free0(file);
+			return NULL;
+		}
+		*c = tolower((unsigned char)*c);
+	}
+	return file;
+}
+
+/*
+ * Atomically replaces dst with a hard link to src.
+ */
+static int
+image_store_replace_with_link(const char *src, const char *dst)
+{
+	char *tmp = mem_printf("%s.link.tmp", dst);
+	int ret = -1;
+
+	if (unlink(tmp) < 0 && errno != ENOENT)
+		WARN_ERRNO("Could not remove %s", tmp);
+	if (link(src, tmp) < 0) {
+		WARN_ERRNO("Could not link %s to %s", tmp, src);
+		goto out;
+	}
+	if (rename(tmp, dst) < 0) {
+		WARN_ERRNO("Could not replace %s with link to %s", dst, src);
+		unlink(tmp);
+		goto out;
+	}
+	ret = 0;
+out:
+	mem_free0(tmp);
+	return ret;
+}
+
+bool
+image_store_link(const char *sha256, const char *img_path)
+{
+	ASSERT(img_path);
+
+	bool ret = false;
+	char *file = image_store_file_new(sha256);
+	IF_NULL_RETVAL(file, false);
+
+	struct stat s, img_s;
+	if (stat(file, &s) < 0)
+		goto out;
+	if (stat(img_path, &img_s) == 0 && img_s.st_dev == s.st_dev && img_s.st_ino == s.st_ino) {
+		ret = true;
+		goto out;
+	}
+
+	if (image_store_replace_with_link(file, img_path) < 0)
+		goto out;
+	hash_cache_relink(file, &s, 1);
+
+	INFO("Linked %s to stored image %s", img_path, file);
+	ret = true;
+out:
+	mem_free0(file);
+	return ret;
+}
+
+void
+image_store_add(const char *sha256, const char *img_path)
+{
+	ASSERT(img_path);
+
+	char *file = image_store_file_new(sha256);
+	IF_NULL_RETURN(file);
+
+	struct stat img_s;
+	if (stat(img_path, &img_s) < 0) {
+		WARN_ERRNO("Could not stat %s", img_path);
+		goto out;
+	}
+
+	if (link(img_path, file) == 0) {
+		hash_cache_relink(file, &img_s, 1);
+		DEBUG("Added %s to image store", img_path);
+	} else if (errno == EEXIST) {
+		// the image is stored already, drop the duplicate
+		image_store_link(sha256, img_path);
+	} else {
+		WARN_ERRNO("Could not add %s to image store", img_path);
+	}
+out:
+	mem_free0(file);
+}
+
+bool
+image_store_release(const char *sha256, const char *img_path)
+{
+	ASSERT(img_path);
+
+	struct stat img_s;
+	if (stat(img_path, &img_s) < 0 || img_s.st_nlink <= 1)
+		return false;
+
+	if (unlink(img_path) < 0) {
+		WARN_ERRNO("Could not remove shared image %s", img_path);
+		return false;
+	}
+	DEBUG("Released shared image %s", img_path);
+
+	char *file = image_store_file_new(sha256);
+	struct stat s;
+	if (file && stat(file, &s) == 0 && s.st_dev == img_s.st_dev && s.st_ino == img_s.st_ino)
+		hash_cache_relink(file, &img_s, -1);
+	mem_free0(file);
+	return true;
+}
+
+void
+image_store_remove(const char *sha256)
+{
+	char *file = image_store_file_new(sha256);
+	IF_NULL_RETURN(file);
+
+	if (unlink(file) < 0 && errno != ENOENT)
+		WARN_ERRNO("Could not remove %s from image store", file);
+	else
+		INFO("Removed %s from image store", file);
+	mem_free0(file);
+}
+
+static int
+image_store_purge_cb(const char *path, const char *name, UNUSED void *data)
+{
+	char *file = mem_printf("%s/%s", path, name);
+	struct stat s;
+
+	// no GuestOS directory links to the stored image anymore
+	if (stat(file, &s) == 0 && S_ISREG(s.st_mode) && s.st_nlink == 1) {
+		if (unlink(file) < 0)
+			WARN_ERRNO("Could not remove unused stored image %s", file);
+		else
+			DEBUG("Removed unused stored image %s", file);
+	}
+	mem_free0(file);
+	return 0;
+}
+
+void
+image_store_purge(void)
+{
+	IF_NULL_RETURN(image_store_path);
+
+	if (dir_foreach(image_store_path, image_store_purge_cb, NULL) < 0)
+		WARN("Could not purge image store %s", image_store_path);
+}
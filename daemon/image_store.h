@@ -0,0 +1,90 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file image_store.h
+ *
+ * Content-addressed store of GuestOS image files, keyed by the SHA256 digest
+ * of an image as given in the signed GuestOS config. The image files in the
+ * GuestOS directories are hard links to the files in the store, so that an
+ * image shared by several GuestOS versions or GuestOSes is only stored and
+ * downloaded once. The link count of a file in the store serves as its
+ * reference count; files which are no longer linked to by any GuestOS are
+ * removed by image_store_purge().
+ *
+ * The store does not verify the images, only verified images must be added,
+ * and linked images have to be checked like downloaded ones.
+ */
+
+#ifndef IMAGE_STORE_H
+#define IMAGE_STORE_H
+
+#include <stdbool.h>
+
+/**
+ * Creates the store directory, which must reside on the same file system as
+ * the GuestOS directories.
+ * @return 0 on success, -1 otherwise
+ */
+int
+image_store_init(const char *path);
+
+/**
+ * Replaces the image file at img_path with a link to the stored image with
+ * the given digest.
+ * @return true if the image has been found in the store and linked
+ */
+bool
+image_store_link(const char *sha256, const char *img_path);
+
+/**
+ * Adds the verified image file at img_path to the store. If an image with the
+ * same digest is already stored, img_path is replaced with a link to it.
+ */
+void
+image_store_add(const char *sha256, const char *img_path);
+
+/**
+ * Removes the image file at img_path if it is shared with the store or other
+ * GuestOSes, e.g., before it is written or when its GuestOS is removed.
+ * @param sha256 digest of the image according to the GuestOS config
+ * @param img_path the image file
+ * @return true if the image file has been removed
+ */
+bool
+image_store_release(const char *sha256, const char *img_path);
+
+/**
+ * Removes the stored image with the given digest, e.g., if it turned out to be
+ * corrupted. Existing links to it are not affected.
+ */
+void
+image_store_remove(const char *sha256);
+
+/**
+ * Removes all stored images which are not linked to by any GuestOS anymore.
+ */
+void
+image_store_purge(void);
+
+#endif /* IMAGE_STORE_H */
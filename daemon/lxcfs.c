@@ -66,21 +66,11 @@ lxcfs_get_bin_path_if_supported(void)
 }
 
 static void
-lxcfs_daemon_sigchld_cb(UNUSED int signum, event_signal_t *sig, void *data)
+lxcfs_daemon_child_cb(pid_t pid, UNUSED int status, event_child_watch_t *watch,
+		      UNUSED void *data)
 {
-	pid_t *lxcfs_pid = data;
-	pid_t pid;
-	int status = 0;
-
-	TRACE("lxcfs SIGCHLD handler called for PID %d", *lxcfs_pid);
-	if ((pid = waitpid(*lxcfs_pid, &status, WNOHANG)) > 0) {
-		TRACE("Reaped lxcfs process: %d", pid);
-		/* remove the sigchld callback for the lxcfs daemon from the event loop */
-		event_remove_signal(sig);
-		event_signal_free(sig);
-	} else {
-		TRACE("Failed to reap lxcfs process");
-	}
+	TRACE("Reaped lxcfs process: %d", pid);
+	event_child_watch_free(watch);
 }
 
 static void
@@ -123,9 +113,9 @@ lxcfs_daemon_start(const char *rt_path)
 		_exit(-1);
 	} else {
 		INFO("lxcfs daemon start done");
-		event_signal_t *sigchld =
-			event_signal_new(SIGCHLD, lxcfs_daemon_sigchld_cb, &lxcfs_daemon_pid);
-		event_add_signal(sigchld);
+		event_child_watch_t *watch =
+			event_child_watch_new(lxcfs_daemon_pid, lxcfs_daemon_child_cb, NULL);
+		event_add_child_watch(watch);
 	}
 
 	return 0;
@@ -56,6 +56,10 @@ struct mount_entry {
 	char *sha256;
 	char *mount_data; /**< mount_data to use for mount syscall e.g. "uid=1000,gid=1000,dmask=227,fmask=337,context=u:object_r:firmware_file:s0" */
 	char *verity_sha256;
+	uint32_t chunk_size;	    /**< size of the image chunks listed in chunk_sha256 */
+	char **chunk_sha256;	    /**< SHA256 hashes of the image chunks */
+	size_t chunk_sha256_count;  /**< number of entries in chunk_sha256 */
+	char *chunks_root_sha256; /**< SHA256 root over the chunk hashes */
 };
 
 mount_t *
@@ -82,6 +86,10 @@ mount_add_entry(mount_t *mnt, enum mount_type type, const char *image_file, cons
 	mntent->sha256 = NULL;
 	mntent->mount_data = NULL;
 	mntent->verity_sha256 = NULL;
+	mntent->chunk_size = 0;
+	mntent->chunk_sha256 = NULL;
+	mntent->chunk_sha256_count = 0;
+	mntent->chunks_root_sha256 = NULL;
 
 	mnt->list = list_append(mnt->list, mntent);
 	return mntent;
@@ -106,6 +114,14 @@ mount_free(mount_t *mnt)
 			mem_free0(mntent->sha256);
 		if (mntent->mount_data)
 			mem_free0(mntent->mount_data);
+		if (mntent->verity_sha256)
+			mem_free0(mntent->verity_sha256);
+		for (size_t i = 0; i < mntent->chunk_sha256_count; ++i)
+			mem_free0(mntent->chunk_sha256[i]);
+		if (mntent->chunk_sha256)
+			mem_free0(mntent->chunk_sha256);
+		if (mntent->chunks_root_sha256)
+			mem_free0(mntent->chunks_root_sha256);
 		mem_free0(mntent);
 		mnt->list = list_unlink(mnt->list, mnt->list);
 	}
@@ -344,6 +360,62 @@ mount_entry_set_verity_sha256(mount_entry_t *mntent, char *sha256)
 	mntent->verity_sha256 = mem_strdup(sha256);
 }
 
+uint32_t
+mount_entry_get_chunk_size(const mount_entry_t *mntent)
+{
+	ASSERT(mntent);
+	return mntent->chunk_size;
+}
+
+void
+mount_entry_set_chunk_size(mount_entry_t *mntent, uint32_t chunk_size)
+{
+	ASSERT(mntent);
+	mntent->chunk_size = chunk_size;
+}
+
+char **
+mount_entry_get_chunk_sha256(const mount_entry_t *mntent, size_t *count)
+{
+	ASSERT(mntent);
+	ASSERT(count);
+	*count = mntent->chunk_sha256_count;
+	return mntent->chunk_sha256;
+}
+
+void
+mount_entry_set_chunk_sha256(mount_entry_t *mntent, char **sha256, size_t count)
+{
+	ASSERT(mntent);
+	IF_TRUE_RETURN(count > 0 && sha256 == NULL);
+
+	for (size_t i = 0; i < mntent->chunk_sha256_count; ++i)
+		mem_free0(mntent->chunk_sha256[i]);
+	if (mntent->chunk_sha256)
+		mem_free0(mntent->chunk_sha256);
+
+	mntent->chunk_sha256 = count ? mem_new0(char *, count) : NULL;
+	for (size_t i = 0; i < count; ++i)
+		mntent->chunk_sha256[i] = mem_strdup(sha256[i]);
+	mntent->chunk_sha256_count = count;
+}
+
+char *
+mount_entry_get_chunks_root_sha256(const mount_entry_t *mntent)
+{
+	ASSERT(mntent);
+	return mntent->chunks_root_sha256;
+}
+
+void
+mount_entry_set_chunks_root_sha256(mount_entry_t *mntent, char *sha256)
+{
+	ASSERT(mntent);
+	IF_NULL_RETURN(sha256);
+	TRACE("Setting chunks root sha256 to %s", sha256);
+	mntent->chunks_root_sha256 = mem_strdup(sha256);
+}
+
 bool
 mount_entry_match_sha1(const mount_entry_t *e, const char *hash)
 {
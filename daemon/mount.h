@@ -166,6 +166,44 @@ mount_entry_set_sha256(mount_entry_t *mntent, char *sha256);
 void
 mount_entry_set_verity_sha256(mount_entry_t *mntent, char *sha256);
 
+/**
+ * Returns the size of the image chunks listed by mount_entry_get_chunk_sha256(),
+ * the last chunk may be shorter.
+ */
+uint32_t
+mount_entry_get_chunk_size(const mount_entry_t *mntent);
+
+/**
+ * Sets the size of the image chunks.
+ */
+void
+mount_entry_set_chunk_size(mount_entry_t *mntent, uint32_t chunk_size);
+
+/**
+ * Returns the SHA256 hashes of the image chunks and stores their number in count.
+ */
+char **
+mount_entry_get_chunk_sha256(const mount_entry_t *mntent, size_t *count);
+
+/**
+ * Sets (copies) the SHA256 hashes of the image chunks.
+ */
+void
+mount_entry_set_chunk_sha256(mount_entry_t *mntent, char **sha256, size_t count);
+
+/**
+ * Returns the SHA256 root hash over the image chunk hashes or NULL
+ * if the image is not verified chunk-wise.
+ */
+char *
+mount_entry_get_chunks_root_sha256(const mount_entry_t *mntent);
+
+/**
+ * Sets the SHA256 root hash over the image chunk hashes.
+ */
+void
+mount_entry_set_chunks_root_sha256(mount_entry_t *mntent, char *sha256);
+
 /**
  * Checks if the given SHA1 hash matches with the one stored in the mount entry.
  */
@@ -41,8 +41,10 @@
 #include "common/uuid.h"
 #include "common/event.h"
 #include "common/fd.h"
+#include "common/frame.h"
 #include "common/logf.h"
 #include "common/list.h"
+#include "common/array.h"
 #include "common/network.h"
 #include "common/reboot.h"
 #include "common/file.h"
@@ -69,8 +71,8 @@
 #define OCI_CONTROL_REMOTE_RECONNECT_INTERVAL 10000
 
 struct oci_control {
-	int sock;			      // listen socket fd
-	list_t *event_io_sock_connected_list; // list of clients
+	int sock;	   // listen socket fd
+	list_t *conn_list; // list of connected clients (frame_conn_t)
 };
 
 struct oci_container {
@@ -92,7 +94,7 @@ typedef struct oci_hook {
 	char **envp;
 } oci_hook_t;
 
-static list_t *oci_containers_list = NULL;
+static array_t *oci_containers = NULL;
 static list_t *oci_control_list = NULL;
 
 /**
@@ -365,8 +367,8 @@ oci_do_hooks_poststop(const container_t *container)
 oci_container_t *
 oci_get_oci_container_by_container(const container_t *container)
 {
-	for (list_t *l = oci_containers_list; l; l = l->next) {
-		oci_container_t *oci_container = l->data;
+	for (unsigned int i = 0; i < array_length(oci_containers); i++) {
+		oci_container_t *oci_container = array_get(oci_containers, i);
 		if (container == oci_container->container)
 			return oci_container;
 	}
@@ -396,7 +398,7 @@ oci_container_free(oci_container_t *oci_container)
 {
 	IF_NULL_RETURN(oci_container);
 
-	oci_containers_list = list_remove(oci_containers_list, oci_container);
+	array_remove(oci_containers, oci_container);
 
 	// do not free oci_container->container, this is done by cmld module
 
@@ -626,7 +628,7 @@ oci_container_new(const char *store_path, const char *peer_path, const char *bun
 		}
 	}
 
-	oci_containers_list = list_append(oci_containers_list, oci_container);
+	oci_containers = array_append(oci_containers, oci_container);
 out:
 	uuid_free(uuid);
 	mem_free0(images_dir);
@@ -917,49 +919,50 @@ oci_control_handle_message(UNUSED oci_control_t *oci_control, const OciCommand *
 }
 
 /**
- * Event callback for incoming data that receives a oci runtime command message (local)
+ * Callback for a complete oci runtime command message received on a client connection (local)
  *
  * The handle_message function will be called to handle the received message.
  *
- * @param fd	    file descriptor of the client connection
- *		    from which the incoming message is read
- * @param events    event flags
- * @param io	    pointer to associated event_io_t struct
- * @param data	    pointer to this control_t struct
+ * @param conn	    the framed client connection
+ * @param buf	    the packed OciCommand message
+ * @param len	    length of the packed message
+ * @param data	    pointer to this oci_control_t struct
  */
 static void
-oci_control_cb_recv_message(int fd, unsigned events, event_io_t *io, void *data)
+oci_control_conn_recv_cb(frame_conn_t *conn, uint8_t *buf, uint32_t len, void *data)
 {
 	oci_control_t *oci_control = data;
-	/*
-	 * always check READ flag first, since also if the peer called close()
-	 * and there is pending data on the socet the READ and EXCEPT flags are set.
-	 * Thus, we have to read pending date before handling the EXCEPT event.
-	 */
-	if (events & EVENT_IO_READ) {
-		// TODO handle incomming json stream
-		OciCommand *msg = (OciCommand *)protobuf_recv_message(fd, &oci_command__descriptor);
-		// close connection if client EOF, or protocol parse error
-		IF_NULL_GOTO_TRACE(msg, connection_err);
-		oci_control_handle_message(oci_control, msg, fd);
-		TRACE("Handled control connection %d", fd);
-		protobuf_free_message((ProtobufCMessage *)msg);
-	}
-	// also check EXCEPT flag
-	if (events & EVENT_IO_EXCEPT) {
-		INFO("OCI Control client closed connection; disconnecting oci control socket.");
-		goto connection_err;
+	int fd = frame_conn_get_fd(conn);
+
+	// TODO handle incomming json stream
+	OciCommand *msg = (OciCommand *)protobuf_unpack_message(&oci_command__descriptor, buf, len);
+	if (!msg) {
+		// close connection on protocol parse error
+		WARN("Failed to parse message on oci control connection %d; disconnecting", fd);
+		oci_control->conn_list = list_remove(oci_control->conn_list, conn);
+		frame_conn_free(conn);
+		return;
 	}
-	return;
 
-connection_err:
-	event_remove_io(io);
-	event_io_free(io);
-	if (close(fd) < 0)
-		WARN_ERRNO("Failed to close connected oci control socket");
-	oci_control->event_io_sock_connected_list =
-		list_remove(oci_control->event_io_sock_connected_list, io);
-	return;
+	oci_control_handle_message(oci_control, msg, fd);
+	TRACE("Handled control connection %d", fd);
+	protobuf_free_message((ProtobufCMessage *)msg);
+}
+
+/**
+ * Callback for a client connection which was closed by the peer or failed.
+ *
+ * @param conn	    the framed client connection
+ * @param data	    pointer to this oci_control_t struct
+ */
+static void
+oci_control_conn_close_cb(frame_conn_t *conn, void *data)
+{
+	oci_control_t *oci_control = data;
+
+	INFO("OCI Control client closed connection; disconnecting oci control socket.");
+	oci_control->conn_list = list_remove(oci_control->conn_list, conn);
+	frame_conn_free(conn);
 }
 
 /**
@@ -995,13 +998,16 @@ oci_control_cb_accept(int fd, unsigned events, event_io_t *io, void *data)
 	}
 	DEBUG("Accepted control connection %d", cfd);
 
-	fd_make_non_blocking(cfd);
-
-	event_io_t *event =
-		event_io_new(cfd, EVENT_IO_READ, oci_control_cb_recv_message, oci_control);
+	frame_conn_t *conn = frame_conn_new(cfd, oci_control_conn_recv_cb,
+					    oci_control_conn_close_cb, oci_control);
+	if (!conn) {
+		WARN("Could not set up oci control connection %d", cfd);
+		close(cfd);
+		return;
+	}
 	DEBUG("local oci control client connected on fd=%d", cfd);
 
-	event_add_io(event);
+	oci_control->conn_list = list_append(oci_control->conn_list, conn);
 }
 
 oci_control_t *
@@ -1047,17 +1053,13 @@ void
 oci_control_free(oci_control_t *oci_control)
 {
 	ASSERT(oci_control);
-	for (list_t *l = oci_control->event_io_sock_connected_list; l; l = l->next) {
-		event_io_t *event_io_sock_connected = l->data;
-		event_remove_io(event_io_sock_connected);
-		shutdown(event_io_get_fd(event_io_sock_connected), SHUT_RDWR);
-		if (close(event_io_get_fd(event_io_sock_connected) < 0)) {
-			WARN_ERRNO("Failed to close connected control socket");
-		}
-		event_io_free(event_io_sock_connected);
+	for (list_t *l = oci_control->conn_list; l; l = l->next) {
+		frame_conn_t *conn = l->data;
+		shutdown(frame_conn_get_fd(conn), SHUT_RDWR);
+		frame_conn_free(conn);
 	}
-	list_delete(oci_control->event_io_sock_connected_list);
-	oci_control->event_io_sock_connected_list = NULL;
+	list_delete(oci_control->conn_list);
+	oci_control->conn_list = NULL;
 
 	oci_control_list = list_remove(oci_control_list, oci_control);
 
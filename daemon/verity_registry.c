@@ -0,0 +1,184 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+//#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
+
+#include "verity_registry.h"
+
+#include "common/macro.h"
+#include "common/mem.h"
+#include "common/file.h"
+#include "common/hashmap.h"
+#include "common/verity.h"
+#include "common/dm.h"
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define VERITY_REGISTRY_LABEL_PREFIX "verity-"
+// longer root hashes would not fit into the uuid of the device
+#define VERITY_REGISTRY_ROOT_HASH_MAX 64
+
+// time in ms to wait for a device which is set up concurrently
+#define VERITY_REGISTRY_WAIT_TIMEOUT 10000
+
+static hashmap_t *verity_registry_refs = NULL; // label -> reference count
+
+/*
+ * Returns the device-mapper name of the shared device for root_hash or NULL
+ * if root_hash is malformed.
+ */
+static char *
+verity_registry_label_new(const char *root_hash)
+{
+	IF_NULL_RETVAL(root_hash, NULL);
+
+	size_t len = strlen(root_hash);
+	if (len == 0 || len > VERITY_REGISTRY_ROOT_HASH_MAX) {
+		WARN("Invalid dm-verity root hash length %zu", len);
+		return NULL;
+	}
+	char *label = mem_printf(VERITY_REGISTRY_LABEL_PREFIX "%s", root_hash);
+	// the same root hash may be given in upper or lower case
+	for (char *c = label + strlen(VERITY_REGISTRY_LABEL_PREFIX); *c; c++) {
+		if (!isxdigit((unsigned char)*c)) {
+			WARN("Invalid dm-verity root hash %s", root_hash);
+			mem_free0(label);
+			return NULL;
+		}
+		*c = tolower((unsigned char)*c);
+	}
+	return label;
+}
+
+static bool
+verity_registry_dm_exists(const char *label)
+{
+	int fd = dm_open_control();
+	IF_TRUE_RETVAL(fd < 0, false);
+
+	char *type = dm_get_target_type_new(fd, label);
+	dm_close_control(fd);
+
+	bool exists = type != NULL;
+	mem_free0(type);
+	return exists;
+}
+
+static bool
+verity_registry_dev_exists(const char *dev)
+{
+	return file_is_blk(dev) || file_links_to_blk(dev);
+}
+
+int
+verity_registry_acquire(const char *root_hash)
+{
+	char *label = verity_registry_label_new(root_hash);
+	IF_NULL_RETVAL(label, -1);
+
+	if (!verity_registry_refs)
+		verity_registry_refs = hashmap_new();
+
+	uintptr_t refs = (uintptr_t)hashmap_get_str(verity_registry_refs, label) + 1;
+	hashmap_put_str(verity_registry_refs, label, (void *)refs);
+	TRACE("Acquired shared dm-verity device %s (%" PRIuPTR " references)", label, refs);
+
+	mem_free0(label);
+	return 0;
+}
+
+void
+verity_registry_release(const char *root_hash)
+{
+	char *label = verity_registry_label_new(root_hash);
+	IF_NULL_RETURN(label);
+
+	uintptr_t refs = (uintptr_t)hashmap_get_str(verity_registry_refs, label);
+	if (refs == 0) {
+		WARN("Shared dm-verity device %s has not been acquired", label);
+		goto out;
+	}
+	if (--refs > 0) {
+		hashmap_put_str(verity_registry_refs, label, (void *)refs);
+		TRACE("Released shared dm-verity device %s (%" PRIuPTR " references)", label,
+		      refs);
+		goto out;
+	}
+	hashmap_remove_str(verity_registry_refs, label);
+
+	// the device may not have been set up, e.g., if the container failed to start
+	if (verity_registry_dm_exists(label)) {
+		if (verity_delete_blk_dev(label) < 0)
+			WARN("Could not delete shared dm-verity device %s", label);
+		else
+			INFO("Removed shared dm-verity device %s", label);
+	}
+out:
+	mem_free0(label);
+}
+
+char *
+verity_registry_open_new(const char *root_hash, const char *img, const char *img_hash,
+			 bool enforce_symlinks)
+{
+	ASSERT(img);
+	ASSERT(img_hash);
+
+	char *label = verity_registry_label_new(root_hash);
+	IF_NULL_RETVAL(label, NULL);
+
+	char *dev = verity_get_device_path_new(label);
+
+	if (verity_registry_dev_exists(dev)) {
+		INFO("Using shared dm-verity device %s for %s", dev, img);
+		goto out;
+	}
+
+	if (verity_create_blk_dev(label, img, img_hash, root_hash, enforce_symlinks) == 0) {
+		INFO("Created shared dm-verity device %s for %s", dev, img);
+		goto out;
+	}
+
+	// another container may have set up the device concurrently, its device
+	// node is only created once the device has been activated successfully
+	for (int waited = 0; waited < VERITY_REGISTRY_WAIT_TIMEOUT; waited += 100) {
+		if (!verity_registry_dm_exists(label))
+			break;
+		if (verity_registry_dev_exists(dev)) {
+			INFO("Using concurrently created dm-verity device %s for %s", dev, img);
+			goto out;
+		}
+		NANOSLEEP(0, 100000000);
+	}
+
+	ERROR("Failed to open %s from %s as dm-verity device with hash-dev %s and hash %s", label,
+	      img, img_hash, root_hash);
+	mem_free0(dev);
+out:
+	mem_free0(label);
+	return dev;
+}
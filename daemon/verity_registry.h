@@ -0,0 +1,72 @@
+/*
+ * This file is part of GyroidOS
+ * Copyright(c) 2013 - 2026 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Förderung der angewandten Forschung e.V.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 (GPL 2), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GPL 2 license for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ * Contact Information:
+ * Fraunhofer AISEC <gyroidos@aisec.fraunhofer.de>
+ */
+
+/**
+ * @file verity_registry.h
+ *
+ * Registry of the dm-verity devices of read-only images which are shared by
+ * all containers using an image with the same root hash. The root hash pins
+ * the content of the image, so the same device, and thus the same page cache,
+ * serves images at different paths as well, e.g., identical images of
+ * different GuestOS versions.
+ *
+ * References are counted in cmld. A container takes its references before its
+ * child process sets up the devices and drops them on cleanup; a device is
+ * removed once its last reference is dropped.
+ */
+
+#ifndef VERITY_REGISTRY_H
+#define VERITY_REGISTRY_H
+
+#include <stdbool.h>
+
+/**
+ * Takes a reference on the shared dm-verity device for the given root hash.
+ * @return 0 on success, -1 if the root hash is malformed
+ */
+int
+verity_registry_acquire(const char *root_hash);
+
+/**
+ * Drops a reference taken by verity_registry_acquire(). The dm-verity device
+ * is removed when the last reference is dropped.
+ */
+void
+verity_registry_release(const char *root_hash);
+
+/**
+ * Sets up the shared dm-verity device for the given root hash unless it exists
+ * already. May be called concurrently from several processes, e.g., the child
+ * processes of starting containers.
+ *
+ * @param root_hash The root hash as a hexadecimal string
+ * @param img The path of the image
+ * @param img_hash The path of the hash-tree image
+ * @param enforce_symlinks Treat existing symlinks at /dev/mapper as error
+ * @return The path of the device, must be freed, or NULL on error
+ */
+char *
+verity_registry_open_new(const char *root_hash, const char *img, const char *img_hash,
+			 bool enforce_symlinks);
+
+#endif /* VERITY_REGISTRY_H */
@@ -35,24 +35,25 @@
 #include "common/macro.h"
 #include "common/mem.h"
 #include "common/sock.h"
-#include "common/fd.h"
 #include "common/event.h"
+#include "common/frame.h"
 #include "common/list.h"
 #include "common/dir.h"
 #include "common/file.h"
-#include "common/proc.h"
 #include "common/protobuf.h"
 #include "common/protobuf-text.h"
 #include "common/ssl_util.h"
 #include "common/sock-sd.h"
+#include "common/threadpool.h"
 
-#include <signal.h>
 #include <unistd.h>
 
 #include <google/protobuf-c/protobuf-c-text.h>
 
 // maximum no. of connections waiting to be accepted on the listening socket
 #define SCD_CONTROL_SOCK_LISTEN_BACKLOG 8
+// a file hashed while it is downloaded must grow at least once in this interval
+#define SCD_HASH_FOLLOW_TIMEOUT_MS (60 * 1000)
 #define KEY_LENGTH_BYTES 64
 
 //#undef LOGF_LOG_MIN_PRIO
@@ -66,6 +67,29 @@ struct scd_control {
 
 UNUSED static list_t *control_list = NULL;
 
+/*
+ * A crypto request which is handled by a worker thread of scd_crypto_pool.
+ * The worker only computes the response; it is sent by the main thread on the
+ * client connection once the job is completed. Thus, responses to requests
+ * which are in flight concurrently on the same connection never interleave.
+ */
+typedef struct scd_crypto_job {
+	DaemonToToken *msg;
+	frame_conn_t *conn; // NULL if the client has gone away in the meantime
+	TokenToDaemon out;
+} scd_crypto_job_t;
+
+/*
+ * Hashes which follow a file while it is being downloaded occupy their worker
+ * until the download is complete. They are run in a pool of their own, so that
+ * they never block the workers of scd_crypto_pool.
+ */
+#define SCD_CONTROL_FOLLOW_WORKERS 4
+
+static threadpool_t *scd_crypto_pool = NULL;
+static threadpool_t *scd_crypto_follow_pool = NULL;
+static list_t *scd_crypto_jobs = NULL;
+
 static tokentype_t
 scd_proto_to_tokentype(const DaemonToToken *msg)
 {
@@ -136,30 +160,56 @@ switch_proto_hash_algo(int hash_algo)
 	return NULL;
 }
 
-static char *
-write_to_tmpfile_new(unsigned char *buf, size_t buflen)
+/*
+ * Sends the response to a DaemonToToken request and echoes its request_id,
+ * if any, so that clients can match responses on a multiplexed connection.
+ */
+static void
+scd_control_send_response(const DaemonToToken *msg, int fd, TokenToDaemon *out)
 {
-	char *file = mem_strdup("/tmp/tmpXXXXXXXX");
-	int fd = mkstemp(file);
-	if (fd != -1) {
-		int len = fd_write(fd, (char *)buf, buflen);
-		close(fd);
-		if (len >= 0 && (size_t)len == buflen)
-			return file;
-		ERROR("Failed to write entire data (%zu bytes) to temp file %s", buflen, file);
-	} else {
-		ERROR("Failed to create temp file.");
-	}
-	mem_free0(file);
-	return NULL;
+	out->has_request_id = msg->has_request_id;
+	out->request_id = msg->request_id;
+	protobuf_send_message(fd, (ProtobufCMessage *)out);
 }
 
 struct verify_cert_ca_cb_data {
-	const char *cert_file;
+	const DaemonToToken *msg;
 	bool ignore_time;
 	bool verified;
 };
 
+/*
+ * Verifies the certificate of a CRYPTO_VERIFY_FILE or CRYPTO_VERIFY_BUF request
+ * against root_cert_file. Certificates passed by buffer are verified in memory.
+ */
+static int
+scd_control_verify_cert(const DaemonToToken *msg, const char *root_cert_file, bool ignore_time)
+{
+	if (msg->code == DAEMON_TO_TOKEN__CODE__CRYPTO_VERIFY_BUF)
+		return ssl_verify_certificate_from_buf(msg->verify_cert_buf.data,
+						       msg->verify_cert_buf.len, root_cert_file,
+						       ignore_time);
+
+	return ssl_verify_certificate(msg->verify_cert_file, root_cert_file, ignore_time);
+}
+
+/*
+ * Verifies the signature of a CRYPTO_VERIFY_FILE or CRYPTO_VERIFY_BUF request.
+ * Signatures passed by buffer are verified in memory.
+ */
+static int
+scd_control_verify_sig(const DaemonToToken *msg, const char *hash_algo)
+{
+	if (msg->code == DAEMON_TO_TOKEN__CODE__CRYPTO_VERIFY_BUF)
+		return ssl_verify_signature_from_buf(
+			msg->verify_cert_buf.data, msg->verify_cert_buf.len,
+			msg->verify_sig_buf.data, msg->verify_sig_buf.len,
+			msg->verify_data_buf.data, msg->verify_data_buf.len, hash_algo);
+
+	return ssl_verify_signature(msg->verify_cert_file, msg->verify_sig_file,
+				    msg->verify_data_file, hash_algo);
+}
+
 static int
 scd_control_verify_cert_ca_cb(const char *path, const char *file, void *data)
 {
@@ -167,7 +217,7 @@ scd_control_verify_cert_ca_cb(const char *path, const char *file, void *data)
 	struct verify_cert_ca_cb_data *cb_data = data;
 	char *ca_file = mem_printf("%s/%s", path, file);
 
-	if (ssl_verify_certificate(cb_data->cert_file, ca_file, cb_data->ignore_time) != 0) {
+	if (scd_control_verify_cert(cb_data->msg, ca_file, cb_data->ignore_time) != 0) {
 		ERROR("Error during certificate validation using ca: %s", ca_file);
 		cb_data->verified = false;
 		ret = 1;
@@ -187,21 +237,30 @@ scd_control_verify_cert_ca_cb(const char *path, const char *file, void *data)
  * It wraps the corresponding OpenSSL calls.
  */
 static TokenToDaemon__Code
-scd_control_handle_verify(const char *verify_data_file, const char *verify_sig_file,
-			  const char *verify_cert_file, bool ignore_time, const char *hash_algo)
+scd_control_handle_verify(const DaemonToToken *msg)
 {
 	int ret;
 	TokenToDaemon__Code out_code = TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_ERROR;
+	const char *hash_algo = switch_proto_hash_algo(msg->hash_algo);
 	IF_NULL_RETVAL(hash_algo, out_code);
 
+	if (msg->code == DAEMON_TO_TOKEN__CODE__CRYPTO_VERIFY_BUF &&
+	    !(msg->verify_data_buf.data && msg->verify_sig_buf.data &&
+	      msg->verify_cert_buf.data)) {
+		ERROR("Incomplete verify request");
+		return out_code;
+	}
+
+	bool ignore_time = msg->has_verify_ignore_time && msg->verify_ignore_time;
+
 	bool verified = false;
 	// At first, we explicitly assume that the file to be verified is a software update file,
 	// and we thus use the software signing root CA.
-	if ((ret = ssl_verify_certificate(verify_cert_file, SSIG_ROOT_CERT, ignore_time)) == 0) {
+	if ((ret = scd_control_verify_cert(msg, SSIG_ROOT_CERT, ignore_time)) == 0) {
 		verified = true;
 	} else {
 		// Try all CA files in trusted CA store
-		struct verify_cert_ca_cb_data cb_data = { .cert_file = verify_cert_file,
+		struct verify_cert_ca_cb_data cb_data = { .msg = msg,
 							  .ignore_time = ignore_time,
 							  .verified = false };
 
@@ -220,7 +279,7 @@ scd_control_handle_verify(const char *verify_data_file, const char *verify_sig_f
 	IF_TRUE_GOTO(verified, do_signature);
 
 	// Retry with Local CA
-	if ((ret = ssl_verify_certificate(verify_cert_file, LOCALCA_ROOT_CERT, ignore_time)) == 0) {
+	if ((ret = scd_control_verify_cert(msg, LOCALCA_ROOT_CERT, ignore_time)) == 0) {
 		goto do_signature;
 	} else if (ret == -1) {
 		ERROR("Certificate not a valid local ssig cert");
@@ -232,8 +291,7 @@ scd_control_handle_verify(const char *verify_data_file, const char *verify_sig_f
 	return out_code;
 
 do_signature:
-	if ((ret = ssl_verify_signature(verify_cert_file, verify_sig_file, verify_data_file,
-					hash_algo)) == 0) {
+	if ((ret = scd_control_verify_sig(msg, hash_algo)) == 0) {
 		out_code = (verified) ? TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_GOOD :
 					TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_LOCALLY_SIGNED;
 	} else if (ret == -1) {
@@ -291,7 +349,7 @@ scd_control_handle_message(const DaemonToToken *msg, int fd)
 			}
 		}
 
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		scd_control_send_response(msg, fd, &out);
 	} break;
 	case DAEMON_TO_TOKEN__CODE__TOKEN_REMOVE: {
 		TokenToDaemon out = TOKEN_TO_DAEMON__INIT;
@@ -306,7 +364,7 @@ scd_control_handle_message(const DaemonToToken *msg, int fd)
 			out.code = TOKEN_TO_DAEMON__CODE__TOKEN_REMOVE_SUCCESSFUL;
 		}
 
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		scd_control_send_response(msg, fd, &out);
 	} break;
 	case DAEMON_TO_TOKEN__CODE__UNLOCK: {
 		TRACE("SCD: Handle messsage UNLOCK");
@@ -335,7 +393,7 @@ scd_control_handle_message(const DaemonToToken *msg, int fd)
 				out.code = TOKEN_TO_DAEMON__CODE__UNLOCK_FAILED;
 		}
 
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		scd_control_send_response(msg, fd, &out);
 	} break;
 	case DAEMON_TO_TOKEN__CODE__LOCK: {
 		TRACE("SCD: Handle messsage LOCK");
@@ -349,7 +407,7 @@ scd_control_handle_message(const DaemonToToken *msg, int fd)
 			out.code = TOKEN_TO_DAEMON__CODE__LOCK_SUCCESSFUL;
 		}
 
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		scd_control_send_response(msg, fd, &out);
 	} break;
 	case DAEMON_TO_TOKEN__CODE__WRAP_KEY: {
 		TRACE("SCD: Handle messsage WRAP_KEY");
@@ -375,7 +433,7 @@ scd_control_handle_message(const DaemonToToken *msg, int fd)
 			ERROR("Key wrapping failed");
 		}
 
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		scd_control_send_response(msg, fd, &out);
 		if (out.has_wrapped_key) {
 			mem_memset0(wrapped_key, wrapped_key_len);
 			mem_free0(wrapped_key);
@@ -415,7 +473,7 @@ scd_control_handle_message(const DaemonToToken *msg, int fd)
 			ERROR("Key unwrapping failed");
 		}
 
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		scd_control_send_response(msg, fd, &out);
 		if (out.has_unwrapped_key && ret_unwrap == 0) {
 			mem_memset0(unwrapped_key, unwrapped_key_len);
 			mem_free0(unwrapped_key);
@@ -451,7 +509,7 @@ scd_control_handle_message(const DaemonToToken *msg, int fd)
 			}
 		}
 
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		scd_control_send_response(msg, fd, &out);
 		if (msg->token_pin) {
 			mem_memset0(msg->token_pin, strlen(msg->token_pin));
 		}
@@ -487,7 +545,7 @@ scd_control_handle_message(const DaemonToToken *msg, int fd)
 			}
 		}
 
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		scd_control_send_response(msg, fd, &out);
 		if (msg->token_pin) {
 			mem_memset0(msg->token_pin, strlen(msg->token_pin));
 		}
@@ -519,7 +577,7 @@ scd_control_handle_message(const DaemonToToken *msg, int fd)
 				out.device_csr.data = csr;
 			}
 		}
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		scd_control_send_response(msg, fd, &out);
 		INFO("csr: %p", csr);
 		if (csr)
 			mem_free0(csr);
@@ -539,7 +597,7 @@ scd_control_handle_message(const DaemonToToken *msg, int fd)
 		} else {
 			out.code = TOKEN_TO_DAEMON__CODE__DEVICE_CERT_OK;
 		}
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		scd_control_send_response(msg, fd, &out);
 	} break;
 	case DAEMON_TO_TOKEN__CODE__REGISTER_EVENT_LISTENER: {
 		TRACE("SCD: Handle messsage REGISTER_EVENT_LISTENER");
@@ -551,72 +609,24 @@ scd_control_handle_message(const DaemonToToken *msg, int fd)
 			event_fd = fd;
 			out.code = TOKEN_TO_DAEMON__CODE__REGISTER_EVENT_LISTENER_OK;
 		}
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		scd_control_send_response(msg, fd, &out);
 	} break;
 	default:
 		WARN("DaemonToToken command %d unknown or not implemented yet", msg->code);
 		TokenToDaemon out = TOKEN_TO_DAEMON__INIT;
 		out.code = TOKEN_TO_DAEMON__CODE__CMD_UNKNOWN;
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		scd_control_send_response(msg, fd, &out);
 		break;
 	}
 }
 
+/*
+ * Handles a crypto request in a worker thread and stores the response in out.
+ * A computed hash value is allocated and must be freed by the caller.
+ */
 static void
-scd_crypto_sigchld_cb(UNUSED int signum, event_signal_t *sig, void *data)
-{
-	pid_t *pid = data;
-	ASSERT(pid);
-
-	int status = 0;
-
-	if (proc_waitpid(*pid, &status, WNOHANG) == *pid) {
-		TRACE("Reaped child process: %d", *pid);
-		/* remove the sigchld callback for this pid from the event loop */
-		event_remove_signal(sig);
-		event_signal_free(sig);
-
-		if ((WIFEXITED(status) && WEXITSTATUS(status)) || WIFSIGNALED(status)) {
-			WARN("asyn crypto handler returned with error");
-		}
-		mem_free0(pid);
-	}
-}
-
-static void
-scd_control_handle_crypto_message(const DaemonToToken *msg, int fd)
+scd_control_handle_crypto_message(const DaemonToToken *msg, TokenToDaemon *out)
 {
-	pid_t pid;
-
-	if (NULL == msg) {
-		WARN("msg=NULL, returning");
-		return;
-	}
-
-	IF_TRUE_RETURN((pid = fork()) < 0);
-
-	if (pid > 0) {
-		/* parent (main scd process) */
-		pid_t *_pid = mem_new0(pid_t, 1);
-		*_pid = pid;
-		event_signal_t *sig = event_signal_new(SIGCHLD, scd_crypto_sigchld_cb, _pid);
-		event_add_signal(sig);
-		return;
-	}
-
-	/* here we are in the worker child */
-	event_reset();
-
-	if (LOGF_PRIO_TRACE >= LOGF_LOG_MIN_PRIO) {
-		char *msg_text;
-		size_t msg_len =
-			protobuf_string_from_message(&msg_text, (ProtobufCMessage *)msg, NULL);
-		TRACE("Worker child handling DaemonToToken message:\n%s",
-		      msg_len > 0 ? msg_text : "NULL");
-		if (msg_text)
-			free(msg_text);
-	}
-
 	switch (msg->code) {
 	/*
 	 * This case handles hashing request as part of
@@ -628,8 +638,7 @@ scd_control_handle_crypto_message(const DaemonToToken *msg, int fd)
 		unsigned int hash_len;
 		const char *hash_algo;
 		unsigned char *hash = NULL;
-		TokenToDaemon out = TOKEN_TO_DAEMON__INIT;
-		out.code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR;
+		out->code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR;
 
 		hash_algo = switch_proto_hash_algo(msg->hash_algo);
 
@@ -637,24 +646,19 @@ scd_control_handle_crypto_message(const DaemonToToken *msg, int fd)
 			if ((hash = ssl_hash_file(msg->hash_file, &hash_len, hash_algo)) == NULL) {
 				ERROR("Hashing file failed");
 			} else {
-				out.has_hash_value = true;
-				out.hash_value.len = hash_len;
-				out.hash_value.data = hash;
-				out.code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK;
+				out->has_hash_value = true;
+				out->hash_value.len = hash_len;
+				out->hash_value.data = hash;
+				out->code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK;
 			}
 		}
-
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
-		if (hash)
-			mem_free0(hash);
 	} break;
 	case DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_BUF: {
 		TRACE("SCD: Handle messsage CRYPTO_HASH_BUF");
 		unsigned int hash_len;
 		const char *hash_algo;
 		unsigned char *hash = NULL;
-		TokenToDaemon out = TOKEN_TO_DAEMON__INIT;
-		out.code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR;
+		out->code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR;
 
 		hash_algo = switch_proto_hash_algo(msg->hash_algo);
 
@@ -663,128 +667,284 @@ scd_control_handle_crypto_message(const DaemonToToken *msg, int fd)
 						 hash_algo)) == NULL) {
 				ERROR("Hashing buffer failed");
 			} else {
-				out.has_hash_value = true;
-				out.hash_value.len = hash_len;
-				out.hash_value.data = hash;
-				out.code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK;
+				out->has_hash_value = true;
+				out->hash_value.len = hash_len;
+				out->hash_value.data = hash;
+				out->code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK;
 			}
 		}
+	} break;
+	case DAEMON_TO_TOKEN__CODE__CRYPTO_HMAC_BUF: {
+		TRACE("SCD: Handle messsage CRYPTO_HMAC_BUF");
+		unsigned int hmac_len;
+		const char *hash_algo;
+		size_t key_len;
+		const uint8_t *key = scd_get_hmac_key(&key_len);
+		unsigned char *hmac = NULL;
+		out->code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR;
+
+		hash_algo = switch_proto_hash_algo(msg->hash_algo);
 
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
-		if (hash)
-			mem_free0(hash);
+		if (key && hash_algo && msg->has_hash_buf && msg->hash_buf.data) {
+			hmac = ssl_hmac_buf(key, key_len, msg->hash_buf.data, msg->hash_buf.len,
+					    &hmac_len, hash_algo);
+			if (hmac == NULL) {
+				ERROR("Computing hmac of buffer failed");
+			} else {
+				out->has_hash_value = true;
+				out->hash_value.len = hmac_len;
+				out->hash_value.data = hmac;
+				out->code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK;
+			}
+		}
 	} break;
-	/*
-	 * This case handles verify requests as part of TSF.CML.Updates
-	 */
-	case DAEMON_TO_TOKEN__CODE__CRYPTO_VERIFY_BUF: {
-		TokenToDaemon out = TOKEN_TO_DAEMON__INIT;
-		out.code = TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_ERROR;
-		char *tmp_data_file =
-			write_to_tmpfile_new(msg->verify_data_buf.data, msg->verify_data_buf.len);
-		char *tmp_sig_file =
-			write_to_tmpfile_new(msg->verify_sig_buf.data, msg->verify_sig_buf.len);
-		char *tmp_cert_file =
-			write_to_tmpfile_new(msg->verify_cert_buf.data, msg->verify_cert_buf.len);
-		bool ignore_time = (msg->has_verify_ignore_time && msg->verify_ignore_time) ?
-					   msg->verify_ignore_time :
-					   false;
-		if (tmp_data_file && tmp_sig_file && tmp_cert_file) {
-			out.code =
-				scd_control_handle_verify(tmp_data_file, tmp_sig_file,
-							  tmp_cert_file, ignore_time,
-							  switch_proto_hash_algo(msg->hash_algo));
+	case DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE_MULTI: {
+		TRACE("SCD: Handle messsage CRYPTO_HASH_FILE_MULTI");
+		size_t n = msg->n_hash_algos;
+		out->code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR;
+
+		if (!msg->hash_file || n == 0) {
+			ERROR("Incomplete multi hash request");
+			break;
 		}
 
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
-		if (tmp_data_file) {
-			unlink(tmp_data_file);
-			mem_free0(tmp_data_file);
+		const char **hash_algos = mem_new0(const char *, n);
+		bool valid = true;
+		for (size_t i = 0; valid && i < n; i++) {
+			hash_algos[i] = switch_proto_hash_algo(msg->hash_algos[i]);
+			valid = hash_algos[i] != NULL;
 		}
-		if (tmp_sig_file) {
-			unlink(tmp_sig_file);
-			mem_free0(tmp_sig_file);
+
+		unsigned char **hashes = mem_new0(unsigned char *, n);
+		unsigned int *hash_lens = mem_new0(unsigned int, n);
+
+		int ret = -1;
+		if (valid && msg->has_hash_follow_size)
+			ret = ssl_hash_file_follow_multi(
+				msg->hash_file, hash_algos, n, msg->hash_follow_size,
+				SCD_HASH_FOLLOW_TIMEOUT_MS, hashes, hash_lens);
+		else if (valid)
+			ret = ssl_hash_file_multi(msg->hash_file, hash_algos, n, hashes, hash_lens);
+
+		if (valid && ret < 0) {
+			ERROR("Hashing file failed");
+		} else if (valid) {
+			out->n_hash_values = n;
+			out->hash_values = mem_new0(ProtobufCBinaryData, n);
+			for (size_t i = 0; i < n; i++) {
+				out->hash_values[i].data = hashes[i];
+				out->hash_values[i].len = hash_lens[i];
+			}
+			out->code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK;
 		}
-		if (tmp_cert_file) {
-			unlink(tmp_cert_file);
-			mem_free0(tmp_cert_file);
+
+		mem_free0(hash_lens);
+		mem_free0(hashes);
+		mem_free0(hash_algos);
+	} break;
+	case DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE_BLOCKS: {
+		TRACE("SCD: Handle messsage CRYPTO_HASH_FILE_BLOCKS");
+		unsigned int hash_len;
+		size_t n;
+		const char *hash_algo = switch_proto_hash_algo(msg->hash_algo);
+		out->code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR;
+
+		if (!hash_algo || !msg->hash_file || !msg->has_hash_length ||
+		    !msg->has_hash_block_size) {
+			ERROR("Incomplete block hash request");
+			break;
+		}
+
+		unsigned char **hashes = ssl_hash_file_blocks_new(
+			msg->hash_file, hash_algo, msg->hash_offset, msg->hash_length,
+			msg->hash_block_size, msg->has_hash_salt ? msg->hash_salt.data : NULL,
+			msg->has_hash_salt ? msg->hash_salt.len : 0, &hash_len, &n);
+		if (!hashes) {
+			ERROR("Hashing blocks of file failed");
+			break;
 		}
 
+		out->n_hash_values = n;
+		out->hash_values = mem_new0(ProtobufCBinaryData, n);
+		for (size_t i = 0; i < n; i++) {
+			out->hash_values[i].data = hashes[i];
+			out->hash_values[i].len = hash_len;
+		}
+		out->code = TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_OK;
+		mem_free0(hashes);
 	} break;
+	/*
+	 * This case handles verify requests as part of TSF.CML.Updates
+	 */
+	case DAEMON_TO_TOKEN__CODE__CRYPTO_VERIFY_BUF:
+		TRACE("SCD: Handle messsage CRYPTO_VERIFY_BUF");
+		out->code = scd_control_handle_verify(msg);
+		break;
 	/*
 	 * This case handles verify requests as part of TSF.CML.SecureCompartmentInit
 	 */
-	case DAEMON_TO_TOKEN__CODE__CRYPTO_VERIFY_FILE: {
+	case DAEMON_TO_TOKEN__CODE__CRYPTO_VERIFY_FILE:
 		TRACE("SCD: Handle messsage CRYPTO_VERIFY_FILE");
-		TokenToDaemon out = TOKEN_TO_DAEMON__INIT;
-		bool ignore_time = (msg->has_verify_ignore_time && msg->verify_ignore_time) ?
-					   msg->verify_ignore_time :
-					   false;
-		out.code = scd_control_handle_verify(msg->verify_data_file, msg->verify_sig_file,
-						     msg->verify_cert_file, ignore_time,
-						     switch_proto_hash_algo(msg->hash_algo));
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
-	} break;
+		out->code = scd_control_handle_verify(msg);
+		break;
 	default:
 		WARN("DaemonToToken command %d unknown or not implemented yet", msg->code);
-		TokenToDaemon out = TOKEN_TO_DAEMON__INIT;
-		out.code = TOKEN_TO_DAEMON__CODE__CMD_UNKNOWN;
-		protobuf_send_message(fd, (ProtobufCMessage *)&out);
+		out->code = TOKEN_TO_DAEMON__CODE__CMD_UNKNOWN;
 		break;
 	}
+}
+
+static void
+scd_crypto_job_free(scd_crypto_job_t *job)
+{
+	if (job->out.hash_value.data)
+		mem_free0(job->out.hash_value.data);
+	for (size_t i = 0; i < job->out.n_hash_values; i++)
+		mem_free0(job->out.hash_values[i].data);
+	if (job->out.hash_values)
+		mem_free0(job->out.hash_values);
+	protobuf_free_message((ProtobufCMessage *)job->msg);
+	mem_free0(job);
+}
+
+static void
+scd_crypto_job_run(void *data)
+{
+	scd_crypto_job_t *job = data;
+	scd_control_handle_crypto_message(job->msg, &job->out);
+}
+
+static void
+scd_crypto_job_done_cb(void *data)
+{
+	scd_crypto_job_t *job = data;
+
+	if (job->conn)
+		scd_control_send_response(job->msg, frame_conn_get_fd(job->conn), &job->out);
+	else
+		TRACE("Dropping crypto response to request %u for closed connection",
+		      job->msg->request_id);
+
+	scd_crypto_jobs = list_remove(scd_crypto_jobs, job);
+	scd_crypto_job_free(job);
+}
+
+/*
+ * Queues a crypto request received on conn; takes ownership of msg.
+ */
+static void
+scd_crypto_jobs_add(DaemonToToken *msg, frame_conn_t *conn)
+{
+	if (LOGF_PRIO_TRACE >= LOGF_LOG_MIN_PRIO) {
+		char *msg_text;
+		size_t msg_len =
+			protobuf_string_from_message(&msg_text, (ProtobufCMessage *)msg, NULL);
+		TRACE("Queueing DaemonToToken message:\n%s", msg_len > 0 ? msg_text : "NULL");
+		if (msg_text)
+			free(msg_text);
+	}
+
+	scd_crypto_job_t *job = mem_new0(scd_crypto_job_t, 1);
+	job->msg = msg;
+	job->conn = conn;
+	token_to_daemon__init(&job->out);
+
+	threadpool_t *pool = (msg->code == DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE_MULTI &&
+			      msg->has_hash_follow_size) ?
+				     scd_crypto_follow_pool :
+				     scd_crypto_pool;
+	if (threadpool_add(pool, scd_crypto_job_run, scd_crypto_job_done_cb, job) < 0) {
+		// do not let the client wait forever
+		ERROR("Could not queue crypto request %u", msg->request_id);
+		job->out.code = (msg->code == DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE ||
+				 msg->code == DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_BUF ||
+				 msg->code == DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE_MULTI ||
+				 msg->code == DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE_BLOCKS ||
+				 msg->code == DAEMON_TO_TOKEN__CODE__CRYPTO_HMAC_BUF) ?
+					TOKEN_TO_DAEMON__CODE__CRYPTO_HASH_ERROR :
+					TOKEN_TO_DAEMON__CODE__CRYPTO_VERIFY_ERROR;
+		scd_control_send_response(msg, frame_conn_get_fd(conn), &job->out);
+		scd_crypto_job_free(job);
+		return;
+	}
+	scd_crypto_jobs = list_append(scd_crypto_jobs, job);
+}
 
-	// worker child exit
-	_exit(0);
+/*
+ * Detaches the crypto requests of a closed connection. Their responses are
+ * discarded once the workers have finished.
+ */
+static void
+scd_crypto_jobs_conn_closed(frame_conn_t *conn)
+{
+	for (list_t *l = scd_crypto_jobs; l; l = l->next) {
+		scd_crypto_job_t *job = l->data;
+		if (job->conn == conn)
+			job->conn = NULL;
+	}
 }
 
 /**
- * Event callback for incoming data that a ControllerToDaemon message.
+ * Callback for a complete DaemonToToken message received on a client connection.
  *
  * The handle_message function will be called to handle the received message.
  *
- * @param fd	    file descriptor of the client connection
- *		    from which the incoming message is read
- * @param events    event flags
- * @param io	    pointer to associated event_io_t struct
+ * @param conn	    the framed client connection
+ * @param buf	    the packed DaemonToToken message
+ * @param len	    length of the packed message
  * @param data	    pointer to this scd_control_t struct
  */
 static void
-scd_control_cb_recv_message(int fd, unsigned events, event_io_t *io, UNUSED void *data)
+scd_control_conn_recv_cb(frame_conn_t *conn, uint8_t *buf, uint32_t len, UNUSED void *data)
 {
-	if (events & EVENT_IO_READ) {
-		DaemonToToken *msg =
-			(DaemonToToken *)protobuf_recv_message(fd, &daemon_to_token__descriptor);
-		// close connection if client EOF, or protocol parse error
-		IF_NULL_GOTO_TRACE(msg, connection_err);
-
-		switch (msg->code) {
-		case DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE:
-		case DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_BUF:
-		case DAEMON_TO_TOKEN__CODE__CRYPTO_VERIFY_FILE:
-		case DAEMON_TO_TOKEN__CODE__CRYPTO_VERIFY_BUF:
-			scd_control_handle_crypto_message(msg, fd);
-			break;
-		default:
-			scd_control_handle_message(msg, fd);
-		}
-		protobuf_free_message((ProtobufCMessage *)msg);
-		DEBUG("Handled control connection %d", fd);
+	int fd = frame_conn_get_fd(conn);
+
+	DaemonToToken *msg =
+		(DaemonToToken *)protobuf_unpack_message(&daemon_to_token__descriptor, buf, len);
+	if (!msg) {
+		// close connection on protocol parse error
+		WARN("Failed to parse message on control connection %d; disconnecting", fd);
+		if (fd == event_fd)
+			event_fd = -1;
+		scd_crypto_jobs_conn_closed(conn);
+		frame_conn_free(conn);
+		return;
 	}
-	if (events & EVENT_IO_EXCEPT) {
-		INFO("Control client closed connection; disconnecting control socket.");
-		goto connection_err;
+
+	switch (msg->code) {
+	case DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE:
+	case DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_BUF:
+	case DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE_MULTI:
+	case DAEMON_TO_TOKEN__CODE__CRYPTO_HASH_FILE_BLOCKS:
+	case DAEMON_TO_TOKEN__CODE__CRYPTO_HMAC_BUF:
+	case DAEMON_TO_TOKEN__CODE__CRYPTO_VERIFY_FILE:
+	case DAEMON_TO_TOKEN__CODE__CRYPTO_VERIFY_BUF:
+		// several requests may be in flight; responses are tagged with their request_id
+		scd_crypto_jobs_add(msg, conn);
+		break;
+	default:
+		scd_control_handle_message(msg, fd);
+		protobuf_free_message((ProtobufCMessage *)msg);
 	}
-	return;
-
-connection_err:
-	event_remove_io(io);
-	event_io_free(io);
-	if (close(fd) < 0)
-		WARN_ERRNO("Failed to close connected control socket");
-	if (fd == event_fd)
+	DEBUG("Handled control connection %d", fd);
+}
+
+/**
+ * Callback for a client connection which was closed by the peer or failed.
+ *
+ * @param conn	    the framed client connection
+ * @param data	    pointer to this scd_control_t struct
+ */
+static void
+scd_control_conn_close_cb(frame_conn_t *conn, UNUSED void *data)
+{
+	INFO("Control client closed connection; disconnecting control socket.");
+	if (frame_conn_get_fd(conn) == event_fd)
 		event_fd = -1;
-	return;
+	scd_crypto_jobs_conn_closed(conn);
+	frame_conn_free(conn);
 }
+
 /**
  * Event callback for accepting incoming connections on the listening socket.
  *
@@ -817,10 +977,10 @@ scd_control_cb_accept(int fd, unsigned events, event_io_t *io, void *data)
 	}
 	DEBUG("Accepted control connection %d", cfd);
 
-	fd_make_non_blocking(cfd);
-
-	event_io_t *event = event_io_new(cfd, EVENT_IO_READ, scd_control_cb_recv_message, control);
-	event_add_io(event);
+	if (!frame_conn_new(cfd, scd_control_conn_recv_cb, scd_control_conn_close_cb, control)) {
+		WARN("Could not set up control connection %d", cfd);
+		close(cfd);
+	}
 }
 
 ssize_t
@@ -843,8 +1003,18 @@ scd_control_send_event(scd_event_t event, const char *token_uuid)
 }
 
 scd_control_t *
-scd_control_new(const char *path)
+scd_control_new(const char *path, unsigned int crypto_workers)
 {
+	if (!scd_crypto_pool && !(scd_crypto_pool = threadpool_new(crypto_workers))) {
+		WARN("Could not create crypto worker pool");
+		return NULL;
+	}
+	if (!scd_crypto_follow_pool &&
+	    !(scd_crypto_follow_pool = threadpool_new(SCD_CONTROL_FOLLOW_WORKERS))) {
+		WARN("Could not create crypto worker pool for following hashes");
+		return NULL;
+	}
+
 	int sock = path ? sock_unix_create_and_bind(SOCK_SEQPACKET | SOCK_NONBLOCK, path) :
 			  sock_sd_listen_fd(NULL);
 	if (sock < 0) {
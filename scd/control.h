@@ -35,8 +35,18 @@ typedef enum {
 
 typedef struct scd_control scd_control_t;
 
+/**
+ * Creates the control socket at path, or takes the socket passed by systemd if
+ * path is NULL. Crypto requests (hashing and signature verification) received
+ * on the socket are handled concurrently by a pool of crypto_workers threads
+ * which is shared by all control sockets.
+ *
+ * @param path Path of the control socket.
+ * @param crypto_workers Number of crypto worker threads; 0 selects the number of online CPUs.
+ * @return The new control socket or NULL on error.
+ */
 scd_control_t *
-scd_control_new(const char *path);
+scd_control_new(const char *path, unsigned int crypto_workers);
 
 ssize_t
 scd_control_send_event(scd_event_t event, const char *token_uuid);
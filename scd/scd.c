@@ -34,6 +34,7 @@
 #include "common/sock.h"
 #include "common/dir.h"
 #include "common/file.h"
+#include "common/fd.h"
 #include "common/uuid.h"
 #include "common/protobuf.h"
 #include "common/protobuf-text.h"
@@ -41,6 +42,10 @@
 #include "common/ssl_util.h"
 #include "token.h"
 
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
@@ -63,6 +68,9 @@
 
 #define TOKEN_DEFAULT_EXT ".p12"
 
+#define HMAC_KEY_FILE SCD_TOKEN_DIR "/hmac.key"
+#define HMAC_KEY_LEN 32
+
 //#undef LOGF_LOG_MIN_PRIO
 //#define LOGF_LOG_MIN_PRIO LOGF_PRIO_TRACE
 
@@ -71,6 +79,8 @@ static list_t *scd_token_list = NULL;
 static scd_control_t *scd_control_cmld = NULL;
 static logf_handler_t *scd_logfile_handler = NULL;
 static void *scd_logfile_p = NULL;
+static uint8_t scd_hmac_key[HMAC_KEY_LEN];
+static bool scd_hmac_key_loaded = false;
 
 static void
 scd_sigterm_cb(UNUSED int signum, UNUSED event_signal_t *sig, UNUSED void *data)
@@ -204,6 +214,55 @@ provisioning_mode()
 	}
 }
 
+/**
+ * Loads the hmac key, a new random key is created on first boot. The key is
+ * only read once before the crypto workers are started, so it can be used
+ * by them without locking.
+ */
+static int
+scd_hmac_key_init(void)
+{
+	if (!file_exists(HMAC_KEY_FILE)) {
+		INFO("Creating hmac key %s", HMAC_KEY_FILE);
+		uint8_t key[HMAC_KEY_LEN];
+		if (file_read("/dev/urandom", (char *)key, sizeof(key)) != (int)sizeof(key)) {
+			ERROR("Failed to read random hmac key from /dev/urandom");
+			return -1;
+		}
+		char *tmp_file = mem_printf("%s.tmp", HMAC_KEY_FILE);
+		int fd = open(tmp_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if (fd < 0 || fd_write(fd, (char *)key, sizeof(key)) != (ssize_t)sizeof(key) ||
+		    fsync(fd) < 0 || rename(tmp_file, HMAC_KEY_FILE) < 0) {
+			ERROR_ERRNO("Failed to store hmac key %s", HMAC_KEY_FILE);
+			if (fd >= 0)
+				close(fd);
+			unlink(tmp_file);
+			mem_free0(tmp_file);
+			return -1;
+		}
+		close(fd);
+		mem_free0(tmp_file);
+	}
+
+	if (file_read(HMAC_KEY_FILE, (char *)scd_hmac_key, sizeof(scd_hmac_key)) !=
+	    (int)sizeof(scd_hmac_key)) {
+		ERROR("Failed to read hmac key %s", HMAC_KEY_FILE);
+		return -1;
+	}
+	scd_hmac_key_loaded = true;
+	return 0;
+}
+
+const uint8_t *
+scd_get_hmac_key(size_t *len)
+{
+	ASSERT(len);
+	IF_FALSE_RETVAL(scd_hmac_key_loaded, NULL);
+
+	*len = sizeof(scd_hmac_key);
+	return scd_hmac_key;
+}
+
 static void
 scd_logfile_rename_cb(UNUSED event_timer_t *timer, UNUSED void *data)
 {
@@ -232,9 +291,42 @@ main_sync_fs()
 	SYNC_INFO();
 }
 
+static void
+print_usage(const char *cmd)
+{
+	printf("\n");
+	printf("Usage: %s [-j <workers>] \n", cmd);
+	printf("\n");
+	printf("\t use -j option to set the number of threads handling crypto requests,"
+	       " defaults to the number of online CPUs");
+	printf("\n");
+	exit(-1);
+}
+
+static const struct option global_options[] = { { "crypto-workers", required_argument, 0, 'j' },
+						{ "help", no_argument, 0, 'h' },
+						{ 0, 0, 0, 0 } };
+
 int
-main(UNUSED int argc, UNUSED char **argv)
+main(int argc, char **argv)
 {
+	unsigned int crypto_workers = 0;
+
+	for (int c, option_index = 0;
+	     -1 != (c = getopt_long(argc, argv, ":j:h", global_options, &option_index));) {
+		switch (c) {
+		case 'j': {
+			char *end;
+			long workers = strtol(optarg, &end, 10);
+			if (*end != '\0' || workers < 1 || workers > 1024)
+				print_usage(argv[0]);
+			crypto_workers = (unsigned int)workers;
+		} break;
+		default: // includes cases 'h' and '?'
+			print_usage(argv[0]);
+		}
+	}
+
 	event_timer_t *logfile_timer = event_timer_new(
 		HOURS_TO_MILLISECONDS(24), EVENT_TIMER_REPEAT_FOREVER, scd_logfile_rename_cb, NULL);
 	event_add_timer(logfile_timer);
@@ -254,6 +346,10 @@ main(UNUSED int argc, UNUSED char **argv)
 		FATAL("Failed to initialize OpenSSL stack for scd runtime");
 	}
 
+	if (scd_hmac_key_init() < 0) {
+		WARN("No hmac key available, authenticating data of the cmld is not supported");
+	}
+
 	if (!file_exists(DEVICE_ID_CONF)) {
 		INFO("Generating device identity from %s!", DEVICE_CERT_FILE);
 
@@ -278,7 +374,7 @@ main(UNUSED int argc, UNUSED char **argv)
 		FATAL("Could not create directory for scd_control socket");
 	}
 
-	scd_control_cmld = scd_control_new(SCD_CONTROL_SOCKET);
+	scd_control_cmld = scd_control_new(SCD_CONTROL_SOCKET, crypto_workers);
 	if (!scd_control_cmld) {
 		FATAL("Could not init scd_control socket");
 	}
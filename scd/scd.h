@@ -57,4 +57,11 @@ scd_token_free(token_t *token);
 bool
 scd_in_provisioning_mode(void);
 
+/**
+ * Returns the device local key for authenticating data of the cmld, e.g., its
+ * hash cache, and its length via the parameter len. The key never leaves the scd.
+ */
+const uint8_t *
+scd_get_hmac_key(size_t *len);
+
 #endif // SCD_H